@@ -321,6 +321,15 @@ int sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code,
                               void * pcontrol_arr[], int * reported_lenp,
                               int verbose);
 
+/* As sg_get_mode_page_controls() but uses the given work buffer (wbuff,
+ * wbuff_len bytes long) rather than allocating one on each call. */
+int sg_get_mode_page_controls_wb(int sg_fd, bool mode6, int pg_code,
+                                 int sub_pg_code, bool dbd, bool flexible,
+                                 int mx_mpage_len, int * success_mask,
+                                 void * pcontrol_arr[], int * reported_lenp,
+                                 uint8_t * wbuff, int wbuff_len,
+                                 int verbose);
+
 /* Returns file descriptor >= 0 if successful. If error in Unix returns
    negated errno. Implementation calls scsi_pt_open_device(). */
 int sg_cmds_open_device(const char * device_name, bool read_only, int verbose);
@@ -680,14 +680,9 @@ sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code, int sub_pg_code,
                           int * success_mask, void * pcontrol_arr[],
                           int * reported_lenp, int verbose)
 {
-    bool resp_mode6;
-    int k, n, res, offset, calc_len, xfer_len;
-    int resid = 0;
-    const int msense10_hlen = MODE10_RESP_HDR_LEN;
+    int res;
     uint8_t * buffp;
     uint8_t * free_buffp;
-    char ebuff[EBUFF_SZ];
-    int first_err = 0;
 
     if (success_mask)
         *success_mask = 0;
@@ -698,6 +693,41 @@ sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code, int sub_pg_code,
     buffp = sg_memalign(MODE_RESP_ARB_LEN, 0, &free_buffp, false);
     if (NULL == buffp)
         return sg_convert_errno(ENOMEM);
+    res = sg_get_mode_page_controls_wb(sg_fd, mode6, pg_code, sub_pg_code,
+                                       dbd, flexible, mx_mpage_len,
+                                       success_mask, pcontrol_arr,
+                                       reported_lenp, buffp,
+                                       MODE_RESP_ARB_LEN, verbose);
+    if (free_buffp)
+        free(free_buffp);
+    return res;
+}
+
+/* As sg_get_mode_page_controls() but uses the given work buffer (wbuff,
+ * wbuff_len bytes long, at least MODE10_RESP_HDR_LEN) for the responses
+ * rather than allocating one from the heap. For callers that fetch many
+ * mode pages. */
+int
+sg_get_mode_page_controls_wb(int sg_fd, bool mode6, int pg_code,
+                             int sub_pg_code, bool dbd, bool flexible,
+                             int mx_mpage_len, int * success_mask,
+                             void * pcontrol_arr[], int * reported_lenp,
+                             uint8_t * wbuff, int wbuff_len, int verbose)
+{
+    bool resp_mode6;
+    int k, n, res, offset, calc_len, xfer_len;
+    int resid = 0;
+    const int msense10_hlen = MODE10_RESP_HDR_LEN;
+    uint8_t * buffp = wbuff;
+    char ebuff[EBUFF_SZ];
+    int first_err = 0;
+
+    if (success_mask)
+        *success_mask = 0;
+    if (reported_lenp)
+        *reported_lenp = 0;
+    if ((mx_mpage_len < 4) || (wbuff_len < msense10_hlen))
+        return 0;
 
     memset(ebuff, 0, sizeof(ebuff));
     /* first try to find length of current page response */
@@ -746,8 +776,8 @@ sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code, int sub_pg_code,
         pr2ws(">>> msense(%d) but resp[0]=%d so switch response "
               "processing\n", (mode6 ? 6 : 10), buffp[0]);
     calc_len = sg_msense_calc_length(buffp, msense10_hlen, resp_mode6, NULL);
-    if (calc_len > MODE_RESP_ARB_LEN)
-        calc_len = MODE_RESP_ARB_LEN;
+    if (calc_len > wbuff_len)
+        calc_len = wbuff_len;
     offset = sg_mode_page_offset(buffp, calc_len, resp_mode6, ebuff, EBUFF_SZ);
     if (offset < 0) {
         if (('\0' != ebuff[0]) && (verbose > 0))
@@ -795,8 +825,6 @@ sg_get_mode_page_controls(int sg_fd, bool mode6, int pg_code, int sub_pg_code,
             *success_mask |= (1 << k);
     }
 fini:
-    if (free_buffp)
-        free(free_buffp);
     return first_err;
 }
 
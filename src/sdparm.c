@@ -75,6 +75,12 @@ static int map_if_lk24(int sg_fd, const char * device_name, bool rw,
 
 #endif  /* SG_LIB_LINUX */
 
+#include <time.h>
+#ifndef SG_LIB_WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
@@ -86,23 +92,8 @@ static const char * version_str = "1.17 20231125 [svn: r389]";
 static const char * my_name = "sdparm: ";
 
 
-static uint8_t * inhex_buffp;
-static uint8_t * cur_aligned_mp;
-static uint8_t * cha_aligned_mp;
-static uint8_t * def_aligned_mp;
-static uint8_t * sav_aligned_mp;
-static uint8_t * oth_aligned_mp;
-static uint8_t * free_inhex_buffp;
-static uint8_t * free_cur_aligned_mp;
-static uint8_t * free_cha_aligned_mp;
-static uint8_t * free_def_aligned_mp;
-static uint8_t * free_sav_aligned_mp;
-static uint8_t * free_oth_aligned_mp;
-
-/* incremented when subpage requested but non-subpage returned */
-static int non_spg_warning;
-
 static const char * ms_s = "Mode sense";
+static const char * msel_s = "Mode select";
 static const char * ump_s = "Mode page";
 static const char * mp_s = "mode page";
 static const char * mp_sn = "mode_page";
@@ -122,15 +113,6 @@ static const char * sddap_s = "so don't decode any pages";
 static const char * const pad_2_s = "  ";
 static const char * const pad_4_s = "    ";
 
-static int msense6_good_count;
-static int msense6_pc_not_sup_count;  /* > 0 page controls not supported */
-static int msense6_ill_req_count;
-static int msense6_oth_err_count;
-static int msense10_good_count;
-static int msense10_pc_not_sup_count;
-static int msense10_ill_req_count;
-static int msense10_oth_err_count;
-
 static int print_full_mpgs(int sg_fd, int pn, int spn, int pdt,
                            struct sdparm_opt_coll * op, sgj_opaque_p jop);
 
@@ -634,7 +616,7 @@ examine_vpd_page(int sg_fd, int pn, int spn, int req_pdt, bool protect,
 }
 
 static void
-list_mp_settings(const struct sdparm_mp_settings_t * mps, bool getter,
+list_mp_settings(const struct sdparm_mp_settings_t * mps,
                  struct sdparm_opt_coll * op)
 {
     int k, n;
@@ -647,11 +629,8 @@ list_mp_settings(const struct sdparm_mp_settings_t * mps, bool getter,
               mps->pg_num, mps->subpg_num, mps->num_it_vals);
     for (k = 0; k < mps->num_it_vals; ++k) {
         mpip = &mps->it_vals[k].mp_it;
-        n = 0;
-        if (getter)
-            n = sg_scnpr(b, blen, "  [0x%x,0x%x]", mpip->pg_num,
-                         mpip->subpg_num);
-
+        n = sg_scnpr(b, blen, "  [0x%x,0x%x]", mpip->pg_num,
+                     mpip->subpg_num);
         n += sg_scn3pr(b, blen, n, "  pdt=%d start_byte=0x%x start_bit=%d "
                        "num_bits=%d  val=%" PRId64 "", mpip->com_pdt,
                        mpip->start_byte, mpip->start_bit, mpip->num_bits,
@@ -788,40 +767,197 @@ print_a_mitem(const char * pre, int smask,
     return stop_if_set;
 }
 
-/* Gets current (page control) response from MODE SENSE (10(def) or 6) for
- * the given mode page ('pn') and subpage ('spn'). The start of the response
- * (if there is no error) is the mode parameter header followed by zero or
- * more block descriptors, followed by zero or more mode pages.  */
+#ifndef SG_LIB_WIN32
+
+#define DEADLINE_REPEAT_MS 10
+
+/* The deadline itself is kept in struct sdparm_ctx_t (see
+ * sdp_ctx_set_deadline()) and is checked before each command is sent. The
+ * SIGALRM timer below is only used by sdparm itself (i.e. via sdp_main()),
+ * never by the library calls, as the timer and signal disposition are
+ * process wide. Its handler does nothing; the signal is there to interrupt
+ * a pass-through call that is blocked on an unresponsive DEVICE. */
+static void
+deadline_handler(int sig)
+{
+    if (sig) { }        /* suppress warning */
+}
+
+/* Installed without SA_RESTART so that a pass-through ioctl() blocked on an
+ * unresponsive DEVICE fails with EINTR when the deadline expires. This is
+ * effective with sg device nodes; block device nodes (e.g. /dev/sda) may
+ * wait uninterruptibly. Returns 0 if successful. */
 static int
-ll_mode_sense(int fd, int pn, int spn, bool llbaa, uint8_t * resp,
-              int mx_resp_len, int * residp, int verb,
-              const struct sdparm_opt_coll * op)
+deadline_init(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = deadline_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGALRM, &sa, NULL) < 0) {
+        int err = errno;
+
+        pr2serr("%s: sigaction: %s\n", __func__, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    return 0;
+}
+
+/* Starts the deadline timer for ms milliseconds. After it expires the timer
+ * repeats every DEADLINE_REPEAT_MS so that any pass-through call that is
+ * already under way is interrupted promptly. */
+static void
+deadline_arm(int ms)
+{
+    struct itimerval itv;
+
+    memset(&itv, 0, sizeof(itv));
+    itv.it_value.tv_sec = ms / 1000;
+    itv.it_value.tv_usec = (ms % 1000) * 1000;
+    itv.it_interval.tv_usec = DEADLINE_REPEAT_MS * 1000;
+    setitimer(ITIMER_REAL, &itv, NULL);
+}
+
+/* Stops the deadline timer. */
+static void
+deadline_disarm(void)
+{
+    struct itimerval itv;
+
+    memset(&itv, 0, sizeof(itv));
+    setitimer(ITIMER_REAL, &itv, NULL);
+}
+
+/* Returns milliseconds since *startp, updating *startp when it is zero. */
+static int
+deadline_elapsed_ms(struct timespec * startp)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((0 == startp->tv_sec) && (0 == startp->tv_nsec)) {
+        *startp = now;
+        return 0;
+    }
+    return (int)(((now.tv_sec - startp->tv_sec) * 1000) +
+                 ((now.tv_nsec - startp->tv_nsec) / 1000000));
+}
+
+/* Commands sent via ctxp after ms milliseconds from now are not sent and
+ * yield SG_LIB_CAT_TIMEOUT instead. An ms of 0 (or less) removes the
+ * deadline. Each context has its own deadline. */
+void
+sdp_ctx_set_deadline(struct sdparm_ctx_t * ctxp, int ms)
+{
+    struct timespec * tsp = &ctxp->dl_end;
+
+    if (ms <= 0) {
+        memset(tsp, 0, sizeof(*tsp));
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, tsp);
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (ms % 1000) * 1000000L;
+    if (tsp->tv_nsec >= 1000000000L) {
+        ++tsp->tv_sec;
+        tsp->tv_nsec -= 1000000000L;
+    }
+}
+
+/* True when the deadline of ctxp has expired so the command about to be
+ * issued to the DEVICE should not be sent. */
+bool
+sdp_deadline_expired(const struct sdparm_ctx_t * ctxp)
+{
+    struct timespec now;
+    const struct timespec * tsp;
+
+    if (NULL == ctxp)
+        return false;
+    tsp = &ctxp->dl_end;
+    if ((0 == tsp->tv_sec) && (0 == tsp->tv_nsec))
+        return false;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec > tsp->tv_sec) ||
+           ((now.tv_sec == tsp->tv_sec) && (now.tv_nsec >= tsp->tv_nsec));
+}
+
+#else   /* SG_LIB_WIN32 */
+
+static int
+deadline_init(void)
+{
+    return 0;
+}
+
+static void
+deadline_arm(int ms)
+{
+    if (ms) { }         /* suppress warning */
+}
+
+static void
+deadline_disarm(void)
+{
+}
+
+static int
+deadline_elapsed_ms(struct timespec * startp)
+{
+    if (startp) { }     /* suppress warning */
+    return 0;
+}
+
+void
+sdp_ctx_set_deadline(struct sdparm_ctx_t * ctxp, int ms)
+{
+    if (ctxp && ms) { } /* suppress warning */
+}
+
+bool
+sdp_deadline_expired(const struct sdparm_ctx_t * ctxp)
+{
+    if (ctxp) { }       /* suppress warning */
+    return false;
+}
+
+#endif  /* SG_LIB_WIN32 */
+
+/* Gets the response for page control 'pc' (0: current, 3: saved) from
+ * MODE SENSE (10(def) or 6) for the given mode page ('pn') and subpage
+ * ('spn'). The start of the response (if there is no error) is the mode
+ * parameter header followed by zero or more block descriptors, followed by
+ * zero or more mode pages.  */
+static int
+ll_mode_sense_pc(int fd, int pc, int pn, int spn, bool llbaa, uint8_t * resp,
+                 int mx_resp_len, int * residp, int verb,
+                 const struct sdparm_opt_coll * op)
 {
     int res;
     const int vb = (verb >= 0) ? verb : op->verbose;
+    struct sdparm_msense_counts_t * mscp;
 
+    if (sdp_deadline_expired(op->ctxp))
+        return SG_LIB_CAT_TIMEOUT;
     if (op->mode_6) {
         if (residp)
             *residp = 0;
-        res = sg_ll_mode_sense6(fd, op->dbd, 0 /*current */, pn, spn,
-                                resp, mx_resp_len, true /* noisy */, vb);
-        if (0 == res)
-            ++msense6_good_count;
-        else if (SG_LIB_CAT_ILLEGAL_REQ == res)
-            ++msense6_ill_req_count; /* N.B. doesn't include invalid opcode */
-        else
-            ++msense6_oth_err_count;
+        res = sg_ll_mode_sense6(fd, op->dbd, pc, pn, spn, resp,
+                                mx_resp_len, true /* noisy */, vb);
+        mscp = &op->ctxp->ms6_cnt;
     } else {
-        res = sg_ll_mode_sense10_v2(fd, llbaa, op->dbd, 0, pn,
+        res = sg_ll_mode_sense10_v2(fd, llbaa, op->dbd, pc, pn,
                                     spn, resp, mx_resp_len, 0, residp,
                                     true /* noisy */, vb);
-        if (0 == res)
-            ++msense10_good_count;
-        else if (SG_LIB_CAT_ILLEGAL_REQ == res)
-            ++msense10_ill_req_count; /* N.B. doesn't include invalid opcode */
-        else
-            ++msense10_oth_err_count;
+        mscp = &op->ctxp->ms10_cnt;
     }
+    if (0 == res)
+        ++mscp->good;
+    else if (SG_LIB_CAT_ILLEGAL_REQ == res)
+        ++mscp->ill_req;   /* N.B. doesn't include invalid opcode */
+    else
+        ++mscp->oth_err;
     if ((0 == res) && (vb > 2)) {
         int resid = residp ? *residp : 0;
         int num_ret = mx_resp_len - resid;
@@ -835,35 +971,48 @@ ll_mode_sense(int fd, int pn, int spn, bool llbaa, uint8_t * resp,
     return res;
 }
 
+/* Gets current (page control) response, see ll_mode_sense_pc() */
+static int
+ll_mode_sense(int fd, int pn, int spn, bool llbaa, uint8_t * resp,
+              int mx_resp_len, int * residp, int verb,
+              const struct sdparm_opt_coll * op)
+{
+    return ll_mode_sense_pc(fd, 0 /* current */, pn, spn, llbaa, resp,
+                            mx_resp_len, residp, verb, op);
+}
+
 static int
 ll_mode_page_controls(int sg_fd, bool mode_6, int pn, int spn, int req_len,
                       int * smaskp, void * pc_arr[], int * resp_lenp, int verb,
                       const struct sdparm_opt_coll * op)
 {
-    int res = sg_get_mode_page_controls(sg_fd, mode_6, pn, spn, op->dbd,
-                                    op->flexible, req_len, smaskp, pc_arr,
-                                    resp_lenp, verb);
-    if (mode_6) {
-        if (0 == res)
-            ++msense6_good_count;
-        else if (SG_LIB_CAT_ILLEGAL_REQ == res) {
-            if (*smaskp)
-                ++msense6_pc_not_sup_count;
-            else
-                ++msense6_ill_req_count; /* N.B. excluding invalid opcode */
-        } else
-            ++msense6_oth_err_count;
-    } else {
-        if (0 == res)
-            ++msense10_good_count;
-        else if (SG_LIB_CAT_ILLEGAL_REQ == res) {
-            if (*smaskp)
-                ++msense10_pc_not_sup_count;
-            else
-                ++msense10_ill_req_count; /* N.B. excluding invalid opcode */
-        } else
-            ++msense10_oth_err_count;
+    int res;
+    const struct sdparm_arena_t * arp = op->arenap;
+    struct sdparm_msense_counts_t * mscp;
+
+    if (sdp_deadline_expired(op->ctxp)) {
+        *smaskp = 0;
+        return SG_LIB_CAT_TIMEOUT;
     }
+    if (arp)    /* no heap allocation when DEVICE has a scratch arena */
+        res = sg_get_mode_page_controls_wb(sg_fd, mode_6, pn, spn, op->dbd,
+                                           op->flexible, req_len, smaskp,
+                                           pc_arr, resp_lenp, arp->mpc_b,
+                                           arp->mpc_b_sz, verb);
+    else
+        res = sg_get_mode_page_controls(sg_fd, mode_6, pn, spn, op->dbd,
+                                        op->flexible, req_len, smaskp,
+                                        pc_arr, resp_lenp, verb);
+    mscp = mode_6 ? &op->ctxp->ms6_cnt : &op->ctxp->ms10_cnt;
+    if (0 == res)
+        ++mscp->good;
+    else if (SG_LIB_CAT_ILLEGAL_REQ == res) {
+        if (*smaskp)
+            ++mscp->pc_not_sup;
+        else
+            ++mscp->ill_req;    /* N.B. excluding invalid opcode */
+    } else
+        ++mscp->oth_err;
     return res;
 }
 
@@ -1103,7 +1252,8 @@ print_mpgs_in_hex(int sg_fd, int pn, int spn, struct sdparm_opt_coll * op)
     uint8_t * pg1_p;
     const struct sdparm_mp_name_t * mnp;
     void * pc_arr[4];
-    uint8_t * oth_mp = oth_aligned_mp;
+    struct sdparm_ctx_t * ctxp = op->ctxp;
+    uint8_t * oth_mp = ctxp->oth_mp;
 
     /* First get mode parameter header and any following block descriptors */
     memset(oth_mp, 0, op->mode_6 ? DEF_MODE_6_RESP_LEN : DEF_MODE_RESP_LEN);
@@ -1153,10 +1303,10 @@ try_again:
     /* Now get the mode pages, for each available page control */
     req_len = l_mode_6 ? DEF_MODE_6_RESP_LEN : MAX_MP_BUFF_SZ;
 
-    pc_arr[0] = cur_aligned_mp;
-    pc_arr[1] = cha_aligned_mp;
-    pc_arr[2] = def_aligned_mp;
-    pc_arr[3] = sav_aligned_mp;
+    pc_arr[0] = ctxp->cur_mp;
+    pc_arr[1] = ctxp->cha_mp;
+    pc_arr[2] = ctxp->def_mp;
+    pc_arr[3] = ctxp->sav_mp;
 
 one_more:
     res = ll_mode_page_controls(sg_fd, l_mode_6, l_pn, l_spn, req_len,
@@ -1349,7 +1499,7 @@ fetch_print_mparam_hdr(int sg_fd, int decay_pdt, struct sdparm_opt_coll * op,
 {
     int res, req_len, resid;
     int verb = (op->verbose > 0) ? op->verbose - 1 : 0;
-    uint8_t * cur_mp = oth_aligned_mp;
+    uint8_t * cur_mp = op->ctxp->oth_mp;
 
     memset(cur_mp, 0, op->mode_6 ? DEF_MODE_6_RESP_LEN : DEF_MODE_RESP_LEN);
     req_len = 8 + (15 * 16);    /* allow for 15 'long' block descriptors */
@@ -1411,7 +1561,7 @@ print_mode_page_hex(int sg_fd, int pn, int spn,
                     const struct sdparm_opt_coll * op)
 {
     int res, len, resid, vb;
-    uint8_t * mdpg = oth_aligned_mp;
+    uint8_t * mdpg = op->ctxp->oth_mp;
 
     vb = (op->verbose > 2) ? op->verbose - 2 : 0;
     len = (op->mode_6) ? DEF_MODE_6_RESP_LEN : MAX_MODE_DATA_LEN;
@@ -1526,10 +1676,10 @@ print_full_mpgs(int sg_fd, int o_pn, int o_spn, int pdt,
     if (op->do_hex > 0) {
         return print_mpgs_in_hex(sg_fd, o_pn, o_spn, op);
     }
-    cur_mp = (MP_OM_CUR & op->out_mask) ? cur_aligned_mp : NULL;
-    cha_mp = (MP_OM_CHA & op->out_mask) ? cha_aligned_mp : NULL;
-    def_mp = (MP_OM_DEF & op->out_mask) ? def_aligned_mp : NULL;
-    sav_mp = (MP_OM_SAV & op->out_mask) ? sav_aligned_mp : NULL;
+    cur_mp = (MP_OM_CUR & op->out_mask) ? op->ctxp->cur_mp : NULL;
+    cha_mp = (MP_OM_CHA & op->out_mask) ? op->ctxp->cha_mp : NULL;
+    def_mp = (MP_OM_DEF & op->out_mask) ? op->ctxp->def_mp : NULL;
+    sav_mp = (MP_OM_SAV & op->out_mask) ? op->ctxp->sav_mp : NULL;
     if (cur_mp)
         first_mp = cur_mp;
     else if (cha_mp)
@@ -1568,7 +1718,7 @@ print_full_mpgs(int sg_fd, int o_pn, int o_spn, int pdt,
         }
     }
     if (NULL == first_mp) {
-        printf("No page control selected by --out_mask=OM\n");
+        sgj_pr_hr(jsp, "No page control selected by --out_mask=OM\n");
         return 0;
     }
     l_pn = o_pn;
@@ -1696,7 +1846,7 @@ print_full_mpgs(int sg_fd, int o_pn, int o_spn, int pdt,
                                 "bit not set in response, ignore\n",
                                 __func__, l_pn, l_spn);
                     /* say nothing was reported */
-                    ++non_spg_warning;
+                    ++op->ctxp->non_spg_warning;
                     skip_spn = l_spn;
                     continue;
                 }
@@ -2366,10 +2516,8 @@ print_get_mitems(int sg_fd, const struct sdparm_mp_settings_t * mps,
     uint8_t * cha_mp;
     uint8_t * def_mp;
     uint8_t * sav_mp;
-    uint8_t * free_cur_mp = NULL;
-    uint8_t * free_cha_mp = NULL;
-    uint8_t * free_def_mp = NULL;
-    uint8_t * free_sav_mp = NULL;
+    uint8_t * free_mp = NULL;
+    const struct sdparm_arena_t * arp = op->arenap;
     const struct sdparm_mp_it_val_t * ivp;
     sgj_state * jsp = &op->json_st;
     sgj_opaque_p jo2p = NULL;
@@ -2383,15 +2531,20 @@ print_get_mitems(int sg_fd, const struct sdparm_mp_settings_t * mps,
     static const int flen = sizeof(f);
 
     req_len = mode6 ? DEF_MODE_6_RESP_LEN : DEF_MODE_RESP_LEN;
-    cur_mp = sg_memalign(req_len, 0, &free_cur_mp, false);
-    cha_mp = sg_memalign(req_len, 0, &free_cha_mp, false);
-    def_mp = sg_memalign(req_len, 0, &free_def_mp, false);
-    sav_mp = sg_memalign(req_len, 0, &free_sav_mp, false);
-    if ((NULL == cur_mp) || (NULL == cha_mp) || (NULL == def_mp) ||
-        (NULL == sav_mp)) {
-        pr2serr("%s: unable to allocate heap\n", __func__);
-        res = sg_convert_errno(ENOMEM);
-        goto out;
+    if (arp) {  /* no heap allocation when DEVICE has a scratch arena */
+        cur_mp = arp->gmi_b[0];
+        cha_mp = arp->gmi_b[1];
+        def_mp = arp->gmi_b[2];
+        sav_mp = arp->gmi_b[3];
+    } else {
+        cur_mp = sg_memalign(MP_NUM_PG_CTL * req_len, 0, &free_mp, false);
+        if (NULL == cur_mp) {
+            pr2serr("%s: unable to allocate heap\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        cha_mp = cur_mp + req_len;
+        def_mp = cha_mp + req_len;
+        sav_mp = def_mp + req_len;
     }
     warned = false;
     verb = (op->verbose > 0) ? op->verbose - 1 : 0;
@@ -2513,28 +2666,40 @@ print_get_mitems(int sg_fd, const struct sdparm_mp_settings_t * mps,
         print_get_mi_innerh("", smask, mpip, val, pc_arr, op, jo2p);
     }           /* end of loop over --get=<acron>[=<mpi_get_val>] options */
 out:
-    if (free_cur_mp)
-        free(free_cur_mp);
-    if (free_cha_mp)
-        free(free_cha_mp);
-    if (free_def_mp)
-        free(free_def_mp);
-    if (free_sav_mp)
-        free(free_sav_mp);
+    if (free_mp)
+        free(free_mp);
     return res;
 }
 
-/* Return of 0 -> success, most errors indicated by various SG_LIB_CAT_*
- * positive values, -1 -> other failures */
 static int
-change_mode_page(int sg_fd, int pdt,
-                 const struct sdparm_mp_settings_t * mps,
-                 const struct sdparm_opt_coll * op)
+mode_select_md(int sg_fd, uint8_t * md, int md_len, bool sp,
+               const struct sdparm_opt_coll * op)
+{
+    if (op->mode_6)
+        return sg_ll_mode_select6(sg_fd, true /* PF */, sp, md, md_len, true,
+                                  op->verbose);
+    return sg_ll_mode_select10_v2(sg_fd, true /* PF */, false /* RTD */, sp,
+                                  md, md_len, true, op->verbose);
+}
+
+/* Fetches the current values of the mode page in mcp with a single MODE
+ * SENSE then applies those fields in mps that belong to that page. If vit
+ * is non-NULL, vit[k] is set to where field mps->it_vals[k] was placed
+ * (i.e. after any descriptor adjustment). Return of 0 -> success, most
+ * errors indicated by various SG_LIB_CAT_* positive values, -1 -> other
+ * failures */
+static int
+fetch_modify_mpage(int sg_fd, int pdt, struct sdparm_mp_change_t * mcp,
+                   const struct sdparm_mp_settings_t * mps,
+                   struct sdparm_mp_item_t * vit,
+                   const struct sdparm_opt_coll * op)
 {
     bool mode6 = op->mode_6;
-    int k, off, md_len, len, res, desc_num, pn, spn;
+    int k, off, md_len, len, res, desc_num, alloc_len;
     int resid = 0;
     int vb = op->verbose;
+    int pn = mcp->pn;
+    int spn = mcp->spn;
     const struct sdparm_mp_name_t * mnp = NULL;
     const struct sdparm_mp_it_val_t * ivp;
     const struct sdparm_mp_item_t * mpip;
@@ -2542,28 +2707,17 @@ change_mode_page(int sg_fd, int pdt,
     char b[128];
     char b_tmp[32];
     char ebuff[EBUFF_SZ];
-    uint8_t * mdpg = oth_aligned_mp;
+    uint8_t * mdpg = mcp->md;
     struct sdparm_mp_item_t a_mp_it;
 
-    if (pdt >= 0) {
-        /* sanity check: check acronym's pdt matches device's pdt */
-        for (k = 0; k < mps->num_it_vals; ++k) {
-            ivp = &mps->it_vals[k];
-            if (ivp->mp_it.acron && ! sg_pdt_s_eq(pdt, ivp->mp_it.com_pdt)) {
-                pr2serr("%s: peripheral device type (pdt) is 0x%x but "
-                        "acronym %s\n  is associated with pdt 0x%x. To "
-                        "bypass use numeric addressing mode.\n", __func__,
-                         pdt, ivp->mp_it.acron, ivp->mp_it.com_pdt);
-                return SG_LIB_SYNTAX_ERROR;
-            }
-        }
-    }
-    pn = mps->pg_num;
-    spn = mps->subpg_num;
     mnp = sdp_get_mp_nm_with_str(pn, spn, pdt, op->transport, op->vendor_id,
                                  0, false, sizeof(b), b);
+    /* ask for as much as could be needed rather than probing the mode
+     * data length first, saves a MODE SENSE per page */
+    alloc_len = mode6 ? DEF_MODE_6_RESP_LEN : MAX_MODE_DATA_LEN;
     memset(mdpg, 0, MAX_MODE_DATA_LEN);
-    res = ll_mode_sense(sg_fd, pn, spn, false, mdpg, 4, &resid, vb, op);
+    res = ll_mode_sense(sg_fd, pn, spn, false, mdpg, alloc_len, &resid, vb,
+                        op);
     if (0 != res) {
         if (SG_LIB_CAT_INVALID_OP == res) {
             pr2serr("%s byte %s cdb not supported, try again with%s '-6' "
@@ -2577,29 +2731,23 @@ change_mode_page(int sg_fd, int pdt,
         pr2serr("%s: failed fetching page: %s\n", __func__, b);
         return res;
     }
-    if (resid > 0) {
+    len = alloc_len - resid;
+    if (len < 4) {
         pr2serr("%s: resid=%d implies even short mpage truncated\n",
                 __func__, resid);
         return SG_LIB_CAT_MALFORMED;
     }
     md_len = mode6 ? (mdpg[0] + 1) : (sg_get_unaligned_be16(mdpg) + 2);
-    if (md_len > MAX_MODE_DATA_LEN) {
+    if (md_len > alloc_len) {
         pr2serr("%s: mode data length=%d exceeds allocation length=%d\n",
-                __func__, md_len, MAX_MODE_DATA_LEN);
+                __func__, md_len, alloc_len);
         return SG_LIB_CAT_MALFORMED;
     }
-    res = ll_mode_sense(sg_fd, pn, spn, false, mdpg, md_len, &resid, vb, op);
-    if (0 != res) {
-        pr2serr("%s: failed fetching page: %s\n", __func__, b);
-        return res;
-    }
-    if (resid > 0) {
-        md_len -= resid;
-        if (md_len < 4) {
+    if (md_len > len) {
+        md_len = len;
+        if (vb)
             pr2serr("%s: resid=%d implies mpage truncated\n", __func__,
                     resid);
-            return SG_LIB_CAT_MALFORMED;
-        }
     }
     off = sg_mode_page_offset(mdpg, md_len, mode6, ebuff, EBUFF_SZ);
     if (off < 0) {
@@ -2607,15 +2755,28 @@ change_mode_page(int sg_fd, int pdt,
         return SG_LIB_CAT_MALFORMED;
     }
     len = sdp_mpage_len(mdpg + off);
+    if ((off + len) < md_len)
+        md_len = off + len;     /* ignore anything after requested page */
     mdpg[0] = 0;        /* mode data length reserved for mode select */
     if (! mode6)
         mdpg[1] = 0;    /* mode data length reserved for mode select */
     if (PDT_DISK == pdt)       /* entire disk specific parameters is ... */
         mdpg[mode6 ? 2 : 3] = 0x00;     /* reserved for mode select */
+    if ((! (mdpg[off] & 0x80)) && op->save) {
+        pr2serr("%s: %s %s indicates it is not saveable but\n    '--save' "
+                "option given (try without it)\n", __func__, b, mp_s);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    mdpg[off] &= 0x7f;   /* mask out PS bit, reserved in mode select */
+    memcpy(mcp->orig, mdpg, md_len);
+    mcp->off = off;
+    mcp->md_len = md_len;
 
     for (k = 0; k < mps->num_it_vals; ++k) {
         ivp = &mps->it_vals[k];
         mpip = &ivp->mp_it;
+        if ((pn != mpip->pg_num) || (spn != mpip->subpg_num))
+            continue;
         desc_num = ivp->descriptor_num;
         if (desc_num > 0) {
             if (check_desc_convert_mpip(desc_num, mnp, mpip, &a_mp_it,
@@ -2658,63 +2819,460 @@ change_mode_page(int sg_fd, int pdt,
             pr2serr("    applying anyway\n");
         }
         sdp_mitem_set_value(ivp->val, mpip, mdpg + off);
+        if (vit)
+            vit[k] = *mpip;
     }
+    return 0;
+}
 
-    if ((! (mdpg[off] & 0x80)) && op->save) {
-        pr2serr("%s: %s indicates it is not saveable but\n    '--save' "
-                "option given (try without it)\n", __func__, mp_s);
+/* Fetches page control pc (0: current, 3: saved) of the page in mcp into
+ * rb using the mode data length learnt when it was fetched for changing.
+ * Places the offset of the page in *offp and its length in *lenp . */
+static int
+verify_fetch(int sg_fd, int pc, const struct sdparm_mp_change_t * mcp,
+             uint8_t * rb, int * offp, int * lenp,
+             const struct sdparm_opt_coll * op)
+{
+    int res, len, off;
+    int resid = 0;
+    char ebuff[EBUFF_SZ];
+
+    res = ll_mode_sense_pc(sg_fd, pc, mcp->pn, mcp->spn, false, rb,
+                           mcp->md_len, &resid, op->verbose, op);
+    if (res)
+        return res;
+    len = mcp->md_len - resid;
+    off = sg_mode_page_offset(rb, len, op->mode_6, ebuff, EBUFF_SZ);
+    if ((off < 0) || ((rb[off] & 0x3f) != mcp->pn) ||
+        (((rb[off] & 0x40) ? rb[off + 1] : 0) != mcp->spn)) {
+        pr2serr("%s: page offset failed: %s\n", __func__,
+                (off < 0) ? ebuff : "wrong page or subpage");
         return SG_LIB_CAT_MALFORMED;
     }
-    mdpg[off] &= 0x7f;   /* mask out PS bit, reserved in mode select */
-    if (op->dummy) {
-        pr2serr("Mode data that would have been written:\n");
-        hex2stderr(mdpg, md_len, 1);
+    *offp = off;
+    *lenp = len - off;
+    return 0;
+}
+
+/* Checks that each field in mps reads back as it was written by
+ * sdp_write_mpages(). Only the current values of each changed page are
+ * re-read (plus the saved values when --save is given), using the page
+ * length already known, so this costs one or two MODE SENSE commands per
+ * page. Returns 0 if all fields were accepted, SG_LIB_CAT_MISCOMPARE if
+ * any was not, else the error from MODE SENSE. */
+static int
+verify_mpages(int sg_fd, const struct sdparm_mp_change_t * mc_arr, int num,
+              const struct sdparm_mp_settings_t * mps,
+              const struct sdparm_mp_item_t * vit,
+              const struct sdparm_opt_coll * op, sgj_opaque_p jop)
+{
+    bool cur_ok, sav_ok;
+    int k, j, res, off, len;
+    int n_bad = 0;
+    int ret = 0;
+    uint64_t want, cur_v, sav_v;
+    const struct sdparm_mp_change_t * mcp;
+    const struct sdparm_mp_item_t * mpip;
+    const struct sdparm_mp_it_val_t * ivp;
+    uint8_t * rb = op->ctxp->oth_mp;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    const char * status;
+    uint64_t cur_arr[MAX_MP_IT_VAL];
+    uint64_t sav_arr[MAX_MP_IT_VAL];
+    bool cur_has[MAX_MP_IT_VAL];
+    bool sav_has[MAX_MP_IT_VAL];
+    char b[64];
+
+    memset(cur_has, 0, sizeof(cur_has));
+    memset(sav_has, 0, sizeof(sav_has));
+    for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+        res = verify_fetch(sg_fd, 0 /* current */, mcp, rb, &off, &len, op);
+        if (res)
+            return res;
+        for (j = 0; j < mps->num_it_vals; ++j) {
+            mpip = vit + j;
+            if ((mpip->pg_num != mcp->pn) || (mpip->subpg_num != mcp->spn))
+                continue;
+            if (mpip->start_byte < len) {
+                cur_arr[j] = sdp_mitem_get_value(mpip, rb + off);
+                cur_has[j] = true;
+            }
+        }
+        if (! op->save)
+            continue;
+        res = verify_fetch(sg_fd, 3 /* saved */, mcp, rb, &off, &len, op);
+        if (res)
+            return res;
+        for (j = 0; j < mps->num_it_vals; ++j) {
+            mpip = vit + j;
+            if ((mpip->pg_num != mcp->pn) || (mpip->subpg_num != mcp->spn))
+                continue;
+            if (mpip->start_byte < len) {
+                sav_arr[j] = sdp_mitem_get_value(mpip, rb + off);
+                sav_has[j] = true;
+            }
+        }
+    }
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "mode_page_verify");
+    for (j = 0; j < mps->num_it_vals; ++j) {
+        ivp = mps->it_vals + j;
+        mpip = vit + j;
+        for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+            if ((mpip->pg_num == mcp->pn) && (mpip->subpg_num == mcp->spn))
+                break;
+        }
+        want = sdp_mitem_get_value(mpip, mcp->md + mcp->off);
+        cur_v = cur_arr[j];
+        sav_v = sav_arr[j];
+        cur_ok = cur_has[j] && (cur_v == want);
+        sav_ok = (! op->save) || (sav_has[j] && (sav_v == want));
+        if (! cur_ok)
+            status = "rejected";
+        else if (! sav_ok)
+            status = "not_saved";
+        else
+            status = "accepted";
+        if (! (cur_ok && sav_ok))
+            ++n_bad;
+        if (ivp->mp_it.acron)
+            snprintf(b, sizeof(b), "%s", ivp->mp_it.acron);
+        else
+            snprintf(b, sizeof(b), "0x%x:%d:%d", ivp->mp_it.start_byte,
+                     ivp->mp_it.start_bit, ivp->mp_it.num_bits);
+        if (ivp->descriptor_num > 0)
+            snprintf(b + strlen(b), sizeof(b) - strlen(b), ".%d",
+                     ivp->descriptor_num);
+        if ((0 == op->do_quiet) || (! (cur_ok && sav_ok))) {
+            if (cur_has[j] && op->save && sav_has[j])
+                sgj_pr_hr(jsp, "    %s: wrote %" PRIu64 ", current %" PRIu64
+                          ", saved %" PRIu64 " [%s]\n", b, want, cur_v,
+                          sav_v, status);
+            else if (cur_has[j])
+                sgj_pr_hr(jsp, "    %s: wrote %" PRIu64 ", current %" PRIu64
+                          " [%s]\n", b, want, cur_v, status);
+            else
+                sgj_pr_hr(jsp, "    %s: wrote %" PRIu64 ", not in page read "
+                          "back [%s]\n", b, want, status);
+        }
+        if (jap) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "field", b);
+            sgj_js_nv_ihex(jsp, jo2p, "page_code", mpip->pg_num);
+            sgj_js_nv_ihex(jsp, jo2p, "subpage_code", mpip->subpg_num);
+            sgj_js_nv_i(jsp, jo2p, "requested_value", (int64_t)want);
+            if (cur_has[j])
+                sgj_js_nv_i(jsp, jo2p, "current_value", (int64_t)cur_v);
+            if (op->save && sav_has[j])
+                sgj_js_nv_i(jsp, jo2p, "saved_value", (int64_t)sav_v);
+            sgj_js_nv_b(jsp, jo2p, "accepted", cur_ok && sav_ok);
+            sgj_js_nv_s(jsp, jo2p, "status", status);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+    }
+    if (n_bad > 0) {
+        pr2serr("%d of %d field%s did not read back as written\n", n_bad,
+                mps->num_it_vals, (1 == mps->num_it_vals) ? "" : "s");
+        ret = SG_LIB_CAT_MISCOMPARE;
+    }
+    return ret;
+}
+
+/* Builds, in mdp, a single mode parameter list holding all the pages in
+ * mc_arr[0..num-1]. The mode parameter header is built afresh without
+ * block descriptors (so no page's block descriptor is applied), only the
+ * medium type and device specific parameter are carried over as they
+ * belong to the DEVICE rather than a page. Returns its length or 0 if it
+ * would exceed max_len . */
+static int
+coalesce_mpages(const struct sdparm_mp_change_t * mc_arr, int num,
+                uint8_t * mdp, int max_len, bool mode6)
+{
+    int k, n, len;
+    const struct sdparm_mp_change_t * mcp;
+    const uint8_t * hp = mc_arr[0].md;
+
+    n = mode6 ? 4 : 8;
+    if (n > max_len)
         return 0;
+    memset(mdp, 0, n);
+    if (mode6) {
+        mdp[1] = hp[1];         /* medium type */
+        mdp[2] = hp[2];         /* device specific parameter */
+    } else {
+        mdp[2] = hp[2];
+        mdp[3] = hp[3];
     }
-    if (mode6)
-        res = sg_ll_mode_select6(sg_fd, true /* PF */, op->save, mdpg, md_len,
-                                 true, vb);
-    else
-        res = sg_ll_mode_select10_v2(sg_fd, true /* PF */, false /* RTD */,
-                                     op->save, mdpg, md_len, true, vb);
-    if (0 != res) {
-        pr2serr("%s: failed setting page: %s\n", __func__, b);
-        return res;
+    for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+        len = mcp->md_len - mcp->off;
+        if ((n + len) > max_len)
+            return 0;
+        memcpy(mdp + n, mcp->md + mcp->off, len);
+        n += len;
     }
-    return 0;
+    return n;
 }
 
-/* Return of 0 -> success, various SG_LIB_CAT_* positive values,
- * -1 -> other failure */
+/* Fetches the saved values (page control 3) of the page in mcp into sav,
+ * made ready for MODE SELECT in the same way as mcp->orig . Places the
+ * mode parameter list length in *sav_lenp . Used by '--rollback --save'
+ * since a MODE SELECT with SP=1 overwrites the saved values, which may
+ * differ from the current values held in mcp->orig . */
 static int
-set_def_mode_page(int sg_fd, int pn, int spn,
-                  const uint8_t * mode_pg, int mode_pg_len,
+fetch_saved_mpage(int sg_fd, int pdt, const struct sdparm_mp_change_t * mcp,
+                  uint8_t * sav, int * sav_lenp,
                   const struct sdparm_opt_coll * op)
 {
     bool mode6 = op->mode_6;
-    int len, off, md_len;
+    int res, len, off, md_len, alloc_len;
     int resid = 0;
-    int ret = -1;
-    uint8_t * mdp;
     char ebuff[EBUFF_SZ];
-    char b[128];
 
-    len = mode_pg_len + MODE_DATA_OVERHEAD;
-    mdp = (uint8_t *)malloc(len);
-    if (NULL ==mdp) {
-        pr2serr("%s: malloc failed, out of memory\n", __func__);
-        return sg_convert_errno(ENOMEM);
+    alloc_len = mode6 ? DEF_MODE_6_RESP_LEN : MAX_MODE_DATA_LEN;
+    memset(sav, 0, alloc_len);
+    res = ll_mode_sense_pc(sg_fd, 3 /* saved */, mcp->pn, mcp->spn, false,
+                           sav, alloc_len, &resid, op->verbose, op);
+    if (res)
+        return res;
+    len = alloc_len - resid;
+    if (len < 4)
+        return SG_LIB_CAT_MALFORMED;
+    md_len = mode6 ? (sav[0] + 1) : (sg_get_unaligned_be16(sav) + 2);
+    if (md_len > len)
+        md_len = len;
+    off = sg_mode_page_offset(sav, md_len, mode6, ebuff, EBUFF_SZ);
+    if ((off < 0) || ((sav[off] & 0x3f) != mcp->pn) ||
+        (((sav[off] & 0x40) ? sav[off + 1] : 0) != mcp->spn)) {
+        pr2serr("%s: page offset failed: %s\n", __func__,
+                (off < 0) ? ebuff : "wrong page or subpage");
+        return SG_LIB_CAT_MALFORMED;
     }
-    memset(mdp, 0, len);
-    ret = ll_mode_sense(sg_fd, pn, spn, true, mdp, 4, &resid, op->verbose, op);
-    if (0 != ret) {
-        sdp_get_mp_nm_with_str(pn, spn, -1, op->transport, op->vendor_id, 0,
-                               false, sizeof(b), b);
-        pr2serr("%s: failed fetching page: %s\n", __func__, b);
-        goto err_out;
+    len = sdp_mpage_len(sav + off);
+    if ((off + len) < md_len)
+        md_len = off + len;
+    /* same clean up as applied to orig by fetch_modify_mpage() */
+    sav[0] = 0;
+    if (! mode6)
+        sav[1] = 0;
+    if (PDT_DISK == pdt)
+        sav[mode6 ? 2 : 3] = 0x00;
+    sav[off] &= 0x7f;
+    *sav_lenp = md_len;
+    return 0;
+}
+
+/* Writes the mode pages in mc_arr[0..num-1] to the DEVICE. When there is
+ * more than one they are sent in a single MODE SELECT if they fit; if the
+ * DEVICE rejects that, or they don't fit, a MODE SELECT is sent per page.
+ * If one of those fails and '--rollback' is given then the pages already
+ * changed are written back from their orig images. With '--save' as well
+ * the saved values of each page are fetched before any page is written
+ * and put back first (SP=1), then the current values from orig (SP=0).
+ * Return of 0 -> success, most errors indicated by various SG_LIB_CAT_*
+ * positive values, -1 -> other failures */
+int
+sdp_write_mpages(int sg_fd, int pdt, struct sdparm_mp_change_t * mc_arr,
+                 int num, const struct sdparm_opt_coll * op)
+{
+    bool mode6 = op->mode_6;
+    int k, j, n, res, res2;
+    int vb = op->verbose;
+    struct sdparm_mp_change_t * mcp;
+    uint8_t * sav_arr = NULL;
+    uint8_t * free_sav = NULL;
+    int sav_len[MAX_MP_IT_VAL];
+    char b[128];
+
+    if (num > 1) {
+        /* try to send all pages in one parameter list */
+        n = coalesce_mpages(mc_arr, num, op->ctxp->oth_mp,
+                            mode6 ? 255 : MAX_MP_BUFF_SZ, mode6);
+        if (n > 0) {
+            if (op->dummy) {
+                pr2serr("Mode data that would have been written (%d "
+                        "%ss):\n", num, mp_s);
+                hex2stderr(op->ctxp->oth_mp, n, 1);
+                return 0;
+            }
+            res = mode_select_md(sg_fd, op->ctxp->oth_mp, n, op->save, op);
+            if ((SG_LIB_CAT_ILLEGAL_REQ != res) &&
+                (SG_LIB_CAT_INVALID_PARAM != res))
+                return res;
+            /* a rejected parameter list should change nothing */
+            if (vb)
+                pr2serr("DEVICE rejected %d %ss in one %s, now trying "
+                        "one at a time\n", num, mp_s, msel_s);
+        } else if (vb)
+            pr2serr("%d %ss too long for one %s, sending one at a time\n",
+                    num, mp_s, msel_s);
     }
-    if (resid > 0) {
-        pr2serr("%s: resid=%d implies even short mpage truncated\n",
+    if (op->rollback && op->save && (num > 1) && (! op->dummy)) {
+        /* the last page is never rolled back */
+        if (num > MAX_MP_IT_VAL)
+            return SG_LIB_LOGIC_ERROR;
+        sav_arr = sg_memalign((num - 1) * MAX_MODE_DATA_LEN, 0, &free_sav,
+                              false);
+        if (NULL == sav_arr) {
+            pr2serr("%s: unable to allocate saved page buffers\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        for (k = 0; k < (num - 1); ++k) {
+            res = fetch_saved_mpage(sg_fd, pdt, mc_arr + k,
+                                    sav_arr + (k * MAX_MODE_DATA_LEN),
+                                    sav_len + k, op);
+            if (res) {
+                pr2serr("%s: unable to fetch saved values for '--rollback', "
+                        "nothing changed\n", __func__);
+                goto fini;
+            }
+        }
+    }
+    for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+        if (op->dummy) {
+            pr2serr("Mode data that would have been written:\n");
+            hex2stderr(mcp->md, mcp->md_len, 1);
+            continue;
+        }
+        res = mode_select_md(sg_fd, mcp->md, mcp->md_len, op->save, op);
+        if (0 == res)
+            continue;
+        sdp_get_mp_nm_with_str(mcp->pn, mcp->spn, pdt, op->transport,
+                               op->vendor_id, 0, false, sizeof(b), b);
+        pr2serr("%s: failed setting page: %s\n", __func__, b);
+        if ((k > 0) && (! op->rollback))
+            pr2serr("    %d prior %s(s) changed, use '--rollback' to undo "
+                    "in this case\n", k, mp_s);
+        for (j = k - 1; op->rollback && (j >= 0); --j) {
+            sdp_get_mp_nm_with_str(mc_arr[j].pn, mc_arr[j].spn, pdt,
+                                   op->transport, op->vendor_id, 0, false,
+                                   sizeof(b), b);
+            res2 = 0;
+            if (sav_arr)        /* saved values first, SP=1 sets both */
+                res2 = mode_select_md(sg_fd,
+                                      sav_arr + (j * MAX_MODE_DATA_LEN),
+                                      sav_len[j], true, op);
+            if (0 == res2)
+                res2 = mode_select_md(sg_fd, mc_arr[j].orig,
+                                      mc_arr[j].md_len, false, op);
+            if (res2)
+                pr2serr("%s: rollback of %s failed\n", __func__, b);
+            else if (vb)
+                pr2serr("rolled back %s\n", b);
+        }
+        goto fini;
+    }
+    res = 0;
+fini:
+    if (free_sav)
+        free(free_sav);
+    return res;
+}
+
+/* Applies the fields in mps, which may come from several mode pages. Each
+ * page is fetched once, modified and then written by sdp_write_mpages().
+ * With --verify the changed fields are then read back, see
+ * verify_mpages(). Return of 0 -> success, most errors indicated by
+ * various SG_LIB_CAT_* positive values, -1 -> other failures */
+static int
+change_mode_pages(int sg_fd, int pdt,
+                  const struct sdparm_mp_settings_t * mps,
+                  const struct sdparm_opt_coll * op, sgj_opaque_p jop)
+{
+    int k, j, n, res, num, pg_sz;
+    const struct sdparm_mp_it_val_t * ivp;
+    struct sdparm_mp_change_t * mcp;
+    uint8_t * bp;
+    uint8_t * free_bp = NULL;
+    struct sdparm_mp_change_t mc_arr[MAX_MP_IT_VAL];
+    struct sdparm_mp_item_t vit[MAX_MP_IT_VAL];
+
+    if (pdt >= 0) {
+        /* sanity check: check acronym's pdt matches device's pdt */
+        for (k = 0; k < mps->num_it_vals; ++k) {
+            ivp = &mps->it_vals[k];
+            if (ivp->mp_it.acron && ! sg_pdt_s_eq(pdt, ivp->mp_it.com_pdt)) {
+                pr2serr("%s: peripheral device type (pdt) is 0x%x but "
+                        "acronym %s\n  is associated with pdt 0x%x. To "
+                        "bypass use numeric addressing mode.\n", __func__,
+                         pdt, ivp->mp_it.acron, ivp->mp_it.com_pdt);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        }
+    }
+    /* distinct pages in the order their first field was given */
+    for (k = 0, num = 0; k < mps->num_it_vals; ++k) {
+        ivp = &mps->it_vals[k];
+        for (j = 0; j < num; ++j) {
+            if ((mc_arr[j].pn == ivp->mp_it.pg_num) &&
+                (mc_arr[j].spn == ivp->mp_it.subpg_num))
+                break;
+        }
+        if (j < num)
+            continue;
+        memset(mc_arr + num, 0, sizeof(mc_arr[0]));
+        mc_arr[num].pn = ivp->mp_it.pg_num;
+        mc_arr[num].spn = ivp->mp_it.subpg_num;
+        ++num;
+    }
+    if (num < 1)
+        return 0;
+    pg_sz = sg_get_page_size();
+    n = ((2 * MAX_MODE_DATA_LEN + pg_sz - 1) / pg_sz) * pg_sz;
+    bp = sg_memalign(num * n, 0, &free_bp, false);
+    if (NULL == bp) {
+        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                num * n);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+        mcp->md = bp + (k * n);
+        mcp->orig = mcp->md + MAX_MODE_DATA_LEN;
+        res = fetch_modify_mpage(sg_fd, pdt, mcp, mps, vit, op);
+        if (res)
+            goto fini;      /* nothing written yet */
+    }
+    res = sdp_write_mpages(sg_fd, pdt, mc_arr, num, op);
+    if ((0 == res) && op->do_verify && (! op->dummy))
+        res = verify_mpages(sg_fd, mc_arr, num, mps, vit, op, jop);
+fini:
+    if (free_bp)
+        free(free_bp);
+    return res;
+}
+
+/* Return of 0 -> success, various SG_LIB_CAT_* positive values,
+ * -1 -> other failure */
+static int
+set_def_mode_page(int sg_fd, int pn, int spn,
+                  const uint8_t * mode_pg, int mode_pg_len,
+                  const struct sdparm_opt_coll * op)
+{
+    bool mode6 = op->mode_6;
+    int len, off, md_len;
+    int resid = 0;
+    int ret = -1;
+    uint8_t * mdp;
+    char ebuff[EBUFF_SZ];
+    char b[128];
+
+    len = mode_pg_len + MODE_DATA_OVERHEAD;
+    mdp = (uint8_t *)malloc(len);
+    if (NULL ==mdp) {
+        pr2serr("%s: malloc failed, out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    memset(mdp, 0, len);
+    ret = ll_mode_sense(sg_fd, pn, spn, true, mdp, 4, &resid, op->verbose, op);
+    if (0 != ret) {
+        sdp_get_mp_nm_with_str(pn, spn, -1, op->transport, op->vendor_id, 0,
+                               false, sizeof(b), b);
+        pr2serr("%s: failed fetching page: %s\n", __func__, b);
+        goto err_out;
+    }
+    if (resid > 0) {
+        pr2serr("%s: resid=%d implies even short mpage truncated\n",
                 __func__, resid);
         ret = SG_LIB_CAT_MALFORMED;
         goto err_out;
@@ -2901,6 +3459,7 @@ build_mp_settings(const char * arg, struct sdparm_mp_settings_t * mps,
     struct sdparm_mp_it_val_t * ivp;
     const struct sdparm_mp_item_t * mpip;
     const struct sdparm_mp_item_t * prev_mpip;
+    const struct sdparm_mp_item_t * first_mpip;
     static const int blen = sizeof(b);
 
     cp = arg;
@@ -2995,10 +3554,19 @@ build_mp_settings(const char * arg, struct sdparm_mp_settings_t * mps,
                 } while ((mps->pg_num != mpip->pg_num) ||
                          (mps->subpg_num != mpip->subpg_num));
             } else {    /* --set or --clear */
+                /* Fields may come from several mode pages. An acronym
+                 * found in more than one page is taken from the page given
+                 * by --page= or, failing that, from the page of the first
+                 * field; otherwise its first match is used. */
+                first_mpip = NULL;
                 do {
                     mpip = sdp_find_mitem_by_acron(acron, &from,
                                  op->transport, op->vendor_id);
                     if (NULL == mpip) {
+                        if (cont && (NULL == op->page_str)) {
+                            mpip = first_mpip;
+                            break;
+                        }
                         if (cont) {
                             pr2serr("%s of acronym: %s [0x%x,0x%x] doesn't "
                                     "match prior\n", mp_s, acron,
@@ -3006,8 +3574,9 @@ build_mp_settings(const char * arg, struct sdparm_mp_settings_t * mps,
                                     prev_mpip->subpg_num);
                             pr2serr("    %s: 0x%x,0x%x\n", mp_s,
                                     mps->pg_num, mps->subpg_num);
-                            pr2serr("For '--set' and '--clear' all fields "
-                                    "must be in the same %s\n", mp_s);
+                            pr2serr("With '--page=' all fields given to "
+                                    "'--set' and '--clear'\nmust be in that "
+                                    "%s\n", mp_s);
                             goto err;
                         }
                         if ((op->vendor_id < 0) && (op->transport < 0)) {
@@ -3031,6 +3600,8 @@ build_mp_settings(const char * arg, struct sdparm_mp_settings_t * mps,
                         mps->subpg_num = mpip->subpg_num;
                         break;
                     }
+                    if (NULL == first_mpip)
+                        first_mpip = mpip;
                     cont = true;
                     prev_mpip = mpip;
                     /* got acronym match but if not at specified pn,spn */
@@ -3104,10 +3675,9 @@ build_mp_settings(const char * arg, struct sdparm_mp_settings_t * mps,
                 pr2serr("need '--page=' option for %s name or number\n",
                         mp_s);
                 goto err;
-            } else if (get) {
-                ivp->mp_it.pg_num = mps->pg_num;
-                ivp->mp_it.subpg_num = mps->subpg_num;
             }
+            ivp->mp_it.pg_num = mps->pg_num;
+            ivp->mp_it.subpg_num = mps->subpg_num;
             ivp->orig_val = ivp->val;
             if (ivp->mp_it.num_bits < 64) {
                 int64_t ll1 = 1;
@@ -3130,10 +3700,53 @@ err:
     return false;
 }
 
-/* Returns open file descriptor ( >= 0) or negated sg3_utils error code. */
+/* Makes the per DEVICE scratch arena with a single page aligned heap
+ * allocation. Returns 0 on success, otherwise an sg3_utils error code. */
+static int
+arena_create(struct sdparm_arena_t * arp)
+{
+    int k, pg_sz, vpd_sz, mpc_sz, gmi_sz;
+    uint8_t * bp;
+
+    memset(arp, 0, sizeof(*arp));
+    pg_sz = sg_get_page_size();
+    vpd_sz = 2 * pg_sz;         /* as used by sdp_process_vpd_page() */
+    mpc_sz = ((MAX_MP_BUFF_SZ + pg_sz - 1) / pg_sz) * pg_sz;
+    gmi_sz = MP_NUM_PG_CTL * DEF_MODE_RESP_LEN;
+    bp = sg_memalign((SDP_ARENA_VPD_LEVELS * vpd_sz) + mpc_sz + gmi_sz, 0,
+                     &arp->free_arena, false);
+    if (NULL == bp) {
+        pr2serr("%s: unable to allocate scratch arena\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < SDP_ARENA_VPD_LEVELS; ++k, bp += vpd_sz)
+        arp->vpd_b[k] = bp;
+    arp->vpd_b_sz = vpd_sz;
+    arp->mpc_b = bp;
+    arp->mpc_b_sz = mpc_sz;
+    bp += mpc_sz;
+    for (k = 0; k < MP_NUM_PG_CTL; ++k, bp += DEF_MODE_RESP_LEN)
+        arp->gmi_b[k] = bp;
+    arp->gmi_b_sz = DEF_MODE_RESP_LEN;
+    return 0;
+}
+
+static void
+arena_destroy(struct sdparm_arena_t * arp)
+{
+    if (arp->free_arena)
+        free(arp->free_arena);
+    memset(arp, 0, sizeof(*arp));
+}
+
+/* Returns open file descriptor ( >= 0) or negated sg3_utils error code.
+ * On success the scratch arena pointed to by arp is ready for use and
+ * op->arenap points to it; caller should call arena_destroy() after the
+ * DEVICE is closed. */
 static int
 open_and_simple_inquiry(const char * device_name, bool rw, int * pdt,
-                        bool * protect, struct sdparm_opt_coll * op)
+                        bool * protect, struct sdparm_arena_t * arp,
+                        struct sdparm_opt_coll * op)
 {
     int n, res, verb, sg_fd, l_pdt;
     sgj_state * jsp = &op->json_st;
@@ -3177,6 +3790,11 @@ open_and_simple_inquiry(const char * device_name, bool rw, int * pdt,
     }
     l_pdt = sir.peripheral_type;
     op->sinq_version = sir.version;
+    snprintf(op->ctxp->vendor, sizeof(op->ctxp->vendor), "%.8s", sir.vendor);
+    snprintf(op->ctxp->product, sizeof(op->ctxp->product), "%.16s",
+             sir.product);
+    snprintf(op->ctxp->revision, sizeof(op->ctxp->revision), "%.4s",
+             sir.revision);
     if ((PDT_WO == l_pdt) || (PDT_OPTICAL == l_pdt))
         *pdt = PDT_DISK;       /* map disk-like pdt's to PDT_DISK */
     else
@@ -3190,6 +3808,12 @@ open_and_simple_inquiry(const char * device_name, bool rw, int * pdt,
             sg_scn3pr(b, blen, n, "  [%s]", sg_get_pdt_str(l_pdt, clen, c));
         sgj_pr_hr(jsp, "%s\n", b);
     }
+    res = arena_create(arp);
+    if (res) {
+        res = -res;
+        goto err_out;
+    }
+    op->arenap = arp;
     return sg_fd;
 
 err_out:
@@ -3243,7 +3867,7 @@ print_mpgs_normal(int sg_fd, const struct sdparm_mp_settings_t * mps,
             pr2serr("no fields found to set or clear\n");
             return SG_LIB_CAT_OTHER;
         }
-        res = change_mode_page(sg_fd, pdt, mps, op);
+        res = change_mode_pages(sg_fd, pdt, mps, op, jop);
         if (res)
             return res;
     } else if (get) {
@@ -3483,14 +4107,608 @@ parse_page_str(int * t_com_pdtp, struct sdparm_opt_coll * op)
 }
 
 
+/*
+ * The sdp_ctx_*() functions below are the library interface to the mode and
+ * VPD page engine; sdp_main() is built on them. See struct sdparm_ctx_t in
+ * sdparm.h . Unless stated otherwise they return 0 on success, otherwise
+ * an sg3_utils error code (e.g. SG_LIB_CAT_ILLEGAL_REQ).
+ */
+
+/* Sets the same option defaults as sdparm's command line. Does not
+ * allocate heap. */
+int
+sdp_ctx_init(struct sdparm_ctx_t * ctxp)
+{
+    struct sdparm_opt_coll * op = &ctxp->opts;
+
+    memset(ctxp, 0, sizeof(*ctxp));
+    op->out_mask = MP_OM_ALL;   /* 0xf */
+    op->in_mask = MP_IM_ALL;    /* 0xf */
+    op->cl_pdt = -1;
+    op->transport = -1;
+    op->vendor_id = -1;
+    op->ctxp = ctxp;
+    ctxp->sg_fd = -1;
+    ctxp->pdt = -1;
+    return 0;
+}
+
+/* The current, changeable, default, saved and other mode page buffers
+ * share a single heap allocation which is kept until sdp_ctx_fini(). */
+static int
+ctx_alloc_mp_bufs(struct sdparm_ctx_t * ctxp)
+{
+    int pg_sz, sz;
+    uint8_t * bp;
+
+    if (ctxp->free_mp_bufs)
+        return 0;
+    pg_sz = sg_get_page_size();
+    sz = ((MAX_MP_BUFF_SZ + pg_sz - 1) / pg_sz) * pg_sz;
+    bp = sg_memalign(5 * sz, 0, &ctxp->free_mp_bufs, false);
+    if (NULL == bp) {
+        pr2serr("%s: unable to allocate heap\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    ctxp->cur_mp = bp;
+    ctxp->cha_mp = bp + sz;
+    ctxp->def_mp = bp + (2 * sz);
+    ctxp->sav_mp = bp + (3 * sz);
+    ctxp->oth_mp = bp + (4 * sz);
+    return 0;
+}
+
+/* Opens device_name (read-write if ctxp->opts.do_rw is set) and does a
+ * standard INQUIRY on it. Any DEVICE already open in this context is closed
+ * first. */
+int
+sdp_ctx_open(struct sdparm_ctx_t * ctxp, const char * device_name)
+{
+    int res, sg_fd;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+
+    if (ctxp->sg_fd >= 0) {
+        res = sdp_ctx_close(ctxp);
+        if (res)
+            return res;
+    }
+    res = ctx_alloc_mp_bufs(ctxp);
+    if (res)
+        return res;
+    sg_fd = open_and_simple_inquiry(device_name, op->do_rw, &ctxp->pdt,
+                                    &ctxp->protect, &ctxp->arena, op);
+    if (sg_fd < 0)
+        return -sg_fd;
+    ctxp->sg_fd = sg_fd;
+    ctxp->device_name = device_name;
+    return 0;
+}
+
+int
+sdp_ctx_close(struct sdparm_ctx_t * ctxp)
+{
+    int res;
+
+    if (ctxp->sg_fd < 0)
+        return 0;
+    res = sg_cmds_close_device(ctxp->sg_fd);
+    ctxp->sg_fd = -1;
+    ctxp->pdt = -1;
+    ctxp->device_name = NULL;
+    ctxp->opts.arenap = NULL;
+    arena_destroy(&ctxp->arena);
+    if (res < 0) {
+        pr2serr("close error: %s\n", safe_strerror(-res));
+        return sg_convert_errno(-res);
+    }
+    return 0;
+}
+
+/* Closes the DEVICE (if open) and frees all heap held by the context. */
+void
+sdp_ctx_fini(struct sdparm_ctx_t * ctxp)
+{
+    sdp_ctx_close(ctxp);
+    if (ctxp->free_mp_bufs)
+        free(ctxp->free_mp_bufs);
+    if (ctxp->free_cmd_b)
+        free(ctxp->free_cmd_b);
+    ctxp->free_mp_bufs = NULL;
+    ctxp->free_cmd_b = NULL;
+    ctxp->cur_mp = NULL;
+    ctxp->cha_mp = NULL;
+    ctxp->def_mp = NULL;
+    ctxp->sav_mp = NULL;
+    ctxp->oth_mp = NULL;
+    ctxp->cmd_b = NULL;
+    ctxp->cmd_b_sz = 0;
+}
+
+/* The library calls that decode pages don't write to stdout, which belongs
+ * to the calling program: their output goes into a JSON tree. Returns
+ * false if JSON output is not active in op->json_st, if jop is NULL or if
+ * hex output ('-H') is asked for. The human readable lines can be had in
+ * the tree's "output" array with JSON option 'o'. */
+static bool
+ctx_output_ok(const struct sdparm_opt_coll * op, sgj_opaque_p jop,
+              const char * fn)
+{
+    if (op->json_st.pr_as_json && jop && (0 == op->do_hex))
+        return true;
+    if (op->verbose)
+        pr2serr("%s: needs JSON output active and jop, no hex\n", fn);
+    return false;
+}
+
+/* Decodes mode page pn,spn (or all pages when pn is -1) as '-p' and '-a'
+ * would. Output is placed under jop; JSON output must be active in
+ * ctxp->opts.json_st. */
+int
+sdp_ctx_mode_pages(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                   sgj_opaque_p jop)
+{
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    if (! ctx_output_ok(&ctxp->opts, jop, __func__))
+        return SG_LIB_CONTRADICT;
+    return print_full_mpgs(ctxp->sg_fd, pn, spn, ctxp->pdt, &ctxp->opts,
+                           jop);
+}
+
+/* Decodes VPD page pn,spn. With pn of -1 the standard INQUIRY response is
+ * decoded. Output as for sdp_ctx_mode_pages(). */
+int
+sdp_ctx_vpd_page(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                 sgj_opaque_p jop)
+{
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    if (! ctx_output_ok(&ctxp->opts, jop, __func__))
+        return SG_LIB_CONTRADICT;
+    return sdp_process_vpd_page(ctxp->sg_fd, pn, ((spn < 0) ? 0 : spn),
+                                ctxp->opts.cl_pdt, ctxp->protect, NULL, NULL,
+                                0, &ctxp->opts, jop);
+}
+
+/* Parses arg, in the form given to '--set=', '--clear=' or '--get=', into
+ * mps. Returns true if successful. */
+bool
+sdp_ctx_build_mp_settings(struct sdparm_ctx_t * ctxp, const char * arg,
+                          struct sdparm_mp_settings_t * mps, bool clear,
+                          bool get)
+{
+    return build_mp_settings(arg, mps, &ctxp->opts, clear, get);
+}
+
+/* Applies the fields in mps (from sdp_ctx_build_mp_settings() with get
+ * false) with MODE SELECT; to saved values as well if ctxp->opts.save is
+ * set. */
+int
+sdp_ctx_change_mode_page(struct sdparm_ctx_t * ctxp,
+                         const struct sdparm_mp_settings_t * mps)
+{
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    return change_mode_pages(ctxp->sg_fd, ctxp->pdt, mps, &ctxp->opts,
+                             NULL);
+}
+
+/* Fetches the value of each field in mps for each page control (current,
+ * changeable, default and saved) that the DEVICE supports, placing them in
+ * arr[0 .. mps->num_it_vals - 1]. The caller decides how to present them.
+ * An entry's smask is 0 when its field lies beyond the end of the page
+ * that the DEVICE returned and ctxp->opts.flexible is set. */
 int
-main(int argc, char * argv[])
+sdp_ctx_fetch_mitem_vals(struct sdparm_ctx_t * ctxp,
+                         const struct sdparm_mp_settings_t * mps,
+                         struct sdparm_mitem_vals_t * arr)
+{
+    bool mode6;
+    int k, j, verb, smask, pn, spn, rep_len, req_len, len, desc_num;
+    int res = 0;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    const struct sdparm_mp_item_t * mpip;
+    const struct sdparm_mp_name_t * mnp;
+    const struct sdparm_mp_it_val_t * ivp;
+    void * pc_arr[MP_NUM_PG_CTL];
+    struct sdparm_mp_item_t a_mp_it;
+    char f[32];
+    static const int flen = sizeof(f);
+
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    mode6 = op->mode_6;
+    req_len = mode6 ? DEF_MODE_6_RESP_LEN : DEF_MODE_RESP_LEN;
+    pc_arr[0] = ctxp->cur_mp;
+    pc_arr[1] = ctxp->cha_mp;
+    pc_arr[2] = ctxp->def_mp;
+    pc_arr[3] = ctxp->sav_mp;
+    verb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    smask = 0;
+    rep_len = 0;
+    for (k = 0, pn = -1, spn = -1; k < mps->num_it_vals; ++k) {
+        ivp = &mps->it_vals[k];
+        desc_num = ivp->descriptor_num;
+        mpip = &ivp->mp_it;
+        memset(arr + k, 0, sizeof(arr[k]));
+        mnp = sdp_get_mp_nm(mpip->pg_num, mpip->subpg_num, mpip->com_pdt,
+                            op->transport, op->vendor_id);
+        if ((pn != mpip->pg_num) || (spn != mpip->subpg_num)) {
+            pn = mpip->pg_num;
+            spn = mpip->subpg_num;
+            smask = 0;
+            res = ll_mode_page_controls(ctxp->sg_fd, mode6, pn, spn,
+                                        req_len, &smask, pc_arr, &rep_len,
+                                        verb, op);
+            if (0 == (smask & 1)) {
+                if (0 == res)
+                    res = SG_LIB_CAT_OTHER;
+                if (verb)
+                    report_error(res, mode6);
+                return res;
+            }
+            res = 0;
+        }
+        if (desc_num > 0) {
+            if (! check_desc_convert_mpip(desc_num, mnp, mpip, &a_mp_it,
+                                          flen, f) ||
+                ! desc_adjust_start_byte(desc_num, mnp, ctxp->cur_mp,
+                                         rep_len, &a_mp_it, op)) {
+                pr2serr("%s: can't find descriptor %d for %s\n", __func__,
+                        desc_num, (mpip->acron ? mpip->acron : "field"));
+                return SG_LIB_CAT_OTHER;
+            }
+            mpip = &a_mp_it;
+        }
+        len = sdp_mpage_len(ctxp->cur_mp);
+        if (mpip->start_byte >= len) {
+            if (op->flexible)
+                continue;
+            pr2serr("%s: %s field position exceeds %s length=%d\n",
+                    __func__, (mpip->acron ? mpip->acron : "field"), mp_s,
+                    len);
+            return SG_LIB_CAT_OTHER;
+        }
+        arr[k].smask = smask;
+        for (j = 0; j < MP_NUM_PG_CTL; ++j) {
+            if (smask & (1 << j))
+                arr[k].val[j] = sdp_mitem_get_value(mpip,
+                                            (const uint8_t *)pc_arr[j]);
+        }
+    }
+    return res;
+}
+
+/* Room left in MAX_MP_BUFF_SZ for the mode parameter header and block
+ * descriptor(s) that precede the mode pages in a MODE SENSE(10) response */
+#define SDP_MS_HDR_ROOM 64
+
+/* Fetches mode page pn (or all mode pages when pn is ALL_MPAGES) together
+ * with its subpages when the DEVICE claims SPC-3 or later, for each page
+ * control that the DEVICE supports into ctxp->cur_mp, cha_mp, def_mp and
+ * sav_mp. MODE SENSE(10) is used irrespective of --six . Bit 0 of *smaskp
+ * is set if current values are fetched through to bit 3 for saved values.
+ * The pages start at offset 0 (i.e. there is no mode parameter header) and
+ * *resp_lenp is their total length, limited to what fits in those buffers.
+ * If truncp is non-NULL, *truncp is set when the DEVICE had more than
+ * that; fetching one page code at a time is then needed. */
+int
+sdp_ctx_mpages(struct sdparm_ctx_t * ctxp, int pn, int * smaskp,
+               int * resp_lenp, bool * truncp)
+{
+    int res, spn, verb;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    void * pc_arr[MP_NUM_PG_CTL];
+
+    if (truncp)
+        *truncp = false;
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    pc_arr[0] = ctxp->cur_mp;
+    pc_arr[1] = ctxp->cha_mp;
+    pc_arr[2] = ctxp->def_mp;
+    pc_arr[3] = ctxp->sav_mp;
+    verb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    spn = ((0xf & op->sinq_version) >= 0x3) ? ALL_MSPAGES : 0;
+again:
+    *smaskp = 0;
+    *resp_lenp = 0;
+    res = ll_mode_page_controls(ctxp->sg_fd, false, pn, spn,
+                                MAX_MP_BUFF_SZ, smaskp, pc_arr, resp_lenp,
+                                verb, op);
+    if (res) {
+        if (0 == *smaskp) {
+            if (ALL_MSPAGES == spn) {
+                spn = 0;        /* may not support subpages, try without */
+                goto again;
+            }
+            return verb ? report_error(res, false) : res;
+        } else if (SG_LIB_CAT_ILLEGAL_REQ != res)
+            return verb ? report_error(res, false) : res;
+    }
+    if (*resp_lenp > (MAX_MP_BUFF_SZ - SDP_MS_HDR_ROOM)) {
+        if (truncp)
+            *truncp = true;
+        *resp_lenp = MAX_MP_BUFF_SZ - SDP_MS_HDR_ROOM;
+    }
+    return 0;
+}
+
+/* Fetches every mode page, see sdp_ctx_mpages(). */
+int
+sdp_ctx_all_mpages(struct sdparm_ctx_t * ctxp, int * smaskp, int * resp_lenp)
+{
+    return sdp_ctx_mpages(ctxp, ALL_MPAGES, smaskp, resp_lenp, NULL);
+}
+
+/* Does a MODE SENSE (6 or 10 byte cdb depending on --six) for current
+ * values of mode page pn,spn on the open sg_fd placing up to mx_resp_len
+ * bytes in resp. For callers that keep several DEVICEs open at once. */
+int
+sdp_mode_sense_cur(int sg_fd, int pn, int spn, uint8_t * resp,
+                   int mx_resp_len, int * residp,
+                   const struct sdparm_opt_coll * op)
+{
+    return ll_mode_sense(sg_fd, pn, spn, false, resp, mx_resp_len, residp,
+                         -1, op);
+}
+
+/* As sdp_mode_sense_cur() on the DEVICE open in the context. Useful for
+ * fetching the mode parameter header that precedes the page. */
+int
+sdp_ctx_mode_sense(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                   uint8_t * resp, int mx_resp_len, int * residp)
+{
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    return sdp_mode_sense_cur(ctxp->sg_fd, pn, spn, resp, mx_resp_len,
+                              residp, &ctxp->opts);
+}
+
+/* As sdp_ctx_mode_sense() but for page control pc (0: current, 1:
+ * changeable, 2: default, 3: saved). */
+int
+sdp_ctx_mode_sense_pc(struct sdparm_ctx_t * ctxp, int pc, int pn, int spn,
+                      uint8_t * resp, int mx_resp_len, int * residp)
+{
+    if (ctxp->sg_fd < 0)
+        return SG_LIB_FILE_ERROR;
+    return ll_mode_sense_pc(ctxp->sg_fd, pc, pn, spn, false, resp,
+                            mx_resp_len, residp, -1, &ctxp->opts);
+}
+
+
+/* What sdp_main() does to each DEVICE, decided from the command line */
+struct sdp_dev_loop_t {
+    struct sdparm_ctx_t * ctxp;
+    const char ** device_name_arr;
+    int pn;
+    int spn;
+    int req_pdt;
+    int cmd_arg;
+    const struct sdparm_command_t * scmdp;
+    const struct sdparm_mp_settings_t * mps;
+    struct sdparm_diff_t * dfp;         /* non-NULL for --diff */
+    struct sdparm_profile_t * pfp;      /* non-NULL for --profile= */
+    struct sdparm_cdl_t * clp;          /* non-NULL for --cdl[=FILE] */
+    struct sdparm_bgw_t * bwp;          /* non-NULL for --bg-window= */
+    struct sdparm_ioad_t * iap;         /* non-NULL for --ioad[=FILE] */
+    struct sdparm_phy_t * php;          /* non-NULL for --phy-audit */
+    struct timespec * sweep_startp;     /* when the first DEVICE started */
+};
+
+/* Opens the k-th DEVICE, does what the command line asked, then closes it.
+ * When --deadline= is given the time taken is bounded and a DEVICE that
+ * exceeds it is reported as timed out. Returns 0 if successful. */
+static int
+process_device(int k, const struct sdp_dev_loop_t * dlp, sgj_opaque_p jop)
+{
+    int r, res, sg_fd, pdt;
+    int dl_ms = 0;
+    bool protect;
+    struct sdparm_ctx_t * ctxp = dlp->ctxp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    const char * device_name = dlp->device_name_arr[k];
+
+    if (op->deadline_ms || op->sweep_deadline_ms) {
+        dl_ms = op->deadline_ms;
+        if (op->sweep_deadline_ms) {
+            int left = op->sweep_deadline_ms -
+                       deadline_elapsed_ms(dlp->sweep_startp);
+
+            if (left <= 0) {
+                sgj_pr_hr(jsp, "    %s: timed out, sweep deadline of %d ms "
+                          "passed\n", device_name, op->sweep_deadline_ms);
+                sgj_js_nv_b(jsp, jop, "timed_out", true);
+                return SG_LIB_CAT_TIMEOUT;
+            }
+            if ((0 == dl_ms) || (left < dl_ms))
+                dl_ms = left;
+        }
+        sdp_ctx_set_deadline(ctxp, dl_ms);
+        deadline_arm(dl_ms);
+    }
+    if (op->verbose > 1)
+        pr2serr(">>> about to open device name: %s\n", device_name);
+    r = sdp_ctx_open(ctxp, device_name);
+    if (0 == r) {
+        sg_fd = ctxp->sg_fd;
+        pdt = ctxp->pdt;
+        protect = ctxp->protect;
+
+        if (op->inquiry) {
+            if (op->examine)
+                r = examine_vpd_page(sg_fd, dlp->pn, dlp->spn, dlp->req_pdt,
+                                     protect, op, jop);
+            else
+                r = sdp_process_vpd_page(sg_fd, dlp->pn,
+                                         ((dlp->spn < 0) ? 0: dlp->spn),
+                                         dlp->req_pdt, protect, NULL, NULL,
+                                         0, op, jop);
+        } else {
+            if (op->cmd_str && dlp->scmdp)   /* process command */
+                r = sdp_process_cmd(sg_fd, dlp->scmdp, dlp->cmd_arg, pdt,
+                                    op);
+            else if (op->do_cpr)
+                r = sdp_cpr(ctxp, device_name, jop);
+            else if (op->do_advq)
+                r = sdp_advise_queue(ctxp, device_name, jop);
+            else if (op->do_log)
+                r = sdp_log(ctxp, jop);
+            else if (op->do_lbam)
+                r = sdp_lba_map(ctxp, device_name, jop);
+            else {                  /* mode page */
+                if (op->examine)
+                    r = examine_mode_pages(sg_fd, dlp->pn, dlp->req_pdt, op,
+                                           jop);
+                else if (dlp->dfp)
+                    r = sdp_diff_add_dev(dlp->dfp, ctxp, device_name);
+                else if (dlp->pfp)
+                    r = sdp_prof_apply(dlp->pfp, k, ctxp,
+                                       device_name);
+                else if (dlp->php)
+                    r = sdp_phy_add_dev(dlp->php, k, ctxp);
+                else if (op->snap_fn)
+                    r = sdp_snapshot(ctxp, op->snap_fn, jop);
+                else if (op->restore_fn)
+                    r = sdp_restore(ctxp, op->restore_fn, jop);
+                else if (dlp->clp)
+                    r = sdp_cdl(dlp->clp, ctxp, jop);
+                else if (dlp->bwp)
+                    r = sdp_bg_window(dlp->bwp, ctxp, jop);
+                else if (dlp->iap)
+                    r = sdp_ioad(dlp->iap, ctxp, jop);
+                else
+                    r = print_mpgs_normal(sg_fd, dlp->mps, dlp->pn,
+                                          dlp->spn, pdt, op, jop);
+            }
+        }
+    }
+    if (dl_ms) {
+        deadline_disarm();
+        if (sdp_deadline_expired(ctxp))
+            r = SG_LIB_CAT_TIMEOUT;
+        sdp_ctx_set_deadline(ctxp, 0);
+    }
+    res = sdp_ctx_close(ctxp);
+    if (res && (0 == r))
+        r = res;
+    if (dl_ms) {
+        bool timed_out = (SG_LIB_CAT_TIMEOUT == r);
+
+        if (timed_out)
+            sgj_pr_hr(jsp, "    %s: timed out, deadline of %d ms "
+                      "exceeded\n", device_name, dl_ms);
+        sgj_js_nv_b(jsp, jop, "timed_out", timed_out);
+    }
+    return r;
+}
+
+/* Options that each choose what is done to the DEVICEs, for example
+ * '--profile=' and '--lba-map'. At most one of them may be given and
+ * none with options that select or change particular pages or fields
+ * (e.g. '--get=', '--set=', '--inquiry' and '--command='), apart from
+ * '--page=' and '--inhex=' where noted. '--watch=' samples the fields
+ * chosen by '--get=' or '--page=', or the log pages of '--log', so it may
+ * only be given with those. Returns 0 if the options are acceptable,
+ * else SG_LIB_CONTRADICT . */
+static int
+check_modes(const struct sdparm_opt_coll * op)
+{
+    bool others;
+    int k;
+    struct mode_opt_t {
+        bool given;
+        bool page_ok;           /* '--page=' may also be given */
+        bool inhex_ok;          /* '--inhex=' may also be given */
+        const char * name;
+        const char * what;      /* the reason for the restriction */
+    };
+    const struct mode_opt_t mode_arr[] = {
+        {!! op->snap_fn, true, false, "--snapshot=", "acts on all"},
+        {!! op->restore_fn, true, false, "--restore=", "acts on all"},
+        {op->do_diff, true, false, "--diff", "compares all"},
+        {!! op->profile_fn, true, false, "--profile=",
+         "chooses the fields of"},
+        {op->do_cdl, true, false, "--cdl",
+         "shows or changes whole command duration limit"},
+        {!! op->bgw_str, true, false, "--bg-window=",
+         "chooses the background control fields of"},
+        {op->do_cpr, true, false, "--cpr",
+         "decodes a VPD page, not"},
+        {op->do_advq, true, false, "--advise-queue",
+         "compares a VPD page with sysfs, not"},
+        {op->do_ioad, true, false, "--ioad",
+         "shows or changes the whole IO advice hints grouping"},
+        {op->do_phy_audit, true, false, "--phy-audit",
+         "only reads the SAS phy control and discover"},
+        {op->do_log, false, true, "--log", "decodes log pages, not"},
+        {op->do_lbam, false, false, "--lba-map",
+         "reads the provisioning status of LBAs, not"},
+    };
+    const int num = (int)(sizeof(mode_arr) / sizeof(mode_arr[0]));
+    const struct mode_opt_t * mop;
+    const struct mode_opt_t * first_p = NULL;
+
+    others = op->set_clear || op->get_str || op->defaults || op->inquiry ||
+             op->cmd_str || op->do_enum || op->examine;
+    for (k = 0, mop = mode_arr; k < num; ++k, ++mop) {
+        if (! mop->given)
+            continue;
+        if (first_p) {
+            pr2serr("Can only give one of '%s' and '%s'\n", first_p->name,
+                    mop->name);
+            return SG_LIB_CONTRADICT;
+        }
+        first_p = mop;
+        if (others || (op->page_str && (! mop->page_ok)) ||
+            (op->inhex_fn && (! mop->inhex_ok))) {
+            pr2serr("'%s' %s %ss so\ncan't be used with options that "
+                    "select or change particular pages or fields\n",
+                    mop->name, mop->what, mp_s);
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    if (op->watch_ms) {
+        if ((first_p && (! op->do_log)) || op->set_clear || op->defaults ||
+            op->inquiry || op->cmd_str || op->inhex_fn || op->do_enum ||
+            op->examine) {
+            pr2serr("'--watch=' only samples fields given by '--get=' or "
+                    "'--page=', or the\nstatistics of '--log', so can't be "
+                    "used with options that change or\ncompare them\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
+    return 0;
+}
+
+/* Called by sdp_sched_run() in a child process for the k-th DEVICE. The
+ * returned value becomes the child's exit status. */
+static int
+device_job(int k, void * arg)
+{
+    int r;
+    const struct sdp_dev_loop_t * dlp = (const struct sdp_dev_loop_t *)arg;
+    const struct sdparm_ctx_t * ctxp = dlp->ctxp;
+
+    r = process_device(k, dlp, NULL);
+    /* as in sdp_main(), expected ILLEGAL REQUESTs are not errors */
+    if ((SG_LIB_CAT_ILLEGAL_REQ == r) && (0 == ctxp->ms6_cnt.oth_err) &&
+        (0 == ctxp->ms10_cnt.oth_err))
+        r = 0;
+    return (r >= 0) ? r : SG_LIB_CAT_OTHER;
+}
+
+
+int
+sdp_main(int argc, char * argv[])
 {
     bool protect = false;
     bool as_json = false;
+    bool is_lkb = false;
     int t_com_pdt, req_pdt, k, r, vb;
     int res = 0;
-    int sg_fd = -1;
     int cmd_arg = -1;
     int pn = -1;
     int spn = -1;
@@ -3502,16 +4720,18 @@ main(int argc, char * argv[])
     sgj_opaque_p jop = NULL;
     sgj_opaque_p jo2p = NULL;
     const struct sdparm_command_t * scmdp = NULL;
-    struct sdparm_opt_coll opts SG_C_CPP_ZERO_INIT;
+    uint8_t * inhex_buffp;
+    uint8_t * free_inhex_buffp = NULL;
+    struct sdparm_ctx_t ctx;
+    struct sdparm_ctx_t * ctxp = &ctx;
     struct sdparm_mp_settings_t mp_settings SG_C_CPP_ZERO_INIT;
     struct sdparm_mp_settings_t * mps = &mp_settings;
+    struct timespec sweep_start;
+    struct sdp_dev_loop_t dl;
 
-    op = &opts;
-    op->out_mask = MP_OM_ALL;   /* 0xf */
-    op->in_mask = MP_IM_ALL;    /* 0xf */
-    op->cl_pdt = -1;
-    op->transport = -1;
-    op->vendor_id = -1;
+    sdp_ctx_init(ctxp);
+    memset(&sweep_start, 0, sizeof(sweep_start));
+    op = &ctxp->opts;
     memset(device_name_arr, 0, sizeof(device_name_arr));
     t_com_pdt = -1;
 
@@ -3551,6 +4771,24 @@ main(int argc, char * argv[])
         return 0;
     }
     vb = op->verbose;
+#ifndef SDPARM_MEM_STATS
+    if (op->do_stats) {
+        pr2serr("--stats ignored, needs sdparm built after "
+                "'./configure --enable-mem-stats'\n");
+        op->do_stats = false;
+    }
+#endif
+#ifdef SG_LIB_WIN32
+    if (op->deadline_ms || op->sweep_deadline_ms) {
+        pr2serr("--deadline= ignored, not supported on Windows\n");
+        op->deadline_ms = 0;
+        op->sweep_deadline_ms = 0;
+    }
+    if (op->jobs > 1) {
+        pr2serr("--jobs= ignored, not supported on Windows\n");
+        op->jobs = 1;
+    }
+#endif
 
     if (op->read_only)
         op->do_rw = false;         // override any read-write settings
@@ -3559,6 +4797,87 @@ main(int argc, char * argv[])
         pr2serr("Can only give one of '--get=', '--set=' and '--clear='\n");
         return SG_LIB_CONTRADICT;
     }
+    res = check_modes(op);
+    if (res)
+        return res;
+    if (op->snap_fn && (op->num_devices > 1)) {
+        pr2serr("'--snapshot=FILE' takes a single DEVICE\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_diff) {
+        if ((NULL == op->baseline_fn) && (op->num_devices < 2)) {
+            pr2serr("'--diff' needs two or more DEVICEs, or a "
+                    "'--baseline=FILE'\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->jobs > 1) {
+            if (op->verbose)
+                pr2serr("--jobs= ignored with --diff\n");
+            op->jobs = 1;
+        }
+    }
+    if (op->bgw_str && op->save) {
+        pr2serr("'--bg-window=' restores off-peak settings from the saved "
+                "values so\n'--save' is not permitted\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_ioad && op->mode_6) {
+        pr2serr("the ioad %s is too long for MODE SENSE(6) so '--six' is "
+                "not\npermitted with '--ioad'\n", mp_s);
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->lbam_fn && (op->num_devices > 1)) {
+        pr2serr("'--lba-map=FILE' takes one DEVICE\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->cmd_str) {
+        scmdp = sdp_build_cmd(op->cmd_str, NULL, NULL);
+        is_lkb = scmdp && (CMD_LINKBENCH == scmdp->cmd_num);
+    }
+    if (op->qdepth && (! op->do_lbam) && (! is_lkb)) {
+        pr2serr("'--qdepth=' only applies to '--lba-map' and "
+                "'--command=linkbench'\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_verify && (! op->set_clear) && (! is_lkb)) {
+        pr2serr("'--verify' reads back fields changed by '--set=' or "
+                "'--clear='\nso needs one of them (or "
+                "'--command=linkbench')\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->stagger_max && (NULL == op->cmd_str)) {
+        pr2serr("'--stagger=' needs '--command=start'\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_wait && (NULL == op->cmd_str)) {
+        pr2serr("'--wait' needs '--command=ready'\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if ((op->stagger_max || op->do_wait) &&
+        (op->deadline_ms || op->sweep_deadline_ms)) {
+        pr2serr("'--deadline=' does not apply to '--stagger=' or '--wait', "
+                "they take\ntheir own time limit in seconds\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->watch_ms) {
+        if ((NULL == op->get_str) && (NULL == op->page_str) &&
+            (! op->do_log)) {
+            pr2serr("'--watch=' needs '--get=STR', '--page=PG[,SPG]' or "
+                    "'--log'\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->do_json) {
+            pr2serr("'--watch=' output is already JSON (one object per "
+                    "line), so\n'--json' is not accepted with it\n");
+            return SG_LIB_CONTRADICT;
+        }
+        if (op->jobs > 1) {
+            if (op->verbose)
+                pr2serr("--jobs= ignored with --watch=, DEVICEs stay "
+                        "open\n");
+            op->jobs = 1;
+        }
+    }
 #ifdef SG_LIB_WIN32
     if (op->do_wscan)
         return sg_do_wscan('\0', op->do_wscan, vb);
@@ -3581,6 +4900,15 @@ main(int argc, char * argv[])
         jop = sgj_start_r(sdp_sn, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    /* --profile= and --phy-audit results are gathered in memory shared
+     * with children; other JSON output can't be merged from children */
+    if (as_json && (op->jobs > 1) && (NULL == op->profile_fn) &&
+        (! op->do_phy_audit)) {
+        pr2serr("--jobs=J (J > 1) can't be used with --json unless "
+                "--profile= or\n--phy-audit is given\n");
+        ret = SG_LIB_CONTRADICT;
+        goto fini;
+    }
 
     t_com_pdt = op->cl_pdt;
     if (op->page_str) {
@@ -3646,6 +4974,16 @@ main(int argc, char * argv[])
             ret = SG_LIB_SYNTAX_ERROR;
             goto fini;
         }
+        if (op->do_wait && (CMD_READY != scmdp->cmd_num)) {
+            pr2serr("'--wait' only applies to '--command=ready'\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (op->stagger_max && (CMD_START != scmdp->cmd_num)) {
+            pr2serr("'--stagger=' only applies to '--command=start'\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
         if (op->read_only)
             op->do_rw = false;         // override any read-write settings
     } else {            /* assume mode page access */
@@ -3696,7 +5034,7 @@ main(int argc, char * argv[])
         }
 
         if (vb && (mps->num_it_vals > 0))
-            list_mp_settings(mps, (NULL != op->get_str), op);
+            list_mp_settings(mps, op);
 
         if ((1 == op->defaults) && (pn < 0)) {
             pr2serr("to set a page's defaults, the '--page=' option must be "
@@ -3731,6 +5069,8 @@ main(int argc, char * argv[])
             ret = sdp_process_vpd_page(-1, pn, ((spn < 0) ? 0: spn),
                                        t_com_pdt, protect, inhex_buffp,
                                        NULL, 0, op, jo2p);
+        else if (op->do_log)
+            ret = sdp_log_inhex(inhex_buffp, op->inhex_len, op, jo2p);
         else if (mps->num_it_vals > 0)
             ret = print_get_mitems_inhex(inhex_buffp, mps, op, jo2p);
         else
@@ -3749,43 +5089,90 @@ main(int argc, char * argv[])
         goto fini;
     }
 
-    /* MAX_MP_BUFF_SZ byte sized heap allocations aligned to a page */
-    cur_aligned_mp = sg_memalign(MAX_MP_BUFF_SZ, 0, &free_cur_aligned_mp,
-                                 false);
-    cha_aligned_mp = sg_memalign(MAX_MP_BUFF_SZ, 0, &free_cha_aligned_mp,
-                                 false);
-    def_aligned_mp = sg_memalign(MAX_MP_BUFF_SZ, 0, &free_def_aligned_mp,
-                                 false);
-    sav_aligned_mp = sg_memalign(MAX_MP_BUFF_SZ, 0, &free_sav_aligned_mp,
-                                 false);
-    oth_aligned_mp = sg_memalign(MAX_MP_BUFF_SZ, 0, &free_oth_aligned_mp,
-                                 false);
-    if ((NULL == cur_aligned_mp) || (NULL == cha_aligned_mp) ||
-        (NULL == def_aligned_mp) || (NULL == sav_aligned_mp) ||
-        (NULL == oth_aligned_mp)) {
-        ret = sg_convert_errno(ENOMEM);
+    if (op->watch_ms) {
+        if (op->do_log)
+            ret = sdp_log_watch(ctxp, device_name_arr);
+        else
+            ret = sdp_watch(ctxp, device_name_arr, mps);
+        goto fini;
+    }
+    if (scmdp && (CMD_BLINK == scmdp->cmd_num)) {
+        /* all DEVICEs blink together so not done one at a time */
+        ret = sdp_blink(ctxp, device_name_arr, cmd_arg);
         goto fini;
     }
-
     if (as_json)
         jo_p = sgj_named_subobject_r(jsp, jop, sdp_rsp_sn);
+    if (scmdp && (CMD_START == scmdp->cmd_num) && (op->stagger_max > 0)) {
+        ret = sdp_fleet_start(ctxp, device_name_arr, jo_p);
+        goto fini;
+    }
+    if (scmdp && (CMD_READY == scmdp->cmd_num) && op->do_wait) {
+        ret = sdp_wait_ready(ctxp, device_name_arr, jo_p);
+        goto fini;
+    }
     req_pdt = t_com_pdt;
     ret = 0;
+    if (op->deadline_ms || op->sweep_deadline_ms) {
+        ret = deadline_init();
+        if (ret)
+            goto fini;
+        deadline_elapsed_ms(&sweep_start);
+    }
+    dl.ctxp = ctxp;
+    dl.device_name_arr = device_name_arr;
+    dl.pn = pn;
+    dl.spn = spn;
+    dl.req_pdt = req_pdt;
+    dl.cmd_arg = cmd_arg;
+    dl.scmdp = scmdp;
+    dl.mps = mps;
+    dl.dfp = NULL;
+    dl.pfp = NULL;
+    dl.clp = NULL;
+    dl.bwp = NULL;
+    dl.iap = NULL;
+    dl.php = NULL;
+    dl.sweep_startp = &sweep_start;
+    if (op->do_diff) {
+        ret = sdp_diff_new(op->num_devices, op->baseline_fn, op, &dl.dfp);
+        if (ret)
+            goto fini;
+    }
+    if (op->profile_fn) {
+        ret = sdp_prof_new(op->num_devices, op->profile_fn, ctxp, &dl.pfp);
+        if (ret)
+            goto fini;
+    }
+    if (op->do_cdl) {
+        ret = sdp_cdl_new(op->cdl_fn, op, &dl.clp);
+        if (ret)
+            goto fini;
+    }
+    if (op->bgw_str) {
+        ret = sdp_bgw_new(op->bgw_str, op, &dl.bwp);
+        if (ret)
+            goto fini;
+    }
+    if (op->do_ioad) {
+        ret = sdp_ioad_new(op->ioad_fn, op, &dl.iap);
+        if (ret)
+            goto fini;
+    }
+    if (op->do_phy_audit) {
+        ret = sdp_phy_new(op->num_devices, op->phy_audit_str, op, &dl.php);
+        if (ret)
+            goto fini;
+    }
+    if ((op->jobs > 1) && (op->num_devices > 1)) {
+        ret = sdp_sched_run(device_name_arr, op->num_devices, device_job,
+                            &dl, op);
+        goto prof_report;
+    }
     for (k = 0; k < op->num_devices; ++k) {
-        int pdt = -1;
-
-        if (vb > 1)
-            pr2serr(">>> about to open device name: %s\n",
-                    device_name_arr[k]);
-        sg_fd = open_and_simple_inquiry(device_name_arr[k], op->do_rw, &pdt,
-                                        &protect, op);
-        if (sg_fd < 0) {
-            if (0 == ret)
-                ret = -sg_fd;
-            continue;
-        }
         if (as_json) {
-            if (op->num_devices > 1) {
+            if ((op->num_devices > 1) && (NULL == dl.dfp) &&
+                (NULL == dl.pfp) && (NULL == dl.php)) {
                 char b[32];
                 static const int blen = sizeof(b);
 
@@ -3796,56 +5183,46 @@ main(int argc, char * argv[])
             } else
                 jo2p = jo_p;
         }
-
-        if (op->inquiry) {
-            if (op->examine)
-                r = examine_vpd_page(sg_fd, pn, spn, req_pdt, protect, op,
-                                     jo2p);
-            else
-                r = sdp_process_vpd_page(sg_fd, pn, ((spn < 0) ? 0: spn),
-                                         req_pdt, protect, NULL, NULL, 0,
-                                         op, jo2p);
-        } else {
-            if (op->cmd_str && scmdp)   /* process command */
-                r = sdp_process_cmd(sg_fd, scmdp, cmd_arg, pdt, op);
-            else {                  /* mode page */
-                if (op->examine)
-                    r = examine_mode_pages(sg_fd, pn, req_pdt, op, jo2p);
-
-                else
-                    r = print_mpgs_normal(sg_fd, mps, pn, spn, pdt, op, jo2p);
-            }
-        }
-
-        res = sg_cmds_close_device(sg_fd);
-        if (res < 0) {
-            pr2serr("close error: %s\n", safe_strerror(-res));
-            if (0 == r)
-                r = -res;
-        }
+        r = process_device(k, &dl, jo2p);
         if (r  && ((0 == ret) || (SG_LIB_FILE_ERROR == ret)))
             ret = r;
     }   /* end of DEVICEs for loop */
+    if (dl.dfp) {
+        r = sdp_diff_report(dl.dfp, op, jo_p);
+        if (r && ((0 == ret) || (SG_LIB_CAT_ILLEGAL_REQ == ret)))
+            ret = r;
+        sdp_diff_free(dl.dfp);
+    }
+prof_report:
+    if (dl.pfp) {
+        r = sdp_prof_report(dl.pfp, device_name_arr, op, jo_p);
+        if (r && ((0 == ret) || (SG_LIB_CAT_ILLEGAL_REQ == ret)))
+            ret = r;
+        sdp_prof_free(dl.pfp);
+    }
+    if (dl.php) {
+        r = sdp_phy_report(dl.php, device_name_arr, op, jo_p);
+        if (r && ((0 == ret) || (SG_LIB_CAT_ILLEGAL_REQ == ret)))
+            ret = r;
+        sdp_phy_free(dl.php);
+    }
+    if (dl.clp)
+        sdp_cdl_free(dl.clp);
+    if (dl.bwp)
+        sdp_bgw_free(dl.bwp);
+    if (dl.iap)
+        sdp_ioad_free(dl.iap);
 
 fini:           /* error expected in ret, ret==0 means no error */
     if (free_inhex_buffp)
         free(free_inhex_buffp);
-    if (free_cur_aligned_mp)
-        free(free_cur_aligned_mp);
-    if (free_cha_aligned_mp)
-        free(free_cha_aligned_mp);
-    if (free_def_aligned_mp)
-        free(free_def_aligned_mp);
-    if (free_sav_aligned_mp)
-        free(free_sav_aligned_mp);
-    if (free_oth_aligned_mp)
-        free(free_oth_aligned_mp);
+    sdp_ctx_fini(ctxp);
     ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
     if (SG_LIB_CAT_ILLEGAL_REQ == ret) {
         /* suppress ILLEGAL REQUEST errors cause by either a page control
          * (e.g. 'save') not being supported or a page_code/subpage_code
          * not being supported. These are expected. */
-        if ((0 == msense6_oth_err_count) && (0 == msense10_oth_err_count))
+        if ((0 == ctxp->ms6_cnt.oth_err) && (0 == ctxp->ms10_cnt.oth_err))
             ret = 0;
     }
     if (as_json) {
@@ -3869,19 +5246,22 @@ fini:           /* error expected in ret, ret==0 means no error */
         if ((0 == ret) && (res > 0))
             ret = res;
     }
-    if ((0 == op->do_quiet) && (non_spg_warning > 0))
+    if ((0 == op->do_quiet) && (ctxp->non_spg_warning > 0))
         pr2serr("%d instances of mode subpage requested but non-subpage "
-                "returned\n", non_spg_warning);
+                "returned\n", ctxp->non_spg_warning);
     if (vb > 1) {
         pr2serr("mode_sense_6 counts: good=%d, pc_not_sup=%d, ill_req=%d, "
-                "oth_err=%d\n", msense6_good_count, msense6_pc_not_sup_count,
-                msense6_ill_req_count,
-                msense6_oth_err_count);
+                "oth_err=%d\n", ctxp->ms6_cnt.good, ctxp->ms6_cnt.pc_not_sup,
+                ctxp->ms6_cnt.ill_req, ctxp->ms6_cnt.oth_err);
         pr2serr("mode_sense_10 counts: good=%d, pc_not_sup=%d, ill_req=%d, "
-                "oth_err=%d\n", msense10_good_count,
-                msense10_pc_not_sup_count, msense10_ill_req_count,
-                msense10_oth_err_count);
+                "oth_err=%d\n", ctxp->ms10_cnt.good,
+                ctxp->ms10_cnt.pc_not_sup, ctxp->ms10_cnt.ill_req,
+                ctxp->ms10_cnt.oth_err);
     }
+#ifdef SDPARM_MEM_STATS
+    if (op->do_stats)
+        sdp_ms_report();
+#endif
     return ret;
 }
 
@@ -9,9 +9,18 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "sg_json_sg_lib.h"
 
+#ifdef SDPARM_MEM_STATS
+#include "sg_lib.h"     /* sg_memalign() prototype must precede macro */
+#include "sdparm_mstats.h"
+
+/* attribute each sg_memalign() in src/ to its caller, for '--stats' */
+#define sg_memalign(n, a, bp, vb) sdp_ms_memalign(n, a, bp, vb, __func__)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -221,13 +230,48 @@ extern "C" {
 #define CMD_CAPACITY 9
 #define CMD_SPEED 10
 #define CMD_PROFILE 11
+#define CMD_BLINK 12
+#define CMD_PING 13
+#define CMD_PREFETCH 14
+#define CMD_LINKBENCH 15
 
 #define MAX_DEV_NAMES 256
+#define MAX_QDEPTH 256         /* upper limit of --qdepth=QD */
+
+
+/* Per DEVICE scratch arena: a single page aligned heap allocation made when
+ * the DEVICE is opened, carved into the buffers that the fetch paths would
+ * otherwise sg_memalign() and free() on each call. VPD pages can be fetched
+ * while decoding another VPD page (e.g. '-iaa') hence more than one VPD
+ * buffer. */
+#define SDP_ARENA_VPD_LEVELS 2
+
+struct sdparm_arena_t {
+    int vpd_depth;      /* number of vpd_b[] buffers currently in use */
+    int vpd_b_sz;       /* each is 2 pages long */
+    int mpc_b_sz;       /* MAX_MP_BUFF_SZ rounded up to a page */
+    uint8_t * vpd_b[SDP_ARENA_VPD_LEVELS];  /* for sdp_process_vpd_page() */
+    uint8_t * mpc_b;    /* for fetching each page control of a mode page */
+    int gmi_b_sz;       /* DEF_MODE_RESP_LEN */
+    uint8_t * gmi_b[MP_NUM_PG_CTL]; /* page controls for '--get=' items */
+    uint8_t * free_arena;
+};
 
+struct sdparm_ctx_t;
 
 /* Mainly command line options */
 struct sdparm_opt_coll {
     bool dbd;
+    bool do_cdl;        /* --cdl[=FILE] */
+    bool do_cpr;        /* --cpr[=dm] */
+    bool cpr_dm;        /* --cpr=dm */
+    bool do_advq;       /* --advise-queue[=apply] */
+    bool advq_apply;    /* --advise-queue=apply */
+    bool do_ioad;       /* --ioad[=FILE] */
+    bool do_phy_audit;  /* --phy-audit[=MIN[,ERR]] */
+    bool do_log;        /* --log[=LP[,SPG]] */
+    bool do_lbam;       /* --lba-map[=FILE] */
+    bool do_diff;       /* --diff or --baseline=FILE */
     bool dummy;
     bool examine;
     bool flexible;
@@ -239,8 +283,12 @@ struct sdparm_opt_coll {
     bool do_rw;         /* true: requires RDWR, false: perhaps RDONLY ok */
     bool mph;           /* show 'Mode parameter header' and block descs */
     bool read_only;
+    bool rollback;      /* undo earlier pages if a later --set fails */
+    bool do_verify;     /* --verify: read back fields after MODE SELECT */
+    bool do_wait;       /* --wait[=TIMEOUT] with --command=ready */
     bool save;
     bool set_clear;     /* --set= or --clear= has been invoked */
+    bool do_stats;      /* --stats , needs ./configure --enable-mem-stats */
     bool verbose_given;
     bool version_given;
 #ifdef SG_LIB_WIN32
@@ -248,6 +296,20 @@ struct sdparm_opt_coll {
 #endif
     int cl_pn;          /* Mode or VPD page number from --page= */
     int cl_spn;         /* Mode or VPD subpage number from --page= */
+    int deadline_ms;    /* --deadline=MS[,SMS] per DEVICE, 0 -> none */
+    int sweep_deadline_ms;  /* SMS from --deadline= for all DEVICEs */
+    int jobs;           /* --jobs=J[,HL[,EL]] DEVICEs at once, 0,1 -> serial */
+    int host_limit;     /* HL: max DEVICEs at once per SCSI host, 0 -> J */
+    int exp_limit;      /* EL: max DEVICEs at once per expander, 0 -> J */
+    int stagger_max;    /* --stagger=N[,MS] spin-ups at once, 0 -> no */
+    int stagger_ms;     /* MS from --stagger=, least time between starts */
+    int stagger_secs;   /* SECS from --stagger=, spin-up limit, 0 -> def */
+    int wait_secs;      /* --wait[=TIMEOUT], -1 -> default, 0 -> no limit */
+    int qdepth;         /* --qdepth=QD commands at once per DEVICE, 0 -> def */
+    int log_pn;         /* --log=LP[,SPG] page, -1 -> statistics pages */
+    int log_spn;
+    int watch_ms;       /* --watch=SECS[,COUNT] poll period, 0 -> no watch */
+    int watch_count;    /* COUNT from --watch=, 0 -> until interrupted */
     int defaults;       /* set mode page to its default values, or when set
                          * twice set RTD bit to set defaults on all pages */
     int do_all;         /* -iaa outputs all VPD pages found in the Supported
@@ -274,11 +336,104 @@ struct sdparm_opt_coll {
     const char * get_str;
     const char * page_str;
     const char * set_str;
+    const char * snap_fn;       /* --snapshot=FILE */
+    const char * restore_fn;    /* --restore=FILE */
+    const char * baseline_fn;   /* --baseline=FILE */
+    const char * profile_fn;    /* --profile=FILE */
+    const char * cdl_fn;        /* --cdl=FILE, NULL if just --cdl */
+    const char * bgw_str;       /* --bg-window=WINDOWS */
+    const char * ioad_fn;       /* --ioad=FILE, NULL if just --ioad */
+    const char * phy_audit_str;
+    const char * lbam_fn;       /* --lba-map=FILE */ /* --phy-audit=MIN[,ERR] */
     const char * json_arg;
     const char * js_file;
+    struct sdparm_arena_t * arenap;  /* NULL when no DEVICE open */
+    struct sdparm_ctx_t * ctxp;      /* context that contains this object */
     sgj_state json_st;
 };
 
+/* Outcome counts of MODE SENSE commands, one instance for each cdb size */
+struct sdparm_msense_counts_t {
+    int good;
+    int pc_not_sup;     /* > 0 page controls not supported */
+    int ill_req;        /* N.B. doesn't include invalid opcode */
+    int oth_err;
+};
+
+/* Context object for the mode and VPD page engine. It holds the options
+ * plus the state that the engine keeps between calls, so that a program
+ * can use the engine in-process (see the sdp_ctx_*() functions) rather
+ * than fork and exec sdparm. Contexts are independent of one another: use
+ * one per thread. Set up with sdp_ctx_init() and release with
+ * sdp_ctx_fini(). */
+struct sdparm_ctx_t {
+    struct sdparm_opt_coll opts;        /* opts.ctxp points back here */
+    bool protect;       /* PROTECT bit from standard INQUIRY of DEVICE */
+    int sg_fd;          /* open DEVICE, -1 if none */
+    int pdt;            /* of open DEVICE, disk-like types map to 0 */
+    const char * device_name;   /* of open DEVICE, NULL if none */
+    int non_spg_warning;    /* subpage requested, non-subpage returned */
+    /* from standard INQUIRY of open DEVICE, NUL terminated */
+    char vendor[9];
+    char product[17];
+    char revision[5];
+    struct sdparm_msense_counts_t ms6_cnt;
+    struct sdparm_msense_counts_t ms10_cnt;
+    /* each of the following is MAX_MP_BUFF_SZ bytes, aligned to a page */
+    uint8_t * cur_mp;   /* current values mode page(s) */
+    uint8_t * cha_mp;   /* changeable values mode page(s) */
+    uint8_t * def_mp;   /* default values mode page(s) */
+    uint8_t * sav_mp;   /* saved values mode page(s) */
+    uint8_t * oth_mp;   /* MODE SENSE response, MODE SELECT parameters */
+    uint8_t * free_mp_bufs;
+    uint8_t * cmd_b;    /* for --command=CMD responses, lazily allocated */
+    uint8_t * free_cmd_b;
+    int cmd_b_sz;
+    struct sdparm_arena_t arena;        /* valid while DEVICE open */
+    struct timespec dl_end;     /* see sdp_ctx_set_deadline(), 0 -> none */
+};
+
+/* A mode page to be written by sdp_write_mpages(). md holds the mode
+ * parameter list (header, any block descriptors and the page) while orig
+ * holds the same list as fetched, used by '--rollback'. */
+struct sdparm_mp_change_t {
+    int pn;
+    int spn;
+    int off;            /* offset of mode page within md */
+    int md_len;         /* length of mode parameter list in md and orig */
+    uint8_t * md;
+    uint8_t * orig;
+};
+
+/* A mode page held in a --snapshot=FILE, see sdparm_snap.c */
+struct sdparm_snap_pg_t {
+    int pn;
+    int spn;
+    int pg_len;
+    int smask;          /* bit 0 set: current values present, through to
+                         * bit 3 set: saved values present */
+    const uint8_t * pc_arr[MP_NUM_PG_CTL];      /* NULL if not present */
+};
+
+/* Contents of a --snapshot=FILE after sdp_snap_read() */
+struct sdparm_snap_t {
+    int version;
+    int pdt;
+    char vendor[9];     /* T10 vendor, product and revision of the DEVICE */
+    char product[17];
+    char revision[5];
+    int num_pgs;
+    struct sdparm_snap_pg_t * pgs;
+    uint8_t * free_b;   /* file image, pgs[] point into it */
+};
+
+/* Decoded value of a mode page item (field) for each page control */
+struct sdparm_mitem_vals_t {
+    int smask;          /* OR-ed MP_OM_* values indicating which val[] are
+                         * valid: current, changeable, default, saved */
+    uint64_t val[MP_NUM_PG_CTL];
+};
+
 /* Instances and arrays of the following templates are mainly found in the
  * sdparm_data.c file. */
 
@@ -488,6 +643,8 @@ int sdp_find_transport_id_by_acron(const char * ap);
 const char * sdp_get_vendor_name(int vendor_num);
 const struct sdparm_vendor_name_t * sdp_find_vendor_by_acron(const char * ap);
 const struct sdparm_vendor_pair * sdp_get_vendor_pair(int vendor_num);
+const struct sdparm_mp_item_t * sdp_get_mitem_arr(int transp_proto,
+                                                  int vendor_id);
 const struct sdparm_mp_item_t * sdp_find_mitem_by_acron(const char * ap,
                 int * from, int transp_proto, int vendor_num);
 uint64_t sdp_mitem_get_value(const struct sdparm_mp_item_t *mpi,
@@ -504,6 +661,44 @@ int sdp_strcase_eq_upto(const char * s1p, const char * s2p, int n);
 char * sdp_mp_convert2snake(const char * in_name, char * sn_name,
                             int max_sn_name_len);
 
+/*
+ * Declarations for functions found in sdparm.c
+ */
+
+int sdp_ctx_init(struct sdparm_ctx_t * ctxp);
+void sdp_ctx_fini(struct sdparm_ctx_t * ctxp);
+int sdp_ctx_open(struct sdparm_ctx_t * ctxp, const char * device_name);
+int sdp_ctx_close(struct sdparm_ctx_t * ctxp);
+int sdp_ctx_mode_pages(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                       sgj_opaque_p jop);
+int sdp_ctx_vpd_page(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                     sgj_opaque_p jop);
+bool sdp_ctx_build_mp_settings(struct sdparm_ctx_t * ctxp, const char * arg,
+                               struct sdparm_mp_settings_t * mps, bool clear,
+                               bool get);
+int sdp_ctx_change_mode_page(struct sdparm_ctx_t * ctxp,
+                             const struct sdparm_mp_settings_t * mps);
+int sdp_ctx_fetch_mitem_vals(struct sdparm_ctx_t * ctxp,
+                             const struct sdparm_mp_settings_t * mps,
+                             struct sdparm_mitem_vals_t * arr);
+int sdp_ctx_all_mpages(struct sdparm_ctx_t * ctxp, int * smaskp,
+                       int * resp_lenp);
+int sdp_ctx_mpages(struct sdparm_ctx_t * ctxp, int pn, int * smaskp,
+                   int * resp_lenp, bool * truncp);
+int sdp_mode_sense_cur(int sg_fd, int pn, int spn, uint8_t * resp,
+                       int mx_resp_len, int * residp,
+                       const struct sdparm_opt_coll * op);
+int sdp_ctx_mode_sense(struct sdparm_ctx_t * ctxp, int pn, int spn,
+                       uint8_t * resp, int mx_resp_len, int * residp);
+int sdp_ctx_mode_sense_pc(struct sdparm_ctx_t * ctxp, int pc, int pn,
+                          int spn, uint8_t * resp, int mx_resp_len,
+                          int * residp);
+int sdp_write_mpages(int sg_fd, int pdt, struct sdparm_mp_change_t * mc_arr,
+                     int num, const struct sdparm_opt_coll * op);
+int sdp_main(int argc, char * argv[]);
+void sdp_ctx_set_deadline(struct sdparm_ctx_t * ctxp, int ms);
+bool sdp_deadline_expired(const struct sdparm_ctx_t * ctxp);
+
 /*
  * Declarations for functions found in sdparm_vpd.c
  */
@@ -523,6 +718,177 @@ const struct sdparm_command_t * sdp_build_cmd(const char * cmd_str,
 void sdp_enumerate_commands(struct sdparm_opt_coll * op);
 int sdp_process_cmd(int sg_fd, const struct sdparm_command_t * scmdp,
                     int cmd_arg, int pdt, const struct sdparm_opt_coll * opts);
+int sdp_blink(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+              int secs);
+
+/*
+ * Declarations for functions found in sdparm_ready.c
+ */
+
+int sdp_fleet_start(struct sdparm_ctx_t * ctxp,
+                    const char * device_name_arr[], sgj_opaque_p jop);
+int sdp_wait_ready(struct sdparm_ctx_t * ctxp,
+                   const char * device_name_arr[], sgj_opaque_p jop);
+
+
+/*
+ * Declarations for functions found in sdparm_snap.c
+ */
+
+int sdp_snap_read(const char * fn, struct sdparm_snap_t * snp, int verbose);
+void sdp_snap_free(struct sdparm_snap_t * snp);
+const struct sdparm_snap_pg_t * sdp_snap_find_pg(
+                const struct sdparm_snap_t * snp, int pn, int spn);
+int sdp_find_mpage(const uint8_t * mp, int mp_len, int pn, int spn,
+                   int * pg_lenp);
+int sdp_snapshot(struct sdparm_ctx_t * ctxp, const char * fn,
+                 sgj_opaque_p jop);
+int sdp_restore(struct sdparm_ctx_t * ctxp, const char * fn,
+                sgj_opaque_p jop);
+
+
+/*
+ * Declarations for functions found in sdparm_diff.c
+ */
+
+struct sdparm_diff_t;           /* opaque, only sdparm_diff.c sees inside */
+
+int sdp_diff_new(int max_devs, const char * baseline_fn,
+                 const struct sdparm_opt_coll * op,
+                 struct sdparm_diff_t ** dfpp);
+int sdp_diff_add_dev(struct sdparm_diff_t * dfp, struct sdparm_ctx_t * ctxp,
+                     const char * device_name);
+int sdp_diff_report(struct sdparm_diff_t * dfp, struct sdparm_opt_coll * op,
+                    sgj_opaque_p jop);
+void sdp_diff_free(struct sdparm_diff_t * dfp);
+
+
+/*
+ * Declarations for functions found in sdparm_prof.c
+ */
+
+struct sdparm_profile_t;        /* opaque, only sdparm_prof.c sees inside */
+
+int sdp_prof_new(int max_devs, const char * fn, struct sdparm_ctx_t * ctxp,
+                 struct sdparm_profile_t ** pfpp);
+int sdp_prof_apply(struct sdparm_profile_t * pfp, int k,
+                   struct sdparm_ctx_t * ctxp, const char * device_name);
+int sdp_prof_report(const struct sdparm_profile_t * pfp,
+                    const char * device_name_arr[],
+                    struct sdparm_opt_coll * op, sgj_opaque_p jop);
+void sdp_prof_free(struct sdparm_profile_t * pfp);
+
+
+/*
+ * Declarations for functions found in sdparm_cdl.c
+ */
+
+struct sdparm_cdl_t;            /* opaque, only sdparm_cdl.c sees inside */
+
+int sdp_cdl_new(const char * fn, const struct sdparm_opt_coll * op,
+                struct sdparm_cdl_t ** clpp);
+int sdp_cdl(const struct sdparm_cdl_t * clp, struct sdparm_ctx_t * ctxp,
+            sgj_opaque_p jop);
+void sdp_cdl_free(struct sdparm_cdl_t * clp);
+
+
+/*
+ * Declarations for functions found in sdparm_bgw.c
+ */
+
+struct sdparm_bgw_t;            /* opaque, only sdparm_bgw.c sees inside */
+
+int sdp_bgw_new(const char * spec, const struct sdparm_opt_coll * op,
+                struct sdparm_bgw_t ** bwpp);
+int sdp_bg_window(const struct sdparm_bgw_t * bwp,
+                  struct sdparm_ctx_t * ctxp, sgj_opaque_p jop);
+void sdp_bgw_free(struct sdparm_bgw_t * bwp);
+
+
+/*
+ * Declarations for functions found in sdparm_cpr.c
+ */
+
+int sdp_cpr(struct sdparm_ctx_t * ctxp, const char * device_name,
+            sgj_opaque_p jop);
+bool sdp_bdev_name(const char * device_name, char * b, int blen); /* Linux */
+
+
+/*
+ * Declarations for functions found in sdparm_queue.c
+ */
+
+int sdp_advise_queue(struct sdparm_ctx_t * ctxp, const char * device_name,
+                     sgj_opaque_p jop);
+
+
+/*
+ * Declarations for functions found in sdparm_ioad.c
+ */
+
+struct sdparm_ioad_t;           /* opaque, only sdparm_ioad.c sees inside */
+
+int sdp_ioad_new(const char * fn, const struct sdparm_opt_coll * op,
+                 struct sdparm_ioad_t ** iapp);
+int sdp_ioad(const struct sdparm_ioad_t * iap, struct sdparm_ctx_t * ctxp,
+             sgj_opaque_p jop);
+void sdp_ioad_free(struct sdparm_ioad_t * iap);
+
+
+/*
+ * Declarations for functions found in sdparm_phy.c
+ */
+
+struct sdparm_phy_t;            /* opaque, only sdparm_phy.c sees inside */
+
+int sdp_phy_new(int max_devs, const char * spec,
+                const struct sdparm_opt_coll * op,
+                struct sdparm_phy_t ** phpp);
+int sdp_phy_add_dev(struct sdparm_phy_t * php, int k,
+                    struct sdparm_ctx_t * ctxp);
+int sdp_phy_report(const struct sdparm_phy_t * php,
+                   const char * device_name_arr[],
+                   struct sdparm_opt_coll * op, sgj_opaque_p jop);
+void sdp_phy_free(struct sdparm_phy_t * php);
+
+
+/*
+ * Declarations for functions found in sdparm_log.c
+ */
+
+int sdp_log_str2pg(const char * s, int * pnp, int * spnp);
+int sdp_log(struct sdparm_ctx_t * ctxp, sgj_opaque_p jop);
+int sdp_log_inhex(const uint8_t * ibp, int ilen, struct sdparm_opt_coll * op,
+                  sgj_opaque_p jop);
+int sdp_log_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[]);
+
+
+/*
+ * Declarations for functions found in sdparm_lbam.c
+ */
+
+int sdp_lba_map(struct sdparm_ctx_t * ctxp, const char * device_name,
+                sgj_opaque_p jop);
+
+
+/*
+ * Declarations for functions found in sdparm_watch.c
+ */
+
+int sdp_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+              const struct sdparm_mp_settings_t * mps);
+
+
+/*
+ * Declarations for functions found in sdparm_sched.c
+ */
+
+int sdp_sched_run(const char * device_name_arr[], int num_devices,
+                  int (*fn)(int dev_ind, void * arg), void * arg,
+                  const struct sdparm_opt_coll * op);
+int sdp_sched_jobs(int num_jobs, int (*fn)(int job, void * arg), void * arg);
+void * sdp_shm_alloc(size_t len);
+void sdp_shm_free(void * p, size_t len);
 
 
 /*
@@ -55,11 +55,20 @@
 
 static struct option long_options[] = {
     {"six", no_argument, 0, '6'},
+    {"advise-queue", optional_argument, 0, ']'},  /* long option only */
+    {"advise_queue", optional_argument, 0, ']'},
     {"all", no_argument, 0, 'a'},
+    {"baseline", required_argument, 0, '('},   /* long option only */
+    {"bg-window", required_argument, 0, '}'},  /* long option only */
+    {"bg_window", required_argument, 0, '}'},
+    {"cdl", optional_argument, 0, '{'},     /* long option only */
+    {"cpr", optional_argument, 0, '['},     /* long option only */
     {"dbd", no_argument, 0, 'B'},
+    {"deadline", required_argument, 0, '%'},    /* long option only */
     {"clear", required_argument, 0, 'c'},
     {"command", required_argument, 0, 'C'},
     {"defaults", no_argument, 0, 'D'},
+    {"diff", no_argument, 0, ')'},          /* long option only */
     {"dummy", no_argument, 0, 'd'},
     {"enumerate", no_argument, 0, 'e'},
     {"examine", no_argument, 0, 'E'},
@@ -69,12 +78,17 @@ static struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"inquiry", no_argument, 0, 'i'},
+    {"ioad", optional_argument, 0, '/'},    /* long option only */
     {"inhex", required_argument, 0, 'I'},
     {"inner-hex", no_argument, 0, 'x'},
     {"inner_hex", no_argument, 0, 'x'},
     {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"jobs", required_argument, 0, '&'},        /* long option only */
     {"js-file", required_argument, 0, 'J'},
     {"js_file", required_argument, 0, 'J'},
+    {"lba-map", optional_argument, 0, '`'},  /* long option only */
+    {"lba_map", optional_argument, 0, '`'},
+    {"log", optional_argument, 0, '.'},     /* long option only */
     {"long", no_argument, 0, 'l'},
     {"mph", no_argument, 0, 'm'},
     {"num-desc", no_argument, 0, 'n'},
@@ -84,15 +98,27 @@ static struct option long_options[] = {
     {"out_mask", required_argument, 0, 'o'},
     {"page", required_argument, 0, 'p'},
     {"pdt", required_argument, 0, 'P'},
+    {"phy-audit", optional_argument, 0, ';'},  /* long option only */
+    {"phy_audit", optional_argument, 0, ';'},
+    {"profile", required_argument, 0, '*'},    /* long option only */
+    {"qdepth", required_argument, 0, ','},     /* long option only */
     {"quiet", no_argument, 0, 'q'},
     {"raw", no_argument, 0, 'R'},
     {"readonly", no_argument, 0, 'r'},
+    {"restore", required_argument, 0, '<'},    /* long option only */
+    {"rollback", no_argument, 0, '!'},      /* long option only */
     {"set", required_argument, 0, 's'},
+    {"snapshot", required_argument, 0, '>'},   /* long option only */
     {"save", no_argument, 0, 'S'},
+    {"stagger", required_argument, 0, '@'},    /* long option only */
+    {"stats", no_argument, 0, '$'},         /* long option only */
     {"transport", required_argument, 0, 't'},
     {"vendor", required_argument, 0, 'M'},
     {"verbose", no_argument, 0, 'v'},
+    {"verify", no_argument, 0, '#'},        /* long option only */
     {"version", no_argument, 0, 'V'},
+    {"wait", optional_argument, 0, '+'},    /* long option only */
+    {"watch", required_argument, 0, '~'},   /* long option only */
 #ifdef SG_LIB_WIN32
     {"wscan", no_argument, 0, 'w'},
 #endif
@@ -113,6 +139,11 @@ static void mp_rd_usage(bool long_opt)
             "           [--quiet] [--readonly] [--six] "
             "[--transport=TN]\n"
             "           [--vendor=VN] [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --watch=SECS[,COUNT] --get=STR|--page=PG[,SPG] "
+            "[--quiet]\n"
+            "           [--six] [--transport=TN] [--vendor=VN] [--verbose] "
+            "DEVICE\n"
+            "           [DEVICE...]\n"
               );
     else
         pr2serr(
@@ -129,10 +160,42 @@ static void mp_wr_usage(bool long_opt)
     if (long_opt)
         pr2serr(
             "    sdparm [--clear=STR] [--defaults] [--dummy] [--flexible]\n"
-            "           [--page=PG[,SPG]] [--quiet] [--save] [--set=STR] "
-            "[--six]\n"
-            "           [--transport=TN] [--vendor=VN] [--verbose]\n"
+            "           [--page=PG[,SPG]] [--quiet] [--rollback] [--save] "
+            "[--set=STR]\n"
+            "           [--six] [--transport=TN] [--vendor=VN] [--verbose] "
+            "[--verify]\n"
             "           DEVICE [DEVICE...]\n"
+            "    sdparm --snapshot=FILE [--verbose] DEVICE\n"
+            "    sdparm --diff [--baseline=FILE] [--json[=JO]] [--verbose] "
+            "DEVICE\n"
+            "           [DEVICE...]\n"
+            "    sdparm --profile=FILE [--dummy] [--jobs=J] [--json[=JO]] "
+            "[--save]\n"
+            "           [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --restore=FILE [--dummy] [--flexible] [--rollback] "
+            "[--save]\n"
+            "           [--six] [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --cdl[=FILE] [--dummy] [--json[=JO]] [--save] [--six]\n"
+            "           [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --bg-window=WINDOWS [--dummy] [--json[=JO]] [--six]\n"
+            "           [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --cpr[=dm] [--json[=JO]] [--verbose] DEVICE "
+            "[DEVICE...]\n"
+            "    sdparm --advise-queue[=apply] [--dummy] [--json[=JO]] "
+            "[--verbose]\n"
+            "           DEVICE [DEVICE...]\n"
+            "    sdparm --ioad[=FILE] [--dummy] [--json[=JO]] [--save] "
+            "[--verbose]\n"
+            "           DEVICE [DEVICE...]\n"
+            "    sdparm --phy-audit[=MIN[,ERR]] [--jobs=J[,HL[,EL]]] "
+            "[--json[=JO]]\n"
+            "           [--verbose] DEVICE [DEVICE...]\n"
+            "    sdparm --log[=LP[,SPG]] [--hex] [--inhex=FN] [--json[=JO]] "
+            "[--verbose]\n"
+            "           [--watch=SECS[,COUNT]] DEVICE [DEVICE...]\n"
+            "    sdparm --lba-map[=FILE] [--jobs=J] [--json[=JO]] [--long] "
+            "[--qdepth=QD]\n"
+            "           [--verbose] DEVICE [DEVICE...]\n"
               );
     else
         pr2serr(
@@ -166,9 +229,10 @@ static void cmd_usage(bool long_opt)
 {
     if (long_opt)
         pr2serr(
-            "    sdparm --command=CMD [--hex] [--long] [--readonly] "
-            "[--verbose]\n"
-            "           DEVICE [DEVICE...]\n"
+            "    sdparm --command=CMD [--hex] [--jobs=J] [--long] "
+            "[--qdepth=QD]\n"
+            "           [--readonly] [--verbose] [--verify] DEVICE "
+            "[DEVICE...]\n"
               );
     else
         pr2serr(
@@ -263,8 +327,26 @@ sdp_usage(const struct sdparm_opt_coll * op)
 
             "  where mode page access (1st usage) and change (2nd usage) "
             "options are:\n"
+            "    --advise-queue[=apply]    compare Block limits VPD page "
+            "with sysfs\n"
+            "                          queue limits; 'apply': write "
+            "recommended ones\n"
             "    --all | -a            list all known pages and fields for "
             "given DEVICE\n"
+            "    --baseline=FILE       compare DEVICEs with FILE (snapshot "
+            "or JSON)\n"
+            "    --bg-window=WINDOWS    suspend background scans in peak "
+            "WINDOWS\n"
+            "                          (HH:MM-HH:MM,... local time), resume "
+            "otherwise\n"
+            "    --cdl[=FILE]          show command duration limit tables, "
+            "or apply\n"
+            "                          those in FILE (JSON) or preset: off, "
+            "tail\n"
+            "    --cpr[=dm]            show actuator LBA ranges (VPD 0xb9) "
+            "and check\n"
+            "                          sysfs; 'dm': output dm-linear tables "
+            "instead\n"
             "    --clear=STR | -c STR    clear (zero) field value(s), or "
             "set to 'val'\n"
             "    --dbd | -B            set DBD bit in mode sense cdb "
@@ -274,6 +356,9 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "values\n"
             "                          when use twice set all pages to "
             "their defaults\n"
+            "    --diff                report mode page fields that differ "
+            "between\n"
+            "                          DEVICEs (or from '--baseline=FILE')\n"
             "    --dummy | -d          don't write back modified mode page\n"
             "    --flags | -F          show enumeration item flags\n"
             "    --flexible | -f       compensate for common errors, "
@@ -286,6 +371,14 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "    --json[=JO] | -j[=JO]    output in JSON instead of plain "
             "text\n"
             "                             Use --json=? for JSON help\n"
+            "    --lba-map[=FILE]      map provisioning status of all LBAs "
+            "with\n"
+            "                          QD (def: 4) GET LBA STATUS commands "
+            "at once\n"
+            "    --log[=LP[,SPG]]      decode statistics log pages (def: "
+            "gsp, cms,\n"
+            "                          cdls and bsr); with '--watch=' output "
+            "rates\n"
             "    --long | -l           add description to field output\n"
             "    --num-desc | -n       report number of mode page "
             "descriptors\n"
@@ -298,15 +391,29 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "subpage) number\n"
             "                          [or abbrev] to output, change or "
             "enumerate\n"
+            "    --phy-audit[=MIN[,ERR]]    table of SAS phy link rates "
+            "and error\n"
+            "                          counters; flag slow links and "
+            "counters > ERR\n"
+            "    --profile=FILE        apply rules in FILE, change only "
+            "fields that\n"
+            "                          differ and report compliance\n"
             "    --quiet | -q          suppress DEVICE vendor/product/"
             "revision strings\n"
             "    --readonly | -r       force read-only open of DEVICE (def: "
             "depends\n"
             "                          on operation). Mainly for ATA disks\n"
+            "    --restore=FILE        write changeable current values in "
+            "FILE to DEVICE\n"
+            "    --rollback            if changing one of several mode pages "
+            "fails,\n"
+            "                          restore those already changed\n"
             "    --save | -S           place mode changes in saved page as "
             "well\n"
             "    --set=STR | -s STR    set field value(s) to 1, or to "
             "'val'\n"
+            "    --snapshot=FILE       save all mode pages of DEVICE to "
+            "FILE\n"
             "    --six | -6            use 6 byte SCSI mode cdbs (def: 10 "
             "byte)\n"
             "    --transport=TN | -t TN    transport protocol number "
@@ -314,6 +421,13 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "    --vendor=VN | -M VN    vendor (manufacturer) number "
             "[or abbrev]\n"
             "    --verbose | -v        increase verbosity\n"
+            "    --verify              after '--set=' or '--clear=' read "
+            "back the\n"
+            "                          changed fields and report each one\n"
+            "                          (or compare linkbench data)\n"
+            "    --watch=SECS[,COUNT]    poll every SECS seconds, output "
+            "NDJSON line\n"
+            "                          for each field value that changes\n"
             "\nAccess or change SCSI mode page fields (e.g. of a disk or "
             "CD/DVD drive).\nSTR can be <acronym>[=val] or "
             "<start_byte>:<start_bit>:<num_bits>[=val].\nUse '-h' or "
@@ -342,6 +456,14 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "page(s))\n"
             "                          use --page=PG for VPD number (-1 "
             "for std inq)\n"
+            "    --ioad[=FILE]         show IO advice hints groups, or "
+            "apply those in\n"
+            "                          FILE (JSON) or preset: off, rwh "
+            "(write hints)\n"
+            "    --jobs=J[,HL[,EL]]    process up to J DEVICEs at once, "
+            "at most HL\n"
+            "                          per SCSI host and EL per SAS "
+            "expander\n"
             "    --js-file=JFN | -J JFN    JFN is a filename to which JSON "
             "output is\n"
             "                              written (def: stdout); truncates "
@@ -352,9 +474,25 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "to inhex\n"
             "    --pdt=DT|-P DT        peripheral Device Type (e.g. "
             "0->disk)\n"
+            "    --qdepth=QD           commands at once on each DEVICE "
+            "with '--lba-map'\n"
+            "                          or '--command=linkbench'\n"
             "    --raw | -R            FN (in '-I FN') assumed to be "
             "binary\n"
+            "    --stagger=N[,MS[,SECS]]    with '--command=start' spin up "
+            "at most N\n"
+            "                          DEVICEs at once, starts MS "
+            "milliseconds apart,\n"
+            "                          give up after SECS (def: 300)\n"
+            "    --stats               output heap allocation statistics "
+            "on exit;\n"
+            "                          needs build with '--enable-mem-stats'"
+            "\n"
             "    --version | -V        print version string and exit\n"
+            "    --wait[=TIMEOUT]      with '--command=ready' poll until "
+            "all DEVICEs\n"
+            "                          are ready, at most TIMEOUT seconds "
+            "(def: 300)\n"
             "\nThe available commands will be listed when a invalid CMD is "
             "given\n(e.g. '--command=xxx'). VPD page(s) are read and decoded "
             "in the\n'--inquiry DEVICE' form. The '--enumerate' form outputs "
@@ -374,8 +512,21 @@ sdp_usage(const struct sdparm_opt_coll * op)
         pr2serr(
             "  where some additional options are:\n"
             "    --command=CMD | -C CMD    perform CMD (e.g. 'eject')\n"
+            "    --deadline=MS[,SMS]    give up on a DEVICE after MS "
+            "milliseconds,\n"
+            "                          and on all DEVICEs after SMS "
+            "milliseconds\n"
             "    --enumerate | -e      list known pages and fields "
             "(ignore DEVICE)\n"
+            "    --stagger=N[,MS[,SECS]]    with '--command=start' spin up "
+            "at most N\n"
+            "                          DEVICEs at once, starts MS "
+            "milliseconds apart,\n"
+            "                          give up after SECS (def: 300)\n"
+            "    --wait[=TIMEOUT]      with '--command=ready' poll until "
+            "all DEVICEs\n"
+            "                          are ready, at most TIMEOUT seconds "
+            "(def: 300)\n"
             "    --wscan | -w          windows scan for device names\n"
         );
         return;
@@ -452,8 +603,26 @@ sdp_usage(const struct sdparm_opt_coll * op)
 
             "  where mode page read (1st usage) and change (2nd usage) "
             "options are:\n"
+            "    --advise-queue[=apply]    compare Block limits VPD page "
+            "with sysfs\n"
+            "                          queue limits; 'apply': write "
+            "recommended ones\n"
             "    --all | -a            list all known pages and fields for "
             "given DEVICE\n"
+            "    --baseline=FILE       compare DEVICEs with FILE (snapshot "
+            "or JSON)\n"
+            "    --bg-window=WINDOWS    suspend background scans in peak "
+            "WINDOWS\n"
+            "                          (HH:MM-HH:MM,... local time), resume "
+            "otherwise\n"
+            "    --cdl[=FILE]          show command duration limit tables, "
+            "or apply\n"
+            "                          those in FILE (JSON) or preset: off, "
+            "tail\n"
+            "    --cpr[=dm]            show actuator LBA ranges (VPD 0xb9) "
+            "and check\n"
+            "                          sysfs; 'dm': output dm-linear tables "
+            "instead\n"
             "    --clear=STR | -c STR    clear (zero) field value(s), or "
             "set to 'val'\n"
             "    --dbd | -B            set DBD bit in mode sense cdb\n"
@@ -461,6 +630,9 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "values\n"
             "                          when use twice set all pages to "
             "their defaults\n"
+            "    --diff                report mode page fields that differ "
+            "between\n"
+            "                          DEVICEs (or from '--baseline=FILE')\n"
             "    --dummy | -d          don't write back modified mode page\n"
             "    --examine | -E        cycle through mode or vpd page "
             "numbers (default\n"
@@ -479,6 +651,14 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "output is\n"
             "                            written (def: stdout); truncates "
             "then writes\n"
+            "    --lba-map[=FILE]      map provisioning status of all LBAs "
+            "with\n"
+            "                          QD (def: 4) GET LBA STATUS commands "
+            "at once\n"
+            "    --log[=LP[,SPG]]      decode statistics log pages (def: "
+            "gsp, cms,\n"
+            "                          cdls and bsr); with '--watch=' output "
+            "rates\n"
             "    --long | -l           add description to field output\n"
             "    --num-desc | -n       report number of mode page "
             "descriptors\n"
@@ -491,15 +671,29 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "subpage) number\n"
             "                          [or abbrev] to output, change or "
             "enumerate\n"
+            "    --phy-audit[=MIN[,ERR]]    table of SAS phy link rates "
+            "and error\n"
+            "                          counters; flag slow links and "
+            "counters > ERR\n"
+            "    --profile=FILE        apply rules in FILE, change only "
+            "fields that\n"
+            "                          differ and report compliance\n"
             "    --quiet | -q          suppress DEVICE vendor/product/"
             "revision string line\n"
             "    --readonly | -r       force read-only open of DEVICE (def: "
             "depends\n"
             "                          on operation). Mainly for ATA disks\n"
+            "    --restore=FILE        write changeable current values in "
+            "FILE to DEVICE\n"
+            "    --rollback            if changing one of several mode pages "
+            "fails,\n"
+            "                          restore those already changed\n"
             "    --save | -S           place mode changes in saved page as "
             "well\n"
             "    --set=STR | -s STR    set field value(s) to 1, or to "
             "'val'\n"
+            "    --snapshot=FILE       save all mode pages of DEVICE to "
+            "FILE\n"
             "    --six | -6            use 6 byte SCSI mode cdbs (def: 10 "
             "byte)\n"
             "    --transport=TN | -t TN    transport protocol number "
@@ -507,6 +701,13 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "    --vendor=VN | -M VN    vendor (manufacturer) number "
             "[or abbrev]\n"
             "    --verbose | -v        increase verbosity\n"
+            "    --verify              after '--set=' or '--clear=' read "
+            "back the\n"
+            "                          changed fields and report each one\n"
+            "                          (or compare linkbench data)\n"
+            "    --watch=SECS[,COUNT]    poll every SECS seconds, output "
+            "NDJSON line\n"
+            "                          for each field value that changes\n"
             "\nView or change SCSI mode page fields (e.g. of a disk or "
             "CD/DVD drive).\nSTR can be <acronym>[=val] or "
             "<start_byte>:<start_bit>:<num_bits>[=val].\nUse '-h' or "
@@ -537,6 +738,10 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "       sdparm [--help] [--version]\n\n"
             "  where the additional options are:\n"
             "    --command=CMD | -C CMD    perform CMD (e.g. 'eject')\n"
+            "    --deadline=MS[,SMS]    give up on a DEVICE after MS "
+            "milliseconds,\n"
+            "                          and on all DEVICEs after SMS "
+            "milliseconds\n"
             "    --enumerate | -e      list known pages and fields "
             "(ignore DEVICE)\n"
             "    --help | -h           print out usage message\n"
@@ -548,13 +753,37 @@ sdp_usage(const struct sdparm_opt_coll * op)
             "page(s))\n"
             "                          use --page=PG for VPD number (-1 "
             "for std inq)\n"
+            "    --ioad[=FILE]         show IO advice hints groups, or "
+            "apply those in\n"
+            "                          FILE (JSON) or preset: off, rwh "
+            "(write hints)\n"
+            "    --jobs=J[,HL[,EL]]    process up to J DEVICEs at once, "
+            "at most HL\n"
+            "                          per SCSI host and EL per SAS "
+            "expander\n"
             "    --out-mask=,IM | -o ,IM    mask like '-o OM' but applies "
             "to inhex\n"
             "    --pdt=DT|-P DT        peripheral Device Type (e.g. "
             "0->disk)\n"
+            "    --qdepth=QD           commands at once on each DEVICE "
+            "with '--lba-map'\n"
+            "                          or '--command=linkbench'\n"
             "    --raw | -R            FN (in '-I FN') assumed to be "
             "binary\n"
+            "    --stagger=N[,MS[,SECS]]    with '--command=start' spin up "
+            "at most N\n"
+            "                          DEVICEs at once, starts MS "
+            "milliseconds apart,\n"
+            "                          give up after SECS (def: 300)\n"
+            "    --stats               output heap allocation statistics "
+            "on exit;\n"
+            "                          needs build with '--enable-mem-stats'"
+            "\n"
             "    --version | -V        print version string and exit\n"
+            "    --wait[=TIMEOUT]      with '--command=ready' poll until "
+            "all DEVICEs\n"
+            "                          are ready, at most TIMEOUT seconds "
+            "(def: 300)\n"
             "    --wscan | -w          windows scan for device names\n"
             "\nThe available commands will be listed when a invalid CMD is "
             "given\n(e.g. '--command=xxx'). VPD page(s) are read and decoded "
@@ -668,6 +897,8 @@ sdp_parse_cmdline(struct sdparm_opt_coll * op, int argc, char * argv[],
                   const char * device_name_arr[])
 {
     int c, res, t_proto;
+    double secs;
+    char * ecp;
     const char * ccp;
     const struct sdparm_vendor_name_t * vnp;
 
@@ -883,6 +1114,194 @@ sdp_parse_cmdline(struct sdparm_opt_coll * op, int argc, char * argv[],
         case 'S':
             op->save = true;
             break;
+        case '<':       /* for: --restore=FILE */
+            op->restore_fn = optarg;
+            op->do_rw = true;
+            break;
+        case '>':       /* for: --snapshot=FILE */
+            op->snap_fn = optarg;
+            break;
+        case '*':       /* for: --profile=FILE */
+            op->profile_fn = optarg;
+            op->do_rw = true;
+            break;
+        case '`':       /* for: --lba-map[=FILE] */
+            op->do_lbam = true;
+            op->lbam_fn = optarg;
+            break;
+        case '.':       /* for: --log[=LP[,SPG]] */
+            op->do_log = true;
+            op->log_pn = -1;
+            if (optarg) {
+                if (sdp_log_str2pg(optarg, &op->log_pn, &op->log_spn))
+                    return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case ';':       /* for: --phy-audit[=MIN[,ERR]] */
+            op->do_phy_audit = true;
+            op->phy_audit_str = optarg;
+            break;
+        case '/':       /* for: --ioad[=FILE] */
+            op->do_ioad = true;
+            if (optarg) {
+                op->ioad_fn = optarg;
+                op->do_rw = true;
+            }
+            break;
+        case '{':       /* for: --cdl[=FILE] */
+            op->do_cdl = true;
+            if (optarg) {
+                op->cdl_fn = optarg;
+                op->do_rw = true;
+            }
+            break;
+        case ']':       /* for: --advise-queue[=apply] */
+            op->do_advq = true;
+            if (optarg) {
+                if (0 == strcmp(optarg, "apply"))
+                    op->advq_apply = true;
+                else {
+                    pr2serr("--advise-queue= expects 'apply'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
+        case '[':       /* for: --cpr[=dm] */
+            op->do_cpr = true;
+            if (optarg) {
+                if (0 == strcmp(optarg, "dm")) {
+                    op->cpr_dm = true;
+                    if (0 == op->do_quiet)  /* output only the tables */
+                        op->do_quiet = 1;
+                } else if (strcmp(optarg, "map")) {
+                    pr2serr("--cpr= expects 'dm' or 'map'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
+        case '}':       /* for: --bg-window=WINDOWS */
+            op->bgw_str = optarg;
+            op->do_rw = true;
+            break;
+        case '(':       /* for: --baseline=FILE */
+            op->baseline_fn = optarg;
+            op->do_diff = true;
+            break;
+        case ')':       /* for: --diff */
+            op->do_diff = true;
+            break;
+        case '#':       /* for: --verify */
+            op->do_verify = true;
+            break;
+        case '!':       /* for: --rollback */
+            op->rollback = true;
+            break;
+        case '~':       /* for: --watch=SECS[,COUNT] */
+            secs = strtod(optarg, &ecp);
+            if ((ecp == optarg) || ((',' != *ecp) && ('\0' != *ecp)) ||
+                (secs < 0.001) || (secs > 86400.0)) {
+                pr2serr("bad argument to '--watch=', expect SECS from 0.001 "
+                        "to 86400\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->watch_ms = (int)(secs * 1000.0 + 0.5);
+            if (',' == *ecp) {
+                op->watch_count = sg_get_num_nomult(ecp + 1);
+                if (op->watch_count < 0) {
+                    pr2serr("bad COUNT argument to '--watch=SECS,COUNT'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
+        case '$':       /* for: --stats */
+            op->do_stats = true;
+            break;
+        case '&':       /* for: --jobs=J[,HL[,EL]] */
+            op->jobs = sg_get_num_nomult(optarg);
+            if (op->jobs < 1) {
+                pr2serr("bad argument to '--jobs=', expect 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ccp = strchr(optarg, ',');
+            if (ccp) {
+                op->host_limit = sg_get_num_nomult(ccp + 1);
+                if (op->host_limit < 0) {
+                    pr2serr("bad HL argument to '--jobs=J,HL'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                ccp = strchr(ccp + 1, ',');
+                if (ccp) {
+                    op->exp_limit = sg_get_num_nomult(ccp + 1);
+                    if (op->exp_limit < 0) {
+                        pr2serr("bad EL argument to '--jobs=J,HL,EL'\n");
+                        return SG_LIB_SYNTAX_ERROR;
+                    }
+                }
+            }
+            break;
+        case '+':       /* for: --wait[=TIMEOUT] */
+            op->do_wait = true;
+            op->wait_secs = -1;
+            if (optarg) {
+                op->wait_secs = sg_get_num_nomult(optarg);
+                if (op->wait_secs < 0) {
+                    pr2serr("bad argument to '--wait=', expect TIMEOUT in "
+                            "seconds\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
+        case ',':       /* for: --qdepth=QD */
+            op->qdepth = sg_get_num_nomult(optarg);
+            if ((op->qdepth < 1) || (op->qdepth > MAX_QDEPTH)) {
+                pr2serr("bad argument to '--qdepth=', expect 1 to %d\n",
+                        MAX_QDEPTH);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case '@':       /* for: --stagger=N[,MS[,SECS]] */
+            op->stagger_max = sg_get_num_nomult(optarg);
+            if (op->stagger_max < 1) {
+                pr2serr("bad argument to '--stagger=', expect N of 1 or "
+                        "more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ccp = strchr(optarg, ',');
+            if (ccp) {
+                op->stagger_ms = sg_get_num_nomult(ccp + 1);
+                if (op->stagger_ms < 0) {
+                    pr2serr("bad MS argument to '--stagger=N,MS'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                ccp = strchr(ccp + 1, ',');
+                if (ccp) {
+                    op->stagger_secs = sg_get_num_nomult(ccp + 1);
+                    if (op->stagger_secs < 1) {
+                        pr2serr("bad SECS argument to "
+                                "'--stagger=N,MS,SECS'\n");
+                        return SG_LIB_SYNTAX_ERROR;
+                    }
+                }
+            }
+            break;
+        case '%':       /* for: --deadline=MS[,SMS] */
+            ccp = strchr(optarg, ',');
+            if (ccp) {
+                op->sweep_deadline_ms = sg_get_num_nomult(ccp + 1);
+                if (op->sweep_deadline_ms < 0) {
+                    pr2serr("bad SMS argument to '--deadline=MS,SMS'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            if (',' != optarg[0]) {
+                op->deadline_ms = sg_get_num_nomult(optarg);
+                if (op->deadline_ms < 0) {
+                    pr2serr("bad argument to '--deadline=', expect MS (in "
+                            "milliseconds)\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            }
+            break;
         case 't':
             if (isalpha((uint8_t)optarg[0])) {
                 t_proto = sdp_find_transport_id_by_acron(optarg);
@@ -1220,6 +1639,21 @@ sdp_get_vendor_pair(int vendor_id)
             ? (sdparm_vendor_mp + vendor_id) : NULL;
 }
 
+/* Returns the mode page item (field) array selected by --vendor= or
+ * --transport= (in that order), else the generic array. */
+const struct sdparm_mp_item_t *
+sdp_get_mitem_arr(int transp_proto, int vendor_id)
+{
+    if (vendor_id >= 0) {
+        const struct sdparm_vendor_pair * svpp;
+
+        svpp = sdp_get_vendor_pair(vendor_id);
+        return svpp ? svpp->mitem : NULL;
+    } else if ((transp_proto >= 0) && (transp_proto < 16))
+        return sdparm_transport_mp[transp_proto].mitem;
+    return sdparm_mitem_arr;
+}
+
 /* Searches mpage items table from (and including) the current position
  * looking for the first match on 'ap' (pointer to acromym). Checks
  * against the inbuilt table (in sdparm_data.c) of generic (when both
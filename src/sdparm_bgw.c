@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_bgw.c : keeps background scans out of peak hours
+ * ('--bg-window=WINDOWS'). WINDOWS is a list of peak windows in local time
+ * (e.g. "08:00-12:00,13:00-20:00"). Each run decides, once for all
+ * DEVICEs, whether it is in a peak window. In a peak window the current
+ * values of EN_BMS (Background control subpage) and BO_MODE (Background
+ * operation control subpage) are cleared, which suspends background medium
+ * scans and host initiated advanced background operations during IO. A
+ * pre-scan can't be suspended, only halted, and setting EN_PS again starts
+ * a new one from the beginning. So EN_PS is only cleared when the
+ * Background scan results log page shows a pre-scan is active. Outside
+ * peak windows each of those fields is put back to its saved value, so the
+ * saved values (never changed here) hold the off-peak settings. Nothing is
+ * written when the fields already have the wanted values, so it is safe to
+ * run this from cron every few minutes. */
+
+#define BGW_MAX_WINS 16
+#define BGW_MS_BUFF_LEN 256
+#define BGW_LS_BUFF_LEN 1024
+#define BGW_BSR_LPAGE 0x15      /* Background scan results log page */
+#define BGW_PRESCAN_ACTIVE 2    /* background scan status */
+
+struct bgw_win_t {              /* minutes after local midnight */
+    int start;
+    int end;                    /* start > end when window spans midnight,
+                                 * 24:00 is (24 * 60) */
+};
+
+struct sdparm_bgw_t {
+    const char * spec;
+    bool peak;                  /* decided once so all DEVICEs agree */
+    bool forced;                /* WINDOWS was "peak" or "off-peak" */
+    int now_min;
+    int win_ind;                /* window that contains now, else -1 */
+    int num_wins;
+    struct bgw_win_t wins[BGW_MAX_WINS];
+};
+
+struct bgw_fld_t {              /* a field this file may change */
+    const char * acron;
+    int pn;
+    int spn;
+};
+
+static const struct bgw_fld_t bgw_fld_arr[] = {
+    {"EN_BMS", IEC_MP, MSP_BACK_CTL},
+    {"EN_PS", IEC_MP, MSP_BACK_CTL},
+    {"BO_MODE", CONTROL_MP, MSP_SBC_BACK_OP},
+};
+
+#define BGW_NUM_FLDS ((int)(sizeof(bgw_fld_arr) / sizeof(bgw_fld_arr[0])))
+#define BGW_EN_BMS 0
+#define BGW_EN_PS 1
+#define BGW_BO_MODE 2
+
+/* From SBC-4, Background scan results log page, parameter 0 */
+static const char * bgw_scan_status_arr[] = {
+    "no background scans active",
+    "background medium scan is active",
+    "background pre-scan is active",
+    "halted due to fatal error",
+    "halted due to a vendor specific pattern of errors",
+    "halted due to medium formatted without P-List",
+    "halted, vendor specific cause",
+    "halted due to temperature out of allowed range",
+    "waiting for background medium scan interval timer to expire",
+    "halted, background scan results list full",
+    "halted, pre-scan time limit timer expired",
+};
+
+static const char * mp_s = "mode page";
+
+
+/* Parses "H[:MM]" placing minutes after midnight in *minp. "24:00" is
+ * accepted as the end of a window. Returns pointer after it or NULL. */
+static const char *
+bgw_parse_hm(const char * cp, int * minp)
+{
+    int h, m = 0;
+    char * ep;
+
+    if ((*cp < '0') || (*cp > '9'))
+        return NULL;
+    h = (int)strtol(cp, &ep, 10);
+    if (':' == *ep) {
+        cp = ep + 1;
+        if ((*cp < '0') || (*cp > '9'))
+            return NULL;
+        m = (int)strtol(cp, &ep, 10);
+    }
+    if ((h > 24) || (m > 59) || ((24 == h) && (m > 0)))
+        return NULL;
+    *minp = (h * 60) + m;
+    return ep;
+}
+
+/* Parses WINDOWS into bwp. Returns 0 on success. */
+static int
+bgw_parse(struct sdparm_bgw_t * bwp, const char * spec)
+{
+    const char * cp = spec;
+    struct bgw_win_t * wp;
+
+    if ((0 == strcmp(spec, "peak")) || (0 == strcmp(spec, "off-peak")) ||
+        (0 == strcmp(spec, "off_peak"))) {
+        bwp->forced = true;
+        bwp->peak = ('p' == spec[0]);
+        return 0;
+    }
+    while (*cp) {
+        if (bwp->num_wins >= BGW_MAX_WINS) {
+            pr2serr("--bg-window= can have at most %d windows\n",
+                    BGW_MAX_WINS);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        wp = bwp->wins + bwp->num_wins;
+        cp = bgw_parse_hm(cp, &wp->start);
+        if ((NULL == cp) || ('-' != *cp))
+            goto bad;
+        cp = bgw_parse_hm(cp + 1, &wp->end);
+        if (NULL == cp)
+            goto bad;
+        if (wp->start >= (24 * 60))
+            goto bad;
+        if ((wp->start == wp->end) ||
+            ((0 == wp->end) && (0 == wp->start))) {
+            pr2serr("--bg-window= window %d is empty\n", bwp->num_wins + 1);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        ++bwp->num_wins;
+        if (',' == *cp)
+            ++cp;
+        else if (*cp)
+            goto bad;
+    }
+    if (bwp->num_wins > 0)
+        return 0;
+bad:
+    pr2serr("--bg-window= expects HH:MM-HH:MM[,HH:MM-HH:MM...] (local time) "
+            "or 'peak'\nor 'off-peak', problem near: %s\n",
+            cp ? cp : spec);
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+/* Parses WINDOWS (spec) and decides, from the local time now, whether this
+ * run is in a peak window. On success returns 0 and places a new object in
+ * *bwpp . */
+int
+sdp_bgw_new(const char * spec, const struct sdparm_opt_coll * op,
+            struct sdparm_bgw_t ** bwpp)
+{
+    int k, res;
+    time_t t;
+    struct tm tm;
+    const struct bgw_win_t * wp;
+    struct sdparm_bgw_t * bwp;
+
+    *bwpp = NULL;
+    bwp = (struct sdparm_bgw_t *)calloc(1, sizeof(*bwp));
+    if (NULL == bwp)
+        return sg_convert_errno(ENOMEM);
+    bwp->spec = spec;
+    bwp->win_ind = -1;
+    res = bgw_parse(bwp, spec);
+    if (res) {
+        free(bwp);
+        return res;
+    }
+    t = time(NULL);
+    localtime_r(&t, &tm);
+    bwp->now_min = (tm.tm_hour * 60) + tm.tm_min;
+    for (k = 0, wp = bwp->wins; k < bwp->num_wins; ++k, ++wp) {
+        if ((wp->start < wp->end) ?
+            ((bwp->now_min >= wp->start) && (bwp->now_min < wp->end)) :
+            ((bwp->now_min >= wp->start) || (bwp->now_min < wp->end))) {
+            bwp->win_ind = k;
+            break;
+        }
+    }
+    if (! bwp->forced)
+        bwp->peak = (bwp->win_ind >= 0);
+    if (op->verbose)
+        pr2serr("local time %02d:%02d, %s\n", bwp->now_min / 60,
+                bwp->now_min % 60, bwp->peak ? "peak" : "off-peak");
+    *bwpp = bwp;
+    return 0;
+}
+
+void
+sdp_bgw_free(struct sdparm_bgw_t * bwp)
+{
+    if (bwp)
+        free(bwp);
+}
+
+static const struct sdparm_mp_item_t *
+bgw_find_mitem(const struct bgw_fld_t * fp)
+{
+    int from = 0;
+    const struct sdparm_mp_item_t * mpi;
+
+    while ((mpi = sdp_find_mitem_by_acron(fp->acron, &from, -1, -1))) {
+        if ((fp->pn == mpi->pg_num) && (fp->spn == mpi->subpg_num))
+            return mpi;
+    }
+    return NULL;
+}
+
+/* Fetches page control pc (0: current, 3: saved) of mode page pn,spn into
+ * b (BGW_MS_BUFF_LEN bytes). On success places the offset of the page
+ * within b in *offp and its length in *lenp. */
+static int
+bgw_fetch(struct sdparm_ctx_t * ctxp, int pc, int pn, int spn, uint8_t * b,
+          int * offp, int * lenp)
+{
+    bool mode6 = ctxp->opts.mode_6;
+    int res, off, len, n, mx_len;
+    int resid = 0;
+    char e[128];
+
+    mx_len = mode6 ? 252 : BGW_MS_BUFF_LEN;
+    memset(b, 0, BGW_MS_BUFF_LEN);
+    res = sdp_ctx_mode_sense_pc(ctxp, pc, pn, spn, b, mx_len, &resid);
+    if (res)
+        return res;
+    len = mx_len - resid;
+    n = sg_msense_calc_length(b, len, mode6, NULL);
+    if ((n > 0) && (n < len))
+        len = n;
+    off = sg_mode_page_offset(b, len, mode6, e, sizeof(e));
+    if ((off < 0) || ((off + 4) > len) || (pn != (b[off] & 0x3f)) ||
+        (spn != ((b[off] & 0x40) ? b[off + 1] : 0))) {
+        if (ctxp->opts.verbose)
+            pr2serr("%s: [0x%x,0x%x]: %s\n", __func__, pn, spn,
+                    (off < 0) ? e : "wrong page in response");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    n = sdp_mpage_len(b + off);
+    *offp = off;
+    *lenp = ((off + n) > len) ? (len - off) : n;
+    return 0;
+}
+
+/* Reads parameter 0 of the Background scan results log page. Places the
+ * background scan status in *statusp and the background medium scan
+ * progress (in 65536ths) in *progp. Returns 0 on success. */
+static int
+bgw_scan_status(struct sdparm_ctx_t * ctxp, int * statusp, int * progp)
+{
+    int k, res, len, pl;
+    int resid = 0;
+    const int vb = ctxp->opts.verbose;
+    uint8_t b[BGW_LS_BUFF_LEN];
+
+    res = sg_ll_log_sense_v2(ctxp->sg_fd, false, false, 1 /* cumulative */,
+                             BGW_BSR_LPAGE, 0, 0, b, sizeof(b), 0, &resid,
+                             vb > 0, vb > 1 ? vb - 1 : 0);
+    if (res)
+        return res;
+    len = (int)sizeof(b) - resid;
+    if ((len < 4) || (BGW_BSR_LPAGE != (b[0] & 0x3f)))
+        return SG_LIB_CAT_MALFORMED;
+    pl = sg_get_unaligned_be16(b + 2) + 4;
+    if (pl < len)
+        len = pl;
+    for (k = 4; (k + 4) <= len; k += b[k + 3] + 4) {
+        if (0 != sg_get_unaligned_be16(b + k))
+            continue;
+        if ((b[k + 3] < 10) || ((k + 14) > len))
+            break;
+        *statusp = b[k + 9];
+        *progp = sg_get_unaligned_be16(b + k + 12);
+        return 0;
+    }
+    return SG_LIB_CAT_MALFORMED;
+}
+
+/* Makes the page (and its mode parameter header) fetched into b a MODE
+ * SELECT parameter list, without block descriptors, described by mcp.
+ * The orig image is placed at b + BGW_MS_BUFF_LEN. */
+static void
+bgw_prep_select(struct sdparm_ctx_t * ctxp, int pn, int spn, uint8_t * b,
+                int off, int pg_len, struct sdparm_mp_change_t * mcp)
+{
+    bool mode6 = ctxp->opts.mode_6;
+    int hdr_len = mode6 ? 4 : 8;
+
+    if (off > hdr_len)
+        memmove(b + hdr_len, b + off, pg_len);
+    b[0] = 0;                   /* mode data length reserved */
+    if (mode6)
+        b[3] = 0;               /* block descriptor length */
+    else {
+        b[1] = 0;
+        b[4] &= 0xfe;           /* LONGLBA */
+        b[6] = 0;
+        b[7] = 0;
+    }
+    if (PDT_DISK == ctxp->pdt)  /* device specific parameter is */
+        b[mode6 ? 2 : 3] = 0;   /* reserved for mode select */
+    b[hdr_len] &= 0x7f;         /* PS bit reserved in mode select */
+    mcp->pn = pn;
+    mcp->spn = spn;
+    mcp->off = hdr_len;
+    mcp->md_len = hdr_len + pg_len;
+    mcp->md = b;
+    mcp->orig = b + BGW_MS_BUFF_LEN;
+    memcpy(mcp->orig, b, mcp->md_len);
+}
+
+/* Applies the peak or off-peak settings decided in bwp to the DEVICE open
+ * in ctxp. Returns 0 on success. */
+int
+sdp_bg_window(const struct sdparm_bgw_t * bwp, struct sdparm_ctx_t * ctxp,
+              sgj_opaque_p jop)
+{
+    bool have_bc, have_bop, have_sav, have_status;
+    bool changed = false;
+    int k, res, off, pg_len, s_off, s_len, num;
+    int status = -1;
+    int prog = 0;
+    int64_t cur[BGW_NUM_FLDS];
+    int64_t want[BGW_NUM_FLDS];
+    int64_t sav[BGW_NUM_FLDS];
+    const char * note[BGW_NUM_FLDS];
+    const struct sdparm_mp_item_t * mpi_arr[BGW_NUM_FLDS];
+    const struct bgw_win_t * wp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap = NULL;
+    struct sdparm_mp_change_t mc_arr[2];
+    uint8_t bc_b[2 * BGW_MS_BUFF_LEN];
+    uint8_t bop_b[2 * BGW_MS_BUFF_LEN];
+    uint8_t s_b[BGW_MS_BUFF_LEN];
+    char b[64];
+
+    for (k = 0; k < BGW_NUM_FLDS; ++k) {
+        mpi_arr[k] = bgw_find_mitem(bgw_fld_arr + k);
+        cur[k] = -1;
+        want[k] = -1;
+        sav[k] = -1;
+        note[k] = NULL;
+        if (NULL == mpi_arr[k])
+            return SG_LIB_LOGIC_ERROR;
+    }
+    if (bwp->forced)
+        snprintf(b, sizeof(b), "forced");
+    else if (bwp->win_ind >= 0) {
+        wp = bwp->wins + bwp->win_ind;
+        snprintf(b, sizeof(b), "%02d:%02d-%02d:%02d", wp->start / 60,
+                 wp->start % 60, wp->end / 60, wp->end % 60);
+    } else
+        snprintf(b, sizeof(b), "outside %s", bwp->spec);
+    sgj_pr_hr(jsp, "Background scan window: %s (%s, local time %02d:%02d)\n",
+              bwp->peak ? "peak" : "off-peak", b, bwp->now_min / 60,
+              bwp->now_min % 60);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "background_window");
+        sgj_js_nv_s(jsp, jo2p, "windows", bwp->spec);
+        sgj_js_nv_s(jsp, jo2p, "state", bwp->peak ? "peak" : "off_peak");
+    }
+
+    /* Background control subpage: EN_BMS and EN_PS */
+    memset(mc_arr, 0, sizeof(mc_arr));
+    res = bgw_fetch(ctxp, 0, IEC_MP, MSP_BACK_CTL, bc_b, &off, &pg_len);
+    have_bc = (0 == res);
+    if (have_bc) {
+        for (k = BGW_EN_BMS; k <= BGW_EN_PS; ++k)
+            cur[k] = (int64_t)sdp_mitem_get_value(mpi_arr[k], bc_b + off);
+        have_sav = (0 == bgw_fetch(ctxp, 3, IEC_MP, MSP_BACK_CTL, s_b,
+                                   &s_off, &s_len));
+        if (have_sav) {
+            for (k = BGW_EN_BMS; k <= BGW_EN_PS; ++k)
+                sav[k] = (int64_t)sdp_mitem_get_value(mpi_arr[k],
+                                                      s_b + s_off);
+        }
+        bgw_prep_select(ctxp, IEC_MP, MSP_BACK_CTL, bc_b, off, pg_len,
+                        mc_arr + 0);
+        have_status = (0 == bgw_scan_status(ctxp, &status, &prog));
+        if (bwp->peak) {
+            want[BGW_EN_BMS] = 0;
+            if (! have_status) {
+                want[BGW_EN_PS] = cur[BGW_EN_PS];
+                if (cur[BGW_EN_PS])
+                    note[BGW_EN_PS] = "scan status unknown, left as is";
+            } else if (BGW_PRESCAN_ACTIVE == status)
+                want[BGW_EN_PS] = 0;
+            else {
+                want[BGW_EN_PS] = cur[BGW_EN_PS];
+                if (cur[BGW_EN_PS])
+                    note[BGW_EN_PS] = "no pre-scan active";
+            }
+        } else {
+            want[BGW_EN_BMS] = have_sav ? sav[BGW_EN_BMS] : 1;
+            /* only re-enable a pre-scan that was halted in a peak window */
+            if (have_sav && sav[BGW_EN_PS] && (0 == cur[BGW_EN_PS]))
+                want[BGW_EN_PS] = 1;
+            else
+                want[BGW_EN_PS] = cur[BGW_EN_PS];
+        }
+        if (! have_sav)
+            note[BGW_EN_BMS] = "no saved values";
+    } else
+        sgj_pr_hr(jsp, "  Background control %s (bc) not supported\n", mp_s);
+
+    /* Background operation control subpage: BO_MODE */
+    res = bgw_fetch(ctxp, 0, CONTROL_MP, MSP_SBC_BACK_OP, bop_b, &off,
+                    &pg_len);
+    have_bop = (0 == res);
+    if (have_bop) {
+        k = BGW_BO_MODE;
+        cur[k] = (int64_t)sdp_mitem_get_value(mpi_arr[k], bop_b + off);
+        if (0 == bgw_fetch(ctxp, 3, CONTROL_MP, MSP_SBC_BACK_OP, s_b,
+                           &s_off, &s_len))
+            sav[k] = (int64_t)sdp_mitem_get_value(mpi_arr[k], s_b + s_off);
+        if (bwp->peak)
+            want[k] = 0;
+        else if (sav[k] >= 0)
+            want[k] = sav[k];
+        else {
+            want[k] = cur[k];
+            note[k] = "no saved value, left as is";
+        }
+        bgw_prep_select(ctxp, CONTROL_MP, MSP_SBC_BACK_OP, bop_b, off,
+                        pg_len, mc_arr + 1);
+    } else if (op->verbose)
+        pr2serr("  Background operation control %s (bop) not supported\n",
+                mp_s);
+    if ((! have_bc) && (! have_bop)) {
+        pr2serr("DEVICE supports neither the Background control nor the "
+                "Background\noperation control %s\n", mp_s);
+        return SG_LIB_CONTRADICT;
+    }
+
+    if (status >= 0) {
+        const char * cp = "reserved";
+
+        if (status < (int)(sizeof(bgw_scan_status_arr) /
+                           sizeof(bgw_scan_status_arr[0])))
+            cp = bgw_scan_status_arr[status];
+        sgj_pr_hr(jsp, "  background scan status: %s, medium scan progress "
+                  "%.1f%%\n", cp, (prog * 100.0) / 65536.0);
+        if (jo2p) {
+            sgj_js_nv_ihex_nex(jsp, jo2p, "background_scan_status", status,
+                               true, cp);
+            sgj_js_nv_i(jsp, jo2p, "background_medium_scan_progress",
+                        prog);
+        }
+    }
+    if (jo2p)
+        jap = sgj_named_subarray_r(jsp, jo2p, "fields");
+    for (k = 0; k < BGW_NUM_FLDS; ++k) {
+        if (cur[k] < 0)
+            continue;
+        if (want[k] != cur[k]) {
+            changed = true;
+            sdp_mitem_set_value((uint64_t)want[k], mpi_arr[k],
+                                ((BGW_BO_MODE == k) ? mc_arr[1].md :
+                                 mc_arr[0].md) + mc_arr[0].off);
+            sgj_pr_hr(jsp, "  %s: %" PRId64 " -> %" PRId64 "\n",
+                      bgw_fld_arr[k].acron, cur[k], want[k]);
+        } else if (note[k])
+            sgj_pr_hr(jsp, "  %s: %" PRId64 " (%s)\n", bgw_fld_arr[k].acron,
+                      cur[k], note[k]);
+        else
+            sgj_pr_hr(jsp, "  %s: %" PRId64 "\n", bgw_fld_arr[k].acron,
+                      cur[k]);
+        if (jap) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo3p, "acronym", bgw_fld_arr[k].acron);
+            sgj_js_nv_i(jsp, jo3p, "current", cur[k]);
+            sgj_js_nv_i(jsp, jo3p, "wanted", want[k]);
+            if (sav[k] >= 0)
+                sgj_js_nv_i(jsp, jo3p, "saved", sav[k]);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        }
+    }
+    res = 0;
+    if (changed) {
+        /* only pages with a changed field are written */
+        num = 0;
+        if (have_bc && memcmp(mc_arr[0].md, mc_arr[0].orig,
+                              mc_arr[0].md_len))
+            ++num;
+        if (have_bop && memcmp(mc_arr[1].md, mc_arr[1].orig,
+                               mc_arr[1].md_len)) {
+            if (0 == num)
+                mc_arr[0] = mc_arr[1];
+            ++num;
+        }
+        res = sdp_write_mpages(ctxp->sg_fd, ctxp->pdt, mc_arr, num, op);
+    }
+    sgj_pr_hr(jsp, "  %s\n", (! changed) ? "no change needed" :
+              (res ? "change failed" : (op->dummy ? "would change" :
+                                        "changed")));
+    if (jo2p)
+        sgj_js_nv_b(jsp, jo2p, "changed", changed && (0 == res) &&
+                    (! op->dummy));
+    return res;
+}
@@ -0,0 +1,1126 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+#include "sdparm_json_in.h"
+
+/* sdparm_cdl.c : shows and changes the Command Duration Limits (CDL) mode
+ * subpages of the Control mode page as whole tables ('--cdl' and
+ * '--cdl=FILE'). The A and B subpages (cdla and cdlb) each hold seven 4
+ * byte descriptors: a duration limit and its units. The T2A and T2B
+ * subpages (cdt2a and cdt2b) each hold seven 32 byte descriptors: a max
+ * inactive time, a max active time and a command duration guideline, each
+ * with a policy, all in the units given by the descriptor's T2CDLUNITS.
+ * Times are shown, and accepted, as strings like "30ms" and the units are
+ * chosen here. A table applied from FILE replaces the whole subpage: fields
+ * that FILE doesn't give are zeroed (i.e. no limit). Each subpage in FILE
+ * is checked against the DEVICE's changeable mask before anything is
+ * written and then written with its own MODE SELECT. FILE is JSON (e.g.
+ * the output of 'sdparm --cdl --json') or the name of a built-in preset.
+ */
+
+#define CDL_NUM_DESC 7
+#define CDL_NUM_T2_TIMES 3
+#define CDL_MAX_LIMIT 0xffff
+#define CDL_MAX_JSON_LEN (1024 * 1024)
+#define CDL_MAX_JSON_DEPTH 32
+#define CDL_MS_BUFF_LEN 512
+
+struct cdl_unit_t {
+    int code;
+    uint64_t ns;                /* nanoseconds in one unit */
+};
+
+/* finest first, from the CDLUNIT and T2CDLUNITS field descriptions */
+static const struct cdl_unit_t cdl_ab_units[] = {
+    {4, 1000},
+    {5, 10000},
+    {6, 500000},
+    {-1, 0},
+};
+
+static const struct cdl_unit_t cdl_t2_units[] = {
+    {6, 500},
+    {8, 1000},
+    {10, 10000000},
+    {14, 500000000},
+    {-1, 0},
+};
+
+struct cdl_pg_t {               /* a CDL subpage of the Control mode page */
+    int spn;
+    bool t2;                    /* T2A or T2B format */
+    int desc_len;
+    const char * key;           /* subpage acronym, also its JSON name */
+    const char * name;
+    const char * unit_acron;
+    const char * lim_acron;     /* A/B only */
+};
+
+static const struct cdl_pg_t cdl_pg_arr[] = {
+    {MSP_SPC_CDLA, false, 4, "cdla", "Command duration limit A",
+     "CDA_UNIT", "CDA_LIMIT"},
+    {MSP_SPC_CDLB, false, 4, "cdlb", "Command duration limit B",
+     "CDB_UNIT", "CDB_LIMIT"},
+    {MSP_SPC_CDLT2A, true, 32, "cdt2a", "Command duration limit T2A",
+     "T2CDLU", NULL},
+    {MSP_SPC_CDLT2B, true, 32, "cdt2b", "Command duration limit T2B",
+     "T2CDLU", NULL},
+};
+
+#define CDL_NUM_PGS ((int)(sizeof(cdl_pg_arr) / sizeof(cdl_pg_arr[0])))
+
+static const char * cdl_t2_time_acron[CDL_NUM_T2_TIMES] =
+        {"MXINATI", "MXACTTI", "CDGUID"};
+static const char * cdl_t2_pol_acron[CDL_NUM_T2_TIMES] =
+        {"MXINATP", "MXACTTP", "CDGUPOL"};
+static const char * cdl_t2_time_key[CDL_NUM_T2_TIMES] =
+        {"max_inactive_time", "max_active_time",
+         "command_duration_guideline"};
+static const char * cdl_t2_pol_key[CDL_NUM_T2_TIMES] =
+        {"max_inactive_time_policy", "max_active_time_policy",
+         "command_duration_guideline_policy"};
+
+/* Presets that may be given instead of a FILE name. Like FILEs they
+ * replace each subpage they name. */
+struct cdl_preset_t {
+    const char * name;
+    const char * json;
+};
+
+static const struct cdl_preset_t cdl_preset_arr[] = {
+    /* no duration limits in either T2 table */
+    {"off", "{\"cdt2a\": {\"descriptors\": []}, "
+            "\"cdt2b\": {\"descriptors\": []}}"},
+    /* read tail latency caps: T2A descriptors 1 to 7 end a command active
+     * for longer than 20ms up to 500ms with GOOD status and "data currently
+     * unavailable" sense, so the host can fetch the data elsewhere */
+    {"tail", "{\"cdt2a\": {\"descriptors\": ["
+             "{\"max_active_time\": \"20ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"30ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"40ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"50ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"60ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"100ms\", "
+             "\"max_active_time_policy\": 13}, "
+             "{\"max_active_time\": \"500ms\", "
+             "\"max_active_time_policy\": 13}]}}"},
+    {NULL, NULL},
+};
+
+struct cdl_jtime_t {            /* a time given in FILE */
+    bool given;
+    bool is_raw;                /* integer in descriptor's units */
+    uint64_t v;                 /* nanoseconds unless is_raw */
+};
+
+struct cdl_jdesc_t {            /* a descriptor given in FILE */
+    int units;                  /* -1 if not given */
+    int pol[CDL_NUM_T2_TIMES];  /* A/B have no policies */
+    struct cdl_jtime_t t[CDL_NUM_T2_TIMES];     /* A/B only use t[0] */
+};
+
+struct cdl_jpg_t {              /* a subpage given in FILE */
+    bool given;
+    int pvcdg;                  /* T2A only */
+    int num_desc;
+    struct cdl_jdesc_t desc[CDL_NUM_DESC];
+};
+
+struct sdparm_cdl_t {
+    const char * fn;            /* NULL when only showing the tables */
+    bool preset;
+    struct cdl_jpg_t pgs[CDL_NUM_PGS];
+};
+
+struct cdl_jscan_t {            /* state of the CDL JSON scanner */
+    struct sdp_jin_t in;
+    struct sdparm_cdl_t * clp;
+    char err[128];              /* set when JSON is valid but not wanted */
+};
+
+static const char * mp_s = "mode page";
+
+
+static const struct sdparm_mp_item_t *
+cdl_find_mitem(const char * acron, int spn)
+{
+    int from = 0;
+    const struct sdparm_mp_item_t * mpi;
+
+    while ((mpi = sdp_find_mitem_by_acron(acron, &from, -1, -1))) {
+        if ((CONTROL_MP == mpi->pg_num) && (spn == mpi->subpg_num))
+            return mpi;
+    }
+    return NULL;
+}
+
+static const struct cdl_unit_t *
+cdl_find_unit(const struct cdl_pg_t * pgp, int code)
+{
+    const struct cdl_unit_t * up;
+
+    for (up = pgp->t2 ? cdl_t2_units : cdl_ab_units; up->code >= 0; ++up) {
+        if (code == up->code)
+            return up;
+    }
+    return NULL;
+}
+
+/* Places time ns, in the largest unit that represents it exactly, in b */
+static char *
+cdl_ns_str(uint64_t ns, char * b, int blen)
+{
+    if (0 == ns)
+        snprintf(b, blen, "none");
+    else if (0 == (ns % 1000000000))
+        snprintf(b, blen, "%" PRIu64 "s", ns / 1000000000);
+    else if (0 == (ns % 1000000))
+        snprintf(b, blen, "%" PRIu64 "ms", ns / 1000000);
+    else if (0 == (ns % 1000))
+        snprintf(b, blen, "%" PRIu64 "us", ns / 1000);
+    else
+        snprintf(b, blen, "%" PRIu64 "ns", ns);
+    return b;
+}
+
+/* Parses a time such as "30ms", "1.5s", "500us", "0" or "none" into
+ * nanoseconds. Returns false if it is not understood. */
+static bool
+cdl_parse_time(const char * sp, int len, uint64_t * nsp)
+{
+    double d;
+    uint64_t mult;
+    char * cp;
+    char b[32];
+
+    if ((len < 1) || (len >= (int)sizeof(b)))
+        return false;
+    memcpy(b, sp, len);
+    b[len] = '\0';
+    if (0 == strcmp(b, "none")) {
+        *nsp = 0;
+        return true;
+    }
+    d = strtod(b, &cp);
+    if ((cp == b) || (! (d >= 0.0)) || (d > 1e12))
+        return false;
+    while (' ' == *cp)
+        ++cp;
+    if ('\0' == *cp) {
+        if (d != 0.0)
+            return false;       /* only zero may be given without units */
+        mult = 1;
+    } else if (0 == strcmp(cp, "ns"))
+        mult = 1;
+    else if ((0 == strcmp(cp, "us")) || (0 == strcmp(cp, "\xc2\xb5s")))
+        mult = 1000;
+    else if (0 == strcmp(cp, "ms"))
+        mult = 1000000;
+    else if (0 == strcmp(cp, "s"))
+        mult = 1000000000;
+    else
+        return false;
+    *nsp = (uint64_t)((d * mult) + 0.5);
+    return true;
+}
+
+static bool cj_value(struct cdl_jscan_t * jsc);
+
+static bool
+cj_time(struct cdl_jscan_t * jsc, const char * pg_key, int d,
+        const char * key, struct cdl_jtime_t * tp)
+{
+    int len;
+    int64_t i;
+    const char * sp;
+
+    tp->given = true;
+    if (sdp_jin_at(&jsc->in, '"')) {
+        if (! sdp_jin_string(&jsc->in, &sp, &len))
+            return false;
+        if (cdl_parse_time(sp, len, &tp->v))
+            return true;
+        snprintf(jsc->err, sizeof(jsc->err), "%s descriptor %d: %s of "
+                 "\"%.*s\" not understood", pg_key, d, key,
+                 (len > 20) ? 20 : len, sp);
+        return false;
+    }
+    if (! sdp_jin_int(&jsc->in, &i))
+        return false;
+    if ((i < 0) || (i > CDL_MAX_LIMIT)) {
+        snprintf(jsc->err, sizeof(jsc->err), "%s descriptor %d: %s of "
+                 "%" PRId64 " exceeds %d", pg_key, d, key, i, CDL_MAX_LIMIT);
+        return false;
+    }
+    tp->is_raw = true;
+    tp->v = (uint64_t)i;
+    return true;
+}
+
+static bool
+cj_small_int(struct cdl_jscan_t * jsc, const char * pg_key, int d,
+             const char * key, int max, int * vp)
+{
+    int64_t i;
+
+    if (! sdp_jin_int(&jsc->in, &i))
+        return false;
+    if ((i < 0) || (i > max)) {
+        snprintf(jsc->err, sizeof(jsc->err), "%s descriptor %d: %s of "
+                 "%" PRId64 " exceeds %d", pg_key, d, key, i, max);
+        return false;
+    }
+    *vp = (int)i;
+    return true;
+}
+
+/* Scans one element of a subpage's "descriptors" array. Descriptors are
+ * numbered from 1 in array order unless a "descriptor" member says
+ * otherwise. */
+static bool
+cj_desc(struct cdl_jscan_t * jsc, const struct cdl_pg_t * pgp,
+        struct cdl_jpg_t * jpp, int d)
+{
+    bool found;
+    int k, r, k_len;
+    int64_t i;
+    const char * k_s;
+    struct cdl_jdesc_t jd;
+
+    if (! sdp_jin_at(&jsc->in, '{'))
+        return false;
+    memset(&jd, 0, sizeof(jd));
+    jd.units = -1;
+    if (sdp_jin_empty(&jsc->in, '}'))
+        goto store;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        found = true;
+        if (sdp_jin_key_eq(k_s, k_len, "descriptor")) {
+            if (! sdp_jin_int(&jsc->in, &i))
+                return false;
+            if ((i < 1) || (i > CDL_NUM_DESC)) {
+                snprintf(jsc->err, sizeof(jsc->err), "%s: descriptor "
+                         "%" PRId64 " out of range (1 to %d)", pgp->key, i,
+                         CDL_NUM_DESC);
+                return false;
+            }
+            d = (int)i;
+        } else if (! pgp->t2) {
+            if (sdp_jin_key_eq(k_s, k_len, "cdl_unit")) {
+                if (! cj_small_int(jsc, pgp->key, d, "cdl_unit", 7,
+                                   &jd.units))
+                    return false;
+            } else if (sdp_jin_key_eq(k_s, k_len, "duration_limit")) {
+                if (! cj_time(jsc, pgp->key, d, "duration_limit", jd.t + 0))
+                    return false;
+            } else
+                found = false;
+        } else if (sdp_jin_key_eq(k_s, k_len, "t2cdlunits")) {
+            if (! cj_small_int(jsc, pgp->key, d, "t2cdlunits", 15,
+                               &jd.units))
+                return false;
+        } else {
+            for (k = 0; k < CDL_NUM_T2_TIMES; ++k) {
+                if (sdp_jin_key_eq(k_s, k_len, cdl_t2_time_key[k])) {
+                    if (! cj_time(jsc, pgp->key, d, cdl_t2_time_key[k],
+                                  jd.t + k))
+                        return false;
+                    break;
+                } else if (sdp_jin_key_eq(k_s, k_len, cdl_t2_pol_key[k])) {
+                    if (! cj_small_int(jsc, pgp->key, d, cdl_t2_pol_key[k],
+                                       15, jd.pol + k))
+                        return false;
+                    break;
+                }
+            }
+            found = (k < CDL_NUM_T2_TIMES);
+        }
+        if (! found) {
+            snprintf(jsc->err, sizeof(jsc->err), "%s descriptor %d: "
+                     "unknown member \"%.*s\"", pgp->key, d,
+                     (k_len > 40) ? 40 : k_len, k_s);
+            return false;
+        }
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    if (r < 0)
+        return false;
+store:
+    if (d > CDL_NUM_DESC) {
+        snprintf(jsc->err, sizeof(jsc->err), "%s: more than %d descriptors",
+                 pgp->key, CDL_NUM_DESC);
+        return false;
+    }
+    jpp->desc[d - 1] = jd;
+    if (d > jpp->num_desc)
+        jpp->num_desc = d;
+    return true;
+}
+
+/* Scans the object named by a CDL subpage acronym (e.g. "cdt2a"). Members
+ * other than "pvcdg" and "descriptors" (e.g. "page_length" from '--cdl
+ * --json') are skipped. */
+static bool
+cj_page(struct cdl_jscan_t * jsc, int pg_ind)
+{
+    int d, r, k_len;
+    int64_t i;
+    const char * k_s;
+    const struct cdl_pg_t * pgp = cdl_pg_arr + pg_ind;
+    struct cdl_jpg_t * jpp = jsc->clp->pgs + pg_ind;
+
+    if (jpp->given) {
+        snprintf(jsc->err, sizeof(jsc->err), "%s given more than once",
+                 pgp->key);
+        return false;
+    }
+    jpp->given = true;
+    for (d = 0; d < CDL_NUM_DESC; ++d)
+        jpp->desc[d].units = -1;        /* descriptors not given */
+    if (sdp_jin_empty(&jsc->in, '}'))
+        return true;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        if (pgp->t2 && (MSP_SPC_CDLT2A == pgp->spn) &&
+            sdp_jin_key_eq(k_s, k_len, "pvcdg")) {
+            if (! sdp_jin_int(&jsc->in, &i))
+                return false;
+            if ((i < 0) || (i > 15)) {
+                snprintf(jsc->err, sizeof(jsc->err), "%s: pvcdg of "
+                         "%" PRId64 " exceeds 15", pgp->key, i);
+                return false;
+            }
+            jpp->pvcdg = (int)i;
+        } else if (sdp_jin_key_eq(k_s, k_len, "descriptors")) {
+            if (! sdp_jin_at(&jsc->in, '['))
+                return false;
+            if (sdp_jin_empty(&jsc->in, ']'))
+                continue;
+            d = 0;
+            do {
+                sdp_jin_skip_ws(&jsc->in);
+                if (! cj_desc(jsc, pgp, jpp, ++d))
+                    return false;
+            } while ((r = sdp_jin_next(&jsc->in, ']')) > 0);
+            if (r < 0)
+                return false;
+        } else if (! cj_value(jsc))
+            return false;
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    return (0 == r);
+}
+
+/* Scans a JSON object looking for members named by CDL subpage acronyms,
+ * at any depth, so the output of 'sdparm --cdl --json' can be given. */
+static bool
+cj_object(void * arg)
+{
+    bool ok;
+    int k, r, k_len;
+    const char * k_s;
+    struct cdl_jscan_t * jsc = (struct cdl_jscan_t *)arg;
+
+    if (sdp_jin_empty(&jsc->in, '}'))
+        return true;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        for (k = 0; k < CDL_NUM_PGS; ++k) {
+            if (sdp_jin_key_eq(k_s, k_len, cdl_pg_arr[k].key))
+                break;
+        }
+        if ((k < CDL_NUM_PGS) && sdp_jin_at(&jsc->in, '{'))
+            ok = cj_page(jsc, k);
+        else
+            ok = cj_value(jsc);
+        if (! ok)
+            return false;
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    return (0 == r);
+}
+
+static bool
+cj_value(struct cdl_jscan_t * jsc)
+{
+    return sdp_jin_value(&jsc->in, cj_object, jsc);
+}
+
+/* Reads the CDL tables in FILE (or preset) fn into clp. Returns 0 on
+ * success. */
+static int
+cdl_load(struct sdparm_cdl_t * clp, const char * fn, int verbose)
+{
+    bool ok;
+    int k, len;
+    int res = 0;
+    const char * jp = NULL;
+    char * b = NULL;
+    FILE * fp = NULL;
+    const struct cdl_preset_t * psp;
+    struct cdl_jscan_t jsc;
+
+    for (psp = cdl_preset_arr; psp->name; ++psp) {
+        if (0 == strcmp(fn, psp->name)) {
+            jp = psp->json;
+            len = (int)strlen(jp);
+            clp->preset = true;
+            if (verbose)
+                pr2serr("using built-in CDL preset: %s\n", fn);
+            break;
+        }
+    }
+    if (NULL == jp) {
+        if ((1 == strlen(fn)) && ('-' == fn[0]))
+            fp = stdin;
+        else if (NULL == (fp = fopen(fn, "r"))) {
+            res = errno;
+            pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                    safe_strerror(res));
+            return sg_convert_errno(res);
+        }
+        b = (char *)malloc(CDL_MAX_JSON_LEN + 1);
+        if (NULL == b) {
+            res = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        len = (int)fread(b, 1, CDL_MAX_JSON_LEN + 1, fp);
+        if (len > CDL_MAX_JSON_LEN) {
+            pr2serr("%s: %s is too long (more than %d bytes)\n", __func__,
+                    fn, CDL_MAX_JSON_LEN);
+            res = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        b[len] = '\0';
+        jp = b;
+    }
+    memset(&jsc, 0, sizeof(jsc));
+    sdp_jin_init(&jsc.in, jp, len, CDL_MAX_JSON_DEPTH);
+    jsc.clp = clp;
+    sdp_jin_skip_ws(&jsc.in);
+    ok = sdp_jin_at(&jsc.in, '{') && cj_value(&jsc);
+    if (ok) {
+        sdp_jin_skip_ws(&jsc.in);
+        ok = (jsc.in.p >= jsc.in.end);
+    }
+    if (! ok) {
+        if (jsc.err[0])
+            pr2serr("%s: %s\n", fn, jsc.err);
+        else
+            pr2serr("%s: %s is not valid JSON (near offset %d)\n", __func__,
+                    fn, (int)(jsc.in.p - jp));
+        res = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    for (k = 0; k < CDL_NUM_PGS; ++k) {
+        if (clp->pgs[k].given)
+            break;
+    }
+    if (k >= CDL_NUM_PGS) {
+        pr2serr("%s: no CDL tables (cdla, cdlb, cdt2a or cdt2b) found in "
+                "%s\n", __func__, fn);
+        res = SG_LIB_FILE_ERROR;
+    }
+fini:
+    if (fp && (stdin != fp))
+        fclose(fp);
+    if (b)
+        free(b);
+    return res;
+}
+
+/* Prepares for '--cdl' (fn is NULL) or '--cdl=FILE'. When FILE is given it
+ * is read once here so it may be stdin even when there are many DEVICEs.
+ * On success returns 0 and places a new object in *clpp . */
+int
+sdp_cdl_new(const char * fn, const struct sdparm_opt_coll * op,
+            struct sdparm_cdl_t ** clpp)
+{
+    int res;
+    struct sdparm_cdl_t * clp;
+
+    *clpp = NULL;
+    clp = (struct sdparm_cdl_t *)calloc(1, sizeof(*clp));
+    if (NULL == clp)
+        return sg_convert_errno(ENOMEM);
+    clp->fn = fn;
+    if (fn) {
+        res = cdl_load(clp, fn, op->verbose);
+        if (res) {
+            free(clp);
+            return res;
+        }
+    }
+    *clpp = clp;
+    return 0;
+}
+
+void
+sdp_cdl_free(struct sdparm_cdl_t * clp)
+{
+    if (clp)
+        free(clp);
+}
+
+/* Fetches page control pc (0: current, 1: changeable) of CDL subpage pgp
+ * into b (CDL_MS_BUFF_LEN bytes). On success places the offset of the
+ * subpage within b in *offp and its length in *lenp. */
+static int
+cdl_fetch(struct sdparm_ctx_t * ctxp, int pc, const struct cdl_pg_t * pgp,
+          uint8_t * b, int * offp, int * lenp)
+{
+    bool mode6 = ctxp->opts.mode_6;
+    int res, off, len, n, mx_len;
+    int resid = 0;
+    char e[128];
+
+    mx_len = mode6 ? 252 : CDL_MS_BUFF_LEN;
+    memset(b, 0, CDL_MS_BUFF_LEN);
+    res = sdp_ctx_mode_sense_pc(ctxp, pc, CONTROL_MP, pgp->spn, b, mx_len,
+                                &resid);
+    if (res)
+        return res;
+    len = mx_len - resid;
+    n = sg_msense_calc_length(b, len, mode6, NULL);
+    if ((n > 0) && (n < len))
+        len = n;
+    off = sg_mode_page_offset(b, len, mode6, e, sizeof(e));
+    if ((off < 0) || ((off + 4) > len) ||
+        (CONTROL_MP != (b[off] & 0x3f)) || (0 == (b[off] & 0x40)) ||
+        (pgp->spn != b[off + 1])) {
+        if (ctxp->opts.verbose)
+            pr2serr("%s: %s: %s\n", __func__, pgp->key,
+                    (off < 0) ? e : "wrong page in response");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    n = sdp_mpage_len(b + off);
+    *offp = off;
+    *lenp = ((off + n) > len) ? (len - off) : n;
+    return 0;
+}
+
+static int
+cdl_num_desc(const struct cdl_pg_t * pgp, int pg_len)
+{
+    int n = (pg_len - 8) / pgp->desc_len;
+
+    if (n < 0)
+        return 0;
+    return (n > CDL_NUM_DESC) ? CDL_NUM_DESC : n;
+}
+
+/* Outputs a time field (raw value v in units of unit code) to the text
+ * column in b and, if jo2p is non-NULL, as a JSON string (or integer
+ * when the units are not known) named key. */
+static void
+cdl_show_time(const struct cdl_pg_t * pgp, int code, uint64_t v,
+              sgj_state * jsp, sgj_opaque_p jo2p, const char * key, char * b,
+              int blen)
+{
+    const struct cdl_unit_t * up = cdl_find_unit(pgp, code);
+
+    if ((0 == v) || up) {
+        cdl_ns_str(up ? (v * up->ns) : 0, b, blen);
+        if (jo2p)
+            sgj_js_nv_s(jsp, jo2p, key, b);
+    } else {
+        snprintf(b, blen, "%" PRIu64 "?", v);
+        if (jo2p)
+            sgj_js_nv_i(jsp, jo2p, key, (int64_t)v);
+    }
+}
+
+/* Shows the current values of each CDL subpage the DEVICE supports.
+ * Returns 0 if at least one is supported. */
+static int
+cdl_show(struct sdparm_ctx_t * ctxp, sgj_opaque_p jop)
+{
+    int k, j, d, res, off, pg_len, nd, code, num_sup;
+    uint64_t v;
+    const uint8_t * pgp_b;
+    const struct cdl_pg_t * pgp;
+    const struct sdparm_mp_item_t * mpi;
+    const struct sdparm_mp_item_t * unit_mpi;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p = NULL;
+    sgj_opaque_p jo4p = NULL;
+    sgj_opaque_p jap = NULL;
+    uint8_t b[CDL_MS_BUFF_LEN];
+    char t[CDL_NUM_T2_TIMES][32];
+
+    if (jsp->pr_as_json)
+        jo2p = sgj_named_subobject_r(jsp, jop, "command_duration_limits");
+    for (k = 0, num_sup = 0, pgp = cdl_pg_arr; k < CDL_NUM_PGS; ++k, ++pgp) {
+        res = cdl_fetch(ctxp, 0, pgp, b, &off, &pg_len);
+        if (res) {
+            sgj_pr_hr(jsp, "%s [%s] %s: not supported\n", pgp->name,
+                      pgp->key, mp_s);
+            continue;
+        }
+        ++num_sup;
+        pgp_b = b + off;
+        nd = cdl_num_desc(pgp, pg_len);
+        unit_mpi = cdl_find_mitem(pgp->unit_acron, pgp->spn);
+        sgj_pr_hr(jsp, "%s [%s] %s:\n", pgp->name, pgp->key, mp_s);
+        if (jo2p) {
+            jo3p = sgj_named_subobject_r(jsp, jo2p, pgp->key);
+            sgj_js_nv_i(jsp, jo3p, "page_length", pg_len);
+        }
+        if (MSP_SPC_CDLT2A == pgp->spn) {
+            mpi = cdl_find_mitem("PVCDG", pgp->spn);
+            if (mpi) {
+                v = sdp_mitem_get_value(mpi, pgp_b);
+                sgj_pr_hr(jsp, "  perf vs duration guideline [PVCDG]: "
+                          "%" PRIu64 "\n", v);
+                if (jo3p)
+                    sgj_js_nv_i(jsp, jo3p, "pvcdg", (int64_t)v);
+            }
+        }
+        if (jo3p)
+            jap = sgj_named_subarray_r(jsp, jo3p, "descriptors");
+        if (pgp->t2)
+            sgj_pr_hr(jsp, "  desc  units  max_inactive  policy  max_active"
+                      "  policy  guideline  policy\n");
+        else
+            sgj_pr_hr(jsp, "  desc  unit  duration_limit\n");
+        for (d = 0; d < nd; ++d) {
+            const uint8_t * dp = pgp_b + (d * pgp->desc_len);
+            uint64_t pol[CDL_NUM_T2_TIMES];
+
+            code = unit_mpi ? (int)sdp_mitem_get_value(unit_mpi, dp) : 0;
+            if (jap) {
+                jo4p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_i(jsp, jo4p, "descriptor", d + 1);
+                sgj_js_nv_i(jsp, jo4p, pgp->t2 ? "t2cdlunits" : "cdl_unit",
+                            code);
+            }
+            if (! pgp->t2) {
+                mpi = cdl_find_mitem(pgp->lim_acron, pgp->spn);
+                v = mpi ? sdp_mitem_get_value(mpi, dp) : 0;
+                cdl_show_time(pgp, code, v, jsp, jo4p, "duration_limit",
+                              t[0], sizeof(t[0]));
+                sgj_pr_hr(jsp, "  %4d  %4d  %14s\n", d + 1, code, t[0]);
+            } else {
+                for (j = 0; j < CDL_NUM_T2_TIMES; ++j) {
+                    mpi = cdl_find_mitem(cdl_t2_time_acron[j], pgp->spn);
+                    v = mpi ? sdp_mitem_get_value(mpi, dp) : 0;
+                    cdl_show_time(pgp, code, v, jsp, jo4p,
+                                  cdl_t2_time_key[j], t[j], sizeof(t[j]));
+                    mpi = cdl_find_mitem(cdl_t2_pol_acron[j], pgp->spn);
+                    pol[j] = mpi ? sdp_mitem_get_value(mpi, dp) : 0;
+                    if (jo4p)
+                        sgj_js_nv_i(jsp, jo4p, cdl_t2_pol_key[j],
+                                    (int64_t)pol[j]);
+                }
+                sgj_pr_hr(jsp, "  %4d  %5d  %12s  %6" PRIu64 "  %10s  %6"
+                          PRIu64 "  %9s  %6" PRIu64 "\n", d + 1, code, t[0],
+                          pol[0], t[1], pol[1], t[2], pol[2]);
+            }
+            if (jap)
+                sgj_js_nv_o(jsp, jap, NULL /* name */, jo4p);
+        }
+    }
+    if (0 == num_sup) {
+        pr2serr("DEVICE does not support command duration limits\n");
+        return SG_LIB_CAT_ILLEGAL_REQ;
+    }
+    return 0;
+}
+
+/* Converts the times in descriptor jdp (number d) of subpage pgp to the
+ * values for its time fields (placed in vals[]) and returns the units
+ * code. Unless FILE gave the units, or the DEVICE's units field is not
+ * changeable (then fixed is its units code, else -1), the finest units
+ * that hold every time exactly are chosen. Times that can't be held
+ * exactly are rounded up (with a warning). Returns -1 on error. */
+static int
+cdl_encode_times(const struct cdl_pg_t * pgp,
+                 const struct cdl_jdesc_t * jdp, int d, int fixed,
+                 uint64_t * vals)
+{
+    bool exact, fits, any_raw = false;
+    bool any_time = false;
+    int k;
+    int units = (jdp->units >= 0) ? jdp->units : fixed;
+    int nt = pgp->t2 ? CDL_NUM_T2_TIMES : 1;
+    const char * key;
+    const struct cdl_unit_t * up = NULL;
+    const struct cdl_unit_t * ufit = NULL;
+    char b[32];
+
+    for (k = 0; k < nt; ++k) {
+        vals[k] = 0;
+        if (jdp->t[k].is_raw)
+            any_raw = true;
+        else if (jdp->t[k].v > 0)
+            any_time = true;
+    }
+    if (units >= 0) {
+        up = cdl_find_unit(pgp, units);
+        if (any_time && (NULL == up)) {
+            pr2serr("%s descriptor %d: units %d %s, give times as "
+                    "integers\n", pgp->key, d, units,
+                    (jdp->units >= 0) ? "not known" : "fixed by DEVICE");
+            return -1;
+        }
+    } else if (any_raw) {
+        pr2serr("%s descriptor %d: times given as integers need \"%s\"\n",
+                pgp->key, d, pgp->t2 ? "t2cdlunits" : "cdl_unit");
+        return -1;
+    } else if (! any_time)
+        return 0;
+    else {
+        for (up = pgp->t2 ? cdl_t2_units : cdl_ab_units; up->code >= 0;
+             ++up) {
+            for (k = 0, exact = true, fits = true; k < nt; ++k) {
+                if (jdp->t[k].v % up->ns)
+                    exact = false;
+                if (((jdp->t[k].v + up->ns - 1) / up->ns) > CDL_MAX_LIMIT)
+                    fits = false;
+            }
+            if (fits && exact)
+                break;
+            if (fits && (NULL == ufit))
+                ufit = up;
+        }
+        if (up->code < 0) {
+            if (NULL == ufit) {
+                pr2serr("%s descriptor %d: time too long for any units\n",
+                        pgp->key, d);
+                return -1;
+            }
+            up = ufit;
+        }
+    }
+    for (k = 0; k < nt; ++k) {
+        key = pgp->t2 ? cdl_t2_time_key[k] : "duration_limit";
+        if (jdp->t[k].is_raw) {
+            vals[k] = jdp->t[k].v;
+            continue;
+        }
+        if ((0 == jdp->t[k].v) || (NULL == up))
+            continue;
+        vals[k] = (jdp->t[k].v + up->ns - 1) / up->ns;
+        if (vals[k] > CDL_MAX_LIMIT) {
+            pr2serr("%s descriptor %d: %s too long for units %d\n", pgp->key,
+                    d, key, up->code);
+            return -1;
+        }
+        if (jdp->t[k].v % up->ns)
+            pr2serr(">> %s descriptor %d: %s rounded up to %s\n", pgp->key,
+                    d, key, cdl_ns_str(vals[k] * up->ns, b, sizeof(b)));
+    }
+    return (units >= 0) ? units : up->code;
+}
+
+/* Sets field acron of descriptor d (0 based) in page mp to val */
+static void
+cdl_set_fld(const struct cdl_pg_t * pgp, const char * acron, int d,
+            uint64_t val, uint8_t * mp)
+{
+    const struct sdparm_mp_item_t * mpi = cdl_find_mitem(acron, pgp->spn);
+
+    if (mpi)
+        sdp_mitem_set_value(val, mpi, mp + (d * pgp->desc_len));
+}
+
+/* Builds the new subpage in mp (the current values on entry, pg_len bytes
+ * long) from the table jpp. Every descriptor is rewritten, those not given
+ * are zeroed. cha_mp is the DEVICE's changeable mask for the subpage. */
+static int
+cdl_build(const struct cdl_pg_t * pgp, const struct cdl_jpg_t * jpp,
+          const uint8_t * cha_mp, uint8_t * mp, int pg_len)
+{
+    int d, k, nd, code, fixed;
+    const struct cdl_jdesc_t * jdp;
+    const struct sdparm_mp_item_t * unit_mpi;
+    uint64_t vals[CDL_NUM_T2_TIMES];
+
+    nd = cdl_num_desc(pgp, pg_len);
+    if (jpp->num_desc > nd) {
+        pr2serr("%s: %d descriptors given but DEVICE's %s only has %d\n",
+                pgp->key, jpp->num_desc, mp_s, nd);
+        return SG_LIB_CONTRADICT;
+    }
+    unit_mpi = cdl_find_mitem(pgp->unit_acron, pgp->spn);
+    if (MSP_SPC_CDLT2A == pgp->spn)
+        cdl_set_fld(pgp, "PVCDG", 0, jpp->pvcdg, mp);
+    for (d = 0; d < nd; ++d) {
+        jdp = jpp->desc + d;
+        fixed = -1;
+        if (unit_mpi && (0 == sdp_mitem_get_value(unit_mpi, cha_mp +
+                                                 (d * pgp->desc_len))))
+            fixed = (int)sdp_mitem_get_value(unit_mpi,
+                                             mp + (d * pgp->desc_len));
+        code = cdl_encode_times(pgp, jdp, d + 1, fixed, vals);
+        if (code < 0)
+            return SG_LIB_SYNTAX_ERROR;
+        cdl_set_fld(pgp, pgp->unit_acron, d, code, mp);
+        if (! pgp->t2) {
+            cdl_set_fld(pgp, pgp->lim_acron, d, vals[0], mp);
+            continue;
+        }
+        for (k = 0; k < CDL_NUM_T2_TIMES; ++k) {
+            cdl_set_fld(pgp, cdl_t2_time_acron[k], d, vals[k], mp);
+            cdl_set_fld(pgp, cdl_t2_pol_acron[k], d, jdp->pol[k], mp);
+        }
+    }
+    return 0;
+}
+
+/* Names each field of subpage pgp that FILE would change but the DEVICE
+ * doesn't allow to be changed. xp holds, for each byte of the subpage, the
+ * bits that differ from the current values and are not changeable.
+ * Returns the number of fields named. */
+static int
+cdl_pr_not_cha(const struct cdl_pg_t * pgp, const uint8_t * xp, int pg_len)
+{
+    int k, d, n, nd;
+    int num = 0;
+    const struct sdparm_mp_item_t * mpi;
+    const char * acron_arr[1 + (2 * CDL_NUM_T2_TIMES)];
+
+    n = 0;
+    acron_arr[n++] = pgp->unit_acron;
+    if (pgp->t2) {
+        for (k = 0; k < CDL_NUM_T2_TIMES; ++k) {
+            acron_arr[n++] = cdl_t2_time_acron[k];
+            acron_arr[n++] = cdl_t2_pol_acron[k];
+        }
+    } else
+        acron_arr[n++] = pgp->lim_acron;
+    if (MSP_SPC_CDLT2A == pgp->spn) {
+        mpi = cdl_find_mitem("PVCDG", pgp->spn);
+        if (mpi && sdp_mitem_get_value(mpi, xp)) {
+            pr2serr("  %s PVCDG is not changeable\n", pgp->key);
+            ++num;
+        }
+    }
+    nd = cdl_num_desc(pgp, pg_len);
+    for (d = 0; d < nd; ++d) {
+        for (k = 0; k < n; ++k) {
+            mpi = cdl_find_mitem(acron_arr[k], pgp->spn);
+            if ((NULL == mpi) ||
+                (0 == sdp_mitem_get_value(mpi, xp + (d * pgp->desc_len))))
+                continue;
+            pr2serr("  %s descriptor %d %s is not changeable\n", pgp->key,
+                    d + 1, acron_arr[k]);
+            ++num;
+        }
+    }
+    return num;
+}
+
+/* Applies each table in clp to the matching CDL subpage of the DEVICE.
+ * All given subpages are fetched, built and checked against the changeable
+ * mask before any is written. */
+static int
+cdl_apply(const struct sdparm_cdl_t * clp, struct sdparm_ctx_t * ctxp,
+          sgj_opaque_p jop)
+{
+    bool mode6;
+    int k, j, res, off, pg_len, cha_off, cha_len, hdr_len, num, num_bad;
+    int num_skip = 0;
+    uint8_t * mdp;
+    uint8_t * bp = NULL;
+    const struct cdl_pg_t * pgp;
+    const struct cdl_jpg_t * jpp;
+    struct sdparm_mp_change_t * mcp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    struct sdparm_mp_change_t mc_arr[CDL_NUM_PGS];
+    bool changed[CDL_NUM_PGS];
+    uint8_t cha[CDL_MS_BUFF_LEN];
+    uint8_t x[CDL_MS_BUFF_LEN];
+
+    mode6 = op->mode_6;
+    hdr_len = mode6 ? 4 : 8;
+    bp = (uint8_t *)calloc(CDL_NUM_PGS, 2 * CDL_MS_BUFF_LEN);
+    if (NULL == bp)
+        return sg_convert_errno(ENOMEM);
+    memset(mc_arr, 0, sizeof(mc_arr));
+    memset(changed, 0, sizeof(changed));
+    for (k = 0, num = 0, num_bad = 0, pgp = cdl_pg_arr; k < CDL_NUM_PGS;
+         ++k, ++pgp) {
+        jpp = clp->pgs + k;
+        if (! jpp->given)
+            continue;
+        mdp = bp + (num * 2 * CDL_MS_BUFF_LEN);
+        res = cdl_fetch(ctxp, 0, pgp, mdp, &off, &pg_len);
+        if (res) {
+            if (clp->preset) {      /* presets name what might be there */
+                if (op->verbose)
+                    pr2serr("%s not supported, skip\n", pgp->key);
+                ++num_skip;
+                continue;
+            }
+            pr2serr("%s [%s] %s not supported by DEVICE\n", pgp->name,
+                    pgp->key, mp_s);
+            res = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        res = cdl_fetch(ctxp, 1, pgp, cha, &cha_off, &cha_len);
+        if (res) {
+            pr2serr("unable to fetch changeable values of %s\n", pgp->key);
+            goto fini;
+        }
+        if (op->save && (! (mdp[off] & 0x80))) {
+            pr2serr("%s is not saveable but '--save' option given (try "
+                    "without it)\n", pgp->key);
+            res = SG_LIB_CAT_MALFORMED;
+            goto fini;
+        }
+        /* mode parameter list: header then the subpage, no block
+         * descriptors so those are left as they are */
+        if (off > hdr_len)
+            memmove(mdp + hdr_len, mdp + off, pg_len);
+        mdp[0] = 0;                 /* mode data length reserved */
+        if (mode6)
+            mdp[3] = 0;             /* block descriptor length */
+        else {
+            mdp[1] = 0;
+            mdp[4] &= 0xfe;         /* LONGLBA */
+            mdp[6] = 0;
+            mdp[7] = 0;
+        }
+        if (PDT_DISK == ctxp->pdt)      /* device specific parameter is */
+            mdp[mode6 ? 2 : 3] = 0;     /* reserved for mode select */
+        mdp[hdr_len] &= 0x7f;       /* PS bit reserved in mode select */
+        mcp = mc_arr + num;
+        mcp->pn = CONTROL_MP;
+        mcp->spn = pgp->spn;
+        mcp->off = hdr_len;
+        mcp->md_len = hdr_len + pg_len;
+        mcp->md = mdp;
+        mcp->orig = mdp + CDL_MS_BUFF_LEN;
+        memcpy(mcp->orig, mdp, mcp->md_len);
+        if (cha_len < pg_len)
+            memset(cha + cha_off + cha_len, 0, pg_len - cha_len);
+        res = cdl_build(pgp, jpp, cha + cha_off, mdp + hdr_len, pg_len);
+        if (res)
+            goto fini;
+        memset(x, 0, sizeof(x));
+        for (j = 4; j < pg_len; ++j)
+            x[j] = (mdp[hdr_len + j] ^ mcp->orig[hdr_len + j]) &
+                   ~cha[cha_off + j];
+        num_bad += cdl_pr_not_cha(pgp, x, pg_len);
+        changed[num] = !! memcmp(mcp->md + hdr_len, mcp->orig + hdr_len,
+                                 pg_len);
+        ++num;
+    }
+    if (num_bad > 0) {
+        pr2serr("%d field%s not changeable on this DEVICE, nothing "
+                "written\n", num_bad, (1 == num_bad) ? "" : "s");
+        res = SG_LIB_CAT_INVALID_PARAM;
+        goto fini;
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "command_duration_limits");
+        sgj_js_nv_s(jsp, jo2p, "table_file", clp->fn);
+        jap = sgj_named_subarray_r(jsp, jo2p, "subpages");
+    }
+    res = 0;
+    for (k = 0, mcp = mc_arr; k < num; ++k, ++mcp) {
+        const char * key = "";
+        const char * status;
+
+        for (j = 0; j < CDL_NUM_PGS; ++j) {
+            if (cdl_pg_arr[j].spn == mcp->spn)
+                key = cdl_pg_arr[j].key;
+        }
+        if (! changed[k])
+            status = "unchanged";
+        else {
+            /* one MODE SELECT per subpage: each is a complete table */
+            res = sdp_write_mpages(ctxp->sg_fd, ctxp->pdt, mcp, 1, op);
+            if (res) {
+                status = "failed";
+                if ((k > 0) && (0 == op->do_quiet))
+                    pr2serr("    prior CDL %ss were written\n", mp_s);
+            } else
+                status = op->dummy ? "would_write" : "written";
+        }
+        sgj_pr_hr(jsp, "%s: %s\n", key,
+                  (0 == strcmp(status, "would_write")) ? "would write" :
+                  status);
+        if (jap) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "subpage", key);
+            sgj_js_nv_ihex(jsp, jo2p, "subpage_code", mcp->spn);
+            sgj_js_nv_s(jsp, jo2p, "status", status);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+        if (res)
+            goto fini;
+    }
+    if ((0 == num) && (num_skip > 0)) {
+        pr2serr("DEVICE has none of the CDL %ss in preset %s\n", mp_s,
+                clp->fn);
+        res = SG_LIB_CAT_ILLEGAL_REQ;
+    }
+fini:
+    free(bp);
+    return res;
+}
+
+/* Shows (when clp was made without a FILE) or changes the CDL tables of
+ * the DEVICE open in ctxp. Returns 0 on success. */
+int
+sdp_cdl(const struct sdparm_cdl_t * clp, struct sdparm_ctx_t * ctxp,
+        sgj_opaque_p jop)
+{
+    if (NULL == clp->fn)
+        return cdl_show(ctxp, jop);
+    return cdl_apply(clp, ctxp, jop);
+}
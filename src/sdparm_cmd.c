@@ -31,6 +31,8 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <signal.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -38,9 +40,16 @@
 #include "config.h"
 #endif
 
+#ifndef SG_LIB_WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#endif
+
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
 #include "sg_cmds_mmc.h"
+#include "sg_pt.h"
 #include "sdparm.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
@@ -53,32 +62,25 @@
 #define RCAP_REPLY_LEN 8
 #define RCAP16_REPLY_LEN 32
 
-static uint8_t * aligned_buff;
-static uint8_t * free_aligned_buff;
-static int aligned_buff_sz;
+#define BLINK_DEF_SECS 30       /* as scripts/sas_disk_blink */
+#define BLINK_PERIOD_MS 1000    /* LED on for this, then off for this */
+#define BLINK_MS6_ALLOC 252
 
-static uint8_t * allocate_if_needed(void)
+/* Returns a zeroed, page sized and aligned buffer held by the context
+ * (freed by sdp_ctx_fini() ), or NULL if the heap allocation fails. */
+static uint8_t *
+allocate_if_needed(struct sdparm_ctx_t * ctxp)
 {
-    if (NULL == aligned_buff) {
-        aligned_buff = sg_memalign(0, 0, &free_aligned_buff, false);
-        if (NULL == aligned_buff) {
+    if (NULL == ctxp->cmd_b) {
+        ctxp->cmd_b = sg_memalign(0, 0, &ctxp->free_cmd_b, false);
+        if (NULL == ctxp->cmd_b) {
             pr2serr("Unable to allocate aligned_buff\n");
             return NULL;
         }
-        aligned_buff_sz = sg_get_page_size();
-    }
-    return aligned_buff;
-}
-
-static int
-deallocate_res(int res)
-{
-    if (free_aligned_buff) {
-        free(free_aligned_buff);
-        free_aligned_buff = NULL;
-        aligned_buff = NULL;
-    }
-    return res;
+        ctxp->cmd_b_sz = sg_get_page_size();
+    } else
+        memset(ctxp->cmd_b, 0, ctxp->cmd_b_sz);
+    return ctxp->cmd_b;
 }
 
 int
@@ -98,14 +100,14 @@ no_ascii_4hex(const struct sdparm_opt_coll * op)
 }
 
 static int
-do_cmd_read_capacity(int sg_fd, bool do_long, int verbose)
+do_cmd_read_capacity(int sg_fd, bool do_long, uint8_t * resp_buff,
+                     int verbose)
 {
     bool do16;
     int res;
     unsigned int last_blk_addr, block_size;
     uint64_t llast_blk_addr;
     double sz_mib;
-    uint8_t * resp_buff = aligned_buff;
 
     do16 = do_long;
     if (! do16) {
@@ -169,19 +171,19 @@ do_cmd_read_capacity(int sg_fd, bool do_long, int verbose)
 #define MAX_REQ_SENSE_SZ 64
 
 static int
-do_cmd_sense(int sg_fd, bool hex, int do_quiet, int verbose)
+do_cmd_sense(int sg_fd, bool hex, int do_quiet, uint8_t * buff, int buff_sz,
+             int verbose)
 {
     bool something;
     int res, resp_len, sk, asc, ascq, progress, pr, rem;
-    uint8_t * buff = aligned_buff;
     char b[128];
 
     res = sg_ll_request_sense(sg_fd, false /* DESC so fixed format */,
                               buff, MAX_REQ_SENSE_SZ, true, verbose);
     if (0 == res) {
         resp_len = buff[7] + 8;
-        if (resp_len > aligned_buff_sz)
-            resp_len = aligned_buff_sz;
+        if (resp_len > buff_sz)
+            resp_len = buff_sz;
         sk = (0xf & buff[2]);
         if (hex) {
             hex2stdout(buff, resp_len, 1);
@@ -235,7 +237,8 @@ do_cmd_sense(int sg_fd, bool hex, int do_quiet, int verbose)
 
 /* cmd_arg is kBytes/sec if given (i.e. 1000 bytes per second */
 static int
-do_cmd_speed(int sg_fd, int cmd_arg, const struct sdparm_opt_coll * op)
+do_cmd_speed(int sg_fd, int cmd_arg, uint8_t * aligned_buff,
+             const struct sdparm_opt_coll * op)
 {
     int res;
     unsigned int u;
@@ -380,10 +383,9 @@ decode_get_config(uint8_t * resp, int max_resp_len, int len)
 #define MAX_CONFIG_RESPLEN 2048
 
 static int
-do_cmd_profile(int sg_fd, const struct sdparm_opt_coll * op)
+do_cmd_profile(int sg_fd, uint8_t * resp, const struct sdparm_opt_coll * op)
 {
     int res, len;
-    uint8_t * resp = aligned_buff;
 
     /* performance (type=0), tolerance 10% nominal, read speed */
     res = sg_ll_get_config(sg_fd, 0x0 /* rt */, 0 /* starting_lba */,
@@ -395,6 +397,706 @@ do_cmd_profile(int sg_fd, const struct sdparm_opt_coll * op)
     return res;
 }
 
+#define PING_DEF_COUNT 100
+#define PING_MAX_COUNT 1000000
+#define PING_TIMEOUT_SECS 20
+
+static int
+ping_cmp(const void * a, const void * b)
+{
+    uint64_t ua = *(const uint64_t *)a;
+    uint64_t ub = *(const uint64_t *)b;
+
+    return (ua < ub) ? -1 : ((ua > ub) ? 1 : 0);
+}
+
+/* Sends count (def: 100) TEST UNIT READY commands back-to-back on one
+ * pass-through object, built once, then outputs the min, average, 99th
+ * percentile and max round trip times. The time the lower layers report
+ * (get_pt_duration_ns(), e.g. sg v4 driver with nanosecond durations) is
+ * preferred, otherwise the time around do_scsi_pt() is used. A TEST UNIT
+ * READY yielding a CHECK CONDITION (e.g. not ready) is still timed. */
+static int
+do_cmd_ping(int sg_fd, int count, const struct sdparm_opt_coll * op)
+{
+    bool wall = false;
+    int k, res, sense_cat;
+    int n = 0;
+    int n_cc = 0;
+    int ret = 0;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    uint64_t ns, sum;
+    uint64_t * lat_arr;
+    struct sg_pt_base * ptvp;
+    uint8_t tur_cdb[6] = {0, 0, 0, 0, 0, 0};
+    uint8_t sense_b[MAX_REQ_SENSE_SZ];
+#ifdef CLOCK_MONOTONIC
+    struct timespec t0, t1;
+#endif
+
+    if (count < 0)
+        count = PING_DEF_COUNT;
+    if ((count < 1) || (count > PING_MAX_COUNT)) {
+        pr2serr("ping COUNT expected to be from 1 to %d\n", PING_MAX_COUNT);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    lat_arr = (uint64_t *)calloc(count, sizeof(uint64_t));
+    if (NULL == lat_arr)
+        return sg_convert_errno(ENOMEM);
+    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+    if (NULL == ptvp) {
+        free(lat_arr);
+        return sg_convert_errno(ENOMEM);
+    }
+    set_scsi_pt_cdb(ptvp, tur_cdb, sizeof(tur_cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    for (k = 0; k < count; ++k) {
+        if (sdp_deadline_expired(op->ctxp)) {
+            ret = SG_LIB_CAT_TIMEOUT;
+            break;
+        }
+        partial_clear_scsi_pt_obj(ptvp);
+#ifdef CLOCK_MONOTONIC
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+#endif
+        res = do_scsi_pt(ptvp, -1, PING_TIMEOUT_SECS, vb);
+#ifdef CLOCK_MONOTONIC
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+#endif
+        res = sg_cmds_process_resp(ptvp, "test unit ready", res, false, vb,
+                                   &sense_cat);
+        if (-1 == res) {
+            if (get_scsi_pt_transport_err(ptvp))
+                ret = SG_LIB_TRANSPORT_ERROR;
+            else
+                ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+            pr2serr("ping: test unit ready failed after %d commands\n", n);
+            break;
+        } else if (-2 == res)
+            ++n_cc;
+        ns = get_pt_duration_ns(ptvp);
+#ifdef CLOCK_MONOTONIC
+        if (0 == ns) {
+            wall = true;
+            ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+                 (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+        }
+#endif
+        lat_arr[n++] = ns;
+    }
+    destruct_scsi_pt_obj(ptvp);
+    if (n > 0) {
+        qsort(lat_arr, n, sizeof(uint64_t), ping_cmp);
+        for (sum = 0, k = 0; k < n; ++k)
+            sum += lat_arr[k];
+        k = (n * 99 + 99) / 100;        /* nearest rank, 1 based */
+        printf("ping: %d TEST UNIT READY commands", n);
+        if (n_cc)
+            printf(", %d with CHECK CONDITION", n_cc);
+        printf("\n  latency in microseconds (%s): min=%.1f avg=%.1f "
+               "p99=%.1f max=%.1f\n", wall ? "wall clock" : "driver",
+               lat_arr[0] / 1000.0, (double)sum / n / 1000.0,
+               lat_arr[k - 1] / 1000.0, lat_arr[n - 1] / 1000.0);
+    }
+    free(lat_arr);
+    return ret;
+}
+
+#define LKB_DEF_COUNT 100
+#define LKB_MAX_COUNT 100000
+#define LKB_MAX_JOBS 64
+#define LKB_MAX_XFER (1024 * 1024)
+#define LKB_DESC_LEN 4
+#define LKB_TIMEOUT_SECS 20
+#define RWB_MODE_DATA 0x2
+#define RWB_MODE_DESC 0x3
+#define RWB_MODE_ECHO 0xa
+#define RWB_MODE_ECHO_DESC 0xb
+
+/* One job in one direction, shared with the child doing it */
+struct lkb_job_t {
+    int done;           /* commands completed */
+    int miscompares;    /* READ BUFFER data not as written */
+    uint64_t start_ns;  /* before the first command */
+    uint64_t end_ns;    /* after the last command, 0 -> did not start */
+};
+
+struct lkb_t {
+    bool cmp;           /* check the data READ BUFFER returns */
+    bool is_read;       /* direction of the jobs being run */
+    int sg_fd;          /* used by a single job, others open their own */
+    int mode;           /* RWB_MODE_ECHO or RWB_MODE_DATA */
+    int count;          /* commands per job in each direction */
+    int jobs;
+    int xfer_len;       /* bytes per command */
+    int region;         /* data buffer offset step between jobs, 0: shared */
+    int vb;
+    int map_sz;
+    const char * device_name;
+    const struct sdparm_ctx_t * ctxp;   /* for its deadline */
+    struct lkb_job_t * job_arr;     /* jobs writing, then jobs reading */
+    uint64_t * lat_arr; /* job_arr order, count nanoseconds each */
+};
+
+static uint64_t
+lkb_now_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)time(NULL) * 1000000000ULL;
+#endif
+}
+
+/* The pattern the j-th job writes, differs between jobs */
+static void
+lkb_fill(uint8_t * b, int len, int j)
+{
+    int k;
+
+    for (k = 0; k < len; ++k)
+        b[k] = (uint8_t)(0xa5 ^ k ^ (k >> 8) ^ (j << 4));
+}
+
+/* Work done by the j-th job in one direction (lkp->is_read): count WRITE
+ * BUFFER or count READ BUFFER commands, each timed. Called by
+ * sdp_sched_jobs() with arg pointing to the struct lkb_t . When there are
+ * several jobs each opens the DEVICE so it has its own file descriptor. */
+static int
+lkb_job(int j, void * arg)
+{
+    int k, res;
+    int ret = 0;
+    const struct lkb_t * lkp = (const struct lkb_t *)arg;
+    bool is_read = lkp->is_read;
+    int idx = (is_read ? lkp->jobs : 0) + j;
+    int off = j * lkp->region;
+    int sg_fd = lkp->sg_fd;
+    struct lkb_job_t * jp = lkp->job_arr + idx;
+    uint64_t * lap = lkp->lat_arr + ((uint64_t)idx * lkp->count);
+    uint64_t t0;
+    uint8_t * b;
+    uint8_t * free_b;
+    uint8_t * pat_b = NULL;
+
+    b = sg_memalign(lkp->xfer_len, 0, &free_b, false);
+    if (NULL == b)
+        return sg_convert_errno(ENOMEM);
+    if (lkp->jobs > 1) {
+        sg_fd = sg_cmds_open_device(lkp->device_name, false /* rw */,
+                                    lkp->vb);
+        if (sg_fd < 0) {
+            pr2serr("linkbench: job %d, open error: %s: %s\n", j,
+                    lkp->device_name, safe_strerror(-sg_fd));
+            ret = sg_convert_errno(-sg_fd);
+            sg_fd = -1;
+            goto fini;
+        }
+    }
+    lkb_fill(b, lkp->xfer_len, j);
+    if (is_read && lkp->cmp) {
+        pat_b = (uint8_t *)malloc(lkp->xfer_len);
+        if (NULL == pat_b) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        memcpy(pat_b, b, lkp->xfer_len);
+    }
+    jp->start_ns = lkb_now_ns();
+    for (k = 0; k < lkp->count; ++k) {
+        if (sdp_deadline_expired(lkp->ctxp)) {
+            ret = SG_LIB_CAT_TIMEOUT;
+            break;
+        }
+        t0 = lkb_now_ns();
+        if (is_read)
+            res = sg_ll_read_buffer(sg_fd, lkp->mode, 0, off, b,
+                                    lkp->xfer_len, true, lkp->vb);
+        else
+            res = sg_ll_write_buffer_v2(sg_fd, lkp->mode, 0, 0, off, b,
+                                        lkp->xfer_len, LKB_TIMEOUT_SECS,
+                                        true, lkp->vb);
+        lap[k] = lkb_now_ns() - t0;
+        if (res) {
+            ret = (res < 0) ? SG_LIB_CAT_OTHER : res;
+            pr2serr("linkbench: job %d, %s BUFFER failed after %d commands\n",
+                    j, (is_read ? "READ" : "WRITE"), k);
+            break;
+        }
+        ++jp->done;
+        if (pat_b && memcmp(b, pat_b, lkp->xfer_len))
+            ++jp->miscompares;
+    }
+    jp->end_ns = lkb_now_ns();
+fini:
+    free(pat_b);
+    if (free_b)
+        free(free_b);
+    if ((sg_fd >= 0) && (sg_fd != lkp->sg_fd))
+        sg_cmds_close_device(sg_fd);
+    return ret;
+}
+
+/* Runs the jobs of one direction, at once unless there is only one or on
+ * Windows. Returns the first error and, in *elapsed_nsp, the time from the
+ * first job starting its commands until the last job finished them; so
+ * starting the children is not counted. */
+static int
+lkb_run(struct lkb_t * lkp, bool is_read, uint64_t * elapsed_nsp)
+{
+    int j, ret;
+    uint64_t s = 0;
+    uint64_t e = 0;
+    const struct lkb_job_t * jp = lkp->job_arr + (is_read ? lkp->jobs : 0);
+
+    lkp->is_read = is_read;
+    ret = sdp_sched_jobs(lkp->jobs, lkb_job, lkp);
+    for (j = 0; j < lkp->jobs; ++j, ++jp) {
+        if (0 == jp->end_ns)
+            continue;
+        if ((0 == s) || (jp->start_ns < s))
+            s = jp->start_ns;
+        if (jp->end_ns > e)
+            e = jp->end_ns;
+    }
+    *elapsed_nsp = e - s;
+    return ret;
+}
+
+/* Outputs the throughput and latencies of one direction. Returns the
+ * number of miscompares. */
+static int
+lkb_report(const struct lkb_t * lkp, bool is_read, uint64_t elapsed_ns)
+{
+    int j, k, n;
+    int n_mis = 0;
+    int idx = is_read ? lkp->jobs : 0;
+    uint64_t sum;
+    uint64_t * a;
+    const struct lkb_job_t * jp;
+
+    a = (uint64_t *)calloc((uint64_t)lkp->jobs * lkp->count,
+                           sizeof(uint64_t));
+    if (NULL == a)
+        return 0;
+    for (n = 0, j = 0; j < lkp->jobs; ++j) {
+        jp = lkp->job_arr + idx + j;
+        memcpy(a + n, lkp->lat_arr + ((uint64_t)(idx + j) * lkp->count),
+               jp->done * sizeof(uint64_t));
+        n += jp->done;
+        n_mis += jp->miscompares;
+    }
+    printf("  %s BUFFER: %d commands", (is_read ? "READ" : "WRITE"), n);
+    if ((n > 0) && (elapsed_ns > 0)) {
+        printf(", %.1f MB/s\n", ((double)n * lkp->xfer_len * 1000.0) /
+                                (double)elapsed_ns);
+        qsort(a, n, sizeof(uint64_t), ping_cmp);
+        for (sum = 0, k = 0; k < n; ++k)
+            sum += a[k];
+        k = (n * 99 + 99) / 100;        /* nearest rank, 1 based */
+        printf("    latency in microseconds: min=%.1f avg=%.1f p99=%.1f "
+               "max=%.1f\n", a[0] / 1000.0, (double)sum / n / 1000.0,
+               a[k - 1] / 1000.0, a[n - 1] / 1000.0);
+    } else
+        printf("\n");
+    free(a);
+    return n_mis;
+}
+
+/* Measures the bandwidth and latency of the path to the DEVICE (i.e. the
+ * transport, HBA and OS drivers) with WRITE BUFFER then READ BUFFER
+ * commands that don't touch the medium. The echo buffer is used if the
+ * DEVICE has one (its size is fetched with the echo buffer descriptor
+ * mode), otherwise the data buffer (buffer id 0). Each of op->qdepth
+ * jobs (default 1) sends count (default 100) commands in each direction,
+ * the jobs at once. With op->do_verify the data READ BUFFER returns is
+ * compared with that written, unless the jobs share the buffer. */
+static int
+do_cmd_linkbench(int sg_fd, int count, const struct sdparm_opt_coll * op)
+{
+    bool shared;
+    int res, bnd, cap, n_mis;
+    int ret = 0;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    uint64_t w_ns = 0;
+    uint64_t r_ns = 0;
+    struct lkb_t lk;
+    uint8_t d[LKB_DESC_LEN];
+
+    if (count < 0)
+        count = LKB_DEF_COUNT;
+    if ((count < 1) || (count > LKB_MAX_COUNT)) {
+        pr2serr("linkbench COUNT expected to be from 1 to %d\n",
+                LKB_MAX_COUNT);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(&lk, 0, sizeof(lk));
+    lk.sg_fd = sg_fd;
+    lk.device_name = op->ctxp->device_name;
+    lk.ctxp = op->ctxp;
+    lk.count = count;
+    lk.vb = vb;
+    lk.jobs = (op->qdepth > 0) ? op->qdepth : 1;
+    if (lk.jobs > LKB_MAX_JOBS) {
+        pr2serr("linkbench: jobs reduced from %d to %d\n", lk.jobs,
+                LKB_MAX_JOBS);
+        lk.jobs = LKB_MAX_JOBS;
+    }
+    memset(d, 0, sizeof(d));
+    res = sg_ll_read_buffer(sg_fd, RWB_MODE_ECHO_DESC, 0, 0, d, sizeof(d),
+                            false, vb);
+    cap = res ? 0 : (sg_get_unaligned_be16(d + 2) & 0x1fff);
+    if (cap > 0) {
+        lk.mode = RWB_MODE_ECHO;
+        if (op->verbose)
+            pr2serr("echo buffer: %d bytes, EBOS=%d\n", cap, d[0] & 0x1);
+        shared = true;          /* one echo buffer per I_T nexus */
+        lk.xfer_len = cap;
+    } else {
+        memset(d, 0, sizeof(d));
+        res = sg_ll_read_buffer(sg_fd, RWB_MODE_DESC, 0, 0, d, sizeof(d),
+                                false, vb);
+        cap = res ? 0 : (int)sg_get_unaligned_be24(d + 1);
+        if (cap <= 0) {
+            pr2serr("linkbench: neither an echo buffer nor a data buffer "
+                    "found\n");
+            return SG_LIB_CAT_INVALID_OP;
+        }
+        lk.mode = RWB_MODE_DATA;
+        bnd = d[0];
+        if (op->verbose)
+            pr2serr("data buffer: %d bytes, offset boundary 0x%x\n", cap,
+                    bnd);
+        /* give each job its own part of the data buffer if offsets can be
+         * used (0xff -> only 0) */
+        shared = true;
+        if ((lk.jobs > 1) && (bnd < 24)) {
+            lk.region = (cap / lk.jobs) & ~((1 << bnd) - 1);
+            if (lk.region > 0)
+                shared = false;
+        }
+        lk.xfer_len = shared ? cap : lk.region;
+        if (lk.xfer_len > LKB_MAX_XFER)
+            lk.xfer_len = LKB_MAX_XFER;
+    }
+    lk.cmp = op->do_verify;
+    if (lk.cmp && shared && (lk.jobs > 1)) {
+        pr2serr("linkbench: data not compared as the %d jobs share the "
+                "%s buffer\n", lk.jobs,
+                (RWB_MODE_ECHO == lk.mode) ? "echo" : "data");
+        lk.cmp = false;
+    }
+    printf("linkbench: %s buffer, %d job%s, %d commands of %d bytes each "
+           "per job and direction%s\n",
+           (RWB_MODE_ECHO == lk.mode) ? "echo" : "data", lk.jobs,
+           (lk.jobs > 1) ? "s" : "", count, lk.xfer_len,
+           op->dummy ? " (not sent)" : "");
+    if (op->dummy)
+        return 0;
+
+    lk.map_sz = 2 * lk.jobs * (sizeof(struct lkb_job_t) +
+                               (count * sizeof(uint64_t)));
+    lk.job_arr = (struct lkb_job_t *)sdp_shm_alloc(lk.map_sz);
+    if (NULL == lk.job_arr) {
+        res = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    /* lkb_job_t holds uint64_t members so the latencies that follow are
+     * aligned */
+    lk.lat_arr = (uint64_t *)(lk.job_arr + (2 * lk.jobs));
+
+    ret = lkb_run(&lk, false, &w_ns);
+    lkb_report(&lk, false, w_ns);
+    if (0 == ret) {     /* the READ BUFFERs need the data written first */
+        ret = lkb_run(&lk, true, &r_ns);
+        n_mis = lkb_report(&lk, true, r_ns);
+        if (lk.cmp) {
+            if (n_mis)
+                printf("  READ BUFFER data: %d miscompared\n", n_mis);
+            else
+                printf("  READ BUFFER data: as written\n");
+            if (n_mis && (0 == ret))
+                ret = SG_LIB_CAT_MISCOMPARE;
+        }
+    }
+    sdp_shm_free(lk.job_arr, lk.map_sz);
+    return ret;
+}
+
+#define PF_MS_BUFF_LEN 252
+#define PF_MAX_RANGES (1 << 20)
+
+struct pf_range_t {
+    uint64_t lba;
+    uint64_t num;
+};
+
+/* Parses the len characters at sp as one number: decimal, or hex when
+ * prefixed by "0x" or suffixed by "h". The field is copied so that
+ * sg_get_llnum_nomult() sees it alone (it looks at the last character for
+ * the "h" suffix). Any other character makes it fail. Returns -1 if not
+ * understood, else the number. */
+static int64_t
+pf_get_num(const char * sp, int len)
+{
+    bool hex = false;
+    int k, first, last;
+    char b[32];
+
+    if ((len < 1) || (len >= (int)sizeof(b)))
+        return -1;
+    memcpy(b, sp, len);
+    b[len] = '\0';
+    first = 0;
+    last = len;
+    if ((len > 2) && ('0' == b[0]) && ('x' == tolower((uint8_t)b[1]))) {
+        hex = true;
+        first = 2;
+    } else if ((len > 1) && ('h' == tolower((uint8_t)b[len - 1]))) {
+        hex = true;
+        last = len - 1;
+    }
+    for (k = first; k < last; ++k) {
+        if (! (hex ? isxdigit((uint8_t)b[k]) : isdigit((uint8_t)b[k])))
+            return -1;
+    }
+    return sg_get_llnum_nomult(b);
+}
+
+/* Reads "LBA,NUM" (or "LBA NUM") lines, '#' starts a comment, from fn into
+ * a heap array placed in *arrp, its number of elements in *nump. Numbers
+ * are decimal unless prefixed by "0x" (or suffixed by "h"). Anything else
+ * on a line is an error. Returns 0 on success. */
+static int
+pf_read_ranges(const char * fn, struct pf_range_t ** arrp, int * nump)
+{
+    int n, nn, err, k;
+    int num = 0;
+    int mx = 0;
+    int ret = 0;
+    int64_t lba, ll;
+    char * cp;
+    char * np;
+    FILE * fp;
+    struct pf_range_t * arr = NULL;
+    struct pf_range_t * t;
+    static const char * sep_s = " \t,\r\n";
+    char line[256];
+
+    fp = fopen(fn, "r");
+    if (NULL == fp) {
+        err = errno;
+        pr2serr("prefetch: unable to open %s: %s\n", fn, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    for (k = 1; fgets(line, sizeof(line), fp); ++k) {
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        cp = line + strspn(line, " \t\r\n");
+        n = strcspn(cp, sep_s);
+        if (0 == n)
+            continue;           /* blank line or comment */
+        np = cp + n;
+        np += strspn(np, " \t");
+        if (',' == *np) {
+            ++np;
+            np += strspn(np, " \t");
+        }
+        nn = strcspn(np, sep_s);
+        if ((num >= PF_MAX_RANGES) || ((lba = pf_get_num(cp, n)) < 0) ||
+            ((ll = pf_get_num(np, nn)) <= 0) ||
+            (np[nn + strspn(np + nn, " \t\r\n")])) {
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        if (num >= mx) {
+            mx = mx ? (2 * mx) : 64;
+            t = (struct pf_range_t *)realloc(arr, mx * sizeof(*arr));
+            if (NULL == t) {
+                ret = sg_convert_errno(ENOMEM);
+                break;
+            }
+            arr = t;
+        }
+        arr[num].lba = (uint64_t)lba;
+        arr[num++].num = (uint64_t)ll;
+    }
+    fclose(fp);
+    if (SG_LIB_SYNTAX_ERROR == ret)
+        pr2serr("prefetch: %s line %d: expected 'LBA,NUM' (NUM > 0)\n", fn,
+                k);
+    if (ret) {
+        free(arr);
+        return ret;
+    }
+    *arrp = arr;
+    *nump = num;
+    return 0;
+}
+
+/* Places the size of the read cache, in logical blocks of lbs bytes, in
+ * *cache_blksp from the number of cache segments and cache segment size
+ * (LBCSS set: in logical blocks, else bytes) of the Caching mode page; 0 if
+ * not reported. Fails if the read cache is disabled (RCD=1), unless
+ * --flexible is given. */
+static int
+pf_cache_size(struct sdparm_ctx_t * ctxp, uint32_t lbs,
+              uint64_t * cache_blksp)
+{
+    int res, len, n, off;
+    int resid = 0;
+    uint64_t css;
+    const struct sdparm_opt_coll * op = &ctxp->opts;
+    const uint8_t * bp;
+    uint8_t b[PF_MS_BUFF_LEN];
+    char e[128];
+
+    *cache_blksp = 0;
+    res = sdp_ctx_mode_sense_pc(ctxp, 0 /* current */, CACHING_MP, 0, b,
+                                PF_MS_BUFF_LEN, &resid);
+    if (res) {
+        if (op->verbose)
+            pr2serr("prefetch: Caching mode page not available\n");
+        return 0;               /* rely on CONDITION MET */
+    }
+    len = PF_MS_BUFF_LEN - resid;
+    n = sg_msense_calc_length(b, len, op->mode_6, NULL);
+    if ((n > 0) && (n < len))
+        len = n;
+    off = sg_mode_page_offset(b, len, op->mode_6, e, sizeof(e));
+    if ((off < 0) || ((off + 16) > len) || (CACHING_MP != (b[off] & 0x3f)))
+        return 0;
+    bp = b + off;
+    if ((bp[2] & 0x1) && (! op->flexible)) {
+        pr2serr("prefetch: read cache disabled (RCD=1), nothing to warm; "
+                "use '--flexible'\nto override\n");
+        return SG_LIB_CONTRADICT;
+    }
+    css = sg_get_unaligned_be16(bp + 14);
+    *cache_blksp = (uint64_t)bp[13] * css;
+    if (0 == (bp[12] & 0x40))           /* LBCSS clear: css in bytes */
+        *cache_blksp /= lbs;
+    return 0;
+}
+
+/* Warms the cache of the DEVICE with the LBA ranges in the file named after
+ * "prefetch=". Sends a PRE-FETCH(16) with IMMED for each range (split into
+ * pieces that fit the 32 bit NUMBER OF LOGICAL BLOCKS field) in file
+ * order so the most important ranges should come first. CONDITION MET
+ * means the blocks will fit in the cache; GOOD means they won't, so no
+ * more are sent since they would only evict earlier ones. Also stops
+ * before the total exceeds the cache size from the Caching mode page. */
+static int
+do_cmd_prefetch(struct sdparm_ctx_t * ctxp, const struct sdparm_opt_coll * op)
+{
+    bool full = false;
+    int k, res;
+    int num_r = 0;
+    int n_cmds = 0;
+    int n_met = 0;
+    int ret = 0;
+    uint32_t lbs, n;
+    uint64_t nblks, lba, left, cache_blks;
+    uint64_t total = 0;
+    uint64_t issued = 0;
+    const int sg_fd = ctxp->sg_fd;
+    const int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    const char * fn;
+    struct pf_range_t * r_arr = NULL;
+    struct pf_range_t * rp;
+    uint8_t b[RCAP16_REPLY_LEN];
+
+    fn = strchr(op->cmd_str, '=');
+    if ((NULL == fn) || ('\0' == fn[1])) {
+        pr2serr("prefetch needs a file of LBA ranges: "
+                "'--command=prefetch=FILE'\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    ++fn;
+    res = sg_ll_readcap_16(sg_fd, false, 0, b, RCAP16_REPLY_LEN, true, vb);
+    if (res)
+        return res;
+    nblks = sg_get_unaligned_be64(b + 0) + 1;
+    lbs = sg_get_unaligned_be32(b + 8);
+    if (0 == lbs)
+        return SG_LIB_CAT_MALFORMED;
+    res = pf_read_ranges(fn, &r_arr, &num_r);
+    if (res)
+        return res;
+    for (k = 0, rp = r_arr; k < num_r; ++k, ++rp) {
+        if ((rp->lba >= nblks) || (rp->num > (nblks - rp->lba))) {
+            pr2serr("prefetch: range %d (LBA 0x%" PRIx64 ", %" PRIu64
+                    " blocks) exceeds capacity\n", k + 1, rp->lba, rp->num);
+            ret = SG_LIB_LBA_OUT_OF_RANGE;
+            goto fini;
+        }
+        total += rp->num;
+    }
+    ret = pf_cache_size(ctxp, lbs, &cache_blks);
+    if (ret)
+        goto fini;
+    printf("prefetch: %d ranges, %" PRIu64 " blocks from %s\n", num_r,
+           total, fn);
+    if (cache_blks)
+        printf("  cache size: %" PRIu64 " blocks (from Caching mode page)\n",
+               cache_blks);
+    for (k = 0, rp = r_arr; (k < num_r) && (! full); ++k, ++rp) {
+        for (lba = rp->lba, left = rp->num; left > 0; lba += n, left -= n) {
+            n = (left > UINT32_MAX) ? UINT32_MAX : (uint32_t)left;
+            if (cache_blks && ((issued + n) > cache_blks)) {
+                full = true;
+                if (issued >= cache_blks)
+                    break;
+                n = (uint32_t)(cache_blks - issued);
+            }
+            if (sdp_deadline_expired(op->ctxp)) {
+                ret = SG_LIB_CAT_TIMEOUT;
+                goto fini;
+            }
+            if (op->dummy) {
+                printf("    would PRE-FETCH LBA 0x%" PRIx64 ", %u blocks\n",
+                       lba, n);
+                res = SG_LIB_CAT_CONDITION_MET;
+            } else
+                res = sg_ll_pre_fetch_x(sg_fd, false, true /* cdb16 */,
+                                        true /* immed */, lba, n, 0, 0,
+                                        vb > 0, vb);
+            ++n_cmds;
+            if (SG_LIB_CAT_CONDITION_MET == res) {
+                ++n_met;
+                issued += n;
+            } else if (0 == res) {      /* GOOD: won't all fit in cache */
+                issued += n;
+                full = true;
+                if (op->verbose)
+                    pr2serr("prefetch: GOOD status at LBA 0x%" PRIx64
+                            ", cache is full\n", lba);
+            } else {
+                pr2serr("prefetch: PRE-FETCH(16) at LBA 0x%" PRIx64
+                        " failed\n", lba);
+                ret = (res < 0) ? SG_LIB_CAT_OTHER : res;
+                goto fini;
+            }
+            if (full)
+                break;
+        }
+    }
+    printf("  %d PRE-FETCH(16) commands %sfor %" PRIu64 " blocks, %d with "
+           "CONDITION MET\n", n_cmds, (op->dummy ? "(not sent) " : ""),
+           issued, n_met);
+    if (issued < total)
+        printf("  stopped at range %d, cache full: %" PRIu64 " blocks not "
+               "prefetched\n", k, total - issued);
+fini:
+    free(r_arr);
+    return ret;
+}
+
 const struct sdparm_command_t *
 sdp_build_cmd(const char * cmd_str, bool * rwp, int * argp)
 {
@@ -412,7 +1114,10 @@ sdp_build_cmd(const char * cmd_str, bool * rwp, int * argp)
             return NULL;
         strncpy(cbuff, cmd_str, len);
         cbuff[len] = '\0';
-        if (1 != sscanf(eq_cp + 1, "%d", &arg))
+        /* prefetch takes a file name, checked in do_cmd_prefetch() */
+        if ((1 != sscanf(eq_cp + 1, "%d", &arg)) &&
+            (! sdp_strcase_eq("prefetch", cbuff)) &&
+            (! sdp_strcase_eq("pf", cbuff)))
             return NULL;
         cp = cbuff;
     } else
@@ -433,6 +1138,8 @@ sdp_build_cmd(const char * cmd_str, bool * rwp, int * argp)
     if (scmdp->cmd_name) {
         if (rwp) {
             if ((CMD_READY  == scmdp->cmd_num) ||
+                (CMD_PING  == scmdp->cmd_num) ||
+                (CMD_PREFETCH  == scmdp->cmd_num) ||
                 (CMD_SENSE  == scmdp->cmd_num) ||
                 (CMD_CAPACITY  == scmdp->cmd_num))
                 *rwp = false;
@@ -464,21 +1171,28 @@ sdp_process_cmd(int sg_fd, const struct sdparm_command_t * scmdp, int cmd_arg,
                 int pdt, const struct sdparm_opt_coll * op)
 {
     int res, progress;
+    struct sdparm_ctx_t * ctxp = op->ctxp;
+    uint8_t * bp;
 
     if (! (op->flexible ||
           (CMD_READY == scmdp->cmd_num) ||
+          (CMD_PING == scmdp->cmd_num) ||
+          (CMD_LINKBENCH == scmdp->cmd_num) ||
           (CMD_SENSE == scmdp->cmd_num) ||
           (0 == pdt) || (5 == pdt)) ) {
         pr2serr("this command only valid on a disk or cd/dvd; use "
                 "'--flexible' to override\n");
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (NULL == allocate_if_needed())
+    if (sdp_deadline_expired(op->ctxp))
+        return SG_LIB_CAT_TIMEOUT;
+    bp = allocate_if_needed(ctxp);
+    if (NULL == bp)
         return sg_convert_errno(ENOMEM);
     switch (scmdp->cmd_num)
     {
     case CMD_CAPACITY:
-        res = do_cmd_read_capacity(sg_fd, op->do_long, op->verbose);
+        res = do_cmd_read_capacity(sg_fd, op->do_long, bp, op->verbose);
         break;
     case CMD_EJECT:
         res = sg_ll_start_stop_unit(sg_fd, false /* immed */, 0 /* fl_num */,
@@ -486,12 +1200,21 @@ sdp_process_cmd(int sg_fd, const struct sdparm_command_t * scmdp, int cmd_arg,
                                     true /*loej */, false /* start */,
                                     true /* noisy */, op->verbose);
         break;
+    case CMD_LINKBENCH:
+        res = do_cmd_linkbench(sg_fd, cmd_arg, op);
+        break;
     case CMD_LOAD:
         res = sg_ll_start_stop_unit(sg_fd, false, 0, 0, false, true, true,
                                     true, op->verbose);
         break;
+    case CMD_PING:
+        res = do_cmd_ping(sg_fd, cmd_arg, op);
+        break;
+    case CMD_PREFETCH:
+        res = do_cmd_prefetch(ctxp, op);
+        break;
     case CMD_PROFILE:
-        res = do_cmd_profile(sg_fd, op);
+        res = do_cmd_profile(sg_fd, bp, op);
         break;
     case CMD_READY:
         progress = -1;
@@ -508,11 +1231,11 @@ sdp_process_cmd(int sg_fd, const struct sdparm_command_t * scmdp, int cmd_arg,
         }
         break;
     case CMD_SENSE:
-        res = do_cmd_sense(sg_fd, (op->do_hex > 0), op->do_quiet,
-                           op->verbose);
+        res = do_cmd_sense(sg_fd, (op->do_hex > 0), op->do_quiet, bp,
+                           ctxp->cmd_b_sz, op->verbose);
         break;
     case CMD_SPEED:
-        res = do_cmd_speed(sg_fd, cmd_arg, op);
+        res = do_cmd_speed(sg_fd, cmd_arg, bp, op);
         break;
     case CMD_START:
         res = sg_ll_start_stop_unit(sg_fd, false, 0, 0, false, false, true,
@@ -533,5 +1256,269 @@ sdp_process_cmd(int sg_fd, const struct sdparm_command_t * scmdp, int cmd_arg,
         pr2serr("unknown cmd number [%d]\n", scmdp->cmd_num);
         res = SG_LIB_SYNTAX_ERROR;
     }
-    return deallocate_res(res);
+    return res;
+}
+
+#ifndef SG_LIB_WIN32
+
+/* A DEVICE being blinked. The two MODE SELECT parameter lists, one with
+ * RLM set and the other with it clear, are built once from a single MODE
+ * SENSE of the Protocol specific port mode page. */
+struct blink_dev_t {
+    const char * name;
+    int sg_fd;
+    int md_len;
+    bool orig_on;       /* RLM when we started, put back when finished */
+    bool is_on;         /* RLM as last written */
+    bool failed;        /* stop sending to this DEVICE */
+    uint8_t * md_on;
+    uint8_t * md_off;   /* md_len bytes after md_on */
+};
+
+static volatile sig_atomic_t blink_stop;
+
+static void
+blink_sig_handler(int sig)
+{
+    if (sig) { }        /* suppress warning */
+    blink_stop = 1;
+}
+
+/* Opens DEVICE dp and builds its MODE SELECT parameter lists in which
+ * only RLM (ready LED meaning) differs. b is a work buffer of at least
+ * MAX_MODE_DATA_LEN bytes. */
+static int
+blink_prepare(struct blink_dev_t * dp, const struct sdparm_mp_item_t * rlmp,
+              uint8_t * b, const struct sdparm_opt_coll * op)
+{
+    bool mode6 = op->mode_6;
+    int res, alloc_len, len, md_len, off, pdt;
+    int resid = 0;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct sg_simple_inquiry_resp sir;
+    char ebuff[128];
+
+    dp->sg_fd = sg_cmds_open_device(dp->name, false /* rw */, vb);
+    if (dp->sg_fd < 0) {
+        pr2serr("open error: %s [read/write]: %s\n", dp->name,
+                safe_strerror(-dp->sg_fd));
+        return sg_convert_errno(-dp->sg_fd);
+    }
+    res = sg_simple_inquiry(dp->sg_fd, &sir, false, vb);
+    if (res) {
+        pr2serr("SCSI INQUIRY command failed on %s\n", dp->name);
+        return (res > 0) ? res : SG_LIB_CAT_OTHER;
+    }
+    pdt = sir.peripheral_type;
+    alloc_len = mode6 ? BLINK_MS6_ALLOC : MAX_MODE_DATA_LEN;
+    res = sdp_mode_sense_cur(dp->sg_fd, PROT_SPEC_PORT_MP, 0, b, alloc_len,
+                             &resid, op);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(ebuff), ebuff, op->verbose);
+        pr2serr("%s: fetching protocol specific port mode page failed: "
+                "%s\n", dp->name, ebuff);
+        return res;
+    }
+    len = alloc_len - resid;
+    md_len = sg_msense_calc_length(b, len, mode6, NULL);
+    if (md_len > len)
+        md_len = len;
+    off = sg_mode_page_offset(b, md_len, mode6, ebuff, sizeof(ebuff));
+    if (off < 0) {
+        pr2serr("%s: %s\n", dp->name, ebuff);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    if ((PROT_SPEC_PORT_MP != (b[off] & 0x3f)) || (b[off] & 0x40) ||
+        ((off + rlmp->start_byte) >= md_len)) {
+        pr2serr("%s: unexpected protocol specific port mode page\n",
+                dp->name);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    if ((TPROTO_SAS != (b[off + 2] & 0xf)) && (! op->flexible)) {
+        pr2serr("%s: not a SAS device (protocol identifier: 0x%x), RLM "
+                "is a SAS field;\nuse '--flexible' to override\n",
+                dp->name, b[off + 2] & 0xf);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    len = b[off + 1] + 2;
+    if ((off + len) < md_len)
+        md_len = off + len;     /* ignore anything after the page */
+    b[0] = 0;           /* mode data length reserved for mode select */
+    if (! mode6)
+        b[1] = 0;
+    if ((PDT_DISK == pdt) || (PDT_WO == pdt) || (PDT_OPTICAL == pdt))
+        b[mode6 ? 2 : 3] = 0;   /* disk device specific parameter */
+    b[off] &= 0x7f;     /* PS bit is reserved in mode select */
+    dp->md_on = (uint8_t *)malloc(2 * md_len);
+    if (NULL == dp->md_on)
+        return sg_convert_errno(ENOMEM);
+    dp->md_off = dp->md_on + md_len;
+    dp->md_len = md_len;
+    dp->orig_on = !! sdp_mitem_get_value(rlmp, b + off);
+    dp->is_on = dp->orig_on;
+    memcpy(dp->md_on, b, md_len);
+    memcpy(dp->md_off, b, md_len);
+    sdp_mitem_set_value(1, rlmp, dp->md_on + off);
+    sdp_mitem_set_value(0, rlmp, dp->md_off + off);
+    return 0;
 }
+
+/* Sets RLM of DEVICE dp with a single MODE SELECT (never saved) */
+static int
+blink_set(struct blink_dev_t * dp, bool on, const struct sdparm_opt_coll * op)
+{
+    int res;
+    uint8_t * md = on ? dp->md_on : dp->md_off;
+
+    if (op->mode_6)
+        res = sg_ll_mode_select6_v2(dp->sg_fd, true /* PF */, false, false,
+                                    md, dp->md_len, true, op->verbose);
+    else
+        res = sg_ll_mode_select10_v2(dp->sg_fd, true /* PF */, false, false,
+                                     md, dp->md_len, true, op->verbose);
+    if (res) {
+        char b[80];
+
+        sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+        pr2serr("%s: setting RLM failed: %s\n", dp->name, b);
+        dp->failed = true;
+    } else
+        dp->is_on = on;
+    return res;
+}
+
+/* Implements '--command=blink[=SECS]' for all DEVICEs at once. Each is
+ * opened and its Protocol specific port mode page fetched once, then only
+ * the RLM (ready LED meaning) field is flipped every second, in step on
+ * all DEVICEs, for SECS seconds (def: 30). Then each RLM is put back as
+ * it was, also when interrupted (e.g. control-C). As scripts/sas_disk_blink
+ * a SECS of 0 clears RLM and 1 sets it, without blinking. */
+int
+sdp_blink(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+          int secs)
+{
+    int k, n, res;
+    int from = 0;
+    int ret = 0;
+    const int num = ctxp->opts.num_devices;
+    struct blink_dev_t * dev_arr;
+    struct blink_dev_t * dp;
+    const struct sdparm_mp_item_t * rlmp;
+    const struct sdparm_opt_coll * op = &ctxp->opts;
+    uint8_t * b = NULL;
+    uint8_t * free_b = NULL;
+    struct sigaction sa, old_int, old_term, old_hup;
+    struct timespec next;
+
+    if (secs < 0)
+        secs = BLINK_DEF_SECS;
+    rlmp = sdp_find_mitem_by_acron("RLM", &from, TPROTO_SAS, -1);
+    if (NULL == rlmp) {
+        pr2serr("%s: RLM field not found\n", __func__);
+        return SG_LIB_CAT_OTHER;
+    }
+    dev_arr = (struct blink_dev_t *)calloc(num, sizeof(*dev_arr));
+    if (NULL == dev_arr)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0; k < num; ++k)
+        dev_arr[k].sg_fd = -1;
+    b = sg_memalign(MAX_MODE_DATA_LEN, 0, &free_b, false);
+    if (NULL == b) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        dp->name = device_name_arr[k];
+        ret = blink_prepare(dp, rlmp, b, op);
+        if (ret)
+            goto fini;
+        if (op->dummy) {
+            pr2serr("%s: RLM=%d, mode data that would be written to "
+                    "blink:\n", dp->name, (int)dp->orig_on);
+            hex2stderr(dp->md_on, dp->md_len, 1);
+            hex2stderr(dp->md_off, dp->md_len, 1);
+        }
+    }
+    if (op->dummy)
+        goto fini;
+    if (secs < 2) {     /* set or clear RLM, leave it that way */
+        for (k = 0; k < num; ++k) {
+            res = blink_set(dev_arr + k, (1 == secs), op);
+            if (res && (0 == ret))
+                ret = res;
+        }
+        goto fini;
+    }
+
+    blink_stop = 0;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = blink_sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    sigaction(SIGHUP, &sa, &old_hup);
+    if (0 == op->do_quiet)
+        printf("start blinking %d DEVICE%s for %d seconds\n", num,
+               (1 == num) ? "" : "s", secs);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; (n < secs) && (! blink_stop); ++n) {
+        for (k = 0; (k < num) && (! blink_stop); ++k) {
+            dp = dev_arr + k;
+            if (dp->failed)
+                continue;
+            /* each DEVICE toggles from its own starting state */
+            res = blink_set(dp, (0 == (n & 1)) ? (! dp->orig_on) :
+                                                 dp->orig_on, op);
+            if (res && (0 == ret))
+                ret = res;
+        }
+        next.tv_sec += BLINK_PERIOD_MS / 1000;
+        next.tv_nsec += (long)(BLINK_PERIOD_MS % 1000) * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            ++next.tv_sec;
+            next.tv_nsec -= 1000000000L;
+        }
+        while ((! blink_stop) &&
+               (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                         &next, NULL)))
+            ;
+    }
+    for (k = 0; k < num; ++k) {     /* put back RLM as it was */
+        dp = dev_arr + k;
+        if (dp->is_on != dp->orig_on) {
+            res = blink_set(dp, dp->orig_on, op);
+            if (res && (0 == ret))
+                ret = res;
+        }
+    }
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGHUP, &old_hup, NULL);
+    if (0 == op->do_quiet)
+        printf("stop blinking%s\n", blink_stop ? " (interrupted)" : "");
+fini:
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+        free(dp->md_on);
+    }
+    free(dev_arr);
+    if (free_b)
+        free(free_b);
+    return ret;
+}
+
+#else   /* SG_LIB_WIN32 */
+
+int
+sdp_blink(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+          int secs)
+{
+    if (ctxp && device_name_arr && secs) { }    /* suppress warning */
+    pr2serr("'--command=blink' is not supported on Windows\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+#endif  /* SG_LIB_WIN32 */
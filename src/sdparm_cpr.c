@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SG_LIB_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_cpr.c : '--cpr[=dm]' turns the Concurrent positioning ranges VPD
+ * page [0xb9] of a multi-actuator disk into something that can be used to
+ * place data per actuator. Without an argument each DEVICE's map of
+ * actuator (LBA range) to LBAs is shown, together with the same ranges in
+ * 512 byte sectors as used by Linux. On Linux those are checked against
+ * /sys/block/<bdev>/queue/independent_access_ranges, which the kernel
+ * builds from that VPD page. With '--cpr=dm' a dmsetup "concise" line that
+ * creates a dm-linear device for each actuator is output for each DEVICE,
+ * ready for 'dmsetup create --concise'. */
+
+#define CPR_VPD_LEN 4096        /* room for 126 LBA range descriptors */
+#define CPR_DESC_OFF 64
+#define CPR_DESC_LEN 32
+#define CPR_MAX_RANGES ((CPR_VPD_LEN - CPR_DESC_OFF) / CPR_DESC_LEN)
+#define CPR_RCAP16_LEN 32
+#define CPR_RCAP10_LEN 8
+
+struct cpr_range_t {
+    int num;                    /* LBA range number */
+    int nse;                    /* number of storage elements, 0: n/r */
+    uint64_t slba;
+    uint64_t nlbas;
+};
+
+static const char * cpr_vpd_s = "Concurrent positioning ranges VPD page";
+static const char * iar_s = "independent_access_ranges";
+
+
+/* Places logical block length in *lbsp and number of logical blocks in
+ * *nblksp from READ CAPACITY(16), falling back to READ CAPACITY(10). */
+static int
+cpr_read_cap(int sg_fd, uint32_t * lbsp, uint64_t * nblksp, int vb)
+{
+    int res;
+    uint32_t u;
+    uint8_t b[CPR_RCAP16_LEN];
+
+    res = sg_ll_readcap_16(sg_fd, false /* pmi */, 0 /* llba */, b,
+                           CPR_RCAP16_LEN, vb > 0, vb);
+    if (0 == res) {
+        *nblksp = sg_get_unaligned_be64(b + 0) + 1;
+        *lbsp = sg_get_unaligned_be32(b + 8);
+        return 0;
+    }
+    res = sg_ll_readcap_10(sg_fd, false, 0, b, CPR_RCAP10_LEN, vb > 0, vb);
+    if (res)
+        return res;
+    u = sg_get_unaligned_be32(b + 0);
+    if (0xffffffff == u)
+        return SG_LIB_CAT_MALFORMED;    /* should have worked with 16 */
+    *nblksp = (uint64_t)u + 1;
+    *lbsp = sg_get_unaligned_be32(b + 4);
+    return 0;
+}
+
+/* Fetches the Concurrent positioning ranges VPD page and decodes its LBA
+ * range descriptors into rp (CPR_MAX_RANGES elements). Returns 0 and the
+ * number of ranges in *nump on success. */
+static int
+cpr_fetch(int sg_fd, struct cpr_range_t * rp, int * nump, int vb)
+{
+    int k, res, len;
+    int resid = 0;
+    const uint8_t * bp;
+    uint8_t * b;
+    uint8_t * free_b;
+
+    *nump = 0;
+    b = sg_memalign(CPR_VPD_LEN, 0, &free_b, false);
+    if (NULL == b)
+        return sg_convert_errno(ENOMEM);
+    res = sg_ll_inquiry_v2(sg_fd, true, VPD_CON_POS_RANGE, b, CPR_VPD_LEN,
+                           0, &resid, vb > 0, vb);
+    if (res)
+        goto fini;
+    len = CPR_VPD_LEN - resid;
+    if ((len < CPR_DESC_OFF) || (VPD_CON_POS_RANGE != b[1])) {
+        pr2serr("%s: bad or short response\n", cpr_vpd_s);
+        res = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    k = sg_get_unaligned_be16(b + 2) + 4;
+    if (k < len)
+        len = k;
+    for (k = CPR_DESC_OFF, bp = b + k; (k + CPR_DESC_LEN) <= len;
+         k += CPR_DESC_LEN, bp += CPR_DESC_LEN, ++rp, ++*nump) {
+        rp->num = bp[0];
+        rp->nse = bp[1];
+        rp->slba = sg_get_unaligned_be64(bp + 8);
+        rp->nlbas = sg_get_unaligned_be64(bp + 16);
+    }
+fini:
+    free(free_b);
+    return res;
+}
+
+#ifdef SG_LIB_LINUX
+
+/* Finds the block device name (e.g. "sda") of device_name, which may be a
+ * block device, a symlink to one (e.g. under /dev/disk/by-id) or a sg
+ * device. Returns true if found. Also used by sdparm_queue.c . */
+bool
+sdp_bdev_name(const char * device_name, char * b, int blen)
+{
+    bool found = false;
+    const char * bn;
+    DIR * dirp;
+    struct dirent * dep;
+    struct stat st;
+    char rp[PATH_MAX];
+    char d[PATH_MAX + 64];
+
+    if (NULL == realpath(device_name, rp))
+        return false;
+    bn = strrchr(rp, '/');
+    bn = bn ? bn + 1 : rp;
+    snprintf(d, sizeof(d), "/sys/block/%s", bn);
+    if (0 == stat(d, &st)) {
+        if ((int)strlen(bn) >= blen)
+            return false;
+        memcpy(b, bn, strlen(bn) + 1);
+        return true;
+    }
+    snprintf(d, sizeof(d), "/sys/class/scsi_generic/%s/device/block", bn);
+    dirp = opendir(d);
+    if (NULL == dirp)
+        return false;
+    while ((dep = readdir(dirp))) {
+        if ('.' != dep->d_name[0]) {
+            snprintf(b, blen, "%s", dep->d_name);
+            found = true;
+            break;
+        }
+    }
+    closedir(dirp);
+    return found;
+}
+
+static bool
+cpr_sysfs_u64(const char * path, uint64_t * valp)
+{
+    bool ok;
+    FILE * fp = fopen(path, "r");
+
+    if (NULL == fp)
+        return false;
+    ok = (1 == fscanf(fp, "%" SCNu64, valp));
+    fclose(fp);
+    return ok;
+}
+
+/* Compares the ranges in rp (in 512 byte sectors given lbs) with those the
+ * kernel exposes for block device bdev. Returns a short status string. */
+static const char *
+cpr_sysfs_check(const char * bdev, const struct cpr_range_t * rp, int num,
+                uint32_t lbs, int vb)
+{
+    int k, j, n;
+    uint64_t sect, nr;
+    uint64_t spb = lbs / 512;
+    char d[PATH_MAX];
+
+    for (n = 0; ; ++n) {
+        snprintf(d, sizeof(d), "/sys/block/%s/queue/%s/%d/sector", bdev,
+                 iar_s, n);
+        if (! cpr_sysfs_u64(d, &sect))
+            break;
+    }
+    if (0 == n)
+        return "missing";
+    if (n != num) {
+        if (vb)
+            pr2serr("%s: kernel has %d ranges, VPD page has %d\n", bdev, n,
+                    num);
+        return "mismatch";
+    }
+    for (k = 0; k < n; ++k) {   /* kernel sorts by sector, so search */
+        snprintf(d, sizeof(d), "/sys/block/%s/queue/%s/%d/sector", bdev,
+                 iar_s, k);
+        if (! cpr_sysfs_u64(d, &sect))
+            return "mismatch";
+        snprintf(d, sizeof(d), "/sys/block/%s/queue/%s/%d/nr_sectors", bdev,
+                 iar_s, k);
+        if (! cpr_sysfs_u64(d, &nr))
+            return "mismatch";
+        for (j = 0; j < num; ++j) {
+            if ((rp[j].slba * spb == sect) && (rp[j].nlbas * spb == nr))
+                break;
+        }
+        if (j >= num) {
+            if (vb)
+                pr2serr("%s: kernel range %d (sector %" PRIu64 ", %" PRIu64
+                        " sectors) not in VPD page\n", bdev, k, sect, nr);
+            return "mismatch";
+        }
+    }
+    return "match";
+}
+
+#endif  /* SG_LIB_LINUX */
+
+/* Outputs, for DEVICE device_name open in ctxp, its actuator map or (when
+ * --cpr=dm) a dmsetup concise line. Returns 0 on success. */
+int
+sdp_cpr(struct sdparm_ctx_t * ctxp, const char * device_name,
+        sgj_opaque_p jop)
+{
+    bool have_bdev = false;
+    int k, res, num;
+    uint32_t lbs = 0;
+    uint64_t nblks = 0;
+    uint64_t spb, next;
+    const char * bn;
+    const char * ccp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    const int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct cpr_range_t * rp;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap = NULL;
+    char bdev[NAME_MAX + 1];
+    struct cpr_range_t r_arr[CPR_MAX_RANGES];
+
+    res = cpr_fetch(ctxp->sg_fd, r_arr, &num, vb);
+    if (res) {
+        pr2serr("%s: %s not supported, not a multi-actuator disk?\n",
+                device_name, cpr_vpd_s);
+        return (SG_LIB_CAT_ILLEGAL_REQ == res) ? SG_LIB_CONTRADICT : res;
+    }
+    if (0 == num) {
+        pr2serr("%s: %s has no LBA ranges\n", device_name, cpr_vpd_s);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    res = cpr_read_cap(ctxp->sg_fd, &lbs, &nblks, vb);
+    if (res) {
+        pr2serr("%s: READ CAPACITY failed\n", device_name);
+        return res;
+    }
+    if ((lbs < 512) || (lbs % 512)) {
+        pr2serr("%s: logical block length %u not a multiple of 512\n",
+                device_name, lbs);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    spb = lbs / 512;
+#ifdef SG_LIB_LINUX
+    have_bdev = sdp_bdev_name(device_name, bdev, sizeof(bdev));
+#endif
+    if (! have_bdev) {
+        bn = strrchr(device_name, '/');
+        snprintf(bdev, sizeof(bdev), "%s", bn ? bn + 1 : device_name);
+    }
+
+    if (op->cpr_dm) {
+        if (! have_bdev) {
+            pr2serr("%s: no block device found for dm-linear tables\n",
+                    device_name);
+            return SG_LIB_FILE_ERROR;
+        }
+        for (k = 0, rp = r_arr; k < num; ++k, ++rp)
+            printf("%s%s_a%d,,,rw,0 %" PRIu64 " linear /dev/%s %" PRIu64,
+                   (k ? ";" : ""), bdev, rp->num, rp->nlbas * spb, bdev,
+                   rp->slba * spb);
+        printf("\n");
+        return 0;
+    }
+
+    sgj_pr_hr(jsp, "Concurrent positioning ranges: %d, logical block "
+              "length: %u bytes\n", num, lbs);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop,
+                                     "concurrent_positioning_ranges");
+        if (have_bdev)
+            sgj_js_nv_s(jsp, jo2p, "block_device", bdev);
+        sgj_js_nv_i(jsp, jo2p, "logical_block_length", lbs);
+        sgj_js_nv_i(jsp, jo2p, "number_of_logical_blocks", nblks);
+        jap = sgj_named_subarray_r(jsp, jo2p, "actuators");
+    }
+    next = 0;
+    for (k = 0, rp = r_arr; k < num; ++k, ++rp) {
+        sgj_pr_hr(jsp, "  actuator %d: LBA %" PRIu64 " to %" PRIu64 " (%"
+                  PRIu64 " LBAs), sectors %" PRIu64 "+%" PRIu64 "\n",
+                  rp->num, rp->slba, rp->slba + rp->nlbas - 1, rp->nlbas,
+                  rp->slba * spb, rp->nlbas * spb);
+        if (rp->slba != next)
+            pr2serr("%s: warning: actuator %d starts at LBA %" PRIu64
+                    ", expected %" PRIu64 "\n", device_name, rp->num,
+                    rp->slba, next);
+        next = rp->slba + rp->nlbas;
+        if (jap) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo3p, "lba_range_number", rp->num);
+            sgj_js_nv_i(jsp, jo3p, "number_of_storage_elements", rp->nse);
+            sgj_js_nv_i(jsp, jo3p, "starting_lba", rp->slba);
+            sgj_js_nv_i(jsp, jo3p, "number_of_lbas", rp->nlbas);
+            sgj_js_nv_i(jsp, jo3p, "starting_sector", rp->slba * spb);
+            sgj_js_nv_i(jsp, jo3p, "number_of_sectors", rp->nlbas * spb);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        }
+    }
+    if (next != nblks)
+        pr2serr("%s: warning: ranges cover %" PRIu64 " of %" PRIu64
+                " LBAs\n", device_name, next, nblks);
+#ifdef SG_LIB_LINUX
+    if (have_bdev) {
+        ccp = cpr_sysfs_check(bdev, r_arr, num, lbs, op->verbose);
+        sgj_pr_hr(jsp, "  /sys/block/%s/queue/%s: %s\n", bdev, iar_s,
+                  ccp);
+    } else {
+        ccp = "no_block_device";
+        sgj_pr_hr(jsp, "  no block device found, %s not checked\n", iar_s);
+    }
+#else
+    ccp = "not_checked";
+#endif
+    if (jo2p)
+        sgj_js_nv_s(jsp, jo2p, "independent_access_ranges_check", ccp);
+    return 0;
+}
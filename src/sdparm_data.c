@@ -85,7 +85,7 @@ static const struct sdparm_mode_descriptor_t spc_cdl_desc = {
     NULL
 };
 static const struct sdparm_mode_descriptor_t spc_cdl_t2_desc = {
-    2, 2, -1, 8, 4, -1, -1, false,
+    2, 2, -1, 8, 32, -1, -1, false,
     "T2 command duration limit descriptor list", NULL
 };
 
@@ -833,10 +833,10 @@ const struct sdparm_mp_item_t sdparm_mitem_arr[] = {
         "milliseconds\t14: 500 milliseconds"},
     {"MXINATI", CONTROL_MP, MSP_SPC_CDLT2A, -1, 10, 7, 16,
         MF_CLASH_OK | MF_J_USE_DESC,
-        "Max inactive time policy", NULL, NULL},
+        "Max inactive time", NULL, NULL},
     {"MXACTTI", CONTROL_MP, MSP_SPC_CDLT2A, -1, 12, 7, 16,
         MF_CLASH_OK | MF_J_USE_DESC,
-        "Max active time policy", NULL, NULL},
+        "Max active time", NULL, NULL},
     {"MXINATP", CONTROL_MP, MSP_SPC_CDLT2A, -1, 14, 7, 4,
         MF_CLASH_OK | MF_J_USE_DESC,
         "Max inactive time policy", NULL, "0: asap\t"
@@ -851,7 +851,7 @@ const struct sdparm_mp_item_t sdparm_mitem_arr[] = {
         MF_CLASH_OK | MF_J_USE_DESC,
         "Command duration guideline", NULL,
         "0: ignore\t>0: preferred command duration"},
-    {"CDGUPOL", CONTROL_MP, MSP_SPC_CDLT2A, -1, 22, 7, 16,
+    {"CDGUPOL", CONTROL_MP, MSP_SPC_CDLT2A, -1, 22, 3, 4,
         MF_CLASH_OK | MF_J_USE_DESC,
         "Command duration guideline policy", NULL, "0: asap\t"
         "1: next highest CDL descriptor\t"
@@ -893,7 +893,7 @@ const struct sdparm_mp_item_t sdparm_mitem_arr[] = {
     {"CDGUID", CONTROL_MP, MSP_SPC_CDLT2B, -1, 18, 7, 16,
         MF_CLASH_OK | MF_J_USE_DESC, "Command duration guideline", NULL,
         "0: ignore\t>0: preferred command duration"},
-    {"CDGUPOL", CONTROL_MP, MSP_SPC_CDLT2B, -1, 22, 7, 16,
+    {"CDGUPOL", CONTROL_MP, MSP_SPC_CDLT2B, -1, 22, 3, 4,
         MF_CLASH_OK | MF_J_USE_DESC, "Command duration guideline policy",
         NULL, "0: asap\t1: next highest CDL descriptor\t"
         "2: continue as if no CDL\t"
@@ -2164,9 +2164,13 @@ const char * sdparm_mode_page_policy_arr[] =
 
 const struct sdparm_command_t sdparm_command_arr[] =
 {
+    {CMD_BLINK, "blink", "bl", "seconds"},
     {CMD_CAPACITY, "capacity", "ca", NULL},
     {CMD_EJECT, "eject", "ej", NULL},
+    {CMD_LINKBENCH, "linkbench", "li", "count"},
     {CMD_LOAD, "load", "lo", NULL},
+    {CMD_PING, "ping", "pi", "count"},
+    {CMD_PREFETCH, "prefetch", "pf", "file"},
     {CMD_PROFILE, "profile", "pr", NULL},
     {CMD_READY, "ready", "re", NULL},
     {CMD_SENSE, "sense", "se", NULL},
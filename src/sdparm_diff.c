@@ -0,0 +1,914 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+#include "sdparm_json_in.h"
+
+/* sdparm_diff.c : compares the current values of mode page fields (items)
+ * of several DEVICEs ('--diff') or of each DEVICE against a baseline
+ * ('--baseline=FILE'). The baseline is either a file written by
+ * '--snapshot=FILE' or the JSON output of 'sdparm --all --json'. Field
+ * values are decoded with the mode item tables so what is compared is the
+ * same as what '--all' shows, not raw bytes. Only fields that differ are
+ * reported. For mode pages with descriptors each descriptor is compared
+ * in turn, as far as the DEVICE (or baseline) with the most has them.
+ */
+
+#define DIFF_MAX_JSON_LEN (4 * 1024 * 1024)
+#define DIFF_MAX_JSON_DEPTH 64
+#define DIFF_MAX_LIST_DEVS 8    /* more in largest value group: show count */
+#define DIFF_MAX_DESCS 512      /* sanity limit on descriptors per page */
+
+struct diff_jv_t {              /* a field found in a JSON baseline */
+    const char * pg_key;        /* e.g. "caching_mode_page" (not NUL
+                                 * terminated, length in pg_key_len) */
+    const char * acron;         /* e.g. "WCE" (not NUL terminated) */
+    int pg_key_len;
+    int acron_len;
+    int desc_ind;               /* index in descriptor list, else 0 */
+    int64_t val;
+};
+
+struct diff_src_t {             /* a DEVICE or the baseline */
+    const char * name;
+    int pdt;                    /* -1 if not known */
+    int mp_len;                 /* bytes in cur_mp, 0 if none */
+    int num_jv;
+    int max_jv;
+    uint8_t * cur_mp;           /* current values of all mode pages */
+    struct diff_jv_t * jv_arr;  /* non-NULL when baseline is JSON */
+    char * json_b;              /* JSON text that jv_arr points into */
+};
+
+struct sdparm_diff_t {
+    bool have_baseline;         /* if so, srcs[0] is the baseline */
+    int num_srcs;
+    int max_srcs;
+    int num_diffs;              /* total differing fields found */
+    struct diff_src_t * srcs;
+};
+
+struct diff_vg_t {              /* value group when comparing DEVICEs */
+    uint64_t val;
+    int src_ind;
+};
+
+struct diff_jscan_t {           /* state of JSON baseline scanner */
+    struct sdp_jin_t in;
+    struct diff_src_t * sp;
+    int desc_ind;               /* index of descriptor list element */
+};
+
+static const char * mp_s = "mode page";
+
+
+static void
+diff_src_free(struct diff_src_t * sp)
+{
+    if (sp->cur_mp)
+        free(sp->cur_mp);
+    if (sp->jv_arr)
+        free(sp->jv_arr);
+    if (sp->json_b)
+        free(sp->json_b);
+    memset(sp, 0, sizeof(*sp));
+}
+
+/* Builds concatenated current values of all mode pages from a snapshot
+ * file. Returns 0 on success. */
+static int
+diff_load_snap(struct diff_src_t * sp, const char * fn, int verbose)
+{
+    int k, res, n;
+    const struct sdparm_snap_pg_t * spp;
+    struct sdparm_snap_t snap;
+
+    res = sdp_snap_read(fn, &snap, verbose);
+    if (res)
+        return res;
+    for (k = 0, n = 0, spp = snap.pgs; k < snap.num_pgs; ++k, ++spp) {
+        if (spp->smask & 1)
+            n += spp->pg_len;
+    }
+    sp->cur_mp = (uint8_t *)malloc(n ? n : 1);
+    if (NULL == sp->cur_mp) {
+        sdp_snap_free(&snap);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, n = 0, spp = snap.pgs; k < snap.num_pgs; ++k, ++spp) {
+        if (spp->smask & 1) {
+            memcpy(sp->cur_mp + n, spp->pc_arr[0], spp->pg_len);
+            n += spp->pg_len;
+        }
+    }
+    sp->mp_len = n;
+    sp->pdt = snap.pdt;
+    sdp_snap_free(&snap);
+    return 0;
+}
+
+static bool
+js_add_jv(struct diff_jscan_t * jsc, const char * pg_key, int pg_key_len,
+          const char * acron, int acron_len, int64_t val)
+{
+    struct diff_src_t * sp = jsc->sp;
+    struct diff_jv_t * jvp;
+
+    if (sp->num_jv >= sp->max_jv) {
+        int n = sp->max_jv ? (2 * sp->max_jv) : 256;
+
+        jvp = (struct diff_jv_t *)realloc(sp->jv_arr, n * sizeof(*jvp));
+        if (NULL == jvp)
+            return false;
+        sp->jv_arr = jvp;
+        sp->max_jv = n;
+    }
+    jvp = sp->jv_arr + sp->num_jv++;
+    jvp->pg_key = pg_key;
+    jvp->pg_key_len = pg_key_len;
+    jvp->acron = acron;
+    jvp->acron_len = acron_len;
+    jvp->desc_ind = jsc->desc_ind;
+    jvp->val = val;
+    return true;
+}
+
+static bool js_value(struct diff_jscan_t * jsc, const char * okey,
+                     int okey_len, const char * pkey, int pkey_len,
+                     bool * have_ip, int64_t * ip);
+
+/* Scans a JSON object whose name is okey and whose parent object's name is
+ * pkey. An object that has an "acronym" string and a "current" integer is
+ * a mode page field as output by '--all --json', so pkey is the name of
+ * its mode page. If the object has an "i" integer member it is the form
+ * sgj_js_nv_ihex() uses with '--json=h', then *have_ip and *ip are set. */
+static bool
+js_object(struct diff_jscan_t * jsc, const char * okey, int okey_len,
+          const char * pkey, int pkey_len, bool * have_ip, int64_t * ip)
+{
+    bool have_acron = false;
+    bool have_cur = false;
+    bool have_i;
+    int r, k_len, a_len;
+    int64_t i_val;
+    int64_t cur = 0;
+    const char * k_s;
+    const char * a_s = NULL;
+
+    if (sdp_jin_empty(&jsc->in, '}'))
+        return true;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        have_i = false;
+        if (sdp_jin_key_eq(k_s, k_len, "acronym") &&
+            sdp_jin_at(&jsc->in, '"')) {
+            if (! sdp_jin_string(&jsc->in, &a_s, &a_len))
+                return false;
+            have_acron = true;
+        } else {
+            if (! js_value(jsc, k_s, k_len, okey, okey_len, &have_i,
+                           &i_val))
+                return false;
+            if (have_i && sdp_jin_key_eq(k_s, k_len, "current")) {
+                have_cur = true;
+                cur = i_val;
+            } else if (have_i && have_ip &&
+                       sdp_jin_key_eq(k_s, k_len, "i")) {
+                *have_ip = true;
+                *ip = i_val;
+            }
+        }
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    if (r < 0)
+        return false;
+    if (have_acron && have_cur && pkey) {
+        if (! js_add_jv(jsc, pkey, pkey_len, a_s, a_len, cur))
+            return false;
+    }
+    return true;
+}
+
+/* Scans a JSON array whose parent object's name is pkey. '--all --json'
+ * outputs the descriptors of a mode page as the elements of an array in
+ * that page's object, so each element takes pkey (the mode page) as its
+ * name and fields found in it are tagged with the element's index. */
+static bool
+js_array(struct diff_jscan_t * jsc, const char * pkey, int pkey_len)
+{
+    bool ok;
+    int k, r;
+    int sv_desc_ind = jsc->desc_ind;
+
+    if (sdp_jin_empty(&jsc->in, ']'))
+        return true;
+    k = 0;
+    do {
+        jsc->desc_ind = k++;
+        ok = js_value(jsc, pkey, pkey_len, NULL, 0, NULL, NULL);
+        jsc->desc_ind = sv_desc_ind;
+        if (! ok)
+            return false;
+    } while ((r = sdp_jin_next(&jsc->in, ']')) > 0);
+    return (0 == r);
+}
+
+/* Scans any JSON value. If it is an integer (or an object holding one as
+ * its "i" member) then *have_ip is set and the value placed in *ip. */
+static bool
+js_value(struct diff_jscan_t * jsc, const char * okey, int okey_len,
+         const char * pkey, int pkey_len, bool * have_ip, int64_t * ip)
+{
+    bool ok;
+    int64_t i;
+
+    sdp_jin_skip_ws(&jsc->in);
+    if (jsc->in.p >= jsc->in.end)
+        return false;
+    switch (*jsc->in.p) {
+    case '{':
+        if (++jsc->in.depth > jsc->in.max_depth)
+            return false;
+        ok = js_object(jsc, okey, okey_len, pkey, pkey_len, have_ip, ip);
+        --jsc->in.depth;
+        return ok;
+    case '[':
+        if (++jsc->in.depth > jsc->in.max_depth)
+            return false;
+        ok = js_array(jsc, pkey, pkey_len);
+        --jsc->in.depth;
+        return ok;
+    default:
+        if (have_ip && sdp_jin_int(&jsc->in, &i)) {
+            *ip = i;
+            *have_ip = true;
+            return true;
+        }
+        return sdp_jin_value(&jsc->in, NULL, NULL);
+    }
+}
+
+/* Reads a JSON baseline and collects its mode page fields. Returns 0 on
+ * success. */
+static int
+diff_load_json(struct diff_src_t * sp, const char * fn, FILE * fp,
+               int verbose)
+{
+    int len;
+    struct diff_jscan_t jsc;
+
+    sp->json_b = (char *)malloc(DIFF_MAX_JSON_LEN + 1);
+    if (NULL == sp->json_b)
+        return sg_convert_errno(ENOMEM);
+    len = (int)fread(sp->json_b, 1, DIFF_MAX_JSON_LEN + 1, fp);
+    if (len > DIFF_MAX_JSON_LEN) {
+        pr2serr("%s: %s is too long (more than %d bytes)\n", __func__, fn,
+                DIFF_MAX_JSON_LEN);
+        return SG_LIB_FILE_ERROR;
+    }
+    sp->json_b[len] = '\0';
+    memset(&jsc, 0, sizeof(jsc));
+    sdp_jin_init(&jsc.in, sp->json_b, len, DIFF_MAX_JSON_DEPTH);
+    jsc.sp = sp;
+    sdp_jin_skip_ws(&jsc.in);
+    if ((! sdp_jin_at(&jsc.in, '{')) ||
+        (! js_value(&jsc, NULL, 0, NULL, 0, NULL, NULL))) {
+        pr2serr("%s: %s is not a sdparm snapshot nor valid JSON (near "
+                "offset %d)\n", __func__, fn,
+                (int)(jsc.in.p - sp->json_b));
+        return SG_LIB_FILE_ERROR;
+    }
+    if (0 == sp->num_jv) {
+        pr2serr("%s: no %s fields found in %s, expected output of 'sdparm "
+                "--all --json'\n", __func__, mp_s, fn);
+        return SG_LIB_FILE_ERROR;
+    }
+    if (verbose > 1)
+        pr2serr("%s: %d %s fields found in %s\n", __func__, sp->num_jv, mp_s,
+                fn);
+    return 0;
+}
+
+/* Prepares to compare up to max_devs DEVICEs. If baseline_fn is non-NULL
+ * it is read and each DEVICE is compared against it. On success returns 0
+ * and places a new object in *dfpp which the caller should free with
+ * sdp_diff_free(). */
+int
+sdp_diff_new(int max_devs, const char * baseline_fn,
+             const struct sdparm_opt_coll * op, struct sdparm_diff_t ** dfpp)
+{
+    int res;
+    char magic[4];
+    FILE * fp;
+    struct sdparm_diff_t * dfp;
+    struct diff_src_t * sp;
+
+    *dfpp = NULL;
+    dfp = (struct sdparm_diff_t *)calloc(1, sizeof(*dfp));
+    if (NULL == dfp)
+        return sg_convert_errno(ENOMEM);
+    dfp->max_srcs = max_devs + 1;
+    dfp->srcs = (struct diff_src_t *)calloc(dfp->max_srcs,
+                                            sizeof(*dfp->srcs));
+    if (NULL == dfp->srcs) {
+        free(dfp);
+        return sg_convert_errno(ENOMEM);
+    }
+    if (baseline_fn) {
+        dfp->have_baseline = true;
+        sp = dfp->srcs + dfp->num_srcs++;
+        sp->name = baseline_fn;
+        sp->pdt = -1;
+        fp = fopen(baseline_fn, "rb");
+        if (NULL == fp) {
+            res = errno;
+            pr2serr("unable to open baseline %s: %s\n", baseline_fn,
+                    safe_strerror(res));
+            sdp_diff_free(dfp);
+            return sg_convert_errno(res);
+        }
+        if ((sizeof(magic) == fread(magic, 1, sizeof(magic), fp)) &&
+            (0 == memcmp(magic, "SDPM", sizeof(magic)))) {
+            fclose(fp);
+            res = diff_load_snap(sp, baseline_fn, op->verbose);
+        } else {
+            rewind(fp);
+            res = diff_load_json(sp, baseline_fn, fp, op->verbose);
+            fclose(fp);
+        }
+        if (res) {
+            sdp_diff_free(dfp);
+            return res;
+        }
+    }
+    *dfpp = dfp;
+    return 0;
+}
+
+void
+sdp_diff_free(struct sdparm_diff_t * dfp)
+{
+    int k;
+
+    if (NULL == dfp)
+        return;
+    for (k = 0; k < dfp->num_srcs; ++k)
+        diff_src_free(dfp->srcs + k);
+    free(dfp->srcs);
+    free(dfp);
+}
+
+/* Fetches the current values of all mode pages of the DEVICE open in ctxp
+ * and keeps a copy for sdp_diff_report(). Returns 0 on success. */
+int
+sdp_diff_add_dev(struct sdparm_diff_t * dfp, struct sdparm_ctx_t * ctxp,
+                 const char * device_name)
+{
+    int res, smask, resp_len;
+    struct diff_src_t * sp;
+
+    if (dfp->num_srcs >= dfp->max_srcs)
+        return SG_LIB_LOGIC_ERROR;
+    sp = dfp->srcs + dfp->num_srcs++;
+    sp->name = device_name;
+    sp->pdt = ctxp->pdt;
+    res = sdp_ctx_all_mpages(ctxp, &smask, &resp_len);
+    if (res)
+        return res;
+    if ((0 == (smask & 1)) || (resp_len < 2)) {
+        pr2serr("%s: unable to fetch current values of %ss\n", device_name,
+                mp_s);
+        return SG_LIB_CAT_OTHER;
+    }
+    sp->cur_mp = (uint8_t *)malloc(resp_len);
+    if (NULL == sp->cur_mp)
+        return sg_convert_errno(ENOMEM);
+    memcpy(sp->cur_mp, ctxp->cur_mp, resp_len);
+    sp->mp_len = resp_len;
+    return 0;
+}
+
+/* Places the name of field mpip, with ".<d_ind>" appended for fields in
+ * later descriptors (as '--get=' takes them and '--all' shows them), in
+ * b . */
+static char *
+diff_acron_str(const struct sdparm_mp_item_t * mpip, int d_ind, char * b,
+               int blen)
+{
+    if (d_ind > 0)
+        snprintf(b, blen, "%s.%d", mpip->acron, d_ind);
+    else
+        snprintf(b, blen, "%s", mpip->acron);
+    return b;
+}
+
+/* Returns the offset of descriptor d_ind within the mode page at pg
+ * (pg_len bytes long) laid out as described by mdp, or -1 if the page
+ * does not have that descriptor. */
+static int
+diff_desc_off(const struct sdparm_mode_descriptor_t * mdp, const uint8_t * pg,
+              int pg_len, int d_ind)
+{
+    int k, off, len;
+    int num = DIFF_MAX_DESCS;
+    uint64_t u;
+
+    if (mdp->num_descs_bytes > 0) {
+        if ((mdp->num_descs_off + mdp->num_descs_bytes) > pg_len)
+            return -1;
+        u = sg_get_big_endian(pg + mdp->num_descs_off, 7,
+                              mdp->num_descs_bytes * 8);
+        if ((mdp->num_descs_inc < 0) && (mdp->desc_len > 0)) {
+            /* value is a length in bytes, see print_a_mitem_desc() */
+            k = mdp->first_desc_off -
+                (mdp->num_descs_off + mdp->num_descs_bytes);
+            num = ((int64_t)u > k) ? (int)((u - k) / mdp->desc_len) : 0;
+        } else
+            num = (int)u + mdp->num_descs_inc;
+    }
+    if ((d_ind >= num) || (d_ind >= DIFF_MAX_DESCS))
+        return -1;
+    for (k = 0, off = mdp->first_desc_off; off < pg_len; ++k, off += len) {
+        if (k == d_ind)
+            return off;
+        if (mdp->desc_len > 0)
+            len = mdp->desc_len;
+        else {
+            if ((off + mdp->desc_len_off + mdp->desc_len_bytes) > pg_len)
+                break;
+            u = sg_get_big_endian(pg + off + mdp->desc_len_off, 7,
+                                  mdp->desc_len_bytes * 8);
+            len = mdp->desc_len_off + mdp->desc_len_bytes + (int)u;
+        }
+    }
+    return -1;
+}
+
+/* Places value of field mpip in the source sp into *valp and returns true.
+ * Returns false if that source does not have that field. pg_key is the
+ * JSON name of the field's mode page. When mdp is non-NULL and mpip is in
+ * the descriptor list then d_ind selects the descriptor, otherwise only
+ * d_ind 0 is found. */
+static bool
+diff_get_val(const struct diff_src_t * sp,
+             const struct sdparm_mp_item_t * mpip,
+             const struct sdparm_mode_descriptor_t * mdp,
+             const char * pg_key, int d_ind, uint64_t * valp)
+{
+    int k, off, d_off, pg_len, pg_key_len, acron_len;
+    uint64_t mask;
+    const struct diff_jv_t * jvp;
+    struct sdparm_mp_item_t a_mp_it;
+    char a_s[40];
+
+    mask = (mpip->num_bits < 64) ? ((1ULL << mpip->num_bits) - 1) :
+                                   UINT64_MAX;
+    if (sp->jv_arr) {
+        pg_key_len = (int)strlen(pg_key);
+        diff_acron_str(mpip, d_ind, a_s, sizeof(a_s));
+        acron_len = (int)strlen(a_s);
+        for (k = 0, jvp = sp->jv_arr; k < sp->num_jv; ++k, ++jvp) {
+            if ((pg_key_len == jvp->pg_key_len) &&
+                (acron_len == jvp->acron_len) &&
+                (d_ind == jvp->desc_ind) &&
+                (0 == memcmp(pg_key, jvp->pg_key, pg_key_len)) &&
+                (0 == strncasecmp(a_s, jvp->acron, acron_len))) {
+                *valp = (uint64_t)jvp->val & mask;
+                return true;
+            }
+        }
+        return false;
+    }
+    off = sdp_find_mpage(sp->cur_mp, sp->mp_len, mpip->pg_num,
+                         mpip->subpg_num, &pg_len);
+    if (off < 0)
+        return false;
+    if (mdp && (mpip->start_byte >= mdp->first_desc_off)) {
+        d_off = diff_desc_off(mdp, sp->cur_mp + off, pg_len, d_ind);
+        if (d_off < 0)
+            return false;
+        if (mdp->have_desc_id && (mpip->flags & MF_CLASH_OK) &&
+            ((0xf & sp->cur_mp[off + d_off]) !=
+             sdp_get_desc_id(mpip->flags)))
+            return false;       /* field of another descriptor type */
+        a_mp_it = *mpip;
+        a_mp_it.start_byte = d_off + (mpip->start_byte -
+                                      mdp->first_desc_off);
+        mpip = &a_mp_it;
+    } else if (d_ind > 0)
+        return false;
+    if ((mpip->start_byte + (mpip->num_bits + (7 - mpip->start_bit) + 7) /
+         8) > pg_len)
+        return false;
+    *valp = sdp_mitem_get_value(mpip, sp->cur_mp + off) & mask;
+    return true;
+}
+
+static char *
+diff_val_str(const struct sdparm_mp_item_t * mpip, uint64_t u, char * b,
+             int blen)
+{
+    if (MF_TWOS_COMP & mpip->flags)
+        sdp_signed_decimal_str(u, mpip->num_bits, false, b, blen);
+    else if (MF_HEX & mpip->flags)
+        snprintf(b, blen, "0x%" PRIx64, u);
+    else
+        snprintf(b, blen, "%" PRIu64, u);
+    return b;
+}
+
+static int64_t
+diff_val_js(const struct sdparm_mp_item_t * mpip, uint64_t u)
+{
+    if ((MF_TWOS_COMP & mpip->flags) && (mpip->num_bits < 64) &&
+        (u & (1ULL << (mpip->num_bits - 1))))
+        return (int64_t)(u | ~((1ULL << mpip->num_bits) - 1));
+    return (int64_t)u;
+}
+
+static int
+vg_cmp(const void * a, const void * b)
+{
+    const struct diff_vg_t * ap = (const struct diff_vg_t *)a;
+    const struct diff_vg_t * bp = (const struct diff_vg_t *)b;
+
+    if (ap->val != bp->val)
+        return (ap->val < bp->val) ? -1 : 1;
+    return ap->src_ind - bp->src_ind;
+}
+
+static void
+diff_pr_group(const struct sdparm_diff_t * dfp,
+              const struct sdparm_mp_item_t * mpip,
+              const struct diff_vg_t * vg, int n,
+              const struct sdparm_opt_coll * op, sgj_opaque_p jap)
+{
+    int j;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p ja2p;
+    char b[32];
+
+    diff_val_str(mpip, vg->val, b, sizeof(b));
+    if (jsp->pr_as_json) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "value", diff_val_js(mpip, vg->val));
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "device_names");
+        for (j = 0; j < n; ++j)
+            sgj_js_nv_o(jsp, ja2p, NULL, sgj_new_unattached_string_r(jsp,
+                        dfp->srcs[vg[j].src_ind].name));
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    } else if ((n > DIFF_MAX_LIST_DEVS) && (0 == op->verbose))
+        sgj_pr_hr(jsp, "    %s: %d DEVICEs\n", b, n);
+    else {
+        sgj_pr_hr(jsp, "    %s:", b);
+        for (j = 0; j < n; ++j)
+            sgj_pr_hr(jsp, " %s", dfp->srcs[vg[j].src_ind].name);
+        sgj_pr_hr(jsp, "\n");
+    }
+}
+
+/* Outputs one field that has more than one value across the DEVICEs. The
+ * vg array is sorted by value. The most common value is output first,
+ * then the others in ascending order. */
+static void
+diff_pr_groups(const struct sdparm_diff_t * dfp,
+               const struct sdparm_mp_item_t * mpip,
+               const struct diff_vg_t * vg, int num,
+               const struct sdparm_opt_coll * op, sgj_opaque_p jop)
+{
+    int k, n, top, top_n;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    sgj_opaque_p jap = NULL;
+
+    for (k = 0, top = 0, top_n = 0; k < num; k += n) {
+        for (n = 1; ((k + n) < num) && (vg[k + n].val == vg[k].val); ++n)
+            ;
+        if (n > top_n) {
+            top = k;
+            top_n = n;
+        }
+    }
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "values");
+    diff_pr_group(dfp, mpip, vg + top, top_n, op, jap);
+    for (k = 0; k < num; k += n) {
+        for (n = 1; ((k + n) < num) && (vg[k + n].val == vg[k].val); ++n)
+            ;
+        if (k != top)
+            diff_pr_group(dfp, mpip, vg + k, n, op, jap);
+    }
+}
+
+/* Compares all DEVICEs with one another ('--diff' without a baseline) */
+static void
+diff_across(struct sdparm_diff_t * dfp, int ref_pdt,
+            const struct sdparm_opt_coll * op, sgj_opaque_p jop)
+{
+    int k, d, num, n_vals, l_pn, l_spn;
+    bool pg_shown = false;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    const struct sdparm_mp_item_t * mpip;
+    const struct sdparm_mp_name_t * mnp;
+    const struct sdparm_mode_descriptor_t * mdp = NULL;
+    struct diff_vg_t * vg;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    char pg_nm[128];
+    char pg_key[128];
+    char b[64];
+    char a_s[40];
+
+    vg = (struct diff_vg_t *)calloc(dfp->num_srcs, sizeof(*vg));
+    if (NULL == vg)
+        return;
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "mode_page_differences");
+    l_pn = -1;
+    l_spn = -1;
+    for (mpip = sdp_get_mitem_arr(op->transport, op->vendor_id);
+         mpip && mpip->acron; ++mpip) {
+        if (! sg_pdt_s_eq(ref_pdt, mpip->com_pdt))
+            continue;
+        if ((mpip->pg_num != l_pn) || (mpip->subpg_num != l_spn)) {
+            l_pn = mpip->pg_num;
+            l_spn = mpip->subpg_num;
+            pg_shown = false;
+            sdp_get_mp_nm_with_str(l_pn, l_spn, ref_pdt, op->transport,
+                                   op->vendor_id, false, false,
+                                   sizeof(pg_nm), pg_nm);
+            sdp_mp_convert2snake(pg_nm, pg_key, sizeof(pg_key));
+            mnp = sdp_get_mp_nm(l_pn, l_spn, ref_pdt, op->transport,
+                                op->vendor_id);
+            mdp = mnp ? mnp->mp_desc : NULL;
+        }
+        /* d is the descriptor, stop when no source has this one */
+        for (d = 0; d < DIFF_MAX_DESCS; ++d) {
+            bool found = false;
+
+            for (k = 0, num = 0; k < dfp->num_srcs; ++k) {
+                if (diff_get_val(dfp->srcs + k, mpip, mdp, pg_key, d,
+                                 &vg[num].val)) {
+                    vg[num].src_ind = k;
+                    ++num;
+                    found = true;
+                }
+            }
+            if (! found)
+                break;
+            if (num < 2)
+                continue;
+            qsort(vg, num, sizeof(*vg), vg_cmp);
+            for (k = 1, n_vals = 1; k < num; ++k) {
+                if (vg[k].val != vg[k - 1].val)
+                    ++n_vals;
+            }
+            if (n_vals < 2)
+                continue;
+            ++dfp->num_diffs;
+            if (jsp->pr_as_json) {
+                jo2p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_s(jsp, jo2p, "mode_page_name", pg_nm);
+                sgj_js_nv_ihex(jsp, jo2p, "page_code", l_pn);
+                sgj_js_nv_ihex(jsp, jo2p, "subpage_code", l_spn);
+                sgj_js_nv_s(jsp, jo2p, "acronym", mpip->acron);
+                if (mdp && (mpip->start_byte >= mdp->first_desc_off))
+                    sgj_js_nv_i(jsp, jo2p, "descriptor_number", d);
+                diff_pr_groups(dfp, mpip, vg, num, op, jo2p);
+                sgj_js_nv_o(jsp, jap, NULL, jo2p);
+                continue;
+            }
+            if (! pg_shown) {
+                sgj_pr_hr(jsp, "%s [0x%x,0x%x]:\n", pg_nm, l_pn, l_spn);
+                pg_shown = true;
+            }
+            if (op->verbose && mpip->description)
+                snprintf(b, sizeof(b), "  [%s]", mpip->description);
+            else
+                b[0] = '\0';
+            sgj_pr_hr(jsp, "  %s: %d values%s\n",
+                      diff_acron_str(mpip, d, a_s, sizeof(a_s)), n_vals, b);
+            diff_pr_groups(dfp, mpip, vg, num, op, NULL);
+        }
+    }
+    free(vg);
+}
+
+/* Compares each DEVICE with the baseline in dfp->srcs[0] */
+static void
+diff_vs_baseline(struct sdparm_diff_t * dfp, int ref_pdt,
+                 const struct sdparm_opt_coll * op, sgj_opaque_p jop)
+{
+    int k, n, d, num_cmp, l_pn, l_spn;
+    bool pg_shown;
+    uint64_t b_val, d_val;
+    sgj_state * jsp = (sgj_state *)&op->json_st;
+    const struct sdparm_mp_item_t * mpip0 =
+                        sdp_get_mitem_arr(op->transport, op->vendor_id);
+    const struct sdparm_mp_item_t * mpip;
+    const struct sdparm_mp_name_t * mnp;
+    const struct sdparm_mode_descriptor_t * mdp = NULL;
+    const struct diff_src_t * bsp = dfp->srcs;
+    const struct diff_src_t * sp;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p ja2p = NULL;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    char pg_nm[128];
+    char pg_key[128];
+    char b1[32];
+    char b2[32];
+    char a_s[40];
+
+    if (jsp->pr_as_json) {
+        sgj_js_nv_s(jsp, jop, "baseline_file", bsp->name);
+        jap = sgj_named_subarray_r(jsp, jop, "baseline_differences");
+    }
+    for (k = 1; k < dfp->num_srcs; ++k) {
+        sp = dfp->srcs + k;
+        if (0 == sp->mp_len)
+            continue;       /* error already reported */
+        if ((bsp->pdt >= 0) && (sg_lib_pdt_decay(bsp->pdt) !=
+                                sg_lib_pdt_decay(sp->pdt)))
+            pr2serr("%s: peripheral device type 0x%x differs from baseline "
+                    "(0x%x)\n", sp->name, sp->pdt, bsp->pdt);
+        if (jsp->pr_as_json) {
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo2p, "device_name", sp->name);
+        }
+        /* first pass counts, second pass outputs */
+        for (n = 0, num_cmp = 0; n < 2; ++n) {
+            int num_d = 0;
+
+            l_pn = -1;
+            l_spn = -1;
+            pg_shown = false;
+            if ((n > 0) && jsp->pr_as_json)
+                ja2p = sgj_named_subarray_r(jsp, jo2p, "differences");
+            for (mpip = mpip0; mpip && mpip->acron; ++mpip) {
+                if (! sg_pdt_s_eq(ref_pdt, mpip->com_pdt))
+                    continue;
+                if ((mpip->pg_num != l_pn) || (mpip->subpg_num != l_spn)) {
+                    l_pn = mpip->pg_num;
+                    l_spn = mpip->subpg_num;
+                    pg_shown = false;
+                    sdp_get_mp_nm_with_str(l_pn, l_spn, ref_pdt,
+                                           op->transport, op->vendor_id,
+                                           false, false, sizeof(pg_nm),
+                                           pg_nm);
+                    sdp_mp_convert2snake(pg_nm, pg_key, sizeof(pg_key));
+                    mnp = sdp_get_mp_nm(l_pn, l_spn, ref_pdt, op->transport,
+                                        op->vendor_id);
+                    mdp = mnp ? mnp->mp_desc : NULL;
+                }
+                /* d is the descriptor, the baseline decides how many */
+                for (d = 0; d < DIFF_MAX_DESCS; ++d) {
+                    if (! diff_get_val(bsp, mpip, mdp, pg_key, d, &b_val))
+                        break;
+                    if (! diff_get_val(sp, mpip, mdp, pg_key, d, &d_val))
+                        continue;
+                    if (0 == n)
+                        ++num_cmp;
+                    if (b_val == d_val)
+                        continue;
+                    ++num_d;
+                    if (0 == n)
+                        continue;
+                    if (jsp->pr_as_json) {
+                        jo3p = sgj_new_unattached_object_r(jsp);
+                        sgj_js_nv_s(jsp, jo3p, "mode_page_name", pg_nm);
+                        sgj_js_nv_ihex(jsp, jo3p, "page_code", l_pn);
+                        sgj_js_nv_ihex(jsp, jo3p, "subpage_code", l_spn);
+                        sgj_js_nv_s(jsp, jo3p, "acronym", mpip->acron);
+                        if (mdp && (mpip->start_byte >= mdp->first_desc_off))
+                            sgj_js_nv_i(jsp, jo3p, "descriptor_number", d);
+                        sgj_js_nv_i(jsp, jo3p, "baseline_value",
+                                    diff_val_js(mpip, b_val));
+                        sgj_js_nv_i(jsp, jo3p, "current_value",
+                                    diff_val_js(mpip, d_val));
+                        sgj_js_nv_o(jsp, ja2p, NULL, jo3p);
+                        continue;
+                    }
+                    if (! pg_shown) {
+                        sgj_pr_hr(jsp, "  %s [0x%x,0x%x]:\n", pg_nm, l_pn,
+                                  l_spn);
+                        pg_shown = true;
+                    }
+                    sgj_pr_hr(jsp, "    %-10s baseline: %-10s current: "
+                              "%s\n", diff_acron_str(mpip, d, a_s,
+                              sizeof(a_s)), diff_val_str(mpip, b_val, b1,
+                              sizeof(b1)), diff_val_str(mpip, d_val, b2,
+                              sizeof(b2)));
+                }
+            }
+            if (n > 0)
+                break;
+            dfp->num_diffs += num_d;
+            if (jsp->pr_as_json)
+                sgj_js_nv_i(jsp, jo2p, "number_of_differences", num_d);
+            if (0 == num_cmp)
+                sgj_pr_hr(jsp, "%s: no fields in common with baseline\n",
+                          sp->name);
+            else if (num_d)
+                sgj_pr_hr(jsp, "%s: %d of %d fields differ from baseline\n",
+                          sp->name, num_d, num_cmp);
+            else {
+                sgj_pr_hr(jsp, "%s: same as baseline (%d fields)\n",
+                          sp->name, num_cmp);
+                break;
+            }
+        }
+        if (jsp->pr_as_json)
+            sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+}
+
+/* Outputs the differences found between the DEVICEs given to
+ * sdp_diff_add_dev() or between each of them and the baseline. Returns 0
+ * if no differences were found, SG_LIB_OK_FALSE if some were found, or
+ * another error. */
+int
+sdp_diff_report(struct sdparm_diff_t * dfp, struct sdparm_opt_coll * op,
+                sgj_opaque_p jop)
+{
+    int k, num_ok, ref_pdt;
+    sgj_state * jsp = &op->json_st;
+    const struct diff_src_t * sp;
+
+    ref_pdt = -1;
+    for (k = 0, num_ok = 0, sp = dfp->srcs; k < dfp->num_srcs; ++k, ++sp) {
+        if ((sp->mp_len > 0) || sp->jv_arr) {
+            ++num_ok;
+            if ((ref_pdt < 0) && (sp->pdt >= 0))
+                ref_pdt = sp->pdt;
+        }
+    }
+    if (num_ok < 2) {
+        pr2serr("need at least two sets of %ss to compare\n", mp_s);
+        return SG_LIB_CAT_OTHER;
+    }
+    if (ref_pdt < 0)
+        ref_pdt = 0;
+    ref_pdt = sg_lib_pdt_decay(ref_pdt);
+    dfp->num_diffs = 0;
+    if (dfp->have_baseline)
+        diff_vs_baseline(dfp, ref_pdt, op, jop);
+    else {
+        for (k = 1, sp = dfp->srcs + 1; k < dfp->num_srcs; ++k, ++sp) {
+            if (sp->mp_len && (sg_lib_pdt_decay(sp->pdt) != ref_pdt))
+                pr2serr("%s: peripheral device type 0x%x differs from "
+                        "0x%x of %s\n", sp->name, sp->pdt, ref_pdt,
+                        dfp->srcs[0].name);
+        }
+        diff_across(dfp, ref_pdt, op, jop);
+        if (0 == dfp->num_diffs)
+            sgj_pr_hr(jsp, "No differences found between %d DEVICEs\n",
+                      num_ok);
+        else
+            sgj_pr_hr(jsp, "%d fields differ between %d DEVICEs\n",
+                      dfp->num_diffs, num_ok);
+    }
+    if (jsp->pr_as_json)
+        sgj_js_nv_i(jsp, jop, "number_of_differences", dfp->num_diffs);
+    return dfp->num_diffs ? SG_LIB_OK_FALSE : 0;
+}
@@ -0,0 +1,710 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+#include "sdparm_json_in.h"
+
+/* sdparm_ioad.c : '--ioad[=FILE]' shows or replaces the IO advice hints
+ * grouping mode subpage [0xa,0x5] (ioad) as a whole table of its 64 group
+ * descriptors, rather than one '--set=ST_EN.<n>=1' per field. FILE is
+ * compact JSON: a "groups" object whose members are named by a group
+ * number or range (e.g. "2" or "6-9") and hold field acronyms (lower or
+ * upper case, e.g. "st_en": 1) with their values. Groups not named are
+ * marked invalid (IOA_MODE=1); named groups are valid unless "ioa_mode" is
+ * given. An optional "layout" member names a preset to start from, which
+ * the "groups" then override. FILE may instead just be a preset name.
+ *
+ * Preset "rwh" maps the Linux write lifetime hints (RWH_WRITE_LIFE_*) to
+ * groups: since lk 6.10 the sd driver places the write hint of a WRITE in
+ * its GROUP NUMBER field, so hint N (1: NONE ... 5: EXTREME) uses group N.
+ * Those groups are made valid with ST_EN set (permanent streams) and the
+ * overall frequency hint matching the data lifetime. Preset "off"
+ * invalidates every group. The whole subpage is checked against the
+ * changeable values before it is written with one MODE SELECT. */
+
+#define IOAD_NUM_GRPS 64
+#define IOAD_DESC_OFF 16        /* first descriptor within subpage */
+#define IOAD_DESC_LEN 16
+#define IOAD_PG_LEN (IOAD_DESC_OFF + (IOAD_NUM_GRPS * IOAD_DESC_LEN))
+#define IOAD_MS_BUFF_LEN 1536   /* room for header and full subpage */
+#define IOAD_MAX_JSON_LEN (256 * 1024)
+#define IOAD_MAX_JSON_DEPTH 32
+
+/* fields of a group descriptor, in the order they are shown */
+static const char * ioad_acron_arr[] = {
+    "IOA_MODE", "ST_EN", "CS_EN", "IC_EN", "ACDLU", "RLBSR", "LBM_DT",
+    "OV_FR", "RW_FR", "WR_SE", "RD_SE", "IO_CL", "SU_IO", "OSI_PR",
+};
+
+#define IOAD_NUM_FLDS \
+        ((int)(sizeof(ioad_acron_arr) / sizeof(ioad_acron_arr[0])))
+#define IOAD_IOA_MODE 0         /* index of IOA_MODE in ioad_acron_arr */
+
+struct ioad_preset_t {
+    const char * name;
+    const char * json;
+};
+
+static const struct ioad_preset_t ioad_preset_arr[] = {
+    {"off", "{\"groups\": {}}"},
+    /* group N for RWH_WRITE_LIFE_* value N; OV_FR 2: more, 1: less */
+    {"rwh", "{\"groups\": {"
+            "\"1\": {\"st_en\": 1}, "                   /* NONE */
+            "\"2\": {\"st_en\": 1, \"ov_fr\": 2}, "     /* SHORT */
+            "\"3\": {\"st_en\": 1}, "                   /* MEDIUM */
+            "\"4\": {\"st_en\": 1, \"ov_fr\": 1}, "     /* LONG */
+            "\"5\": {\"st_en\": 1, \"ov_fr\": 1, \"rw_fr\": 1}}}"},
+                                                        /* EXTREME */
+    {NULL, NULL},
+};
+
+struct ioad_grp_t {
+    bool given;
+    bool fld_given[IOAD_NUM_FLDS];
+    int val[IOAD_NUM_FLDS];
+};
+
+struct ioad_tbl_t {
+    char layout[16];            /* preset named by "layout", else empty */
+    bool have_groups;
+    struct ioad_grp_t grp[IOAD_NUM_GRPS];
+};
+
+struct sdparm_ioad_t {
+    const char * fn;            /* NULL when only showing the table */
+    struct ioad_tbl_t tbl;
+};
+
+struct ioad_jscan_t {           /* state of the ioad JSON scanner */
+    struct sdp_jin_t in;
+    struct ioad_tbl_t * tp;
+    char err[128];              /* set when JSON is valid but not wanted */
+};
+
+static const char * ioad_s = "IO advice hints grouping";
+static const char * mp_s = "mode page";
+
+
+static const struct sdparm_mp_item_t *
+ioad_find_mitem(const char * acron)
+{
+    int from = 0;
+    const struct sdparm_mp_item_t * mpi;
+
+    while ((mpi = sdp_find_mitem_by_acron(acron, &from, -1, -1))) {
+        if ((CONTROL_MP == mpi->pg_num) &&
+            (MSP_SBC_IO_ADVI == mpi->subpg_num))
+            return mpi;
+    }
+    return NULL;
+}
+
+static bool ij_value(struct ioad_jscan_t * jsc);
+
+/* Parses a group key: "N" or "N-M" with 0 <= N <= M < IOAD_NUM_GRPS */
+static bool
+ij_grp_range(struct ioad_jscan_t * jsc, const char * sp, int len, int * fp,
+             int * lp)
+{
+    int n, m;
+    char b[24];
+    char c;
+
+    if ((len < 1) || (len >= (int)sizeof(b)))
+        goto bad;
+    memcpy(b, sp, len);
+    b[len] = '\0';
+    if (2 == sscanf(b, "%d-%d%c", &n, &m, &c))
+        ;
+    else if (1 == sscanf(b, "%d%c", &n, &c))
+        m = n;
+    else
+        goto bad;
+    if ((n < 0) || (m < n) || (m >= IOAD_NUM_GRPS))
+        goto bad;
+    *fp = n;
+    *lp = m;
+    return true;
+bad:
+    snprintf(jsc->err, sizeof(jsc->err), "group \"%.*s\" should be a number "
+             "or range (0 to %d)", (len > 24) ? 24 : len, sp,
+             IOAD_NUM_GRPS - 1);
+    return false;
+}
+
+/* Scans the fields of one group (or range of groups) */
+static bool
+ij_group(struct ioad_jscan_t * jsc, int first, int last)
+{
+    int g, k, j, r, k_len;
+    int64_t i, max;
+    const char * k_s;
+    const struct sdparm_mp_item_t * mpi;
+    struct ioad_grp_t grp;
+    char acron[16];
+
+    if (! sdp_jin_at(&jsc->in, '{'))
+        return false;
+    memset(&grp, 0, sizeof(grp));
+    grp.given = true;
+    if (sdp_jin_empty(&jsc->in, '}'))
+        goto store;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        for (k = 0; k < IOAD_NUM_FLDS; ++k) {
+            if ((int)strlen(ioad_acron_arr[k]) != k_len)
+                continue;
+            for (j = 0; j < k_len; ++j)
+                acron[j] = toupper((unsigned char)k_s[j]);
+            if (0 == memcmp(acron, ioad_acron_arr[k], k_len))
+                break;
+        }
+        if (k >= IOAD_NUM_FLDS) {
+            snprintf(jsc->err, sizeof(jsc->err), "group %d: unknown field "
+                     "\"%.*s\"", first, (k_len > 40) ? 40 : k_len, k_s);
+            return false;
+        }
+        if (! sdp_jin_int(&jsc->in, &i))
+            return false;
+        mpi = ioad_find_mitem(ioad_acron_arr[k]);
+        max = mpi ? ((1 << mpi->num_bits) - 1) : 0;
+        if ((i < 0) || (i > max)) {
+            snprintf(jsc->err, sizeof(jsc->err), "group %d: %s of %" PRId64
+                     " exceeds %" PRId64, first, ioad_acron_arr[k], i, max);
+            return false;
+        }
+        grp.val[k] = (int)i;
+        grp.fld_given[k] = true;
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    if (r < 0)
+        return false;
+store:
+    for (g = first; g <= last; ++g) {
+        if (jsc->tp->grp[g].given) {
+            snprintf(jsc->err, sizeof(jsc->err), "group %d given more than "
+                     "once", g);
+            return false;
+        }
+        jsc->tp->grp[g] = grp;
+    }
+    return true;
+}
+
+/* Scans the "groups" object */
+static bool
+ij_groups(struct ioad_jscan_t * jsc)
+{
+    int r, k_len, first, last;
+    const char * k_s;
+
+    if (jsc->tp->have_groups) {
+        snprintf(jsc->err, sizeof(jsc->err), "\"groups\" given more than "
+                 "once");
+        return false;
+    }
+    jsc->tp->have_groups = true;
+    if (sdp_jin_empty(&jsc->in, '}'))
+        return true;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        if (! ij_grp_range(jsc, k_s, k_len, &first, &last))
+            return false;
+        if (! ij_group(jsc, first, last))
+            return false;
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    return (0 == r);
+}
+
+/* Scans a JSON object looking for "groups" and "layout" members, at any
+ * depth, so the output of 'sdparm --ioad --json' can be given. */
+static bool
+ij_object(void * arg)
+{
+    bool ok;
+    int r, k_len, len;
+    const char * k_s;
+    const char * sp;
+    struct ioad_jscan_t * jsc = (struct ioad_jscan_t *)arg;
+
+    if (sdp_jin_empty(&jsc->in, '}'))
+        return true;
+    do {
+        if (! sdp_jin_key(&jsc->in, &k_s, &k_len))
+            return false;
+        if (sdp_jin_key_eq(k_s, k_len, "groups") &&
+            sdp_jin_at(&jsc->in, '{'))
+            ok = ij_groups(jsc);
+        else if (sdp_jin_key_eq(k_s, k_len, "layout") &&
+                 sdp_jin_at(&jsc->in, '"')) {
+            ok = sdp_jin_string(&jsc->in, &sp, &len);
+            if (ok && (len >= (int)sizeof(jsc->tp->layout))) {
+                snprintf(jsc->err, sizeof(jsc->err), "unknown layout");
+                ok = false;
+            } else if (ok) {
+                memcpy(jsc->tp->layout, sp, len);
+                jsc->tp->layout[len] = '\0';
+            }
+        } else
+            ok = ij_value(jsc);
+        if (! ok)
+            return false;
+    } while ((r = sdp_jin_next(&jsc->in, '}')) > 0);
+    return (0 == r);
+}
+
+static bool
+ij_value(struct ioad_jscan_t * jsc)
+{
+    return sdp_jin_value(&jsc->in, ij_object, jsc);
+}
+
+/* Scans len bytes of JSON at jp (from name, for messages) into tp */
+static int
+ioad_scan(const char * jp, int len, const char * name,
+          struct ioad_tbl_t * tp)
+{
+    bool ok;
+    struct ioad_jscan_t jsc;
+
+    memset(&jsc, 0, sizeof(jsc));
+    sdp_jin_init(&jsc.in, jp, len, IOAD_MAX_JSON_DEPTH);
+    jsc.tp = tp;
+    sdp_jin_skip_ws(&jsc.in);
+    ok = sdp_jin_at(&jsc.in, '{') && ij_value(&jsc);
+    if (ok) {
+        sdp_jin_skip_ws(&jsc.in);
+        ok = (jsc.in.p >= jsc.in.end);
+    }
+    if (! ok) {
+        if (jsc.err[0])
+            pr2serr("%s: %s\n", name, jsc.err);
+        else
+            pr2serr("%s is not valid JSON (near offset %d)\n", name,
+                    (int)(jsc.in.p - jp));
+        return SG_LIB_FILE_ERROR;
+    }
+    if (! tp->have_groups) {
+        pr2serr("%s: no \"groups\" object found\n", name);
+        return SG_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+static const struct ioad_preset_t *
+ioad_find_preset(const char * name)
+{
+    const struct ioad_preset_t * psp;
+
+    for (psp = ioad_preset_arr; psp->name; ++psp) {
+        if (0 == strcmp(name, psp->name))
+            return psp;
+    }
+    return NULL;
+}
+
+/* Reads the table in FILE (or preset) fn into tp. Returns 0 on success. */
+static int
+ioad_load(struct ioad_tbl_t * tp, const char * fn, int verbose)
+{
+    int g, len;
+    int res = 0;
+    char * b = NULL;
+    FILE * fp = NULL;
+    const struct ioad_preset_t * psp;
+    struct ioad_tbl_t * ftp = NULL;
+
+    psp = ioad_find_preset(fn);
+    if (psp) {
+        if (verbose)
+            pr2serr("using built-in %s preset: %s\n", ioad_s, fn);
+        return ioad_scan(psp->json, (int)strlen(psp->json), fn, tp);
+    }
+    if ((1 == strlen(fn)) && ('-' == fn[0]))
+        fp = stdin;
+    else if (NULL == (fp = fopen(fn, "r"))) {
+        res = errno;
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    b = (char *)malloc(IOAD_MAX_JSON_LEN + 1);
+    ftp = (struct ioad_tbl_t *)calloc(1, sizeof(*ftp));
+    if ((NULL == b) || (NULL == ftp)) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    len = (int)fread(b, 1, IOAD_MAX_JSON_LEN + 1, fp);
+    if (len > IOAD_MAX_JSON_LEN) {
+        pr2serr("%s: %s is too long (more than %d bytes)\n", __func__, fn,
+                IOAD_MAX_JSON_LEN);
+        res = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    b[len] = '\0';
+    res = ioad_scan(b, len, fn, ftp);
+    if (res)
+        goto fini;
+    if (ftp->layout[0]) {   /* start from layout, then groups from FILE */
+        psp = ioad_find_preset(ftp->layout);
+        if (NULL == psp) {
+            pr2serr("%s: unknown layout \"%s\", expect 'off' or 'rwh'\n",
+                    fn, ftp->layout);
+            res = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        res = ioad_scan(psp->json, (int)strlen(psp->json), psp->name, tp);
+        if (res)
+            goto fini;
+        for (g = 0; g < IOAD_NUM_GRPS; ++g) {
+            if (ftp->grp[g].given)
+                tp->grp[g] = ftp->grp[g];
+        }
+    } else
+        *tp = *ftp;
+fini:
+    if (fp && (stdin != fp))
+        fclose(fp);
+    free(b);
+    free(ftp);
+    return res;
+}
+
+/* Prepares for '--ioad' (fn is NULL) or '--ioad=FILE'. When FILE is given
+ * it is read once here so it may be stdin even when there are many
+ * DEVICEs. On success returns 0 and places a new object in *iapp . */
+int
+sdp_ioad_new(const char * fn, const struct sdparm_opt_coll * op,
+             struct sdparm_ioad_t ** iapp)
+{
+    int res;
+    struct sdparm_ioad_t * iap;
+
+    *iapp = NULL;
+    iap = (struct sdparm_ioad_t *)calloc(1, sizeof(*iap));
+    if (NULL == iap)
+        return sg_convert_errno(ENOMEM);
+    iap->fn = fn;
+    if (fn) {
+        res = ioad_load(&iap->tbl, fn, op->verbose);
+        if (res) {
+            free(iap);
+            return res;
+        }
+    }
+    *iapp = iap;
+    return 0;
+}
+
+void
+sdp_ioad_free(struct sdparm_ioad_t * iap)
+{
+    if (iap)
+        free(iap);
+}
+
+/* Fetches page control pc (0: current, 1: changeable) of the ioad subpage
+ * into b (IOAD_MS_BUFF_LEN bytes). On success places the offset of the
+ * subpage within b in *offp and its length in *lenp. */
+static int
+ioad_fetch(struct sdparm_ctx_t * ctxp, int pc, uint8_t * b, int * offp,
+           int * lenp)
+{
+    int res, off, len, n;
+    int resid = 0;
+    char e[128];
+
+    memset(b, 0, IOAD_MS_BUFF_LEN);
+    res = sdp_ctx_mode_sense_pc(ctxp, pc, CONTROL_MP, MSP_SBC_IO_ADVI, b,
+                                IOAD_MS_BUFF_LEN, &resid);
+    if (res)
+        return res;
+    len = IOAD_MS_BUFF_LEN - resid;
+    n = sg_msense_calc_length(b, len, false, NULL);
+    if ((n > 0) && (n < len))
+        len = n;
+    off = sg_mode_page_offset(b, len, false, e, sizeof(e));
+    if ((off < 0) || ((off + IOAD_DESC_OFF) > len) ||
+        (CONTROL_MP != (b[off] & 0x3f)) || (0 == (b[off] & 0x40)) ||
+        (MSP_SBC_IO_ADVI != b[off + 1])) {
+        if (ctxp->opts.verbose)
+            pr2serr("%s: %s\n", __func__,
+                    (off < 0) ? e : "wrong page in response");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    n = sdp_mpage_len(b + off);
+    *offp = off;
+    *lenp = ((off + n) > len) ? (len - off) : n;
+    return 0;
+}
+
+static int
+ioad_num_desc(int pg_len)
+{
+    int n = (pg_len - IOAD_DESC_OFF) / IOAD_DESC_LEN;
+
+    if (n < 0)
+        return 0;
+    return (n > IOAD_NUM_GRPS) ? IOAD_NUM_GRPS : n;
+}
+
+/* Shows the valid groups in the current values of the ioad subpage */
+static int
+ioad_show(struct sdparm_ctx_t * ctxp, sgj_opaque_p jop)
+{
+    int k, g, j, n, res, off, pg_len, nd, num_inv;
+    uint64_t v;
+    const uint8_t * dp;
+    const struct sdparm_mp_item_t * mpi_arr[IOAD_NUM_FLDS];
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p = NULL;
+    sgj_opaque_p jo4p;
+    uint8_t b[IOAD_MS_BUFF_LEN];
+    char key[16];
+    char line[256];
+
+    res = ioad_fetch(ctxp, 0, b, &off, &pg_len);
+    if (res) {
+        pr2serr("%s [ioad] %s not supported by DEVICE\n", ioad_s, mp_s);
+        return SG_LIB_CONTRADICT;
+    }
+    for (k = 0; k < IOAD_NUM_FLDS; ++k) {
+        mpi_arr[k] = ioad_find_mitem(ioad_acron_arr[k]);
+        if (NULL == mpi_arr[k])
+            return SG_LIB_LOGIC_ERROR;
+    }
+    nd = ioad_num_desc(pg_len);
+    sgj_pr_hr(jsp, "%s [ioad] %s, %d group descriptors:\n", ioad_s, mp_s,
+              nd);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "io_advice_hints");
+        sgj_js_nv_i(jsp, jo2p, "number_of_groups", nd);
+        jo3p = sgj_named_subobject_r(jsp, jo2p, "groups");
+    }
+    for (g = 0, num_inv = 0; g < nd; ++g) {
+        dp = b + off + (g * IOAD_DESC_LEN);
+        if (sdp_mitem_get_value(mpi_arr[IOAD_IOA_MODE], dp)) {
+            ++num_inv;
+            continue;
+        }
+        n = snprintf(line, sizeof(line), "  group %2d:", g);
+        jo4p = NULL;
+        if (jo3p) {
+            snprintf(key, sizeof(key), "%d", g);
+            jo4p = sgj_named_subobject_r(jsp, jo3p, key);
+        }
+        for (k = IOAD_IOA_MODE + 1; k < IOAD_NUM_FLDS; ++k) {
+            v = sdp_mitem_get_value(mpi_arr[k], dp);
+            if (v && (n < (int)sizeof(line)))
+                n += snprintf(line + n, sizeof(line) - n, " %s=%" PRIu64,
+                              ioad_acron_arr[k], v);
+            if (jo4p && v) {
+                snprintf(key, sizeof(key), "%s", ioad_acron_arr[k]);
+                for (j = 0; key[j]; ++j)
+                    key[j] = tolower((unsigned char)key[j]);
+                sgj_js_nv_i(jsp, jo4p, key, (int64_t)v);
+            }
+        }
+        sgj_pr_hr(jsp, "%s\n", line);
+    }
+    sgj_pr_hr(jsp, "  %d of %d groups valid\n", nd - num_inv, nd);
+    return 0;
+}
+
+/* Builds the descriptors of the subpage at mp (pg_len bytes) from tp */
+static void
+ioad_build(const struct ioad_tbl_t * tp,
+           const struct sdparm_mp_item_t ** mpi_arr, uint8_t * mp,
+           int pg_len)
+{
+    int g, k, nd;
+    uint8_t * dp;
+    const struct ioad_grp_t * gp;
+
+    nd = ioad_num_desc(pg_len);
+    memset(mp + IOAD_DESC_OFF, 0, nd * IOAD_DESC_LEN);
+    for (g = 0, gp = tp->grp; g < nd; ++g, ++gp) {
+        dp = mp + (g * IOAD_DESC_LEN);
+        if (! gp->given) {
+            sdp_mitem_set_value(1, mpi_arr[IOAD_IOA_MODE], dp);
+            continue;
+        }
+        for (k = 0; k < IOAD_NUM_FLDS; ++k) {
+            if (gp->fld_given[k])
+                sdp_mitem_set_value(gp->val[k], mpi_arr[k], dp);
+        }
+    }
+}
+
+/* Writes the table in iap as the whole ioad subpage of the DEVICE */
+static int
+ioad_apply(const struct sdparm_ioad_t * iap, struct sdparm_ctx_t * ctxp,
+           sgj_opaque_p jop)
+{
+    bool changed;
+    int k, g, j, res, off, pg_len, cha_off, cha_len, nd;
+    int num_bad = 0;
+    const int hdr_len = 8;
+    const char * status;
+    const struct sdparm_mp_item_t * mpi_arr[IOAD_NUM_FLDS];
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    struct sdparm_mp_change_t mc;
+    uint8_t * mdp;
+    uint8_t cha[IOAD_MS_BUFF_LEN];
+    uint8_t x[IOAD_PG_LEN];
+
+    for (k = 0; k < IOAD_NUM_FLDS; ++k) {
+        mpi_arr[k] = ioad_find_mitem(ioad_acron_arr[k]);
+        if (NULL == mpi_arr[k])
+            return SG_LIB_LOGIC_ERROR;
+    }
+    mdp = (uint8_t *)calloc(2, IOAD_MS_BUFF_LEN);
+    if (NULL == mdp)
+        return sg_convert_errno(ENOMEM);
+    res = ioad_fetch(ctxp, 0, mdp, &off, &pg_len);
+    if (res) {
+        pr2serr("%s [ioad] %s not supported by DEVICE\n", ioad_s, mp_s);
+        res = SG_LIB_CONTRADICT;
+        goto fini;
+    }
+    res = ioad_fetch(ctxp, 1, cha, &cha_off, &cha_len);
+    if (res) {
+        pr2serr("unable to fetch changeable values of ioad\n");
+        goto fini;
+    }
+    if (op->save && (! (mdp[off] & 0x80))) {
+        pr2serr("ioad is not saveable but '--save' option given (try "
+                "without it)\n");
+        res = SG_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    nd = ioad_num_desc(pg_len);
+    for (g = nd; g < IOAD_NUM_GRPS; ++g) {
+        if (iap->tbl.grp[g].given) {
+            pr2serr("group %d given but DEVICE's ioad only has %d groups\n",
+                    g, nd);
+            res = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+    }
+    /* mode parameter list: MODE SELECT(10) header then the subpage */
+    if (off > hdr_len)
+        memmove(mdp + hdr_len, mdp + off, pg_len);
+    mdp[0] = 0;                 /* mode data length reserved */
+    mdp[1] = 0;
+    mdp[4] &= 0xfe;             /* LONGLBA */
+    mdp[6] = 0;                 /* block descriptor length */
+    mdp[7] = 0;
+    if (PDT_DISK == ctxp->pdt)  /* device specific parameter is */
+        mdp[3] = 0;             /* reserved for mode select */
+    mdp[hdr_len] &= 0x7f;       /* PS bit reserved in mode select */
+    memset(&mc, 0, sizeof(mc));
+    mc.pn = CONTROL_MP;
+    mc.spn = MSP_SBC_IO_ADVI;
+    mc.off = hdr_len;
+    mc.md_len = hdr_len + pg_len;
+    mc.md = mdp;
+    mc.orig = mdp + IOAD_MS_BUFF_LEN;
+    memcpy(mc.orig, mdp, mc.md_len);
+    if (cha_len < pg_len)
+        memset(cha + cha_off + cha_len, 0, pg_len - cha_len);
+    ioad_build(&iap->tbl, mpi_arr, mdp + hdr_len, pg_len);
+
+    /* name each field that would change but is not changeable */
+    memset(x, 0, sizeof(x));
+    for (j = IOAD_DESC_OFF; j < pg_len; ++j)
+        x[j] = (mdp[hdr_len + j] ^ mc.orig[hdr_len + j]) & ~cha[cha_off + j];
+    for (g = 0; g < nd; ++g) {
+        for (k = 0; k < IOAD_NUM_FLDS; ++k) {
+            if (0 == sdp_mitem_get_value(mpi_arr[k],
+                                         x + (g * IOAD_DESC_LEN)))
+                continue;
+            pr2serr("  group %d %s is not changeable\n", g,
+                    ioad_acron_arr[k]);
+            ++num_bad;
+        }
+    }
+    if (num_bad > 0) {
+        pr2serr("%d field%s not changeable on this DEVICE, nothing "
+                "written\n", num_bad, (1 == num_bad) ? "" : "s");
+        res = SG_LIB_CAT_INVALID_PARAM;
+        goto fini;
+    }
+    changed = !! memcmp(mc.md + hdr_len, mc.orig + hdr_len, pg_len);
+    if (! changed)
+        status = "unchanged";
+    else {
+        res = sdp_write_mpages(ctxp->sg_fd, ctxp->pdt, &mc, 1, op);
+        if (res)
+            status = "failed";
+        else
+            status = op->dummy ? "would_write" : "written";
+    }
+    sgj_pr_hr(jsp, "ioad: %s\n", (0 == strcmp(status, "would_write")) ?
+              "would write" : status);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "io_advice_hints");
+        sgj_js_nv_s(jsp, jo2p, "table_file", iap->fn);
+        sgj_js_nv_s(jsp, jo2p, "status", status);
+    }
+fini:
+    free(mdp);
+    return res;
+}
+
+/* Shows (when iap was made without a FILE) or replaces the IO advice hints
+ * grouping subpage of the DEVICE open in ctxp. Returns 0 on success. */
+int
+sdp_ioad(const struct sdparm_ioad_t * iap, struct sdparm_ctx_t * ctxp,
+         sgj_opaque_p jop)
+{
+    if (NULL == iap->fn)
+        return ioad_show(ctxp, jop);
+    return ioad_apply(iap, ctxp, jop);
+}
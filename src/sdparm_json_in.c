@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sdparm_json_in.h"
+
+/* sdparm_json_in.c : scans JSON input in place, see sdparm_json_in.h */
+
+
+/* Sets up jip to scan the len bytes of JSON at b. Objects and arrays may be
+ * nested up to max_depth deep. */
+void
+sdp_jin_init(struct sdp_jin_t * jip, const char * b, int len, int max_depth)
+{
+    jip->p = b;
+    jip->end = b + len;
+    jip->depth = 0;
+    jip->max_depth = max_depth;
+}
+
+void
+sdp_jin_skip_ws(struct sdp_jin_t * jip)
+{
+    while ((jip->p < jip->end) && ((' ' == *jip->p) || ('\t' == *jip->p) ||
+           ('\n' == *jip->p) || ('\r' == *jip->p)))
+        ++jip->p;
+}
+
+/* True if the next character is c (e.g. '{' to check that the value about
+ * to be scanned is an object) */
+bool
+sdp_jin_at(const struct sdp_jin_t * jip, char c)
+{
+    return (jip->p < jip->end) && (c == *jip->p);
+}
+
+/* Expects jip->p to point at a double quote. Places start and length of the
+ * string (escapes are left as is) in *spp and *lenp. */
+bool
+sdp_jin_string(struct sdp_jin_t * jip, const char ** spp, int * lenp)
+{
+    const char * cp;
+
+    if ((jip->p >= jip->end) || ('"' != *jip->p))
+        return false;
+    for (cp = ++jip->p; cp < jip->end; ++cp) {
+        if ('\\' == *cp)
+            ++cp;
+        else if ('"' == *cp)
+            break;
+    }
+    if (cp >= jip->end)
+        return false;
+    *spp = jip->p;
+    *lenp = (int)(cp - jip->p);
+    jip->p = cp + 1;
+    return true;
+}
+
+/* True if the string of len bytes at sp (not NUL terminated) is key */
+bool
+sdp_jin_key_eq(const char * sp, int len, const char * key)
+{
+    return (len == (int)strlen(key)) && (0 == memcmp(sp, key, len));
+}
+
+/* Expects jip->p to point at the start of a JSON integer. Returns false,
+ * without stepping over it, if it is not a number or has a fraction or
+ * exponent. */
+bool
+sdp_jin_int(struct sdp_jin_t * jip, int64_t * ip)
+{
+    int64_t i;
+    char * cp;
+
+    if ((jip->p >= jip->end) ||
+        (('-' != *jip->p) && ((*jip->p < '0') || (*jip->p > '9'))))
+        return false;
+    i = strtoll(jip->p, &cp, 10);
+    if ((cp == jip->p) || ('.' == *cp) || ('e' == *cp) || ('E' == *cp))
+        return false;
+    *ip = i;
+    jip->p = cp;
+    return true;
+}
+
+/* Scans a key (and the colon after it) inside a JSON object */
+bool
+sdp_jin_key(struct sdp_jin_t * jip, const char ** kpp, int * k_lenp)
+{
+    sdp_jin_skip_ws(jip);
+    if (! sdp_jin_string(jip, kpp, k_lenp))
+        return false;
+    sdp_jin_skip_ws(jip);
+    if ((jip->p >= jip->end) || (':' != *jip->p))
+        return false;
+    ++jip->p;
+    sdp_jin_skip_ws(jip);
+    return true;
+}
+
+/* After a member of an object (or element of an array) steps over the
+ * following comma and returns 1, or over the closing char (cl) and
+ * returns 0. Returns -1 on a syntax error. */
+int
+sdp_jin_next(struct sdp_jin_t * jip, char cl)
+{
+    sdp_jin_skip_ws(jip);
+    if (jip->p >= jip->end)
+        return -1;
+    if (',' == *jip->p) {
+        ++jip->p;
+        return 1;
+    }
+    if (cl == *jip->p) {
+        ++jip->p;
+        return 0;
+    }
+    return -1;
+}
+
+/* Steps over an opening char and any whitespace, returns true if the
+ * object (or array) is empty, stepping over its closing char (cl) too. */
+bool
+sdp_jin_empty(struct sdp_jin_t * jip, char cl)
+{
+    ++jip->p;
+    sdp_jin_skip_ws(jip);
+    if ((jip->p < jip->end) && (cl == *jip->p)) {
+        ++jip->p;
+        return true;
+    }
+    return false;
+}
+
+/* Scans any JSON value. When it is an object and obj_fn is given then
+ * obj_fn(arg) is called with jip->p at the opening brace and must scan the
+ * whole object (typically looking at each key and calling back here for
+ * the values it is not interested in); otherwise the object is stepped
+ * over. Elements of arrays are scanned by calling back here. */
+bool
+sdp_jin_value(struct sdp_jin_t * jip, bool (*obj_fn)(void * arg),
+              void * arg)
+{
+    bool ok = true;
+    int len;
+    int r = 0;
+    int64_t i;
+    const char * sp;
+    char * cp;
+
+    sdp_jin_skip_ws(jip);
+    if (jip->p >= jip->end)
+        return false;
+    switch (*jip->p) {
+    case '{':
+        if (++jip->depth > jip->max_depth)
+            return false;
+        if (obj_fn)
+            ok = obj_fn(arg);
+        else if (! sdp_jin_empty(jip, '}')) {
+            do {
+                ok = sdp_jin_key(jip, &sp, &len) &&
+                     sdp_jin_value(jip, NULL, NULL);
+            } while (ok && ((r = sdp_jin_next(jip, '}')) > 0));
+            ok = ok && (0 == r);
+        }
+        --jip->depth;
+        return ok;
+    case '[':
+        if (++jip->depth > jip->max_depth)
+            return false;
+        if (! sdp_jin_empty(jip, ']')) {
+            do {
+                ok = sdp_jin_value(jip, obj_fn, arg);
+            } while (ok && ((r = sdp_jin_next(jip, ']')) > 0));
+            ok = ok && (0 == r);
+        }
+        --jip->depth;
+        return ok;
+    case '"':
+        return sdp_jin_string(jip, &sp, &len);
+    case 't':
+    case 'f':
+    case 'n':
+        while ((jip->p < jip->end) && (*jip->p >= 'a') && (*jip->p <= 'z'))
+            ++jip->p;
+        return true;
+    default:
+        if (sdp_jin_int(jip, &i))
+            return true;
+        strtod(jip->p, &cp);    /* not an integer */
+        if (cp == jip->p)
+            return false;
+        jip->p = cp;
+        return true;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef SDPARM_JSON_IN_H
+#define SDPARM_JSON_IN_H
+
+/*
+ * A small scanner for JSON input, shared by the options that read JSON
+ * (e.g. '--baseline=FILE', '--cdl=FILE' and '--ioad=FILE'). It works in
+ * place on a buffer, strings are returned as a pointer and a length into
+ * that buffer (escapes are left as is), and nothing is allocated. Each
+ * user walks the objects it is interested in with these primitives and
+ * can step over everything else with sdp_jin_value().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sdp_jin_t {
+    const char * p;             /* next character to be scanned */
+    const char * end;           /* one past the last character */
+    int depth;                  /* of nested objects and arrays */
+    int max_depth;              /* sdp_jin_value() fails when exceeded */
+};
+
+void sdp_jin_init(struct sdp_jin_t * jip, const char * b, int len,
+                  int max_depth);
+void sdp_jin_skip_ws(struct sdp_jin_t * jip);
+bool sdp_jin_at(const struct sdp_jin_t * jip, char c);
+bool sdp_jin_string(struct sdp_jin_t * jip, const char ** spp, int * lenp);
+bool sdp_jin_key_eq(const char * sp, int len, const char * key);
+bool sdp_jin_int(struct sdp_jin_t * jip, int64_t * ip);
+bool sdp_jin_key(struct sdp_jin_t * jip, const char ** kpp, int * k_lenp);
+int sdp_jin_next(struct sdp_jin_t * jip, char cl);
+bool sdp_jin_empty(struct sdp_jin_t * jip, char cl);
+bool sdp_jin_value(struct sdp_jin_t * jip, bool (*obj_fn)(void * arg),
+                   void * arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
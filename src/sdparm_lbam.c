@@ -0,0 +1,592 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include <sys/types.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_lbam.c : '--lba-map[=FILE]' builds the provisioning map of a thin
+ * provisioned (i.e. LBPME=1) DEVICE with the GET LBA STATUS command. The
+ * LBA space is split into chunks that are mapped by up to QD child
+ * processes at once ('--qdepth=QD', default 4, but no more than the queue
+ * depth of the DEVICE on Linux), each with its own file descriptor so
+ * QD commands are in flight. GET LBA STATUS(32) is used when the DEVICE
+ * supports it since its scan length stops a command at the end of its
+ * chunk, otherwise GET LBA STATUS(16). The LBA status descriptors of all
+ * chunks are merged into runs of mapped, deallocated, anchored and
+ * unknown LBAs; a summary is output and, if FILE is given, the runs are
+ * written to it in a compact binary form:
+ *    bytes 0 to 7:   "SDPLBAM1"
+ *    bytes 8 to 11:  logical block length (big endian)
+ *    bytes 12 to 15: reserved
+ *    bytes 16 to 23: number of logical blocks (big endian)
+ *    bytes 24 to 31: number of runs (big endian)
+ *  then 8 bytes (big endian) per run, in LBA order: the provisioning
+ *  status (0: mapped, 1: deallocated, 2: anchored, 3: unknown) in the top
+ *  4 bits and the number of LBAs in the run in the remaining 60 bits. */
+
+#define LBAM_DEF_JOBS 4
+#define LBAM_CHUNKS_PER_JOB 8
+#define LBAM_RESP_LEN (16 * 1024)       /* room for 1023 descriptors */
+#define LBAM_DESC_OFF 8
+#define LBAM_DESC_LEN 16
+#define LBAM_RCAP16_LEN 32
+#define LBAM_LBP_VPD_LEN 64
+#define LBAM_HDR_LEN 32
+#define LBAM_RUN_LEN 8
+#define LBAM_NUM_MASK 0x0fffffffffffffffULL
+#define LBAM_SCAN_MAX 0xffffffffULL
+
+#define LBAM_MAPPED 0
+#define LBAM_DEALLOC 1
+#define LBAM_ANCHORED 2
+#define LBAM_UNKNOWN 3
+#define LBAM_NUM_ST 4
+
+struct lbam_run_t {
+    uint64_t lba;
+    uint64_t num;
+    int st;             /* LBAM_MAPPED, LBAM_DEALLOC, ... */
+};
+
+struct lbam_job_t {     /* in memory shared with the job's child */
+    int cmds;           /* number of GET LBA STATUS commands issued */
+    uint64_t fail_lba;  /* starting LBA of the command that failed */
+};
+
+struct lbam_t {         /* the DEVICE being mapped */
+    const char * device_name;
+    bool use32;         /* true: GET LBA STATUS(32), else (16) */
+    int jobs;
+    int num_chunks;
+    int vb;
+    uint64_t nblks;
+    uint64_t chunk_sz;  /* in LBAs */
+    struct lbam_job_t * job_arr;
+    size_t job_sz;
+    FILE ** fp_arr;     /* runs found by each job, in struct lbam_run_t */
+};
+
+static const char * lbam_st_arr[LBAM_NUM_ST] = {
+    "mapped", "deallocated", "anchored", "unknown",
+};
+
+static const char * prov_type_arr[4] = {
+    "not known or fully provisioned", "resource provisioned",
+    "thin provisioned", "reserved",
+};
+
+static const char * gls_s = "GET LBA STATUS";
+
+
+/* Maps the provisioning status field of a LBA status descriptor */
+static int
+lbam_status(int ps)
+{
+    switch (ps & 0xf) {
+    case 0x0:           /* mapped or unknown */
+    case 0x3:           /* mapped (known) */
+        return LBAM_MAPPED;
+    case 0x1:
+        return LBAM_DEALLOC;
+    case 0x2:
+        return LBAM_ANCHORED;
+    default:
+        return LBAM_UNKNOWN;
+    }
+}
+
+/* Appends num LBAs starting at lba with status st to the run in curp,
+ * first writing curp to fp if they can't be merged. */
+static void
+lbam_add(struct lbam_run_t * curp, uint64_t lba, uint64_t num, int st,
+         FILE * fp)
+{
+    if ((curp->num > 0) && (st == curp->st) &&
+        ((curp->lba + curp->num) == lba)) {
+        curp->num += num;
+        return;
+    }
+    if (curp->num > 0)
+        fwrite(curp, sizeof(*curp), 1, fp);
+    curp->lba = lba;
+    curp->num = num;
+    curp->st = st;
+}
+
+/* Maps LBAs s to (e - 1) with as many GET LBA STATUS commands as needed,
+ * writing the runs found to fp. Returns 0 on success. */
+static int
+lbam_chunk(int sg_fd, const struct lbam_t * lmp, uint64_t s, uint64_t e,
+           uint8_t * b, FILE * fp, struct lbam_job_t * jp)
+{
+    int k, res, len;
+    uint64_t lba, next, d_lba, d_end;
+    const uint8_t * bp;
+    struct lbam_run_t cur;
+
+    memset(&cur, 0, sizeof(cur));
+    for (lba = s; lba < e; lba = next) {
+        if (lmp->use32)
+            res = sg_ll_get_lba_status32(sg_fd, lba, (uint32_t)
+                            (((e - lba) > LBAM_SCAN_MAX) ? LBAM_SCAN_MAX :
+                             (e - lba)), 0, 0, b, LBAM_RESP_LEN,
+                            lmp->vb > 0, lmp->vb);
+        else
+            res = sg_ll_get_lba_status16(sg_fd, lba, 0, b, LBAM_RESP_LEN,
+                                         lmp->vb > 0, lmp->vb);
+        ++jp->cmds;
+        if (res) {
+            jp->fail_lba = lba;
+            return res;
+        }
+        len = (int)sg_get_unaligned_be32(b + 0) + 4;
+        if (len > LBAM_RESP_LEN)
+            len = LBAM_RESP_LEN;
+        next = lba;
+        for (k = LBAM_DESC_OFF, bp = b + k; (k + LBAM_DESC_LEN) <= len;
+             k += LBAM_DESC_LEN, bp += LBAM_DESC_LEN) {
+            d_lba = sg_get_unaligned_be64(bp + 0);
+            d_end = d_lba + sg_get_unaligned_be32(bp + 8);
+            if (d_end <= next)
+                continue;       /* empty or already covered */
+            if (d_lba > next) { /* gap in descriptors */
+                if (d_lba >= e)
+                    break;
+                lbam_add(&cur, next, d_lba - next, LBAM_UNKNOWN, fp);
+                next = d_lba;
+            }
+            if (d_end > e)
+                d_end = e;
+            lbam_add(&cur, next, d_end - next, lbam_status(bp[12]), fp);
+            next = d_end;
+            if (next >= e)
+                break;
+        }
+        if (next == lba) {      /* no progress, give up */
+            pr2serr("%s: %s at LBA 0x%" PRIx64 " returned no descriptor "
+                    "for it\n", lmp->device_name, gls_s, lba);
+            jp->fail_lba = lba;
+            return SG_LIB_CAT_MALFORMED;
+        }
+    }
+    if (cur.num > 0)
+        fwrite(&cur, sizeof(cur), 1, fp);
+    return 0;
+}
+
+/* Work done by the j-th job: chunks j, j + jobs, j + (2 * jobs), ...
+ * Called by sdp_sched_jobs() with arg pointing to the struct lbam_t . */
+static int
+lbam_job(int j, void * arg)
+{
+    int c, sg_fd;
+    int res = 0;
+    uint64_t s, e;
+    const struct lbam_t * lmp = (const struct lbam_t *)arg;
+    struct lbam_job_t * jp = lmp->job_arr + j;
+    FILE * fp = lmp->fp_arr[j];
+    uint8_t * b;
+    uint8_t * free_b;
+
+    sg_fd = sg_cmds_open_device(lmp->device_name, true /* ro */, lmp->vb);
+    if (sg_fd < 0) {
+        pr2serr("%s: open error: %s\n", lmp->device_name,
+                safe_strerror(-sg_fd));
+        return sg_convert_errno(-sg_fd);
+    }
+    b = sg_memalign(LBAM_RESP_LEN, 0, &free_b, false);
+    if (NULL == b)
+        res = sg_convert_errno(ENOMEM);
+    for (c = j; (0 == res) && (c < lmp->num_chunks); c += lmp->jobs) {
+        s = (uint64_t)c * lmp->chunk_sz;
+        if (s >= lmp->nblks)
+            break;
+        e = s + lmp->chunk_sz;
+        if (e > lmp->nblks)
+            e = lmp->nblks;
+        res = lbam_chunk(sg_fd, lmp, s, e, b, fp, jp);
+        if (res)
+            pr2serr("%s: job %d failed at LBA 0x%" PRIx64 "\n",
+                    lmp->device_name, j, jp->fail_lba);
+    }
+    if ((0 == res) && (fflush(fp) || ferror(fp)))
+        res = SG_LIB_FILE_ERROR;
+    if (free_b)
+        free(free_b);
+    sg_cmds_close_device(sg_fd);
+    return res;
+}
+
+static int
+lbam_run_cmp(const void * a, const void * b)
+{
+    const struct lbam_run_t * ap = (const struct lbam_run_t *)a;
+    const struct lbam_run_t * bp = (const struct lbam_run_t *)b;
+
+    return (ap->lba < bp->lba) ? -1 : ((ap->lba > bp->lba) ? 1 : 0);
+}
+
+/* Reads the runs of all jobs, sorts them by LBA and merges neighbours with
+ * the same status (at chunk boundaries). LBAs that no job reported become
+ * unknown. Returns the merged runs (from the heap) and their number in
+ * *nump, or NULL on error. */
+static struct lbam_run_t *
+lbam_merge(const struct lbam_t * lmp, int64_t * nump)
+{
+    int j;
+    long n;
+    int64_t k, m, num;
+    uint64_t next;
+    struct lbam_run_t * arr;
+    struct lbam_run_t * out;
+    FILE * fp;
+
+    for (j = 0, num = 0; j < lmp->jobs; ++j) {
+        fp = lmp->fp_arr[j];
+        if (fseek(fp, 0, SEEK_END) || ((n = ftell(fp)) < 0))
+            return NULL;
+        num += n / (long)sizeof(struct lbam_run_t);
+    }
+    arr = (struct lbam_run_t *)calloc(num + 1, sizeof(*arr));
+    out = (struct lbam_run_t *)calloc((2 * num) + 1, sizeof(*out));
+    if ((NULL == arr) || (NULL == out))
+        goto err_out;
+    for (j = 0, k = 0; j < lmp->jobs; ++j) {
+        fp = lmp->fp_arr[j];
+        rewind(fp);
+        k += fread(arr + k, sizeof(*arr), num - k, fp);
+    }
+    qsort(arr, k, sizeof(*arr), lbam_run_cmp);
+    for (m = 0, num = k, k = 0, next = 0; k < num; ++k) {
+        if (arr[k].lba > next) {
+            out[m].lba = next;
+            out[m].num = arr[k].lba - next;
+            out[m++].st = LBAM_UNKNOWN;
+        }
+        if ((m > 0) && (out[m - 1].st == arr[k].st) &&
+            ((out[m - 1].lba + out[m - 1].num) == arr[k].lba))
+            out[m - 1].num += arr[k].num;
+        else
+            out[m++] = arr[k];
+        next = arr[k].lba + arr[k].num;
+    }
+    if (next < lmp->nblks) {
+        out[m].lba = next;
+        out[m].num = lmp->nblks - next;
+        out[m++].st = LBAM_UNKNOWN;
+    }
+    free(arr);
+    *nump = m;
+    return out;
+err_out:
+    free(arr);
+    free(out);
+    return NULL;
+}
+
+/* Writes the runs to fn in the binary form described at the top */
+static int
+lbam_write(const char * fn, const struct lbam_run_t * rp, int64_t num,
+           uint32_t lbs, uint64_t nblks)
+{
+    int err;
+    int64_t k;
+    uint64_t u, n;
+    FILE * fp;
+    uint8_t b[LBAM_HDR_LEN];
+
+    fp = fopen(fn, "wb");
+    if (NULL == fp) {
+        err = errno;
+        pr2serr("unable to open %s: %s\n", fn, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    memset(b, 0, sizeof(b));
+    memcpy(b, "SDPLBAM1", 8);
+    sg_put_unaligned_be32(lbs, b + 8);
+    sg_put_unaligned_be64(nblks, b + 16);
+    sg_put_unaligned_be64((uint64_t)num, b + 24);
+    fwrite(b, 1, LBAM_HDR_LEN, fp);
+    for (k = 0; k < num; ++k, ++rp) {
+        /* split runs too long for 60 bits, not expected */
+        for (n = rp->num; n > 0; n -= u) {
+            u = (n > LBAM_NUM_MASK) ? LBAM_NUM_MASK : n;
+            sg_put_unaligned_be64(((uint64_t)rp->st << 60) | u, b);
+            fwrite(b, 1, LBAM_RUN_LEN, fp);
+        }
+    }
+    if (fclose(fp)) {
+        err = errno;
+        pr2serr("error writing %s: %s\n", fn, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    return 0;
+}
+
+#ifdef SG_LIB_LINUX
+
+/* Returns the queue depth the kernel uses for the DEVICE, or 0 if not
+ * known. */
+static int
+lbam_queue_depth(const char * device_name)
+{
+    int qd = 0;
+    FILE * fp;
+    char bdev[NAME_MAX + 1];
+    char d[PATH_MAX];
+
+    if (! sdp_bdev_name(device_name, bdev, sizeof(bdev)))
+        return 0;
+    snprintf(d, sizeof(d), "/sys/block/%s/device/queue_depth", bdev);
+    fp = fopen(d, "r");
+    if (NULL == fp)
+        return 0;
+    if (1 != fscanf(fp, "%d", &qd))
+        qd = 0;
+    fclose(fp);
+    return qd;
+}
+
+#endif
+
+static int64_t
+lbam_now_ms(void)
+{
+#ifndef SG_LIB_WIN32
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#else
+    return (int64_t)time(NULL) * 1000;
+#endif
+}
+
+/* Builds the provisioning map of DEVICE device_name open in ctxp, outputs
+ * a summary and (if op->lbam_fn) writes the runs to that file. Returns 0
+ * on success. */
+int
+sdp_lba_map(struct sdparm_ctx_t * ctxp, const char * device_name,
+            sgj_opaque_p jop)
+{
+    bool anc_sup = false;
+    int j, res, pt;
+    int resid = 0;
+    int ret = 0;
+    int cmds = 0;
+    int qd = 0;
+    uint32_t lbs;
+    int64_t k, num_runs, start_ms, elapsed_ms;
+    uint64_t lbas[LBAM_NUM_ST];
+    int runs[LBAM_NUM_ST];
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    const int sg_fd = ctxp->sg_fd;
+    const int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct lbam_run_t * rp;
+    struct lbam_run_t * run_arr = NULL;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    struct lbam_t lm;
+    uint8_t b[LBAM_RCAP16_LEN];
+    uint8_t v[LBAM_LBP_VPD_LEN];
+    uint8_t gls[LBAM_DESC_OFF + LBAM_DESC_LEN];
+
+    memset(&lm, 0, sizeof(lm));
+    res = sg_ll_readcap_16(sg_fd, false /* pmi */, 0 /* llba */, b,
+                           LBAM_RCAP16_LEN, vb > 0, vb);
+    if (res) {
+        pr2serr("%s: READ CAPACITY(16) failed\n", device_name);
+        return res;
+    }
+    if (! (b[14] & 0x80)) {
+        pr2serr("%s: not logical block provisioned (LBPME=0), nothing to "
+                "map\n", device_name);
+        return SG_LIB_CONTRADICT;
+    }
+    lm.nblks = sg_get_unaligned_be64(b + 0) + 1;
+    lbs = sg_get_unaligned_be32(b + 8);
+    pt = -1;
+    if ((0 == sg_ll_inquiry_v2(sg_fd, true, VPD_LB_PROVISIONING, v,
+                               LBAM_LBP_VPD_LEN, 0, &resid, false, vb)) &&
+        ((LBAM_LBP_VPD_LEN - resid) >= 8) && (VPD_LB_PROVISIONING == v[1])) {
+        anc_sup = !! (v[5] & 0x2);
+        pt = v[6] & 0x7;
+        if (op->do_long)        /* full decode of the VPD page */
+            sdp_process_vpd_page(sg_fd, VPD_LB_PROVISIONING, 0, -1, false,
+                                 NULL, NULL, 0, op, jop);
+    }
+    /* the 32 byte variant can stop at the end of each chunk */
+    lm.use32 = (0 == sg_ll_get_lba_status32(sg_fd, 0, 1, 0, 0, gls,
+                                            sizeof(gls), false, vb));
+    lm.device_name = device_name;
+    lm.vb = vb;
+    lm.jobs = (op->qdepth > 0) ? op->qdepth : LBAM_DEF_JOBS;
+#ifdef SG_LIB_LINUX
+    qd = lbam_queue_depth(device_name);
+    if ((qd > 0) && (lm.jobs > qd)) {
+        if (op->verbose)
+            pr2serr("%s: jobs reduced from %d to queue depth %d\n",
+                    device_name, lm.jobs, qd);
+        lm.jobs = qd;
+    }
+#endif
+    lm.num_chunks = lm.jobs * LBAM_CHUNKS_PER_JOB;
+    lm.chunk_sz = (lm.nblks + lm.num_chunks - 1) / lm.num_chunks;
+    if ((uint64_t)lm.num_chunks > lm.nblks) {   /* tiny DEVICE */
+        lm.num_chunks = (int)lm.nblks;
+        lm.chunk_sz = 1;
+    }
+    if (lm.jobs > lm.num_chunks)
+        lm.jobs = lm.num_chunks;
+    if (op->verbose)
+        pr2serr("%s: %s(%d), %d jobs, %d chunks of %" PRIu64 " LBAs\n",
+                device_name, gls_s, lm.use32 ? 32 : 16, lm.jobs,
+                lm.num_chunks, lm.chunk_sz);
+
+    lm.job_sz = lm.jobs * sizeof(struct lbam_job_t);
+    lm.job_arr = (struct lbam_job_t *)sdp_shm_alloc(lm.job_sz);
+    if (NULL == lm.job_arr) {
+        res = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    lm.fp_arr = (FILE **)calloc(lm.jobs, sizeof(FILE *));
+    if (NULL == lm.fp_arr) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (j = 0; j < lm.jobs; ++j) {
+        lm.fp_arr[j] = tmpfile();
+        if (NULL == lm.fp_arr[j]) {
+            res = errno;
+            pr2serr("%s: tmpfile: %s\n", __func__, safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        }
+    }
+
+    start_ms = lbam_now_ms();
+    ret = sdp_sched_jobs(lm.jobs, lbam_job, &lm);
+    elapsed_ms = lbam_now_ms() - start_ms;
+    for (j = 0; j < lm.jobs; ++j)
+        cmds += lm.job_arr[j].cmds;
+    if (ret)
+        goto fini;
+    run_arr = lbam_merge(&lm, &num_runs);
+    if (NULL == run_arr) {
+        pr2serr("%s: unable to merge the runs of each job\n", device_name);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    memset(lbas, 0, sizeof(lbas));
+    memset(runs, 0, sizeof(runs));
+    for (k = 0, rp = run_arr; k < num_runs; ++k, ++rp) {
+        lbas[rp->st] += rp->num;
+        ++runs[rp->st];
+    }
+
+    sgj_pr_hr(jsp, "Provisioning map: %" PRIu64 " LBAs of %u bytes, %s\n",
+              lm.nblks, lbs, (pt < 0) ? "thin provisioned" :
+              prov_type_arr[pt & 3]);
+    for (j = 0; j < LBAM_NUM_ST; ++j) {
+        if ((LBAM_ANCHORED == j) && (! anc_sup) && (0 == runs[j]))
+            continue;
+        sgj_pr_hr(jsp, "  %-12s %" PRIu64 " LBAs (%.2f%%) in %d runs\n",
+                  lbam_st_arr[j], lbas[j],
+                  (100.0 * (double)lbas[j]) / (double)lm.nblks, runs[j]);
+    }
+    sgj_pr_hr(jsp, "  %" PRId64 " runs from %d %s(%d) commands, %d jobs, "
+              "%" PRId64 " ms\n", num_runs, cmds, gls_s,
+              lm.use32 ? 32 : 16, lm.jobs, elapsed_ms);
+    if (op->do_long) {
+        for (k = 0, rp = run_arr; k < num_runs; ++k, ++rp)
+            sgj_pr_hr(jsp, "    LBA 0x%" PRIx64 " + %" PRIu64 ": %s\n",
+                      rp->lba, rp->num, lbam_st_arr[rp->st]);
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "lba_map");
+        sgj_js_nv_i(jsp, jo2p, "logical_block_length", lbs);
+        sgj_js_nv_i(jsp, jo2p, "number_of_logical_blocks", lm.nblks);
+        if (pt >= 0) {
+            sgj_js_nv_ihexstr(jsp, jo2p, "provisioning_type", pt, NULL,
+                              prov_type_arr[pt & 3]);
+            sgj_js_nv_b(jsp, jo2p, "anchor_supported", anc_sup);
+        }
+        sgj_js_nv_s(jsp, jo2p, "command", lm.use32 ?
+                    "GET LBA STATUS(32)" : "GET LBA STATUS(16)");
+        sgj_js_nv_i(jsp, jo2p, "number_of_commands", cmds);
+        sgj_js_nv_i(jsp, jo2p, "jobs", lm.jobs);
+        if (qd > 0)
+            sgj_js_nv_i(jsp, jo2p, "queue_depth", qd);
+        sgj_js_nv_i(jsp, jo2p, "chunks", lm.num_chunks);
+        sgj_js_nv_i(jsp, jo2p, "elapsed_ms", elapsed_ms);
+        sgj_js_nv_i(jsp, jo2p, "number_of_runs", num_runs);
+        for (j = 0; j < LBAM_NUM_ST; ++j) {
+            jo3p = sgj_named_subobject_r(jsp, jo2p, lbam_st_arr[j]);
+            sgj_js_nv_i(jsp, jo3p, "lbas", lbas[j]);
+            sgj_js_nv_i(jsp, jo3p, "runs", runs[j]);
+        }
+        if (op->lbam_fn)
+            sgj_js_nv_s(jsp, jo2p, "map_file", op->lbam_fn);
+    }
+    if (op->lbam_fn)
+        ret = lbam_write(op->lbam_fn, run_arr, num_runs, lbs, lm.nblks);
+fini:
+    free(run_arr);
+    if (lm.fp_arr) {
+        for (j = 0; j < lm.jobs; ++j) {
+            if (lm.fp_arr[j])
+                fclose(lm.fp_arr[j]);
+        }
+        free(lm.fp_arr);
+    }
+    sdp_shm_free(lm.job_arr, lm.job_sz);
+    return ret;
+}
@@ -0,0 +1,1040 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_log.c : decodes log pages that hold device side performance
+ * statistics ('--log[=LP[,SPG]]'): General statistics and performance
+ * [0x19,0x0] (and its group subpages 0x1 to 0x1f), Cache memory statistics
+ * [0x19,0x20], Command duration limits statistics [0x19,0x21] and
+ * Background scan results [0x15]. Without LP all of those the DEVICE
+ * supports are output. '--inhex=FN' decodes log page responses in FN
+ * instead of reading a DEVICE.
+ *
+ * With '--watch=SECS[,COUNT]' the counters are sampled every SECS seconds
+ * and, as for mode page fields, a line of NDJSON is output on stdout for
+ * each DEVICE and log page per interval, holding rates (per second) worked
+ * out from the counter deltas. For example IOPS, the average time taken
+ * by each READ and WRITE command (which includes its queue time) and the
+ * read cache hit ratio. */
+
+#define LOG_MX_LEN 0xfffc       /* largest LOG SENSE allocation length */
+#define LOG_CUMULATIVE 1        /* page control: current cumulative values */
+
+#define LOG_GSP_PG 0x19         /* General statistics and performance */
+#define LOG_GSP_SPG_MAX 0x1f    /* last group statistics subpage */
+#define LOG_CMS_SPG 0x20        /* Cache memory statistics */
+#define LOG_CDLS_SPG 0x21       /* Command duration limits statistics */
+#define LOG_BSR_PG 0x15         /* Background scan results */
+
+#define LOG_NUM_GA 8
+#define LOG_NUM_CMS 4
+#define LOG_NUM_CDL_CNTS 8
+#define LOG_NUM_CDL_DESC 16     /* T2A 1 to 7 and T2B 1 to 7 */
+
+struct log_pg_t {
+    int pn;
+    int spn;
+    const char * acron;
+    const char * name;
+};
+
+/* pages output when '--log' is given without LP, in this order */
+static const struct log_pg_t log_pg_arr[] = {
+    {LOG_GSP_PG, 0, "gsp", "General statistics and performance"},
+    {LOG_GSP_PG, LOG_CMS_SPG, "cms", "Cache memory statistics"},
+    {LOG_GSP_PG, LOG_CDLS_SPG, "cdls", "Command duration limits statistics"},
+    {LOG_BSR_PG, 0, "bsr", "Background scan results"},
+    {-1, -1, NULL, NULL},
+};
+
+struct log_gsp_t {              /* [0x19,0x0] to [0x19,0x1f] */
+    bool have_ga;
+    bool have_idle;
+    bool have_fua;
+    uint64_t ga[LOG_NUM_GA];    /* general access statistics */
+    uint64_t idle;
+    uint64_t fua[LOG_NUM_GA];
+    double ti;                  /* time interval in seconds, 0: unknown */
+};
+
+struct log_cms_t {              /* [0x19,0x20] */
+    bool have[LOG_NUM_CMS];
+    bool have_since_reset;
+    uint64_t cnt[LOG_NUM_CMS];
+    uint64_t since_reset;       /* time intervals since last hard reset */
+    double ti;
+};
+
+struct log_cdls_t {             /* [0x19,0x21] */
+    int num;
+    int pc[LOG_NUM_CDL_DESC];
+    uint32_t cnt[LOG_NUM_CDL_DESC][LOG_NUM_CDL_CNTS];
+};
+
+struct log_watch_t {            /* state of one DEVICE while sampling */
+    const char * name;
+    char js_name[256];          /* name converted to a JSON string */
+    int sg_fd;
+    bool have;                  /* previous sample held below */
+    double ti;                  /* time interval from [0x19,0x0] */
+    bool in_err;
+    struct timespec ts;         /* when previous sample taken */
+    struct log_gsp_t gsp;
+    struct log_cms_t cms;
+    struct log_cdls_t cdls;
+};
+
+static const char * ga_s[LOG_NUM_GA] = {
+    "Number of read commands",
+    "Number of write commands",
+    "Number of logical blocks received",
+    "Number of logical blocks transmitted",
+    "Read command processing intervals",
+    "Write command processing intervals",
+    "Weighted number of read commands plus write commands",
+    "Weighted read command processing plus write command processing",
+};
+
+static const char * fua_s[LOG_NUM_GA] = {
+    "Number of read FUA commands",
+    "Number of write FUA commands",
+    "Number of read FUA_NV commands",
+    "Number of write FUA_NV commands",
+    "Read FUA command processing intervals",
+    "Write FUA command processing intervals",
+    "Read FUA_NV command processing intervals",
+    "Write FUA_NV command processing intervals",
+};
+
+static const char * cms_s[LOG_NUM_CMS] = {
+    "Read cache memory hits",
+    "Reads to cache memory",
+    "Write cache memory hits",
+    "Writes from cache memory",
+};
+
+static const char * cdl_cnt_s[LOG_NUM_CDL_CNTS] = {
+    "Number of inactive target miss commands",
+    "Number of active target miss commands",
+    "Number of latency miss commands",
+    "Number of nonconforming miss commands",
+    "Number of predictive latency miss commands",
+    "Number of latency misses attributable to errors",
+    "Number of latency misses attributable to deferred errors",
+    "Number of latency misses attributable to background operations",
+};
+
+static const char * bsr_status_arr[] = {
+    "No background scans active",
+    "Background medium scan is active",
+    "Background pre-scan is active",
+    "Background scan halted due to fatal error",
+    "Background scan halted due to a vendor specific pattern of errors",
+    "Background scan halted due to medium formatted without P-List",
+    "Background scan halted - vendor specific cause",
+    "Background scan halted due to temperature out of allowed range",
+    "Background scan enabled, none active (waiting for BMS interval timer "
+        "to expire)",
+    "Background scan halted - scan results list full",
+    "Background scan halted - pre-scan time limit timer expired",
+};
+
+static const char * lp_s = "log page";
+
+
+/* Converts the LP[,SPG] argument of '--log=' into a page and subpage
+ * number. LP may be an acronym (e.g. "gsp") or a number. Returns 0 on
+ * success. */
+int
+sdp_log_str2pg(const char * s, int * pnp, int * spnp)
+{
+    int pn, spn;
+    const char * cp;
+    const struct log_pg_t * lpp;
+
+    for (lpp = log_pg_arr; lpp->acron; ++lpp) {
+        if (0 == strcasecmp(s, lpp->acron)) {
+            *pnp = lpp->pn;
+            *spnp = lpp->spn;
+            return 0;
+        }
+    }
+    pn = sg_get_num_nomult(s);
+    spn = 0;
+    cp = strchr(s, ',');
+    if (cp)
+        spn = sg_get_num_nomult(cp + 1);
+    if ((pn < 0) || (pn > 0x3f) || (spn < 0) || (spn > 0xfe)) {
+        pr2serr("--log= expects an acronym: ");
+        for (lpp = log_pg_arr; lpp->acron; ++lpp)
+            pr2serr("%s%s", lpp->acron, lpp[1].acron ? ", " : "");
+        pr2serr("\nor PG[,SPG] numbers (e.g. '0x19,0x1')\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    *pnp = pn;
+    *spnp = spn;
+    return 0;
+}
+
+static const char *
+log_pg_name(int pn, int spn, char * b, int blen)
+{
+    const struct log_pg_t * lpp;
+
+    for (lpp = log_pg_arr; lpp->acron; ++lpp) {
+        if ((pn == lpp->pn) && (spn == lpp->spn))
+            return lpp->name;
+    }
+    if ((LOG_GSP_PG == pn) && (spn > 0) && (spn <= LOG_GSP_SPG_MAX))
+        snprintf(b, blen, "Group statistics and performance (%d)", spn);
+    else
+        snprintf(b, blen, "Log page 0x%x,0x%x", pn, spn);
+    return b;
+}
+
+/* Returns time interval in seconds from a time interval descriptor */
+static double
+log_ti(const uint8_t * bp)
+{
+    int k;
+    uint32_t ex = sg_get_unaligned_be32(bp);
+    double d = (double)sg_get_unaligned_be32(bp + 4);
+
+    for (k = 0; (k < (int)ex) && (k < 30); ++k)
+        d /= 10.0;
+    return d;
+}
+
+/* Fetches 8 byte counters at bp (of a parameter with pl bytes) into arr */
+static void
+log_get_u64s(const uint8_t * bp, int pl, uint64_t * arr, int num)
+{
+    int k;
+
+    for (k = 0; k < num; ++k)
+        arr[k] = ((4 + (k * 8) + 8) <= pl) ?
+                 sg_get_unaligned_be64(bp + 4 + (k * 8)) : 0;
+}
+
+static void
+log_gsp_get(const uint8_t * bp, int len, struct log_gsp_t * gp)
+{
+    int k, pc, pl;
+
+    memset(gp, 0, sizeof(*gp));
+    for (k = 4; (k + 4) <= len; k += pl) {
+        pc = sg_get_unaligned_be16(bp + k);
+        pl = bp[k + 3] + 4;
+        if ((k + pl) > len)
+            break;
+        switch (pc) {
+        case 1:
+            log_get_u64s(bp + k, pl, gp->ga, LOG_NUM_GA);
+            gp->have_ga = true;
+            break;
+        case 2:
+            if (pl >= 12) {
+                gp->idle = sg_get_unaligned_be64(bp + k + 4);
+                gp->have_idle = true;
+            }
+            break;
+        case 3:
+            if (pl >= 12)
+                gp->ti = log_ti(bp + k + 4);
+            break;
+        case 4:
+            log_get_u64s(bp + k, pl, gp->fua, LOG_NUM_GA);
+            gp->have_fua = true;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void
+log_cms_get(const uint8_t * bp, int len, struct log_cms_t * cp)
+{
+    int k, pc, pl;
+
+    memset(cp, 0, sizeof(*cp));
+    for (k = 4; (k + 4) <= len; k += pl) {
+        pc = sg_get_unaligned_be16(bp + k);
+        pl = bp[k + 3] + 4;
+        if (((k + pl) > len) || (pl < 12))
+            break;
+        if ((pc >= 1) && (pc <= LOG_NUM_CMS)) {
+            cp->cnt[pc - 1] = sg_get_unaligned_be64(bp + k + 4);
+            cp->have[pc - 1] = true;
+        } else if (5 == pc) {
+            cp->since_reset = sg_get_unaligned_be64(bp + k + 4);
+            cp->have_since_reset = true;
+        } else if (6 == pc)
+            cp->ti = log_ti(bp + k + 4);
+    }
+}
+
+/* Parameter 0x1 is the achievable latency target, 0x11 to 0x17 the
+ * statistics for T2A descriptors 1 to 7 and 0x21 to 0x27 for T2B
+ * descriptors 1 to 7. Each of those has 4 byte counters. */
+static void
+log_cdls_get(const uint8_t * bp, int len, struct log_cdls_t * cp,
+             uint32_t * altp)
+{
+    int k, j, pc, pl;
+
+    memset(cp, 0, sizeof(*cp));
+    if (altp)
+        *altp = 0;
+    for (k = 4; (k + 4) <= len; k += pl) {
+        pc = sg_get_unaligned_be16(bp + k);
+        pl = bp[k + 3] + 4;
+        if ((k + pl) > len)
+            break;
+        if ((1 == pc) && (pl >= 8)) {
+            if (altp)
+                *altp = sg_get_unaligned_be32(bp + k + pl - 4);
+            continue;
+        }
+        if ((! (((pc >= 0x11) && (pc <= 0x17)) ||
+                ((pc >= 0x21) && (pc <= 0x27)))) ||
+            (cp->num >= LOG_NUM_CDL_DESC))
+            continue;
+        cp->pc[cp->num] = pc;
+        for (j = 0; (j < LOG_NUM_CDL_CNTS) && ((4 + (j + 1) * 4) <= pl); ++j)
+            cp->cnt[cp->num][j] = sg_get_unaligned_be32(bp + k + 4 + j * 4);
+        ++cp->num;
+    }
+}
+
+static void
+log_cdl_desc_name(int pc, char * b, int blen)
+{
+    snprintf(b, blen, "T2%c descriptor %d", (pc < 0x20) ? 'A' : 'B',
+             pc & 0xf);
+}
+
+/* Average milliseconds per command from processing interval and command
+ * count deltas. Returns negative if not known. */
+static double
+log_avg_ms(uint64_t intervals, uint64_t cmds, double ti)
+{
+    if ((0 == cmds) || (ti <= 0.0))
+        return -1.0;
+    return ((double)intervals * ti * 1000.0) / (double)cmds;
+}
+
+static void
+log_pr_avg(sgj_state * jsp, sgj_opaque_p jop, const char * name,
+           const char * js_name, double avg)
+{
+    if (avg < 0.0)
+        return;
+    sgj_pr_hr(jsp, "  %s: %.3f ms\n", name, avg);
+    sgj_js_nv_i(jsp, jop, js_name, (int64_t)(avg * 1000.0 + 0.5));
+}
+
+/* Group subpages 0x1 to 0x1f have no time interval parameter, ti is the
+ * one from [0x19,0x0] (0.0 if not known). */
+static void
+log_decode_gsp(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+               double ti, sgj_opaque_p jop)
+{
+    int k;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jo2p;
+    struct log_gsp_t g;
+
+    log_gsp_get(bp, len, &g);
+    if (g.have_ga) {
+        sgj_pr_hr(jsp, "  General access statistics and performance:\n");
+        jo2p = sgj_named_subobject_r(jsp, jop,
+                        "general_access_statistics_and_performance");
+        for (k = 0; k < LOG_NUM_GA; ++k)
+            sgj_haj_vi(jsp, jo2p, 4, ga_s[k], SGJ_SEP_COLON_1_SPACE,
+                       g.ga[k], false);
+    }
+    if (g.have_idle)
+        sgj_haj_vi(jsp, jop, 2, "Idle time intervals", SGJ_SEP_COLON_1_SPACE,
+                   g.idle, false);
+    if (g.ti > 0.0) {
+        sgj_pr_hr(jsp, "  Time interval: %g seconds\n", g.ti);
+        sgj_js_nv_i(jsp, jop, "time_interval_ns",
+                    (int64_t)(g.ti * 1e9 + 0.5));
+    }
+    if (g.have_fua) {
+        sgj_pr_hr(jsp, "  Force unit access statistics and performance:\n");
+        jo2p = sgj_named_subobject_r(jsp, jop,
+                        "force_unit_access_statistics_and_performance");
+        for (k = 0; k < LOG_NUM_GA; ++k)
+            sgj_haj_vi(jsp, jo2p, 4, fua_s[k], SGJ_SEP_COLON_1_SPACE,
+                       g.fua[k], false);
+    }
+    if (g.ti > 0.0)
+        ti = g.ti;
+    if (g.have_ga) {
+        log_pr_avg(jsp, jop, "Average read command processing time",
+                   "average_read_command_processing_time_us",
+                   log_avg_ms(g.ga[4], g.ga[0], ti));
+        log_pr_avg(jsp, jop, "Average write command processing time",
+                   "average_write_command_processing_time_us",
+                   log_avg_ms(g.ga[5], g.ga[1], ti));
+    }
+}
+
+static void
+log_decode_cms(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+               sgj_opaque_p jop)
+{
+    int k;
+    sgj_state * jsp = &op->json_st;
+    struct log_cms_t c;
+
+    log_cms_get(bp, len, &c);
+    for (k = 0; k < LOG_NUM_CMS; ++k) {
+        if (c.have[k])
+            sgj_haj_vi(jsp, jop, 2, cms_s[k], SGJ_SEP_COLON_1_SPACE,
+                       c.cnt[k], false);
+    }
+    if (c.have_since_reset)
+        sgj_haj_vi(jsp, jop, 2, "Time from last hard reset (intervals)",
+                   SGJ_SEP_COLON_1_SPACE, c.since_reset, false);
+    if (c.ti > 0.0) {
+        sgj_pr_hr(jsp, "  Time interval: %g seconds\n", c.ti);
+        sgj_js_nv_i(jsp, jop, "time_interval_ns",
+                    (int64_t)(c.ti * 1e9 + 0.5));
+    }
+    if (c.have[0] && c.have[1] && c.cnt[1]) {
+        sgj_pr_hr(jsp, "  Read cache hit ratio: %.1f%%\n",
+                  (100.0 * c.cnt[0]) / c.cnt[1]);
+        sgj_js_nv_i(jsp, jop, "read_cache_hit_per_mille",
+                    (int64_t)((1000.0 * c.cnt[0]) / c.cnt[1] + 0.5));
+    }
+}
+
+static void
+log_decode_cdls(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+                sgj_opaque_p jop)
+{
+    int k, j;
+    uint32_t alt;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap;
+    sgj_opaque_p jo2p;
+    struct log_cdls_t c;
+    char b[32];
+
+    log_cdls_get(bp, len, &c, &alt);
+    if (alt)
+        sgj_haj_vi(jsp, jop, 2, "Achievable latency target",
+                   SGJ_SEP_COLON_1_SPACE, alt, false);
+    jap = sgj_named_subarray_r(jsp, jop, "descriptors");
+    for (k = 0; k < c.num; ++k) {
+        log_cdl_desc_name(c.pc[k], b, sizeof(b));
+        sgj_pr_hr(jsp, "  %s:\n", b);
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "descriptor", b);
+        sgj_js_nv_ihex(jsp, jo2p, "parameter_code", c.pc[k]);
+        for (j = 0; j < LOG_NUM_CDL_CNTS; ++j)
+            sgj_haj_vi(jsp, jo2p, 4, cdl_cnt_s[j], SGJ_SEP_COLON_1_SPACE,
+                       c.cnt[k][j], false);
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+}
+
+static void
+log_decode_bsr(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+               sgj_opaque_p jop)
+{
+    int k, pc, pl, st;
+    int num = 0;
+    const char * ccp;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p jo2p;
+    char b[80];
+    char e[128];
+
+    for (k = 4; (k + 4) <= len; k += pl) {
+        pc = sg_get_unaligned_be16(bp + k);
+        pl = bp[k + 3] + 4;
+        if ((k + pl) > len)
+            break;
+        if (0 == pc) {
+            if (pl < 16)
+                continue;
+            sgj_haj_vi(jsp, jop, 2, "Accumulated power on minutes",
+                       SGJ_SEP_COLON_1_SPACE,
+                       sg_get_unaligned_be32(bp + k + 4), false);
+            st = bp[k + 9];
+            ccp = (st < (int)(sizeof(bsr_status_arr) /
+                              sizeof(bsr_status_arr[0]))) ?
+                  bsr_status_arr[st] : "Reserved";
+            sgj_pr_hr(jsp, "  Status: %s [%d]\n", ccp, st);
+            sgj_js_nv_ihexstr(jsp, jop, "status", st, NULL, ccp);
+            sgj_haj_vi(jsp, jop, 2, "Number of background scans performed",
+                       SGJ_SEP_COLON_1_SPACE,
+                       sg_get_unaligned_be16(bp + k + 10), false);
+            sgj_pr_hr(jsp, "  Background medium scan progress: %.2f%%\n",
+                      (100.0 * sg_get_unaligned_be16(bp + k + 12)) /
+                      65536.0);
+            sgj_js_nv_i(jsp, jop, "background_medium_scan_progress",
+                        sg_get_unaligned_be16(bp + k + 12));
+            sgj_haj_vi(jsp, jop, 2,
+                       "Number of background medium scans performed",
+                       SGJ_SEP_COLON_1_SPACE,
+                       sg_get_unaligned_be16(bp + k + 14), false);
+            continue;
+        }
+        if ((pc > 0x800) || (pl < 24))
+            continue;
+        if (NULL == jap) {
+            sgj_pr_hr(jsp, "  Medium scan parameters:\n");
+            jap = sgj_named_subarray_r(jsp, jop, "medium_scan_parameters");
+        }
+        ++num;
+        sg_get_sense_key_str(bp[k + 8] & 0xf, sizeof(b), b);
+        sg_get_asc_ascq_str(bp[k + 9], bp[k + 10], sizeof(e), e);
+        sgj_pr_hr(jsp, "    LBA 0x%" PRIx64 ": %s, %s [reassign status: "
+                  "%d, at %u minutes]\n", sg_get_unaligned_be64(bp + k + 16),
+                  b, e, (bp[k + 8] >> 4) & 0xf,
+                  sg_get_unaligned_be32(bp + k + 4));
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "parameter_code", pc);
+        sgj_js_nv_i(jsp, jo2p, "accumulated_power_on_minutes",
+                    sg_get_unaligned_be32(bp + k + 4));
+        sgj_js_nv_i(jsp, jo2p, "reassign_status", (bp[k + 8] >> 4) & 0xf);
+        sgj_js_nv_ihexstr(jsp, jo2p, "sense_key", bp[k + 8] & 0xf, NULL, b);
+        sgj_js_nv_ihex(jsp, jo2p, "additional_sense_code", bp[k + 9]);
+        sgj_js_nv_ihexstr(jsp, jo2p, "additional_sense_code_qualifier",
+                          bp[k + 10], NULL, e);
+        sgj_js_nv_ihex(jsp, jo2p, "logical_block_address",
+                       sg_get_unaligned_be64(bp + k + 16));
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+    sgj_haj_vi(jsp, jop, 2, "Number of medium scan parameters",
+               SGJ_SEP_COLON_1_SPACE, num, false);
+}
+
+/* Log pages without a decoder: each parameter in hex */
+static void
+log_decode_other(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+                 sgj_opaque_p jop)
+{
+    int k, pc, pl;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap;
+    sgj_opaque_p jo2p;
+
+    jap = sgj_named_subarray_r(jsp, jop, "parameters");
+    for (k = 4; (k + 4) <= len; k += pl) {
+        pc = sg_get_unaligned_be16(bp + k);
+        pl = bp[k + 3] + 4;
+        if ((k + pl) > len)
+            pl = len - k;
+        sgj_pr_hr(jsp, "  Parameter code 0x%x:\n", pc);
+        if (! jsp->pr_as_json)
+            hex2stdout(bp + k + 4, pl - 4, 1);
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "parameter_code", pc);
+        sgj_js_nv_hex_bytes(jsp, jo2p, "parameter_value", bp + k + 4,
+                            pl - 4);
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+}
+
+/* Decodes the log page (response to LOG SENSE) of len bytes at bp. The
+ * time interval ti (in seconds, from [0x19,0x0]) is used by the group
+ * statistics subpages. */
+static void
+log_decode(const uint8_t * bp, int len, struct sdparm_opt_coll * op,
+           double ti, sgj_opaque_p jap)
+{
+    int pn, spn;
+    sgj_state * jsp = &op->json_st;
+    const char * ccp;
+    sgj_opaque_p jo2p = NULL;
+    char b[64];
+
+    pn = bp[0] & 0x3f;
+    spn = (bp[0] & 0x40) ? bp[1] : 0;
+    ccp = log_pg_name(pn, spn, b, sizeof(b));
+    if (op->do_hex < 2)     /* so '-HH' output can be given to --inhex= */
+        sgj_pr_hr(jsp, "%s [0x%x,0x%x] %s:\n", ccp, pn, spn, lp_s);
+    if (op->do_hex) {
+        hex2stdout(bp, len, (1 == op->do_hex) ? 0 : -1);
+        return;
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "log_page_name", ccp);
+        sgj_js_nv_ihex(jsp, jo2p, "page_code", pn);
+        sgj_js_nv_ihex(jsp, jo2p, "subpage_code", spn);
+    }
+    if (LOG_GSP_PG == pn) {
+        if (spn <= LOG_GSP_SPG_MAX)
+            log_decode_gsp(bp, len, op, ti, jo2p);
+        else if (LOG_CMS_SPG == spn)
+            log_decode_cms(bp, len, op, jo2p);
+        else if (LOG_CDLS_SPG == spn)
+            log_decode_cdls(bp, len, op, jo2p);
+        else
+            log_decode_other(bp, len, op, jo2p);
+    } else if ((LOG_BSR_PG == pn) && (0 == spn))
+        log_decode_bsr(bp, len, op, jo2p);
+    else
+        log_decode_other(bp, len, op, jo2p);
+    if (jo2p)
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+}
+
+/* Fetches log page pn,spn (cumulative values) into b. On success returns
+ * 0 and places the page length (including its header) in *lenp. */
+static int
+log_fetch(int sg_fd, int pn, int spn, uint8_t * b, int mx_len, int * lenp,
+          int verbose)
+{
+    int res, len, pl;
+    int resid = 0;
+
+    res = sg_ll_log_sense_v2(sg_fd, false, false, LOG_CUMULATIVE, pn, spn,
+                             0, b, mx_len, 0, &resid, verbose > 0,
+                             verbose > 1 ? verbose - 1 : 0);
+    if (res)
+        return res;
+    len = mx_len - resid;
+    if ((len < 4) || (pn != (b[0] & 0x3f)) ||
+        (spn != ((b[0] & 0x40) ? b[1] : 0))) {
+        if (verbose)
+            pr2serr("%s: wrong or short response for %s [0x%x,0x%x]\n",
+                    __func__, lp_s, pn, spn);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    pl = sg_get_unaligned_be16(b + 2) + 4;
+    *lenp = (pl < len) ? pl : len;
+    return 0;
+}
+
+/* Returns the time interval (in seconds) of the General statistics and
+ * performance log page [0x19,0x0], 0.0 if not known. Uses b as a
+ * LOG_MX_LEN byte buffer. */
+static double
+log_gsp_ti(int sg_fd, uint8_t * b, int verbose)
+{
+    int len;
+    struct log_gsp_t g;
+
+    if (log_fetch(sg_fd, LOG_GSP_PG, 0, b, LOG_MX_LEN, &len, verbose))
+        return 0.0;
+    log_gsp_get(b, len, &g);
+    return g.ti;
+}
+
+/* Outputs the log page chosen by '--log=LP[,SPG]' (op->log_pn >= 0) or all
+ * supported statistics log pages of the DEVICE open in ctxp. Returns 0 on
+ * success. */
+int
+sdp_log(struct sdparm_ctx_t * ctxp, sgj_opaque_p jop)
+{
+    int res, len;
+    int num = 0;
+    double ti = 0.0;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    sgj_opaque_p jap;
+    const struct log_pg_t * lpp;
+    struct log_pg_t one;
+    uint8_t * b;
+
+    b = (uint8_t *)calloc(1, LOG_MX_LEN);
+    if (NULL == b)
+        return sg_convert_errno(ENOMEM);
+    jap = sgj_named_subarray_r(jsp, jop, "log_pages");
+    if (op->log_pn >= 0) {
+        one.pn = op->log_pn;
+        one.spn = op->log_spn;
+        lpp = &one;
+        if ((LOG_GSP_PG == one.pn) && (one.spn > 0) &&
+            (one.spn <= LOG_GSP_SPG_MAX))
+            ti = log_gsp_ti(ctxp->sg_fd, b, op->verbose);
+    } else
+        lpp = log_pg_arr;
+    for ( ; lpp->pn >= 0; ++lpp) {
+        res = log_fetch(ctxp->sg_fd, lpp->pn, lpp->spn, b, LOG_MX_LEN, &len,
+                        op->verbose);
+        if (res) {
+            if (lpp == &one) {
+                pr2serr("%s [0x%x,0x%x] not supported by DEVICE\n", lp_s,
+                        lpp->pn, lpp->spn);
+                free(b);
+                return SG_LIB_CONTRADICT;
+            }
+            if (op->verbose)
+                pr2serr("%s %s not supported, skip\n", lpp->acron, lp_s);
+            continue;
+        }
+        ++num;
+        log_decode(b, len, op, ti, jap);
+        if (lpp == &one)
+            break;
+    }
+    free(b);
+    if (0 == num) {
+        pr2serr("DEVICE supports none of the statistics %ss\n", lp_s);
+        return SG_LIB_CONTRADICT;
+    }
+    return 0;
+}
+
+/* Decodes one or more log pages (LOG SENSE responses placed one after
+ * another) held in the ilen bytes at ibp ('--log --inhex=FN'). Group
+ * statistics subpages use the time interval of a [0x19,0x0] page found
+ * anywhere in the data. */
+int
+sdp_log_inhex(const uint8_t * ibp, int ilen, struct sdparm_opt_coll * op,
+              sgj_opaque_p jop)
+{
+    int k, len;
+    int num = 0;
+    double ti = 0.0;
+    sgj_opaque_p jap;
+    struct log_gsp_t g;
+
+    for (k = 0; (k + 4) <= ilen; k += len) {
+        len = sg_get_unaligned_be16(ibp + k + 2) + 4;
+        if ((k + len) > ilen)
+            len = ilen - k;
+        if ((LOG_GSP_PG == (ibp[k] & 0x3f)) &&
+            (0 == ((ibp[k] & 0x40) ? ibp[k + 1] : 0))) {
+            log_gsp_get(ibp + k, len, &g);
+            ti = g.ti;
+            break;
+        }
+    }
+    jap = sgj_named_subarray_r(&op->json_st, jop, "log_pages");
+    for (k = 0; (k + 4) <= ilen; k += len) {
+        len = sg_get_unaligned_be16(ibp + k + 2) + 4;
+        if ((k + len) > ilen) {
+            pr2serr("%s at offset %d is truncated\n", lp_s, k);
+            len = ilen - k;
+        }
+        if ((op->log_pn >= 0) &&
+            ((op->log_pn != (ibp[k] & 0x3f)) ||
+             (op->log_spn != ((ibp[k] & 0x40) ? ibp[k + 1] : 0))))
+            continue;
+        log_decode(ibp + k, len, op, ti, jap);
+        ++num;
+    }
+    if (0 == num) {
+        pr2serr("no %s%s found in --inhex= data\n", lp_s,
+                (op->log_pn >= 0) ? " matching --log=" : "");
+        return SG_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+#ifndef SG_LIB_WIN32
+
+/* Places an ISO 8601 UTC timestamp with milliseconds in b */
+static void
+log_timestamp(char * b, int blen)
+{
+    int n;
+    struct timespec ts;
+    struct tm tm;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gmtime_r(&ts.tv_sec, &tm);
+    n = (int)strftime(b, blen, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(b + n, blen - n, ".%03dZ", (int)(ts.tv_nsec / 1000000));
+}
+
+/* Starts an NDJSON line for DEVICE dp and log page pn,spn over an interval
+ * of secs seconds, the caller adds members then closes it. */
+static void
+log_line_start(const struct log_watch_t * dp, int pn, int spn, double secs)
+{
+    char ts[40];
+
+    log_timestamp(ts, sizeof(ts));
+    printf("{\"timestamp\":\"%s\",\"device_name\":\"%s\",\"page_code\":%d,"
+           "\"subpage_code\":%d,\"interval_s\":%.3f", ts, dp->js_name, pn,
+           spn, secs);
+}
+
+static void
+log_rate(const char * name, uint64_t now, uint64_t prev, double secs)
+{
+    printf(",\"%s\":%.1f", name, (double)(now - prev) / secs);
+}
+
+static void
+log_watch_gsp(const struct log_watch_t * dp, int spn,
+              const struct log_gsp_t * gp, double secs)
+{
+    double avg;
+    double ti = (gp->ti > 0.0) ? gp->ti : dp->ti;
+    const struct log_gsp_t * pp = &dp->gsp;
+
+    log_line_start(dp, LOG_GSP_PG, spn, secs);
+    log_rate("read_commands_per_s", gp->ga[0], pp->ga[0], secs);
+    log_rate("write_commands_per_s", gp->ga[1], pp->ga[1], secs);
+    log_rate("blocks_received_per_s", gp->ga[2], pp->ga[2], secs);
+    log_rate("blocks_transmitted_per_s", gp->ga[3], pp->ga[3], secs);
+    avg = log_avg_ms(gp->ga[4] - pp->ga[4], gp->ga[0] - pp->ga[0], ti);
+    if (avg >= 0.0)
+        printf(",\"average_read_ms\":%.3f", avg);
+    avg = log_avg_ms(gp->ga[5] - pp->ga[5], gp->ga[1] - pp->ga[1], ti);
+    if (avg >= 0.0)
+        printf(",\"average_write_ms\":%.3f", avg);
+    if (gp->have_idle && (ti > 0.0))
+        printf(",\"idle_percent\":%.1f",
+               (100.0 * (double)(gp->idle - pp->idle) * ti) / secs);
+    printf("}\n");
+}
+
+static void
+log_watch_cms(const struct log_watch_t * dp, const struct log_cms_t * cp,
+              double secs)
+{
+    const struct log_cms_t * pp = &dp->cms;
+
+    log_line_start(dp, LOG_GSP_PG, LOG_CMS_SPG, secs);
+    log_rate("read_cache_hits_per_s", cp->cnt[0], pp->cnt[0], secs);
+    log_rate("reads_to_cache_per_s", cp->cnt[1], pp->cnt[1], secs);
+    log_rate("write_cache_hits_per_s", cp->cnt[2], pp->cnt[2], secs);
+    log_rate("writes_from_cache_per_s", cp->cnt[3], pp->cnt[3], secs);
+    if (cp->cnt[1] > pp->cnt[1])
+        printf(",\"read_hit_percent\":%.1f",
+               (100.0 * (double)(cp->cnt[0] - pp->cnt[0])) /
+               (double)(cp->cnt[1] - pp->cnt[1]));
+    printf("}\n");
+}
+
+/* Descriptors are matched with the previous sample on their parameter
+ * code, those not in the previous sample are skipped. */
+static void
+log_watch_cdls(const struct log_watch_t * dp, const struct log_cdls_t * cp,
+               double secs)
+{
+    int k, j, m;
+    int n = 0;
+    const struct log_cdls_t * pp = &dp->cdls;
+    char b[32];
+
+    log_line_start(dp, LOG_GSP_PG, LOG_CDLS_SPG, secs);
+    printf(",\"descriptors\":[");
+    for (k = 0; k < cp->num; ++k) {
+        for (m = 0; m < pp->num; ++m) {
+            if (pp->pc[m] == cp->pc[k])
+                break;
+        }
+        if (m >= pp->num)
+            continue;
+        log_cdl_desc_name(cp->pc[k], b, sizeof(b));
+        printf("%s{\"descriptor\":\"%s\"", n++ ? "," : "", b);
+        for (j = 0; j < 4; ++j) {       /* the target and latency misses */
+            static const char * miss_s[4] = {
+                "inactive_target_misses_per_s", "active_target_misses_per_s",
+                "latency_misses_per_s", "nonconforming_misses_per_s"};
+
+            log_rate(miss_s[j], cp->cnt[k][j], pp->cnt[m][j], secs);
+        }
+        printf("}");
+    }
+    printf("]}\n");
+}
+
+/* One sample of DEVICE dp, outputs rates since the previous sample */
+static void
+log_sample(struct log_watch_t * dp, int pn, int spn, uint8_t * b,
+           const struct sdparm_opt_coll * op)
+{
+    int res, len;
+    double secs = 0.0;
+    struct timespec now;
+    struct log_gsp_t g;
+    struct log_cms_t c;
+    struct log_cdls_t d;
+    char e[120];
+    char ts[40];
+
+    res = log_fetch(dp->sg_fd, pn, spn, b, LOG_MX_LEN, &len, op->verbose);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (res) {
+        if (! dp->in_err) {     /* only report entry into error state */
+            dp->in_err = true;
+            sg_get_category_sense_str(res, sizeof(e), e, op->verbose);
+            log_timestamp(ts, sizeof(ts));
+            printf("{\"timestamp\":\"%s\",\"device_name\":\"%s\","
+                   "\"page_code\":%d,\"subpage_code\":%d,\"error\":\"%s\"}"
+                   "\n", ts, dp->js_name, pn, spn, e);
+            fflush(stdout);
+        }
+        dp->have = false;
+        return;
+    }
+    dp->in_err = false;
+    if (dp->have)
+        secs = (double)(now.tv_sec - dp->ts.tv_sec) +
+               (double)(now.tv_nsec - dp->ts.tv_nsec) / 1e9;
+    if (LOG_CMS_SPG == spn) {
+        log_cms_get(b, len, &c);
+        if (secs > 0.0)
+            log_watch_cms(dp, &c, secs);
+        dp->cms = c;
+    } else if (LOG_CDLS_SPG == spn) {
+        log_cdls_get(b, len, &d, NULL);
+        if (secs > 0.0)
+            log_watch_cdls(dp, &d, secs);
+        dp->cdls = d;
+    } else {
+        log_gsp_get(b, len, &g);
+        if (secs > 0.0)
+            log_watch_gsp(dp, spn, &g, secs);
+        dp->gsp = g;
+    }
+    fflush(stdout);
+    dp->ts = now;
+    dp->have = true;
+}
+
+/* Adds ms milliseconds to *tsp */
+static void
+log_ts_add(struct timespec * tsp, int ms)
+{
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (tsp->tv_nsec >= 1000000000L) {
+        tsp->tv_nsec -= 1000000000L;
+        ++tsp->tv_sec;
+    }
+}
+
+/* Samples log page op->log_pn,op->log_spn of all DEVICEs every
+ * op->watch_ms milliseconds, outputting a line of rates for each DEVICE
+ * per interval. COUNT from '--watch=SECS,COUNT' is the number of
+ * intervals (so one more sample is taken). Returns 0 unless no DEVICE can
+ * be opened. */
+int
+sdp_log_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[])
+{
+    int k, n, res;
+    int ret = 0;
+    int pn, spn;
+    const int num = ctxp->opts.num_devices;
+    const struct sdparm_opt_coll * op = &ctxp->opts;
+    const int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct log_watch_t * dev_arr;
+    struct log_watch_t * dp;
+    uint8_t * b;
+    struct timespec next;
+
+    pn = (op->log_pn >= 0) ? op->log_pn : LOG_GSP_PG;
+    spn = (op->log_pn >= 0) ? op->log_spn : 0;
+    if ((LOG_GSP_PG != pn) || (spn > LOG_CDLS_SPG)) {
+        pr2serr("--watch= samples the counters of the statistics %ss: "
+                "gsp, cms or cdls\n", lp_s);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    dev_arr = (struct log_watch_t *)calloc(num, sizeof(*dev_arr));
+    b = (uint8_t *)malloc(LOG_MX_LEN);
+    if ((NULL == dev_arr) || (NULL == b)) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0, dp = dev_arr; k < num; ++k, ++dp) {
+        dp->name = device_name_arr[k];
+        sgj_conv2json_string((const uint8_t *)dp->name,
+                             (int)strlen(dp->name), dp->js_name,
+                             (int)sizeof(dp->js_name));
+        dp->sg_fd = sg_cmds_open_device(dp->name, true /* read_only */, vb);
+        if (dp->sg_fd < 0) {
+            pr2serr("open error: %s [read only]: %s\n", dp->name,
+                    safe_strerror(-dp->sg_fd));
+            ret = sg_convert_errno(-dp->sg_fd);
+            goto fini;
+        }
+        if ((LOG_GSP_PG == pn) && (spn > 0) && (spn <= LOG_GSP_SPG_MAX))
+            dp->ti = log_gsp_ti(dp->sg_fd, b, op->verbose);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; (0 == op->watch_count) || (n <= op->watch_count); ++n) {
+        if (n > 0) {
+            log_ts_add(&next, op->watch_ms);
+            do {
+                res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+                                      NULL);
+            } while (EINTR == res);
+        }
+        for (k = 0; k < num; ++k)
+            log_sample(dev_arr + k, pn, spn, b, op);
+    }
+fini:
+    if (dev_arr) {
+        for (k = 0; k < num; ++k) {
+            if (dev_arr[k].sg_fd > 0)
+                sg_cmds_close_device(dev_arr[k].sg_fd);
+        }
+        free(dev_arr);
+    }
+    free(b);
+    return ret;
+}
+
+#else   /* SG_LIB_WIN32 */
+
+int
+sdp_log_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[])
+{
+    if (ctxp && device_name_arr) { }    /* suppress warning */
+    pr2serr("--watch= is not supported on Windows\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+#endif  /* SG_LIB_WIN32 */
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+#include "sdparm_mstats.h"
+
+/* sdparm_mstats.c : counting wrappers for heap allocations made by sdparm
+ * and the parts of sg3_utils library it is built with. Only compiled when
+ * configured with '--enable-mem-stats'. The wrappers below need the real
+ * allocation functions, so undo the redirections in sdparm_mstats.h .
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef posix_memalign
+#undef free
+
+#define MS_INIT_LIVE 1024       /* power of 2, table doubles when needed */
+#define MS_MAX_SITES 128        /* distinct allocating functions tracked */
+
+struct ms_blk_t {
+    void * p;           /* NULL: unused slot; ms_tomb: deleted slot */
+    size_t sz;
+    int site_ind;
+};
+
+struct ms_site_t {
+    const char * name;
+    uint64_t num_allocs;
+    uint64_t num_frees;
+    uint64_t total_bytes;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+};
+
+static char ms_tomb_c;
+static void * const ms_tomb = &ms_tomb_c;
+
+/* open addressing hash table of live allocations, grown (and cleared of
+ * deleted slots) when more than half its slots are used */
+static struct ms_blk_t * ms_blk_arr;
+static int ms_blk_sz;           /* number of slots, a power of 2 */
+static int ms_num_used;         /* live plus deleted slots */
+static struct ms_site_t ms_site_arr[MS_MAX_SITES];
+static int ms_num_sites;
+static int ms_num_live;
+
+static uint64_t ms_num_allocs;
+static uint64_t ms_num_frees;
+static uint64_t ms_total_bytes;
+static uint64_t ms_live_bytes;
+static uint64_t ms_peak_bytes;
+static uint64_t ms_untracked_frees;     /* e.g. heap from strdup() */
+static uint64_t ms_overflow_allocs;     /* when ms_blk_arr[] can't grow */
+
+/* When sg_memalign() is called via sdp_ms_memalign() this holds the name
+ * of the caller so that the underlying posix_memalign() or calloc() is
+ * attributed to it. */
+static const char * ms_pending_site;
+
+
+static int
+ms_hash(const void * p)
+{
+    uintptr_t u = (uintptr_t)p;
+
+    u ^= (u >> 17);
+    u *= 0x9e3779b1U;
+    return (int)((u >> 4) & (ms_blk_sz - 1));
+}
+
+/* Puts p in the first free slot of ms_blk_arr[] which must have one */
+static void
+ms_insert(void * p, size_t sz, int site_ind)
+{
+    int k;
+    struct ms_blk_t * bp;
+
+    for (k = ms_hash(p); ; k = (k + 1) & (ms_blk_sz - 1)) {
+        bp = ms_blk_arr + k;
+        if ((NULL == bp->p) || (ms_tomb == bp->p))
+            break;
+    }
+    if (NULL == bp->p)
+        ++ms_num_used;
+    bp->p = p;
+    bp->sz = sz;
+    bp->site_ind = site_ind;
+}
+
+/* Rebuilds ms_blk_arr[] without deleted slots, doubling its size if more
+ * than a quarter of the slots are live. Returns false if out of memory. */
+static bool
+ms_rehash(void)
+{
+    int k, old_sz;
+    struct ms_blk_t * old_arr = ms_blk_arr;
+    struct ms_blk_t * bp;
+
+    old_sz = ms_blk_sz;
+    if (0 == old_sz)
+        ms_blk_sz = MS_INIT_LIVE;
+    else if (ms_num_live > (old_sz / 4))
+        ms_blk_sz = old_sz * 2;
+    ms_blk_arr = (struct ms_blk_t *)calloc(ms_blk_sz,
+                                           sizeof(struct ms_blk_t));
+    if (NULL == ms_blk_arr) {
+        ms_blk_arr = old_arr;
+        ms_blk_sz = old_sz;
+        return false;
+    }
+    ms_num_used = 0;
+    for (k = 0, bp = old_arr; k < old_sz; ++k, ++bp) {
+        if (bp->p && (ms_tomb != bp->p))
+            ms_insert(bp->p, bp->sz, bp->site_ind);
+    }
+    free(old_arr);
+    return true;
+}
+
+/* Returns index into ms_site_arr[]. If that array is full, the last entry
+ * is used as a catch-all. */
+static int
+ms_find_site(const char * site)
+{
+    int k;
+    struct ms_site_t * sp;
+
+    if (ms_pending_site) {
+        site = ms_pending_site;
+        ms_pending_site = NULL;
+    }
+    if (NULL == site)
+        site = "<unknown>";
+    for (k = 0, sp = ms_site_arr; k < ms_num_sites; ++k, ++sp) {
+        if ((site == sp->name) || (0 == strcmp(site, sp->name)))
+            return k;
+    }
+    if (ms_num_sites >= MS_MAX_SITES) {
+        ms_site_arr[MS_MAX_SITES - 1].name = "<other>";
+        return MS_MAX_SITES - 1;
+    }
+    ms_site_arr[ms_num_sites].name = site;
+    return ms_num_sites++;
+}
+
+static void
+ms_add(void * p, size_t sz, const char * site)
+{
+    int ind = ms_find_site(site);
+    struct ms_site_t * sp = ms_site_arr + ind;
+
+    ++ms_num_allocs;
+    ms_total_bytes += sz;
+    ++sp->num_allocs;
+    sp->total_bytes += sz;
+    if (((ms_num_used + 1) * 2 > ms_blk_sz) && (! ms_rehash()) &&
+        (ms_num_used + 1 >= ms_blk_sz)) {
+        ++ms_overflow_allocs;   /* can't track, won't see matching free */
+        return;
+    }
+    ms_insert(p, sz, ind);
+    ++ms_num_live;
+    ms_live_bytes += sz;
+    if (ms_live_bytes > ms_peak_bytes)
+        ms_peak_bytes = ms_live_bytes;
+    sp->live_bytes += sz;
+    if (sp->live_bytes > sp->peak_live_bytes)
+        sp->peak_live_bytes = sp->live_bytes;
+}
+
+/* Returns index in ms_blk_arr[] holding p, or -1 if not found. */
+static int
+ms_lookup(const void * p)
+{
+    int k, n;
+    const struct ms_blk_t * bp;
+
+    if (0 == ms_blk_sz)
+        return -1;
+    for (k = ms_hash(p), n = 0; n < ms_blk_sz;
+         k = (k + 1) & (ms_blk_sz - 1), ++n) {
+        bp = ms_blk_arr + k;
+        if (NULL == bp->p)
+            break;
+        if (p == bp->p)
+            return k;
+    }
+    return -1;
+}
+
+/* Accounts for the free of the allocation at ms_blk_arr[ind], or for an
+ * untracked free when ind is negative. */
+static void
+ms_remove(int ind)
+{
+    struct ms_blk_t * bp;
+    struct ms_site_t * sp;
+
+    if (ind < 0) {
+        ++ms_untracked_frees;
+        return;
+    }
+    bp = ms_blk_arr + ind;
+    sp = ms_site_arr + bp->site_ind;
+    ++ms_num_frees;
+    ms_live_bytes -= bp->sz;
+    ++sp->num_frees;
+    sp->live_bytes -= bp->sz;
+    bp->p = ms_tomb;
+    --ms_num_live;
+}
+
+void *
+sdp_ms_malloc(size_t size, const char * site)
+{
+    void * p = malloc(size);
+
+    if (p)
+        ms_add(p, size, site);
+    return p;
+}
+
+void *
+sdp_ms_calloc(size_t nmemb, size_t size, const char * site)
+{
+    void * p = calloc(nmemb, size);
+
+    if (p)
+        ms_add(p, nmemb * size, site);
+    return p;
+}
+
+void *
+sdp_ms_realloc(void * ptr, size_t size, const char * site)
+{
+    /* realloc() may free ptr, so look it up beforehand */
+    int ind = ptr ? ms_lookup(ptr) : -2;
+    void * p = realloc(ptr, size);
+
+    if (p || (0 == size)) {
+        if (ind > -2)
+            ms_remove(ind);
+        if (p)
+            ms_add(p, size, site);
+    }
+    return p;
+}
+
+int
+sdp_ms_posix_memalign(void ** memptr, size_t alignment, size_t size,
+                      const char * site)
+{
+    int res = posix_memalign(memptr, alignment, size);
+
+    if ((0 == res) && *memptr)
+        ms_add(*memptr, size, site);
+    return res;
+}
+
+void
+sdp_ms_free(void * ptr)
+{
+    if (NULL == ptr)
+        return;
+    ms_remove(ms_lookup(ptr));
+    free(ptr);
+}
+
+/* Called instead of sg_memalign() from the src directory (see sdparm.h) so
+ * the allocation is attributed to the caller (site). */
+uint8_t *
+sdp_ms_memalign(uint32_t num_bytes, uint32_t align_to,
+                uint8_t ** buff_to_free, bool vb, const char * site)
+{
+    uint8_t * res;
+
+    ms_pending_site = site;
+    res = sg_memalign(num_bytes, align_to, buff_to_free, vb);
+    ms_pending_site = NULL;
+    return res;
+}
+
+/* Outputs allocation statistics to stderr. Expected to be called just
+ * before sdparm exits so live bytes should be close to zero; anything
+ * remaining is either a leak or held by the C library. */
+void
+sdp_ms_report(void)
+{
+    int k;
+    const struct ms_site_t * sp;
+
+    pr2serr("Heap allocation statistics:\n");
+    pr2serr("  peak bytes: %" PRIu64 ", live bytes: %" PRIu64 ", total "
+            "bytes: %" PRIu64 "\n", ms_peak_bytes, ms_live_bytes,
+            ms_total_bytes);
+    pr2serr("  allocations: %" PRIu64 ", frees: %" PRIu64 "\n",
+            ms_num_allocs, ms_num_frees);
+    if (ms_untracked_frees > 0)
+        pr2serr("  untracked frees: %" PRIu64 "\n", ms_untracked_frees);
+    if (ms_overflow_allocs > 0)
+        pr2serr("  untracked allocations (out of memory): %" PRIu64 "\n",
+                ms_overflow_allocs);
+    if (ms_num_sites < 1)
+        return;
+    pr2serr("  %-34s %8s %8s %10s %10s %8s\n", "call site", "allocs",
+            "frees", "bytes", "peak_live", "live");
+    for (k = 0, sp = ms_site_arr; k < ms_num_sites; ++k, ++sp)
+        pr2serr("  %-34s %8" PRIu64 " %8" PRIu64 " %10" PRIu64 " %10"
+                PRIu64 " %8" PRIu64 "\n", sp->name, sp->num_allocs,
+                sp->num_frees, sp->total_bytes, sp->peak_live_bytes,
+                sp->live_bytes);
+}
@@ -0,0 +1,47 @@
+#ifndef SDPARM_MSTATS_H
+#define SDPARM_MSTATS_H
+
+/*
+ * Heap allocation counting, only built when configured with
+ * '--enable-mem-stats'. In that case src/Makefile.am force includes this
+ * header ahead of every source file that makes up sdparm (including those
+ * taken from the lib directory) so that malloc(), calloc(), realloc(),
+ * posix_memalign() and free() calls are routed through the counting
+ * wrappers in sdparm_mstats.c . Each allocation is attributed to the
+ * function (i.e. __func__) that made it. sdparm.h additionally redirects
+ * sg_memalign() calls made from the src directory so that they are
+ * attributed to the caller rather than to sg_memalign() itself. The
+ * results are output by the '--stats' option.
+ */
+
+#include <stdlib.h>     /* system prototypes must precede macros below */
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void * sdp_ms_malloc(size_t size, const char * site);
+void * sdp_ms_calloc(size_t nmemb, size_t size, const char * site);
+void * sdp_ms_realloc(void * ptr, size_t size, const char * site);
+int sdp_ms_posix_memalign(void ** memptr, size_t alignment, size_t size,
+                          const char * site);
+void sdp_ms_free(void * ptr);
+uint8_t * sdp_ms_memalign(uint32_t num_bytes, uint32_t align_to,
+                          uint8_t ** buff_to_free, bool vb,
+                          const char * site);
+void sdp_ms_report(void);
+
+#define malloc(sz) sdp_ms_malloc(sz, __func__)
+#define calloc(nm, sz) sdp_ms_calloc(nm, sz, __func__)
+#define realloc(p, sz) sdp_ms_realloc(p, sz, __func__)
+#define posix_memalign(pp, al, sz) \
+                sdp_ms_posix_memalign(pp, al, sz, __func__)
+#define free(p) sdp_ms_free(p)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_phy.c : audits the SAS phys of DEVICEs ('--phy-audit[=MIN[,ERR]]')
+ * by fetching only the Phy control and discover mode subpage [0x19,0x1]
+ * (pcd) and the Protocol specific port log page [0x18] of each. A phy is
+ * flagged when its negotiated logical link rate is below its hardware
+ * maximum link rate (e.g. a 12 Gbps disk behind a link that trained at
+ * 6 Gbps) or below MIN (e.g. "6G"), or when one of its error counters
+ * (invalid dwords, running disparity errors, loss of dword sync and phy
+ * reset problems) exceeds ERR. Phys without a link are shown but not
+ * flagged since, for example, the second port of a dual ported disk is
+ * often not cabled.
+ *
+ * As with '--profile=', when --jobs= is given DEVICEs are handled in child
+ * processes so results are kept in memory shared with the parent which
+ * outputs one table for all DEVICEs at the end.
+ */
+
+#define PHY_MAX_PHYS 32         /* per DEVICE */
+#define PHY_DESC_OFF 8          /* first phy mode descriptor in pcd */
+#define PHY_DESC_LEN 48
+#define PHY_MS_BUFF_LEN 2048
+#define PHY_PSP_LPAGE 0x18      /* Protocol specific port log page */
+#define PHY_LS_BUFF_LEN 4096
+#define PHY_NUM_CNTS 4
+#define PHY_RATE_1_5G 8         /* link rate codes below this are states */
+
+#define PHY_FL_BELOW_HW_MAX 0x1
+#define PHY_FL_BELOW_MIN 0x2
+#define PHY_FL_ERRORS 0x4
+
+struct phy_res_t {              /* result for one phy of one DEVICE */
+    bool have_cnts;             /* error counters from log page found */
+    uint8_t id;
+    uint8_t adt;                /* attached SAS device type */
+    uint8_t nllr;               /* negotiated logical link rate */
+    uint8_t pmalr;              /* programmed maximum link rate */
+    uint8_t hmalr;              /* hardware maximum link rate */
+    uint8_t flags;              /* PHY_FL_* */
+    uint64_t asasa;             /* attached SAS address */
+    uint32_t cnts[PHY_NUM_CNTS];
+};
+
+struct phy_dev_res_t {          /* result for one DEVICE */
+    int status;         /* 0: not processed, -1: ok, else error */
+    int num_phys;
+    char vendor[9];
+    char product[17];
+    uint64_t sasa;              /* SAS address of first phy */
+    struct phy_res_t phys[PHY_MAX_PHYS];
+};
+
+struct sdparm_phy_t {
+    int min_rate;               /* link rate code, 0 for none */
+    int64_t err_limit;          /* -1 for none */
+    int num_devs;
+    size_t res_sz;
+    struct phy_dev_res_t * res_arr;     /* may be shared with children */
+};
+
+static const char * phy_cnt_s[PHY_NUM_CNTS] = {
+    "invalid_dword_count", "running_disparity_error_count",
+    "loss_of_dword_synchronization_count", "phy_reset_problem_count",
+};
+
+static const char * phy_rate_arr[] = {  /* link rates, index - 8 */
+    "1.5", "3", "6", "12", "22.5",
+};
+
+#define PHY_NUM_RATES \
+        ((int)(sizeof(phy_rate_arr) / sizeof(phy_rate_arr[0])))
+
+
+/* Returns short string for negotiated (or maximum) link rate code lr */
+static const char *
+phy_rate_str(int lr, char * b, int blen)
+{
+    if ((lr >= PHY_RATE_1_5G) && (lr < (PHY_RATE_1_5G + PHY_NUM_RATES)))
+        snprintf(b, blen, "%s Gbps", phy_rate_arr[lr - PHY_RATE_1_5G]);
+    else {
+        switch (lr) {
+        case 0:
+            snprintf(b, blen, "unknown");
+            break;
+        case 1:
+            snprintf(b, blen, "disabled");
+            break;
+        case 2:
+            snprintf(b, blen, "reset problem");
+            break;
+        case 3:
+            snprintf(b, blen, "spinup hold");
+            break;
+        case 4:
+            snprintf(b, blen, "port selector");
+            break;
+        case 5:
+            snprintf(b, blen, "resetting");
+            break;
+        case 6:
+            snprintf(b, blen, "unsupported");
+            break;
+        default:
+            snprintf(b, blen, "0x%x", lr);
+            break;
+        }
+    }
+    return b;
+}
+
+/* Parses MIN[,ERR] where MIN is a link rate in Gbps (e.g. "6", "6G" or
+ * "22.5Gbps") and ERR the largest acceptable error counter value. */
+static int
+phy_parse(const char * spec, struct sdparm_phy_t * php)
+{
+    int k, len;
+    int64_t ll;
+    const char * cp;
+    const char * ecp;
+    char b[16];
+
+    php->min_rate = 0;
+    php->err_limit = -1;
+    if ((NULL == spec) || ('\0' == *spec))
+        return 0;
+    ecp = strchr(spec, ',');
+    len = ecp ? (int)(ecp - spec) : (int)strlen(spec);
+    if (len > 0) {
+        if (len >= (int)sizeof(b))
+            goto bad_rate;
+        memcpy(b, spec, len);
+        b[len] = '\0';
+        if ((len > 4) && (0 == strcasecmp(b + len - 4, "gbps")))
+            b[len - 4] = '\0';
+        else if ((len > 1) && ('G' == toupper((unsigned char)b[len - 1])))
+            b[len - 1] = '\0';
+        for (k = 0; k < PHY_NUM_RATES; ++k) {
+            if (0 == strcmp(b, phy_rate_arr[k]))
+                break;
+        }
+        if (k >= PHY_NUM_RATES)
+            goto bad_rate;
+        php->min_rate = PHY_RATE_1_5G + k;
+    }
+    if (ecp) {
+        cp = ecp + 1;
+        ll = sg_get_llnum(cp);
+        if (ll < 0) {
+            pr2serr("--phy-audit=MIN,ERR: ERR expects a number, not '%s'\n",
+                    cp);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        php->err_limit = ll;
+    }
+    return 0;
+bad_rate:
+    pr2serr("--phy-audit=MIN: MIN expects a link rate in Gbps: 1.5, 3, 6, "
+            "12 or 22.5\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+/* Prepares for '--phy-audit[=MIN[,ERR]]' (spec is NULL if '=' not given)
+ * with room for the results of max_devs DEVICEs. On success returns 0 and
+ * places a new object in *phpp . */
+int
+sdp_phy_new(int max_devs, const char * spec,
+            const struct sdparm_opt_coll * op, struct sdparm_phy_t ** phpp)
+{
+    int res;
+    struct sdparm_phy_t * php;
+
+    *phpp = NULL;
+    php = (struct sdparm_phy_t *)calloc(1, sizeof(*php));
+    if (NULL == php)
+        return sg_convert_errno(ENOMEM);
+    res = phy_parse(spec, php);
+    if (res) {
+        free(php);
+        return res;
+    }
+    php->num_devs = max_devs;
+    php->res_sz = (max_devs > 0 ? max_devs : 1) * sizeof(*php->res_arr);
+    /* shared so children started by --jobs= can leave their results */
+    php->res_arr = (struct phy_dev_res_t *)sdp_shm_alloc(php->res_sz);
+    if (NULL == php->res_arr) {
+        res = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(res));
+        sdp_phy_free(php);
+        return sg_convert_errno(res);
+    }
+    if (op->verbose > 1)
+        pr2serr("%s: minimum link rate code=%d, error limit=%" PRId64 "\n",
+                __func__, php->min_rate, php->err_limit);
+    *phpp = php;
+    return 0;
+}
+
+void
+sdp_phy_free(struct sdparm_phy_t * php)
+{
+    if (NULL == php)
+        return;
+    sdp_shm_free(php->res_arr, php->res_sz);
+    free(php);
+}
+
+/* Decodes the phy mode descriptors of the pcd subpage into drp. Returns 0
+ * on success. */
+static int
+phy_fetch_pcd(struct sdparm_ctx_t * ctxp, struct phy_dev_res_t * drp)
+{
+    int k, res, len, n, off, pg_len, num;
+    int resid = 0;
+    const uint8_t * dp;
+    struct phy_res_t * prp;
+    uint8_t b[PHY_MS_BUFF_LEN];
+    char e[128];
+
+    memset(b, 0, sizeof(b));
+    res = sdp_ctx_mode_sense_pc(ctxp, 0, PROT_SPEC_PORT_MP, MSP_SAS_PCD, b,
+                                sizeof(b), &resid);
+    if (res)
+        return res;
+    len = (int)sizeof(b) - resid;
+    n = sg_msense_calc_length(b, len, ctxp->opts.mode_6, NULL);
+    if ((n > 0) && (n < len))
+        len = n;
+    off = sg_mode_page_offset(b, len, ctxp->opts.mode_6, e, sizeof(e));
+    if ((off < 0) || ((off + PHY_DESC_OFF) > len) ||
+        (PROT_SPEC_PORT_MP != (b[off] & 0x3f)) || (0 == (b[off] & 0x40)) ||
+        (MSP_SAS_PCD != b[off + 1])) {
+        if (ctxp->opts.verbose)
+            pr2serr("%s: %s\n", __func__,
+                    (off < 0) ? e : "wrong page in response");
+        return SG_LIB_CAT_MALFORMED;
+    }
+    if (TPROTO_SAS != (b[off + 5] & 0xf))
+        return SG_LIB_CAT_MALFORMED;
+    pg_len = sdp_mpage_len(b + off);
+    if ((off + pg_len) > len)
+        pg_len = len - off;
+    num = b[off + 7];
+    if (num > ((pg_len - PHY_DESC_OFF) / PHY_DESC_LEN)) {
+        if (ctxp->opts.verbose)
+            pr2serr("%s: only room for %d of %d phys\n", __func__,
+                    (pg_len - PHY_DESC_OFF) / PHY_DESC_LEN, num);
+        num = (pg_len - PHY_DESC_OFF) / PHY_DESC_LEN;
+    }
+    if (num > PHY_MAX_PHYS)
+        num = PHY_MAX_PHYS;
+    dp = b + off + PHY_DESC_OFF;
+    for (k = 0, prp = drp->phys; k < num; ++k, ++prp, dp += PHY_DESC_LEN) {
+        prp->id = dp[1];
+        prp->adt = (dp[4] >> 4) & 0x7;
+        prp->nllr = dp[5] & 0xf;
+        prp->asasa = sg_get_unaligned_be64(dp + 16);
+        prp->pmalr = (dp[33] >> 4) & 0xf;
+        prp->hmalr = dp[33] & 0xf;
+        if (0 == k)
+            drp->sasa = sg_get_unaligned_be64(dp + 8);
+    }
+    drp->num_phys = num;
+    return 0;
+}
+
+/* Places the error counters of each SAS phy log descriptor in the Protocol
+ * specific port log page against the matching phy in drp. Not all DEVICEs
+ * support this log page so failure is not an error. */
+static void
+phy_fetch_cnts(struct sdparm_ctx_t * ctxp, struct phy_dev_res_t * drp)
+{
+    int k, j, m, res, len, pl, num, d_len;
+    int resid = 0;
+    const int vb = ctxp->opts.verbose;
+    const uint8_t * dp;
+    struct phy_res_t * prp;
+    uint8_t * b;
+
+    b = (uint8_t *)calloc(1, PHY_LS_BUFF_LEN);
+    if (NULL == b)
+        return;
+    res = sg_ll_log_sense_v2(ctxp->sg_fd, false, false, 1 /* cumulative */,
+                             PHY_PSP_LPAGE, 0, 0, b, PHY_LS_BUFF_LEN, 0,
+                             &resid, vb > 0, vb > 1 ? vb - 1 : 0);
+    if (res) {
+        if (vb)
+            pr2serr("%s: Protocol specific port log page not available\n",
+                    __func__);
+        goto fini;
+    }
+    len = PHY_LS_BUFF_LEN - resid;
+    if ((len < 4) || (PHY_PSP_LPAGE != (b[0] & 0x3f)))
+        goto fini;
+    pl = sg_get_unaligned_be16(b + 2) + 4;
+    if (pl < len)
+        len = pl;
+    /* one parameter per relative target port, holding its phys */
+    for (k = 4; (k + 8) <= len; k += b[k + 3] + 4) {
+        if (TPROTO_SAS != (b[k + 5] & 0xf))
+            continue;
+        num = b[k + 7];
+        dp = b + k + 8;
+        for (j = 0; (j < num) && ((dp + 4) <= (b + len)); ++j, dp += d_len) {
+            d_len = dp[3] + 4;
+            if ((d_len < 48) || ((dp + d_len) > (b + len)))
+                break;
+            for (m = 0, prp = drp->phys; m < drp->num_phys; ++m, ++prp) {
+                if (prp->id != dp[1])
+                    continue;
+                prp->cnts[0] = sg_get_unaligned_be32(dp + 32);
+                prp->cnts[1] = sg_get_unaligned_be32(dp + 36);
+                prp->cnts[2] = sg_get_unaligned_be32(dp + 40);
+                prp->cnts[3] = sg_get_unaligned_be32(dp + 44);
+                prp->have_cnts = true;
+                break;
+            }
+        }
+    }
+fini:
+    free(b);
+}
+
+/* Audits the phys of the DEVICE open in ctxp, which is the k-th DEVICE,
+ * and records the outcome for sdp_phy_report(). Returns 0 unless there is
+ * an error; flagged phys are not an error here. */
+int
+sdp_phy_add_dev(struct sdparm_phy_t * php, int k,
+                struct sdparm_ctx_t * ctxp)
+{
+    int j, m, res;
+    struct phy_dev_res_t * drp = php->res_arr + k;
+    struct phy_res_t * prp;
+
+    if ((k < 0) || (k >= php->num_devs))
+        return SG_LIB_LOGIC_ERROR;
+    memset(drp, 0, sizeof(*drp));
+    snprintf(drp->vendor, sizeof(drp->vendor), "%s", ctxp->vendor);
+    snprintf(drp->product, sizeof(drp->product), "%s", ctxp->product);
+    res = phy_fetch_pcd(ctxp, drp);
+    if (res) {
+        pr2serr("Phy control and discover (SAS) mode page not supported "
+                "by DEVICE\n");
+        drp->status = SG_LIB_CAT_ILLEGAL_REQ;
+        return 0;
+    }
+    phy_fetch_cnts(ctxp, drp);
+    for (j = 0, prp = drp->phys; j < drp->num_phys; ++j, ++prp) {
+        if (prp->nllr < PHY_RATE_1_5G)
+            continue;           /* no link so rate checks don't apply */
+        if ((prp->hmalr >= PHY_RATE_1_5G) && (prp->nllr < prp->hmalr))
+            prp->flags |= PHY_FL_BELOW_HW_MAX;
+        if (php->min_rate && (prp->nllr < php->min_rate))
+            prp->flags |= PHY_FL_BELOW_MIN;
+        if (prp->have_cnts && (php->err_limit >= 0)) {
+            for (m = 0; m < PHY_NUM_CNTS; ++m) {
+                if (prp->cnts[m] > php->err_limit)
+                    prp->flags |= PHY_FL_ERRORS;
+            }
+        }
+    }
+    drp->status = -1;   /* 0 means DEVICE not processed */
+    return 0;
+}
+
+/* Outputs one table with a line per phy of all DEVICEs after
+ * sdp_phy_add_dev() has been called for them (perhaps in children).
+ * Returns 0 if no phy is flagged, else SG_LIB_OK_FALSE. */
+int
+sdp_phy_report(const struct sdparm_phy_t * php,
+               const char * device_name_arr[], struct sdparm_opt_coll * op,
+               sgj_opaque_p jop)
+{
+    int k, j, m, n, w, n_phys, n_flagged, n_bad_dev;
+    sgj_state * jsp = &op->json_st;
+    const struct phy_dev_res_t * drp;
+    const struct phy_res_t * prp;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jo4p;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p ja2p;
+    char b[160];
+    char r1[32];
+    char r2[32];
+    char c[PHY_NUM_CNTS][16];
+
+    for (k = 0, w = 6; k < php->num_devs; ++k) {
+        n = (int)strlen(device_name_arr[k]);
+        if (n > w)
+            w = (n > 40) ? 40 : n;
+    }
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "phy_audit");
+        if (php->min_rate)
+            sgj_js_nv_ihexstr(jsp, jo2p, "minimum_link_rate", php->min_rate,
+                              NULL, phy_rate_str(php->min_rate, r1,
+                                                 sizeof(r1)));
+        if (php->err_limit >= 0)
+            sgj_js_nv_i(jsp, jo2p, "error_counter_limit", php->err_limit);
+        jap = sgj_named_subarray_r(jsp, jo2p, "devices");
+    }
+    if (php->min_rate)
+        sgj_pr_hr(jsp, "SAS phy audit, minimum link rate: %s\n",
+                  phy_rate_str(php->min_rate, r1, sizeof(r1)));
+    sgj_pr_hr(jsp, "%-*s  phy  negotiated  hw max     invalid  disparity  "
+              "loss_sync  reset_pr  flags\n", w, "DEVICE");
+    n_phys = 0;
+    n_flagged = 0;
+    n_bad_dev = 0;
+    for (k = 0, drp = php->res_arr; k < php->num_devs; ++k, ++drp) {
+        jo3p = NULL;
+        ja2p = NULL;
+        if (jsp->pr_as_json) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo3p, "device_name", device_name_arr[k]);
+        }
+        if (drp->status >= 0) {
+            ++n_bad_dev;
+            sgj_pr_hr(jsp, "%-*s  %s\n", w, device_name_arr[k],
+                      (0 == drp->status) ? "not processed" :
+                                           "no SAS phy information");
+            if (jo3p) {
+                sgj_js_nv_s(jsp, jo3p, "state", (0 == drp->status) ?
+                            "not_processed" : "not_supported");
+                sgj_js_nv_o(jsp, jap, NULL, jo3p);
+            }
+            continue;
+        }
+        if (jo3p) {
+            sgj_js_nv_s(jsp, jo3p, "t10_vendor_identification",
+                        drp->vendor);
+            sgj_js_nv_s(jsp, jo3p, "product_identification", drp->product);
+            sgj_js_nv_ihex(jsp, jo3p, "sas_address", drp->sasa);
+            ja2p = sgj_named_subarray_r(jsp, jo3p, "phys");
+        }
+        for (j = 0, prp = drp->phys; j < drp->num_phys; ++j, ++prp) {
+            ++n_phys;
+            if (prp->flags)
+                ++n_flagged;
+            for (m = 0; m < PHY_NUM_CNTS; ++m) {
+                if (prp->have_cnts)
+                    snprintf(c[m], sizeof(c[m]), "%" PRIu32, prp->cnts[m]);
+                else
+                    snprintf(c[m], sizeof(c[m]), "-");
+            }
+            n = snprintf(b, sizeof(b), "%s%s%s",
+                         (prp->flags & PHY_FL_BELOW_HW_MAX) ?
+                                "  below_hw_max" : "",
+                         (prp->flags & PHY_FL_BELOW_MIN) ? "  below_min" : "",
+                         (prp->flags & PHY_FL_ERRORS) ? "  errors" : "");
+            sgj_pr_hr(jsp, "%-*s  %3d  %-10s  %-9s  %7s  %9s  %9s  %8s"
+                      "%s\n", w, device_name_arr[k], prp->id,
+                      phy_rate_str(prp->nllr, r1, sizeof(r1)),
+                      phy_rate_str(prp->hmalr, r2, sizeof(r2)), c[0], c[1],
+                      c[2], c[3], (n > 0) ? b : "");
+            if (NULL == ja2p)
+                continue;
+            jo4p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo4p, "phy_identifier", prp->id);
+            sgj_js_nv_i(jsp, jo4p, "attached_sas_device_type", prp->adt);
+            sgj_js_nv_ihex(jsp, jo4p, "attached_sas_address", prp->asasa);
+            sgj_js_nv_ihexstr(jsp, jo4p, "negotiated_logical_link_rate",
+                              prp->nllr, NULL, r1);
+            sgj_js_nv_ihexstr(jsp, jo4p, "hardware_maximum_link_rate",
+                              prp->hmalr, NULL, r2);
+            sgj_js_nv_ihexstr(jsp, jo4p, "programmed_maximum_link_rate",
+                              prp->pmalr, NULL,
+                              phy_rate_str(prp->pmalr, r1, sizeof(r1)));
+            if (prp->have_cnts) {
+                for (m = 0; m < PHY_NUM_CNTS; ++m)
+                    sgj_js_nv_i(jsp, jo4p, phy_cnt_s[m], prp->cnts[m]);
+            }
+            sgj_js_nv_b(jsp, jo4p, "below_hardware_maximum",
+                        !! (prp->flags & PHY_FL_BELOW_HW_MAX));
+            sgj_js_nv_b(jsp, jo4p, "below_minimum",
+                        !! (prp->flags & PHY_FL_BELOW_MIN));
+            sgj_js_nv_b(jsp, jo4p, "errors_exceed_limit",
+                        !! (prp->flags & PHY_FL_ERRORS));
+            sgj_js_nv_b(jsp, jo4p, "flagged", !! prp->flags);
+            sgj_js_nv_o(jsp, ja2p, NULL, jo4p);
+        }
+        if (jo3p)
+            sgj_js_nv_o(jsp, jap, NULL, jo3p);
+    }
+    sgj_pr_hr(jsp, "%d DEVICEs, %d phys, %d flagged; %d DEVICEs without SAS "
+              "phy information\n", php->num_devs, n_phys, n_flagged,
+              n_bad_dev);
+    if (jo2p) {
+        sgj_js_nv_i(jsp, jo2p, "number_of_phys", n_phys);
+        sgj_js_nv_i(jsp, jo2p, "number_flagged", n_flagged);
+        sgj_js_nv_i(jsp, jo2p, "number_without_phy_information",
+                    n_bad_dev);
+    }
+    return n_flagged ? SG_LIB_OK_FALSE : 0;
+}
@@ -0,0 +1,852 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_prof.c : applies a profile ('--profile=FILE') of mode page field
+ * rules to DEVICEs. Only fields whose values differ from the rule are
+ * changed and a compliance report is output for each DEVICE. The profile
+ * is an INI style file:
+ *
+ *   # comment
+ *   [policy]
+ *   save = yes              # change saved values as well (like --save)
+ *   verify = yes            # re-read changed fields to confirm them
+ *
+ *   [caching]               # a name then optional qualifiers
+ *   WCE = 1                 # <acronym>[.<desc_num>] = <value>
+ *   RCD = 0
+ *
+ *   [timers pdt=disk vendor=SEAGATE|HGST transport=sas]
+ *   IDLE_B = 1
+ *
+ * ':' may be used in place of '='. The rules of a section only apply to a
+ * DEVICE that matches all its qualifiers. vendor= and product= are matched
+ * against the start of the standard INQUIRY fields (ignoring case) and may
+ * hold '|' separated alternatives. transport= also selects the namespace
+ * used to look up its acronyms, as --transport= does. When a field is named
+ * more than once for a DEVICE, the last applicable rule wins.
+ *
+ * With --jobs= DEVICEs are handled in child processes so results are kept
+ * in memory shared with the parent which outputs the report at the end.
+ */
+
+#define PROF_MAX_SECTS 32
+#define PROF_MAX_LINE 256
+#define PROF_NAME_LEN 32
+#define PROF_QUAL_LEN 64
+#define PROF_RULE_LEN 64
+
+/* State of each field (item) on a DEVICE, index into prof_state_s[] */
+#define PROF_ST_NONE 0          /* DEVICE not processed */
+#define PROF_ST_COMPLIANT 1
+#define PROF_ST_CHANGED 2       /* MODE SELECT done, not verified */
+#define PROF_ST_VERIFIED 3      /* MODE SELECT done, re-read agrees */
+#define PROF_ST_WOULD_CHANGE 4  /* --dummy given */
+#define PROF_ST_REJECTED 5      /* re-read after MODE SELECT disagrees */
+#define PROF_ST_NOT_CHANGEABLE 6
+#define PROF_ST_NOT_SUPPORTED 7 /* page (or field) not found on DEVICE */
+#define PROF_ST_FAILED 8        /* MODE SELECT failed */
+
+static const char * prof_state_s[] = {
+    "not_processed", "compliant", "changed", "changed_verified",
+    "would_change", "rejected", "not_changeable", "not_supported",
+    "failed",
+};
+
+struct prof_sect_t {
+    char name[PROF_NAME_LEN];
+    int pdt;            /* -2 for any */
+    int transport;      /* -1 for any */
+    int line;
+    char vendor[PROF_QUAL_LEN];     /* "" for any */
+    char product[PROF_QUAL_LEN];
+};
+
+struct prof_rule_t {
+    int sect;           /* index into sects[] */
+    int line;
+    char str[PROF_RULE_LEN];        /* in '--set=' form, e.g. "WCE=1" */
+};
+
+struct prof_item_res_t {        /* result for one field on one DEVICE */
+    uint8_t state;      /* PROF_ST_* */
+    bool have_saved;
+    int16_t rule;       /* index into rules[] */
+    int16_t pn;
+    int16_t spn;
+    uint64_t want;
+    uint64_t before;
+    uint64_t after;     /* current value after change, if verified */
+    uint64_t saved;     /* saved value after change, if have_saved */
+};
+
+struct prof_dev_res_t {         /* result for one DEVICE */
+    int pdt;
+    int transport;      /* protocol identifier found, or -1 */
+    int num_items;
+    int status;         /* 0 or error from applying profile */
+    char vendor[9];
+    char product[17];
+    struct prof_item_res_t items[MAX_MP_IT_VAL];
+};
+
+struct sdparm_profile_t {
+    bool save;
+    bool verify;
+    bool need_transport;        /* some section has transport= */
+    int num_sects;
+    int num_rules;
+    int num_devs;
+    size_t res_sz;
+    const char * fn;
+    struct prof_dev_res_t * res_arr;    /* may be shared with children */
+    struct prof_sect_t sects[PROF_MAX_SECTS];
+    struct prof_rule_t rules[MAX_MP_IT_VAL];
+};
+
+
+static char *
+prof_trim(char * cp)
+{
+    char * ep;
+
+    while (isspace((uint8_t)*cp))
+        ++cp;
+    for (ep = cp + strlen(cp); (ep > cp) && isspace((uint8_t)ep[-1]); --ep)
+        ;
+    *ep = '\0';
+    return cp;
+}
+
+static int
+prof_yes_no(const char * cp)
+{
+    if ((0 == strcasecmp(cp, "yes")) || (0 == strcasecmp(cp, "true")) ||
+        (0 == strcasecmp(cp, "on")) || (0 == strcmp(cp, "1")))
+        return 1;
+    if ((0 == strcasecmp(cp, "no")) || (0 == strcasecmp(cp, "false")) ||
+        (0 == strcasecmp(cp, "off")) || (0 == strcmp(cp, "0")))
+        return 0;
+    return -1;
+}
+
+/* Parses "[name qual=val ...]" (brackets already removed) into spp.
+ * Returns true if successful. */
+static bool
+prof_parse_sect(char * cp, struct prof_sect_t * spp, const char * fn,
+                int line)
+{
+    int n;
+    char * tp;
+    char * vp;
+    char * savep = NULL;
+
+    memset(spp, 0, sizeof(*spp));
+    spp->pdt = -2;
+    spp->transport = -1;
+    spp->line = line;
+    tp = strtok_r(cp, " \t", &savep);
+    if (NULL == tp)
+        return true;
+    snprintf(spp->name, sizeof(spp->name), "%s", tp);
+    while ((tp = strtok_r(NULL, " \t", &savep))) {
+        vp = strchr(tp, '=');
+        if ((NULL == vp) || ('\0' == vp[1]))
+            goto bad;
+        *vp++ = '\0';
+        if (0 == strcasecmp(tp, "pdt")) {
+            if (isdigit((uint8_t)*vp)) {
+                n = sg_get_num_nomult(vp);
+                if ((n < 0) || (n > 0x1f))
+                    goto bad;
+            } else {
+                n = sg_get_pdt_from_acronym(vp);
+                if (n < 0)
+                    goto bad;
+            }
+            spp->pdt = n;
+        } else if (0 == strcasecmp(tp, "transport")) {
+            if (isalpha((uint8_t)*vp))
+                n = sdp_find_transport_id_by_acron(vp);
+            else
+                n = sg_get_num_nomult(vp);
+            if ((n < 0) || (n > 15))
+                goto bad;
+            spp->transport = n;
+        } else if (0 == strcasecmp(tp, "vendor"))
+            snprintf(spp->vendor, sizeof(spp->vendor), "%s", vp);
+        else if (0 == strcasecmp(tp, "product"))
+            snprintf(spp->product, sizeof(spp->product), "%s", vp);
+        else
+            goto bad;
+    }
+    return true;
+bad:
+    pr2serr("%s:%d: bad qualifier in section header: %s%s%s\n", fn, line,
+            tp, (vp ? "=" : ""), (vp ? vp : ""));
+    return false;
+}
+
+/* Checks that each rule names a known field by building it as '--set='
+ * would, using its section's transport namespace. */
+static bool
+prof_check_rules(struct sdparm_profile_t * pfp, struct sdparm_ctx_t * ctxp)
+{
+    bool ok = true;
+    int k, sv_transport;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    struct sdparm_mp_settings_t * mps;
+    const struct prof_rule_t * rp;
+
+    mps = (struct sdparm_mp_settings_t *)malloc(sizeof(*mps));
+    if (NULL == mps)
+        return false;
+    sv_transport = op->transport;
+    for (k = 0, rp = pfp->rules; k < pfp->num_rules; ++k, ++rp) {
+        memset(mps, 0, sizeof(*mps));
+        mps->pg_num = -1;
+        mps->subpg_num = -1;
+        if (pfp->sects[rp->sect].transport >= 0)
+            op->transport = pfp->sects[rp->sect].transport;
+        if (! sdp_ctx_build_mp_settings(ctxp, rp->str, mps, false, false)) {
+            pr2serr("%s:%d: unable to use rule: %s\n", pfp->fn, rp->line,
+                    rp->str);
+            ok = false;
+        }
+        op->transport = sv_transport;
+    }
+    free(mps);
+    return ok;
+}
+
+/* Reads and checks the profile in fn, ready to apply to up to max_devs
+ * DEVICEs. On success returns 0 and places a new object in *pfpp which the
+ * caller should free with sdp_prof_free(). The [policy] section may set
+ * ctxp->opts.save . */
+int
+sdp_prof_new(int max_devs, const char * fn, struct sdparm_ctx_t * ctxp,
+             struct sdparm_profile_t ** pfpp)
+{
+    bool in_policy = false;
+    int k, line, res;
+    int cur_sect = -1;
+    char * cp;
+    char * vp;
+    char b[PROF_MAX_LINE];
+    FILE * fp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    struct sdparm_profile_t * pfp;
+    struct prof_rule_t * rp;
+
+    *pfpp = NULL;
+    fp = fopen(fn, "r");
+    if (NULL == fp) {
+        res = errno;
+        pr2serr("unable to open profile %s: %s\n", fn, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    pfp = (struct sdparm_profile_t *)calloc(1, sizeof(*pfp));
+    if (NULL == pfp) {
+        fclose(fp);
+        return sg_convert_errno(ENOMEM);
+    }
+    pfp->fn = fn;
+    for (line = 1; fgets(b, sizeof(b), fp); ++line) {
+        if ((NULL == strchr(b, '\n')) && (! feof(fp))) {
+            pr2serr("%s:%d: line too long\n", fn, line);
+            goto syntax_err;
+        }
+        for (cp = b; *cp; ++cp) {      /* strip comment */
+            if ((('#' == *cp) || (';' == *cp)) &&
+                ((cp == b) || isspace((uint8_t)cp[-1]))) {
+                *cp = '\0';
+                break;
+            }
+        }
+        cp = prof_trim(b);
+        if ('\0' == *cp)
+            continue;
+        if ('[' == *cp) {
+            vp = strchr(cp, ']');
+            if ((NULL == vp) || ('\0' != *prof_trim(vp + 1))) {
+                pr2serr("%s:%d: expected '[' <name> [<qualifier>...] ']'\n",
+                        fn, line);
+                goto syntax_err;
+            }
+            *vp = '\0';
+            cp = prof_trim(cp + 1);
+            in_policy = (0 == strcasecmp(cp, "policy"));
+            if (in_policy)
+                continue;
+            if (pfp->num_sects >= PROF_MAX_SECTS) {
+                pr2serr("%s:%d: too many sections, maximum is %d\n", fn,
+                        line, PROF_MAX_SECTS);
+                goto syntax_err;
+            }
+            cur_sect = pfp->num_sects++;
+            if (! prof_parse_sect(cp, pfp->sects + cur_sect, fn, line))
+                goto syntax_err;
+            if (pfp->sects[cur_sect].transport >= 0)
+                pfp->need_transport = true;
+            continue;
+        }
+        vp = strpbrk(cp, "=:");
+        if (NULL == vp) {
+            pr2serr("%s:%d: expected <acronym>[.<desc_num>] = <value>\n", fn,
+                    line);
+            goto syntax_err;
+        }
+        *vp++ = '\0';
+        cp = prof_trim(cp);
+        vp = prof_trim(vp);
+        if (('\0' == *cp) || ('\0' == *vp)) {
+            pr2serr("%s:%d: expected <acronym>[.<desc_num>] = <value>\n", fn,
+                    line);
+            goto syntax_err;
+        }
+        if (in_policy) {
+            k = prof_yes_no(vp);
+            if ((k < 0) || ((0 != strcasecmp(cp, "save")) &&
+                            (0 != strcasecmp(cp, "verify")))) {
+                pr2serr("%s:%d: policy expects: save|verify = yes|no\n",
+                        fn, line);
+                goto syntax_err;
+            }
+            if (0 == strcasecmp(cp, "save"))
+                pfp->save = !! k;
+            else
+                pfp->verify = !! k;
+            continue;
+        }
+        if (pfp->num_rules >= MAX_MP_IT_VAL) {
+            pr2serr("%s:%d: too many rules, maximum is %d\n", fn, line,
+                    MAX_MP_IT_VAL);
+            goto syntax_err;
+        }
+        if (cur_sect < 0) {     /* rules before any section apply to all */
+            cur_sect = pfp->num_sects++;
+            memset(pfp->sects + cur_sect, 0, sizeof(pfp->sects[0]));
+            pfp->sects[cur_sect].pdt = -2;
+            pfp->sects[cur_sect].transport = -1;
+            pfp->sects[cur_sect].line = line;
+        }
+        rp = pfp->rules + pfp->num_rules++;
+        rp->sect = cur_sect;
+        rp->line = line;
+        if ((int)snprintf(rp->str, sizeof(rp->str), "%s=%s", cp, vp) >=
+            (int)sizeof(rp->str)) {
+            pr2serr("%s:%d: rule too long\n", fn, line);
+            goto syntax_err;
+        }
+        if (strchr(rp->str, ',') || strchr(vp, '=')) {
+            pr2serr("%s:%d: one rule per line please\n", fn, line);
+            goto syntax_err;
+        }
+    }
+    fclose(fp);
+    fp = NULL;
+    if (0 == pfp->num_rules) {
+        pr2serr("%s: no rules found\n", fn);
+        goto syntax_err;
+    }
+    if (! prof_check_rules(pfp, ctxp))
+        goto syntax_err;
+    if (pfp->save)
+        op->save = true;
+
+    pfp->num_devs = max_devs;
+    pfp->res_sz = (max_devs > 0 ? max_devs : 1) * sizeof(*pfp->res_arr);
+    /* shared so children started by --jobs= can leave their results */
+    pfp->res_arr = (struct prof_dev_res_t *)sdp_shm_alloc(pfp->res_sz);
+    if (NULL == pfp->res_arr) {
+        res = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(res));
+        sdp_prof_free(pfp);
+        return sg_convert_errno(res);
+    }
+    if (op->verbose > 1)
+        pr2serr("%s: %d rules in %d sections, save=%d verify=%d\n", fn,
+                pfp->num_rules, pfp->num_sects, (int)pfp->save,
+                (int)pfp->verify);
+    *pfpp = pfp;
+    return 0;
+
+syntax_err:
+    if (fp)
+        fclose(fp);
+    sdp_prof_free(pfp);
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+void
+sdp_prof_free(struct sdparm_profile_t * pfp)
+{
+    if (NULL == pfp)
+        return;
+    sdp_shm_free(pfp->res_arr, pfp->res_sz);
+    free(pfp);
+}
+
+/* Returns true if s (an INQUIRY field) starts with one of the '|'
+ * separated alternatives in quals, ignoring case. Empty quals matches. */
+static bool
+prof_match_str(const char * quals, const char * s)
+{
+    int len;
+    const char * cp;
+    const char * ep;
+
+    if ('\0' == *quals)
+        return true;
+    for (cp = quals; *cp; cp = ep + 1) {
+        ep = strchr(cp, '|');
+        if (NULL == ep)
+            ep = cp + strlen(cp);
+        len = (int)(ep - cp);
+        if ((len > 0) && (0 == strncasecmp(cp, s, len)))
+            return true;
+        if ('\0' == *ep)
+            break;
+    }
+    return false;
+}
+
+/* Finds the transport (protocol identifier) of the DEVICE from the
+ * Protocol specific port mode page. Returns -1 if not known. */
+static int
+prof_dev_transport(struct sdparm_ctx_t * ctxp)
+{
+    int res, resid, len, off;
+    uint8_t b[64];
+    char e[80];
+
+    if (ctxp->opts.transport >= 0)
+        return ctxp->opts.transport;
+    res = sdp_ctx_mode_sense(ctxp, PROT_SPEC_PORT_MP, 0, b, sizeof(b),
+                             &resid);
+    if (res)
+        return -1;
+    len = (int)sizeof(b) - resid;
+    off = sg_mode_page_offset(b, len, ctxp->opts.mode_6, e, sizeof(e));
+    if ((off < 0) || ((off + 3) > len))
+        return -1;
+    return b[off + 2] & 0xf;
+}
+
+static bool
+prof_sect_applies(const struct prof_sect_t * spp,
+                  const struct sdparm_ctx_t * ctxp, int transport)
+{
+    if ((spp->pdt >= -1) && (spp->pdt != ctxp->pdt) &&
+        (spp->pdt != sg_lib_pdt_decay(ctxp->pdt)))
+        return false;
+    if ((spp->transport >= 0) && (spp->transport != transport))
+        return false;
+    if (! prof_match_str(spp->vendor, ctxp->vendor))
+        return false;
+    if (! prof_match_str(spp->product, ctxp->product))
+        return false;
+    return true;
+}
+
+static bool
+prof_same_field(const struct sdparm_mp_it_val_t * a,
+                const struct sdparm_mp_it_val_t * b)
+{
+    return (a->mp_it.pg_num == b->mp_it.pg_num) &&
+           (a->mp_it.subpg_num == b->mp_it.subpg_num) &&
+           (a->mp_it.start_byte == b->mp_it.start_byte) &&
+           (a->mp_it.start_bit == b->mp_it.start_bit) &&
+           (a->descriptor_num == b->descriptor_num);
+}
+
+static uint64_t
+prof_mask(const struct sdparm_mp_item_t * mpip)
+{
+    return (mpip->num_bits < 64) ? ((1ULL << mpip->num_bits) - 1) :
+                                   UINT64_MAX;
+}
+
+/* Fetches the values of the fields in mps a page at a time so that a page
+ * the DEVICE lacks only affects its own fields. On return arr[k].smask is
+ * 0 for fields that could not be fetched. */
+static void
+prof_fetch(struct sdparm_ctx_t * ctxp, const struct sdparm_mp_settings_t * mps,
+           struct sdparm_mp_settings_t * t_mps,
+           struct sdparm_mitem_vals_t * arr, struct sdparm_mitem_vals_t * t_arr)
+{
+    int k, j, n;
+    bool * done;
+
+    memset(arr, 0, mps->num_it_vals * sizeof(*arr));
+    done = (bool *)calloc(mps->num_it_vals ? mps->num_it_vals : 1,
+                          sizeof(bool));
+    if (NULL == done)
+        return;
+    for (k = 0; k < mps->num_it_vals; ++k) {
+        if (done[k])
+            continue;
+        memset(t_mps, 0, sizeof(*t_mps));
+        t_mps->pg_num = mps->it_vals[k].mp_it.pg_num;
+        t_mps->subpg_num = mps->it_vals[k].mp_it.subpg_num;
+        for (j = k, n = 0; j < mps->num_it_vals; ++j) {
+            if ((mps->it_vals[j].mp_it.pg_num == t_mps->pg_num) &&
+                (mps->it_vals[j].mp_it.subpg_num == t_mps->subpg_num))
+                t_mps->it_vals[n++] = mps->it_vals[j];
+        }
+        t_mps->num_it_vals = n;
+        if (sdp_ctx_fetch_mitem_vals(ctxp, t_mps, t_arr))
+            memset(t_arr, 0, n * sizeof(*t_arr));
+        for (j = k, n = 0; j < mps->num_it_vals; ++j) {
+            if ((mps->it_vals[j].mp_it.pg_num == t_mps->pg_num) &&
+                (mps->it_vals[j].mp_it.subpg_num == t_mps->subpg_num)) {
+                arr[j] = t_arr[n++];
+                done[j] = true;
+            }
+        }
+    }
+    free(done);
+}
+
+static void
+prof_pr_item(const struct sdparm_profile_t * pfp,
+             const struct prof_item_res_t * irp, const sgj_state * jsp)
+{
+    char b[64];
+
+    switch (irp->state) {
+    case PROF_ST_COMPLIANT:
+        return;
+    case PROF_ST_NOT_SUPPORTED:
+        snprintf(b, sizeof(b), "field not found");
+        break;
+    case PROF_ST_REJECTED:
+        snprintf(b, sizeof(b), "is %" PRIu64 " after change", irp->after);
+        break;
+    default:
+        snprintf(b, sizeof(b), "was %" PRIu64, irp->before);
+        break;
+    }
+    sgj_pr_hr((sgj_state *)jsp, "    %-24s %s [%s]\n",
+              pfp->rules[irp->rule].str, prof_state_s[irp->state], b);
+}
+
+/* Applies the profile to the DEVICE open in ctxp, which is the k-th
+ * DEVICE, and records the outcome for sdp_prof_report(). Returns 0 unless
+ * there is an error; a DEVICE that is not compliant is not an error here. */
+int
+sdp_prof_apply(struct sdparm_profile_t * pfp, int k,
+               struct sdparm_ctx_t * ctxp, const char * device_name)
+{
+    int j, n, res, transport, sv_transport, num_ok, num_chg, num_bad;
+    uint64_t mask, cur, cha;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct prof_dev_res_t * drp = pfp->res_arr + k;
+    struct prof_item_res_t * irp;
+    struct sdparm_mp_settings_t * mps = NULL;
+    struct sdparm_mp_settings_t * c_mps = NULL;
+    struct sdparm_mp_settings_t * t_mps = NULL;
+    struct sdparm_mitem_vals_t * vals = NULL;
+    struct sdparm_mitem_vals_t * t_vals = NULL;
+    int16_t item_ind[MAX_MP_IT_VAL];    /* c_mps index -> mps index */
+    int16_t rule_of[MAX_MP_IT_VAL];
+
+    if ((k < 0) || (k >= pfp->num_devs))
+        return SG_LIB_LOGIC_ERROR;
+    memset(drp, 0, sizeof(*drp));
+    drp->pdt = ctxp->pdt;
+    snprintf(drp->vendor, sizeof(drp->vendor), "%s", ctxp->vendor);
+    snprintf(drp->product, sizeof(drp->product), "%s", ctxp->product);
+    prof_trim(drp->vendor);     /* trailing spaces only, so in place */
+    prof_trim(drp->product);
+    transport = pfp->need_transport ? prof_dev_transport(ctxp) :
+                                      op->transport;
+    drp->transport = transport;
+    mps = (struct sdparm_mp_settings_t *)calloc(3, sizeof(*mps));
+    vals = (struct sdparm_mitem_vals_t *)calloc(2 * MAX_MP_IT_VAL,
+                                                sizeof(*vals));
+    if ((NULL == mps) || (NULL == vals)) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    c_mps = mps + 1;
+    t_mps = mps + 2;
+    t_vals = vals + MAX_MP_IT_VAL;
+    mps->pg_num = -1;
+    mps->subpg_num = -1;
+
+    /* resolve applicable rules, later rules for the same field win */
+    sv_transport = op->transport;
+    for (j = 0; j < pfp->num_rules; ++j) {
+        const struct prof_sect_t * spp = pfp->sects + pfp->rules[j].sect;
+
+        if (! prof_sect_applies(spp, ctxp, transport))
+            continue;
+        op->transport = (spp->transport >= 0) ? spp->transport :
+                                                sv_transport;
+        c_mps->num_it_vals = 0;
+        c_mps->pg_num = -1;
+        c_mps->subpg_num = -1;
+        if (sdp_ctx_build_mp_settings(ctxp, pfp->rules[j].str, c_mps,
+                                      false, false)) {
+            for (n = 0; n < mps->num_it_vals; ++n) {
+                if (prof_same_field(mps->it_vals + n, c_mps->it_vals))
+                    break;
+            }
+            if (n >= mps->num_it_vals)
+                ++mps->num_it_vals;
+            mps->it_vals[n] = c_mps->it_vals[0];
+            rule_of[n] = j;
+        }
+        op->transport = sv_transport;
+    }
+    if (0 == mps->num_it_vals) {
+        sgj_pr_hr(jsp, "    %s: no rules of profile apply\n", device_name);
+        res = 0;
+        goto fini;
+    }
+
+    /* compare current (and saved if --save) values with the rules */
+    prof_fetch(ctxp, mps, t_mps, vals, t_vals);
+    memset(c_mps, 0, sizeof(*c_mps));
+    c_mps->pg_num = -1;
+    c_mps->subpg_num = -1;
+    for (j = 0; j < mps->num_it_vals; ++j) {
+        const struct sdparm_mp_it_val_t * ivp = mps->it_vals + j;
+
+        irp = drp->items + j;
+        irp->rule = rule_of[j];
+        irp->pn = ivp->mp_it.pg_num;
+        irp->spn = ivp->mp_it.subpg_num;
+        mask = prof_mask(&ivp->mp_it);
+        irp->want = (uint64_t)ivp->val & mask;
+        if (0 == (vals[j].smask & MP_OM_CUR)) {
+            irp->state = PROF_ST_NOT_SUPPORTED;
+            continue;
+        }
+        cur = vals[j].val[0] & mask;
+        irp->before = cur;
+        if ((cur == irp->want) && ((! op->save) ||
+            (0 == (vals[j].smask & MP_OM_SAV)) ||
+            ((vals[j].val[3] & mask) == irp->want))) {
+            irp->state = PROF_ST_COMPLIANT;
+            continue;
+        }
+        cha = (vals[j].smask & MP_OM_CHA) ? (vals[j].val[1] & mask) : 0;
+        if ((cur ^ irp->want) & ~cha) {
+            irp->state = PROF_ST_NOT_CHANGEABLE;
+            continue;
+        }
+        irp->state = op->dummy ? PROF_ST_WOULD_CHANGE : PROF_ST_CHANGED;
+        item_ind[c_mps->num_it_vals] = j;
+        c_mps->it_vals[c_mps->num_it_vals++] = *ivp;
+    }
+    drp->num_items = mps->num_it_vals;
+
+    res = 0;
+    if (c_mps->num_it_vals > 0) {
+        res = sdp_ctx_change_mode_page(ctxp, c_mps);
+        if (res) {
+            for (j = 0; j < c_mps->num_it_vals; ++j)
+                drp->items[item_ind[j]].state = PROF_ST_FAILED;
+        } else if (pfp->verify && (! op->dummy)) {
+            prof_fetch(ctxp, c_mps, t_mps, vals, t_vals);
+            for (j = 0; j < c_mps->num_it_vals; ++j) {
+                irp = drp->items + item_ind[j];
+                mask = prof_mask(&c_mps->it_vals[j].mp_it);
+                irp->after = vals[j].val[0] & mask;
+                if (op->save && (vals[j].smask & MP_OM_SAV)) {
+                    irp->have_saved = true;
+                    irp->saved = vals[j].val[3] & mask;
+                }
+                if ((0 == (vals[j].smask & MP_OM_CUR)) ||
+                    (irp->after != irp->want) ||
+                    (irp->have_saved && (irp->saved != irp->want)))
+                    irp->state = PROF_ST_REJECTED;
+                else
+                    irp->state = PROF_ST_VERIFIED;
+            }
+        }
+    }
+    for (j = 0, num_ok = 0, num_chg = 0, num_bad = 0; j < drp->num_items;
+         ++j) {
+        irp = drp->items + j;
+        prof_pr_item(pfp, irp, jsp);
+        if (PROF_ST_COMPLIANT == irp->state)
+            ++num_ok;
+        else if ((PROF_ST_CHANGED == irp->state) ||
+                 (PROF_ST_VERIFIED == irp->state) ||
+                 (PROF_ST_WOULD_CHANGE == irp->state))
+            ++num_chg;
+        else
+            ++num_bad;
+    }
+    sgj_pr_hr(jsp, "    %s: %d fields: %d compliant, %d %s, %d not "
+              "compliant\n", device_name, drp->num_items, num_ok, num_chg,
+              (op->dummy ? "would change" : "changed"), num_bad);
+fini:
+    drp->status = res ? res : -1;   /* 0 means DEVICE not processed */
+    if (mps)
+        free(mps);
+    if (vals)
+        free(vals);
+    return res;
+}
+
+/* Outputs the compliance report for all DEVICEs after sdp_prof_apply() has
+ * been called for them (perhaps in children). Returns 0 if all DEVICEs
+ * are (or have been made) compliant, else SG_LIB_OK_FALSE. With --dummy a
+ * DEVICE that needs changes is not compliant. */
+int
+sdp_prof_report(const struct sdparm_profile_t * pfp,
+                const char * device_name_arr[], struct sdparm_opt_coll * op,
+                sgj_opaque_p jop)
+{
+    bool compliant;
+    int k, j, num_ok, num_chg, num_bad, n_compl, n_fixed, n_not;
+    sgj_state * jsp = &op->json_st;
+    const struct prof_dev_res_t * drp;
+    const struct prof_item_res_t * irp;
+    sgj_opaque_p jap = NULL;
+    sgj_opaque_p ja2p;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    char b[144];
+
+    if (jsp->pr_as_json) {
+        sgj_js_nv_s(jsp, jop, "profile_file", pfp->fn);
+        sgj_js_nv_b(jsp, jop, "save", op->save);
+        sgj_js_nv_b(jsp, jop, "verify", pfp->verify);
+        jap = sgj_named_subarray_r(jsp, jop, "compliance_report");
+    }
+    n_compl = 0;
+    n_fixed = 0;
+    n_not = 0;
+    for (k = 0, drp = pfp->res_arr; k < pfp->num_devs; ++k, ++drp) {
+        num_ok = 0;
+        num_chg = 0;
+        num_bad = 0;
+        for (j = 0, irp = drp->items; j < drp->num_items; ++j, ++irp) {
+            if (PROF_ST_COMPLIANT == irp->state)
+                ++num_ok;
+            else if ((PROF_ST_CHANGED == irp->state) ||
+                     (PROF_ST_VERIFIED == irp->state) ||
+                     (PROF_ST_WOULD_CHANGE == irp->state))
+                ++num_chg;
+            else
+                ++num_bad;
+        }
+        if ((drp->status >= 0) || num_bad)
+            ++n_not;
+        else if (num_chg)
+            ++n_fixed;
+        else
+            ++n_compl;
+        compliant = (drp->status < 0) && (0 == num_bad) &&
+                    ! (op->dummy && num_chg);
+        if (! jsp->pr_as_json)
+            continue;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo2p, "device_name", device_name_arr[k]);
+        if (0 == drp->status) {
+            sgj_js_nv_s(jsp, jo2p, "state", prof_state_s[PROF_ST_NONE]);
+            sgj_js_nv_b(jsp, jo2p, "compliant", false);
+            sgj_js_nv_o(jsp, jap, NULL, jo2p);
+            continue;
+        }
+        sgj_js_nv_ihexstr(jsp, jo2p, "peripheral_device_type", drp->pdt,
+                          NULL, sg_get_pdt_str(drp->pdt, sizeof(b), b));
+        sgj_js_nv_s(jsp, jo2p, "t10_vendor_identification", drp->vendor);
+        sgj_js_nv_s(jsp, jo2p, "product_identification", drp->product);
+        if (drp->transport >= 0)
+            sgj_js_nv_ihex(jsp, jo2p, "protocol_identifier",
+                           drp->transport);
+        sgj_js_nv_b(jsp, jo2p, "compliant", compliant);
+        if (drp->status > 0)
+            sgj_js_nv_i(jsp, jo2p, "error_status", drp->status);
+        sgj_js_nv_i(jsp, jo2p, "number_of_fields", drp->num_items);
+        sgj_js_nv_i(jsp, jo2p, "number_compliant", num_ok);
+        sgj_js_nv_i(jsp, jo2p, "number_changed", num_chg);
+        sgj_js_nv_i(jsp, jo2p, "number_not_compliant", num_bad);
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "fields");
+        for (j = 0, irp = drp->items; j < drp->num_items; ++j, ++irp) {
+            const struct prof_rule_t * rp = pfp->rules + irp->rule;
+
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo3p, "rule", rp->str);
+            if (pfp->sects[rp->sect].name[0])
+                sgj_js_nv_s(jsp, jo3p, "section", pfp->sects[rp->sect].name);
+            sgj_js_nv_ihex(jsp, jo3p, "page_code", irp->pn);
+            sgj_js_nv_ihex(jsp, jo3p, "subpage_code", irp->spn);
+            sgj_js_nv_s(jsp, jo3p, "state", prof_state_s[irp->state]);
+            sgj_js_nv_i(jsp, jo3p, "desired_value", (int64_t)irp->want);
+            if (PROF_ST_NOT_SUPPORTED != irp->state)
+                sgj_js_nv_i(jsp, jo3p, "previous_value",
+                            (int64_t)irp->before);
+            if ((PROF_ST_VERIFIED == irp->state) ||
+                (PROF_ST_REJECTED == irp->state)) {
+                sgj_js_nv_i(jsp, jo3p, "current_value", (int64_t)irp->after);
+                if (irp->have_saved)
+                    sgj_js_nv_i(jsp, jo3p, "saved_value",
+                                (int64_t)irp->saved);
+            }
+            sgj_js_nv_o(jsp, ja2p, NULL, jo3p);
+        }
+        sgj_js_nv_o(jsp, jap, NULL, jo2p);
+    }
+    snprintf(b, sizeof(b), "Profile %s: %d DEVICEs, %d compliant, %d %s, %d "
+             "not compliant\n", pfp->fn, pfp->num_devs, n_compl, n_fixed,
+             (op->dummy ? "could be made compliant" : "made compliant"),
+             n_not);
+    sgj_pr_hr(jsp, "%s", b);
+    if (jsp->pr_as_json) {
+        sgj_js_nv_i(jsp, jop, "number_compliant", n_compl);
+        sgj_js_nv_i(jsp, jop, "number_made_compliant", n_fixed);
+        sgj_js_nv_i(jsp, jop, "number_not_compliant", n_not);
+    }
+    return (n_not || (op->dummy && n_fixed)) ? SG_LIB_OK_FALSE : 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_queue.c : '--advise-queue[=apply]' compares the limits in the
+ * Block Limits VPD page [0xb0] of each DEVICE with the attributes that
+ * Linux derived from them in /sys/block/<bdev>/queue . The recommended
+ * values follow what the sd driver does: max_sectors_kb is the optimal
+ * transfer length, else the maximum transfer length capped at the block
+ * layer's default (BLK_DEF_MAX_SECTORS_CAP), either one capped by
+ * max_hw_sectors_kb (the HBA's limit); discard_max_bytes is the maximum
+ * unmap LBA count capped by discard_max_hw_bytes and rounded down to
+ * discard_granularity. Only those two are writable; the others (e.g.
+ * optimal_io_size and atomic_write_*) are reported so a mismatch can be
+ * traced to a driver or HBA. With '=apply' the writable attributes that
+ * differ are written (unless --dummy is given). */
+
+#define ADVQ_BL_VPD_LEN 64      /* Block limits VPD page, sbc4r34 */
+#define ADVQ_DEF_MAX_KB 1280    /* BLK_DEF_MAX_SECTORS_CAP: 2560 sectors */
+
+enum advq_rule_e {
+    ADVQ_EQ = 0,                /* sysfs value should equal recommended */
+    ADVQ_LE,                    /* sysfs value should be <= device limit */
+};
+
+struct advq_attr_t {
+    const char * name;          /* under /sys/block/<bdev>/queue */
+    bool writable;
+    enum advq_rule_e rule;
+    bool have_cur;
+    bool have_rec;
+    uint64_t cur;
+    uint64_t rec;               /* recommended (EQ) or device limit (LE) */
+    const char * status;
+};
+
+enum advq_ind_e {               /* index into attribute array */
+    ADVQ_MAX_SECTORS_KB = 0,
+    ADVQ_OPTIMAL_IO_SIZE,
+    ADVQ_MINIMUM_IO_SIZE,
+    ADVQ_DISCARD_MAX_BYTES,
+    ADVQ_DISCARD_GRANULARITY,
+    ADVQ_ATOMIC_WRITE_MAX_BYTES,
+    ADVQ_ATOMIC_WRITE_UNIT_MAX_BYTES,
+    ADVQ_ATOMIC_WRITE_BOUNDARY_BYTES,
+    ADVQ_NUM_ATTRS,
+};
+
+static const char * bl_vpd_s = "Block limits VPD page";
+
+#ifdef SG_LIB_LINUX
+
+static bool
+advq_sysfs_u64(const char * bdev, const char * attr, uint64_t * valp)
+{
+    bool ok;
+    FILE * fp;
+    char b[PATH_MAX];
+
+    snprintf(b, sizeof(b), "/sys/block/%s/queue/%s", bdev, attr);
+    fp = fopen(b, "r");
+    if (NULL == fp)
+        return false;
+    ok = (1 == fscanf(fp, "%" SCNu64, valp));
+    fclose(fp);
+    return ok;
+}
+
+static int
+advq_sysfs_write(const char * bdev, const char * attr, uint64_t val)
+{
+    int res = 0;
+    FILE * fp;
+    char b[PATH_MAX];
+
+    snprintf(b, sizeof(b), "/sys/block/%s/queue/%s", bdev, attr);
+    fp = fopen(b, "w");
+    if (NULL == fp)
+        return errno;
+    if (fprintf(fp, "%" PRIu64 "\n", val) < 0)
+        res = errno;
+    if (fclose(fp))
+        res = errno;    /* sysfs reports a rejected value on close */
+    return res;
+}
+
+/* Fills in the recommended values (or device limits) in aap from the
+ * Block limits VPD page in b, logical and physical block lengths lbs and
+ * pbs, and the hardware limits already read into aap[].cur . */
+static void
+advq_recommend(const uint8_t * b, uint64_t lbs, uint64_t pbs,
+               uint64_t max_hw_kb, bool have_max_hw, uint64_t disc_hw,
+               bool have_disc_hw, struct advq_attr_t * aap)
+{
+    uint32_t otlg = sg_get_unaligned_be16(b + 6);
+    uint32_t mtl = sg_get_unaligned_be32(b + 8);
+    uint32_t otl = sg_get_unaligned_be32(b + 12);
+    uint32_t mulc = sg_get_unaligned_be32(b + 20);
+    uint32_t oug = sg_get_unaligned_be32(b + 28);
+    uint32_t matl = sg_get_unaligned_be32(b + 44);
+    uint32_t mabs = sg_get_unaligned_be32(b + 60);
+    uint64_t u, g;
+    struct advq_attr_t * ap;
+
+    /* as sd_validate_opt_xfer_size(): OTL must be at least a page, no
+     * more than MTL and a multiple of the physical block length */
+    if (otl && ((otl * lbs) < 4096))
+        otl = 0;
+    if (otl && mtl && (otl > mtl))
+        otl = 0;
+    if (otl && ((otl * lbs) % pbs))
+        otl = 0;
+
+    ap = aap + ADVQ_MAX_SECTORS_KB;
+    if (have_max_hw) {
+        u = max_hw_kb;
+        if (otl)
+            g = ((uint64_t)otl * lbs) / 1024;
+        else {      /* as sd: min_not_zero(MTL, BLK_DEF_MAX_SECTORS_CAP) */
+            g = ((uint64_t)mtl * lbs) / 1024;
+            if ((0 == g) || (g > ADVQ_DEF_MAX_KB))
+                g = ADVQ_DEF_MAX_KB;
+        }
+        ap->rec = (g < u) ? g : u;
+        ap->have_rec = true;
+    }
+    ap = aap + ADVQ_OPTIMAL_IO_SIZE;
+    ap->rec = otl * lbs;
+    ap->have_rec = true;
+    ap = aap + ADVQ_MINIMUM_IO_SIZE;
+    u = otlg * lbs;
+    ap->rec = (u > pbs) ? u : pbs;
+    ap->have_rec = true;
+    ap = aap + ADVQ_DISCARD_GRANULARITY;
+    if (oug) {
+        ap->rec = oug * lbs;
+        ap->have_rec = true;
+    }
+    ap = aap + ADVQ_DISCARD_MAX_BYTES;
+    if (have_disc_hw && (disc_hw > 0)) {  /* 0: discard not enabled */
+        u = disc_hw;
+        if (mulc && (0xffffffff != mulc) && ((mulc * lbs) < u))
+            u = mulc * lbs;
+        g = aap[ADVQ_DISCARD_GRANULARITY].have_cur ?
+            aap[ADVQ_DISCARD_GRANULARITY].cur : 0;
+        if ((g > 0) && (u >= g))
+            u -= u % g;
+        ap->rec = u;
+        ap->have_rec = true;
+    }
+    ap = aap + ADVQ_ATOMIC_WRITE_MAX_BYTES;
+    ap->rec = matl * lbs;
+    if (have_max_hw && (ap->rec > (max_hw_kb * 1024)))
+        ap->rec = max_hw_kb * 1024;
+    ap->have_rec = true;
+    aap[ADVQ_ATOMIC_WRITE_UNIT_MAX_BYTES].rec = ap->rec;
+    aap[ADVQ_ATOMIC_WRITE_UNIT_MAX_BYTES].have_rec = true;
+    ap = aap + ADVQ_ATOMIC_WRITE_BOUNDARY_BYTES;
+    ap->rec = mabs * lbs;
+    ap->have_rec = true;
+}
+
+#endif  /* SG_LIB_LINUX */
+
+/* Compares the Block limits VPD page of DEVICE (open in ctxp) with the
+ * queue attributes of its block device and, if '--advise-queue=apply',
+ * writes the recommended values of those that are writable. Returns 0
+ * on success. */
+int
+sdp_advise_queue(struct sdparm_ctx_t * ctxp, const char * device_name,
+                 sgj_opaque_p jop)
+{
+#ifdef SG_LIB_LINUX
+    bool have_max_hw, have_disc_hw;
+    int k, res, len;
+    int resid = 0;
+    int num_mis = 0;
+    int ret = 0;
+    uint64_t lbs, pbs, max_hw_kb, disc_hw;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    const int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct advq_attr_t * ap;
+    sgj_opaque_p jo2p = NULL;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap = NULL;
+    uint8_t b[ADVQ_BL_VPD_LEN];
+    char bdev[NAME_MAX + 1];
+    struct advq_attr_t a_arr[ADVQ_NUM_ATTRS] = {
+        {"max_sectors_kb", true, ADVQ_EQ, false, false, 0, 0, NULL},
+        {"optimal_io_size", false, ADVQ_EQ, false, false, 0, 0, NULL},
+        {"minimum_io_size", false, ADVQ_EQ, false, false, 0, 0, NULL},
+        {"discard_max_bytes", true, ADVQ_EQ, false, false, 0, 0, NULL},
+        {"discard_granularity", false, ADVQ_EQ, false, false, 0, 0, NULL},
+        {"atomic_write_max_bytes", false, ADVQ_LE, false, false, 0, 0,
+         NULL},
+        {"atomic_write_unit_max_bytes", false, ADVQ_LE, false, false, 0, 0,
+         NULL},
+        {"atomic_write_boundary_bytes", false, ADVQ_EQ, false, false, 0, 0,
+         NULL},
+    };
+
+    memset(b, 0, sizeof(b));
+    res = sg_ll_inquiry_v2(ctxp->sg_fd, true, VPD_BLOCK_LIMITS, b,
+                           ADVQ_BL_VPD_LEN, 0, &resid, vb > 0, vb);
+    if (res) {
+        pr2serr("%s: fetching %s failed\n", device_name, bl_vpd_s);
+        return (SG_LIB_CAT_ILLEGAL_REQ == res) ? SG_LIB_CONTRADICT : res;
+    }
+    len = ADVQ_BL_VPD_LEN - resid;
+    if ((len < 16) || (VPD_BLOCK_LIMITS != b[1])) {
+        pr2serr("%s: %s bad or too short\n", device_name, bl_vpd_s);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    if (len < ADVQ_BL_VPD_LEN)  /* older devices: later fields zero */
+        memset(b + len, 0, ADVQ_BL_VPD_LEN - len);
+    if (! sdp_bdev_name(device_name, bdev, sizeof(bdev))) {
+        pr2serr("%s: no block device found\n", device_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    if ((! advq_sysfs_u64(bdev, "logical_block_size", &lbs)) ||
+        (lbs < 512)) {
+        pr2serr("%s: can't read /sys/block/%s/queue/logical_block_size\n",
+                device_name, bdev);
+        return SG_LIB_FILE_ERROR;
+    }
+    if ((! advq_sysfs_u64(bdev, "physical_block_size", &pbs)) ||
+        (pbs < lbs))
+        pbs = lbs;
+    have_max_hw = advq_sysfs_u64(bdev, "max_hw_sectors_kb", &max_hw_kb);
+    have_disc_hw = advq_sysfs_u64(bdev, "discard_max_hw_bytes", &disc_hw);
+    for (k = 0, ap = a_arr; k < ADVQ_NUM_ATTRS; ++k, ++ap)
+        ap->have_cur = advq_sysfs_u64(bdev, ap->name, &ap->cur);
+    advq_recommend(b, lbs, pbs, max_hw_kb, have_max_hw, disc_hw,
+                   have_disc_hw, a_arr);
+
+    if (have_max_hw)
+        sgj_pr_hr(jsp, "Queue of /sys/block/%s (logical block: %" PRIu64
+                  ", max_hw_sectors_kb: %" PRIu64 "):\n", bdev, lbs,
+                  max_hw_kb);
+    else
+        sgj_pr_hr(jsp, "Queue of /sys/block/%s (logical block: %" PRIu64
+                  "):\n", bdev, lbs);
+    if (jsp->pr_as_json) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "queue_advice");
+        sgj_js_nv_s(jsp, jo2p, "block_device", bdev);
+        sgj_js_nv_i(jsp, jo2p, "logical_block_size", lbs);
+        if (have_max_hw)
+            sgj_js_nv_i(jsp, jo2p, "max_hw_sectors_kb", max_hw_kb);
+        jap = sgj_named_subarray_r(jsp, jo2p, "attributes");
+    }
+    for (k = 0, ap = a_arr; k < ADVQ_NUM_ATTRS; ++k, ++ap) {
+        if (! ap->have_cur)
+            ap->status = "not_present";         /* e.g. older kernel */
+        else if (! ap->have_rec)
+            ap->status = "no_recommendation";
+        else if ((ADVQ_EQ == ap->rule) ? (ap->cur == ap->rec) :
+                 ((ap->cur <= ap->rec) && ((0 == ap->rec) == (0 == ap->cur))))
+            ap->status = "ok";
+        else {
+            ++num_mis;
+            ap->status = "mismatch";
+            if (ap->writable && op->advq_apply) {
+                if (op->dummy)
+                    ap->status = "would_write";
+                else {
+                    res = advq_sysfs_write(bdev, ap->name, ap->rec);
+                    if (res) {
+                        pr2serr("%s: writing %s=%" PRIu64 " failed: %s\n",
+                                bdev, ap->name, ap->rec,
+                                safe_strerror(res));
+                        ap->status = "write_failed";
+                        if (0 == ret)
+                            ret = sg_convert_errno(res);
+                    } else
+                        ap->status = "written";
+                }
+            }
+        }
+        if (ap->have_cur && ap->have_rec)
+            sgj_pr_hr(jsp, "  %-28s %12" PRIu64 "  %s %-12" PRIu64 " %s%s\n",
+                      ap->name, ap->cur,
+                      (ADVQ_LE == ap->rule) ? "limit" : "  rec",
+                      ap->rec, ap->status, ap->writable ? "" : " (ro)");
+        else if (op->verbose)
+            sgj_pr_hr(jsp, "  %-28s %s\n", ap->name, ap->status);
+        if (jap) {
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_s(jsp, jo3p, "name", ap->name);
+            if (ap->have_cur)
+                sgj_js_nv_i(jsp, jo3p, "current", ap->cur);
+            if (ap->have_rec)
+                sgj_js_nv_i(jsp, jo3p, (ADVQ_LE == ap->rule) ?
+                            "device_limit" : "recommended", ap->rec);
+            sgj_js_nv_b(jsp, jo3p, "writable", ap->writable);
+            sgj_js_nv_s(jsp, jo3p, "status", ap->status);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo3p);
+        }
+    }
+    if (jo2p)
+        sgj_js_nv_i(jsp, jo2p, "mismatches", num_mis);
+    return ret;
+#else
+    if (ctxp && jop) { }        /* suppress warning */
+    pr2serr("%s: '--advise-queue' needs Linux sysfs\n", device_name);
+    return SG_LIB_CONTRADICT;
+#endif  /* SG_LIB_LINUX */
+}
@@ -0,0 +1,807 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_pt.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_ready.c : '--command=start --stagger=N[,MS[,SECS]]' spins up a
+ * fleet of DEVICEs without drawing the start-up current of all of them at
+ * once. Each DEVICE is sent START STOP UNIT with the IMMED bit set so the
+ * command returns at once; then TEST UNIT READY is polled until the DEVICE
+ * is ready. At most N DEVICEs are spinning up (started but not yet ready)
+ * at any time, and successive starts are at least MS milliseconds apart.
+ * DEVICEs that are already ready are not started and do not count against
+ * N. The time each DEVICE took to become ready is reported.
+ *
+ * '--command=ready --wait[=TIMEOUT]' polls TEST UNIT READY on many DEVICEs
+ * until all are ready or TIMEOUT seconds have passed. Each DEVICE has its
+ * own poll interval: when the sense data carries a progress indication
+ * (e.g. during a FORMAT UNIT or SANITIZE) the rate of progress is used to
+ * estimate when it will finish, otherwise the interval backs off
+ * exponentially.
+ *
+ * Both hand each DEVICE to its own child process with sdp_sched_run() so a
+ * DEVICE that is slow to answer a command only delays itself. The results
+ * are left in memory shared with the children and the spin-up budget is
+ * kept with tokens in pipes. */
+
+#ifndef SG_LIB_WIN32
+
+#define READY_SENSE_LEN 64
+#define READY_POLL_MS 250       /* TEST UNIT READY interval when spinning */
+#define READY_DEF_LIMIT_MS (300 * 1000)   /* unless --stagger=N,MS,SECS */
+#define READY_UA_RETRIES 3
+#define READY_MIN_POLL_MS 100   /* --wait poll interval limits */
+#define READY_MAX_POLL_MS 10000
+#define READY_DEF_WAIT_SECS 300
+
+enum ready_state_e {
+    RDY_ST_PENDING = 0,         /* waiting for its turn to be started */
+    RDY_ST_SPINNING,            /* started, not ready yet */
+    RDY_ST_READY,
+    RDY_ST_ALREADY,             /* was ready before a start was needed */
+    RDY_ST_FAILED,
+    RDY_ST_TIMEOUT,
+    RDY_ST_NOT_READY,           /* --wait: still not ready */
+};
+
+static const char * ready_state_s[] = {
+    "pending", "spinning_up", "ready", "already_ready", "failed",
+    "timed_out", "not_ready",
+};
+
+/* Not ready conditions (asc 0x4) reported by --wait */
+struct ready_cond_t {
+    int ascq;
+    const char * js_name;
+    const char * desc;
+};
+
+static const struct ready_cond_t ready_cond_arr[] = {
+    {0x1, "becoming_ready", "becoming ready"},
+    {0x2, "needs_start", "waiting for a start command"},
+    {0x4, "formatting", "formatting"},
+    {0x7, "operation_in_progress", "operation in progress"},
+    {0x9, "self_test", "running a self-test"},
+    {0x11, "needs_notify", "waiting for a notify (enable spinup)"},
+    {0x1a, "starting", "starting (start stop unit in progress)"},
+    {0x1b, "sanitizing", "in sanitize"},
+    {-1, NULL, NULL},
+};
+
+struct ready_dev_t {
+    const char * name;
+    int sg_fd;
+    struct sg_pt_base * ptvp;   /* reused for every command to DEVICE */
+    enum ready_state_e state;
+    int res;                    /* error status if failed */
+    int sk;                     /* from sense data of last TUR */
+    int asc;
+    int ascq;
+    int progress;               /* 0 to 65535, -1 -> not given */
+    struct timespec start_ts;   /* when START STOP UNIT was sent */
+    int ready_ms;               /* start to ready (or give up) */
+    int ivl_ms;                 /* --wait: current poll interval */
+    int prev_progress;          /* --wait: at previous poll, -1 -> none */
+    struct timespec prev_ts;    /* --wait: time of previous poll */
+    struct timespec next_ts;    /* --wait: time of next poll */
+    uint8_t sense[READY_SENSE_LEN];
+};
+
+static int
+ready_ms_since(const struct timespec * startp, const struct timespec * nowp)
+{
+    return (int)((nowp->tv_sec - startp->tv_sec) * 1000 +
+                 (nowp->tv_nsec - startp->tv_nsec) / 1000000);
+}
+
+static void
+ready_ts_add(struct timespec * tsp, int ms)
+{
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (tsp->tv_nsec >= 1000000000L) {
+        ++tsp->tv_sec;
+        tsp->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool
+ready_ts_before(const struct timespec * a, const struct timespec * b)
+{
+    return (a->tv_sec < b->tv_sec) ||
+           ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+static int
+ready_open(struct ready_dev_t * dp, bool read_only, int vb)
+{
+    dp->sg_fd = sg_cmds_open_device(dp->name, read_only, vb);
+    if (dp->sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", dp->name,
+                safe_strerror(-dp->sg_fd));
+        return sg_convert_errno(-dp->sg_fd);
+    }
+    dp->ptvp = construct_scsi_pt_obj_with_fd(dp->sg_fd, vb);
+    if (NULL == dp->ptvp) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    return 0;
+}
+
+/* Sends TEST UNIT READY to dp, placing the sense key, additional sense
+ * code (and qualifier) and progress indication, if any, in dp. Returns 0
+ * if ready, else a SG_LIB_CAT_* value (e.g. SG_LIB_CAT_NOT_READY). */
+static int
+ready_tur(struct ready_dev_t * dp, int vb)
+{
+    int res, slen;
+    struct sg_scsi_sense_hdr ssh;
+
+    memset(dp->sense, 0, sizeof(dp->sense));
+    set_scsi_pt_sense(dp->ptvp, dp->sense, sizeof(dp->sense));
+    dp->sk = 0;
+    dp->asc = 0;
+    dp->ascq = 0;
+    dp->progress = -1;
+    res = sg_ll_test_unit_ready_progress_pt(dp->ptvp, 0, NULL, false, vb);
+    if (res > 0) {
+        slen = get_scsi_pt_sense_len(dp->ptvp);
+        if (sg_scsi_normalize_sense(dp->sense, slen, &ssh)) {
+            dp->sk = ssh.sense_key;
+            dp->asc = ssh.asc;
+            dp->ascq = ssh.ascq;
+        }
+        if (! sg_get_sense_progress_fld(dp->sense, slen, &dp->progress))
+            dp->progress = -1;
+    }
+    return res;
+}
+
+/* Sends START STOP UNIT with IMMED and START set, retrying a unit
+ * attention (e.g. power on reset) a few times. */
+static int
+ready_start(struct ready_dev_t * dp, int vb)
+{
+    int k, res;
+
+    for (k = 0; k <= READY_UA_RETRIES; ++k) {
+        res = sg_ll_start_stop_unit_pt(dp->ptvp, true /* immed */, 0, 0,
+                                       false, false, true /* start */,
+                                       false /* noisy */, vb);
+        if (SG_LIB_CAT_UNIT_ATTENTION != res)
+            break;
+    }
+    return res;
+}
+
+/* True for TEST UNIT READY results that a START STOP UNIT should cure */
+static bool
+ready_not_yet(int res)
+{
+    return (SG_LIB_CAT_NOT_READY == res) || (SG_LIB_CAT_STANDBY == res) ||
+           (SG_LIB_CAT_UNIT_ATTENTION == res);
+}
+
+static void
+ready_fail(struct ready_dev_t * dp, int res, const char * what)
+{
+    char b[80];
+
+    dp->state = RDY_ST_FAILED;
+    dp->res = res;
+    sg_get_category_sense_str(res, sizeof(b), b, 0);
+    pr2serr("%s: %s failed: %s\n", dp->name, what, b);
+}
+
+/* TEST UNIT READY on a DEVICE that is spinning up, moves it to the ready,
+ * failed or timed out state when appropriate. Returns true if it has left
+ * the spinning up state. */
+static bool
+ready_check(struct ready_dev_t * dp, const struct timespec * nowp,
+            int limit_ms, sgj_state * jsp, int vb)
+{
+    int res = ready_tur(dp, vb);
+
+    dp->ready_ms = ready_ms_since(&dp->start_ts, nowp);
+    if (0 == res) {
+        dp->state = RDY_ST_READY;
+        sgj_pr_hr(jsp, "    %s: ready after %d.%03d seconds\n", dp->name,
+                  dp->ready_ms / 1000, dp->ready_ms % 1000);
+        return true;
+    }
+    if (! ready_not_yet(res)) {
+        ready_fail(dp, res, "test unit ready");
+        return true;
+    }
+    if (dp->ready_ms >= limit_ms) {
+        dp->state = RDY_ST_TIMEOUT;
+        dp->res = SG_LIB_CAT_TIMEOUT;
+        pr2serr("%s: not ready after %d.%03d seconds, giving up\n",
+                dp->name, dp->ready_ms / 1000, dp->ready_ms % 1000);
+        return true;
+    }
+    if (vb && (dp->progress >= 0))
+        pr2serr("%s: becoming ready, %d%% done\n", dp->name,
+                (dp->progress * 100) / 65536);
+    return false;
+}
+
+/* Shared (across fork()) with the child processes, one per DEVICE */
+struct ready_shm_t {
+    struct timespec next_start; /* earliest time of the next start */
+    struct ready_dev_t dev[];   /* the children each fill in their own */
+};
+
+struct ready_run_t {
+    struct ready_shm_t * shmp;
+    size_t shm_len;
+    int slot_fd[2];     /* pipe holding a token per spin-up allowed */
+    int lock_fd[2];     /* pipe holding one token guarding next_start */
+    int limit_ms;
+    const struct sdparm_opt_coll * op;
+    sgj_state * jsp;
+    struct timespec t0;
+    struct timespec end;        /* --wait: give up time if wait_secs > 0 */
+    struct sdparm_opt_coll sched_op;    /* what sdp_sched_run() sees */
+};
+
+/* Maps the results array shared with the children, makes the token pipes
+ * and a copy of the options in which --jobs is all DEVICEs at once (each
+ * mostly sleeps) but --jobs=,HL,EL limits are kept. */
+static int
+ready_run_init(struct ready_run_t * rrp, const char * device_name_arr[],
+               int num, const struct sdparm_opt_coll * op)
+{
+    int k, err;
+
+    memset(rrp, 0, sizeof(*rrp));
+    rrp->slot_fd[0] = -1;
+    rrp->slot_fd[1] = -1;
+    rrp->lock_fd[0] = -1;
+    rrp->lock_fd[1] = -1;
+    rrp->shm_len = sizeof(struct ready_shm_t) +
+                   num * sizeof(struct ready_dev_t);
+    rrp->shmp = (struct ready_shm_t *)sdp_shm_alloc(rrp->shm_len);
+    if (NULL == rrp->shmp) {
+        err = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    if ((pipe(rrp->slot_fd) < 0) || (pipe(rrp->lock_fd) < 0)) {
+        err = errno;
+        pr2serr("%s: pipe: %s\n", __func__, safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    for (k = 0; k < num; ++k) {
+        rrp->shmp->dev[k].name = device_name_arr[k];
+        rrp->shmp->dev[k].sg_fd = -1;
+    }
+    rrp->op = op;
+    rrp->jsp = (sgj_state *)&op->json_st;
+    rrp->sched_op = *op;
+    rrp->sched_op.jobs = num;
+    clock_gettime(CLOCK_MONOTONIC, &rrp->t0);
+    return 0;
+}
+
+static void
+ready_run_fini(struct ready_run_t * rrp)
+{
+    int k;
+
+    for (k = 0; k < 2; ++k) {
+        if (rrp->slot_fd[k] >= 0)
+            close(rrp->slot_fd[k]);
+        if (rrp->lock_fd[k] >= 0)
+            close(rrp->lock_fd[k]);
+    }
+    sdp_shm_free(rrp->shmp, rrp->shm_len);
+}
+
+/* A DEVICE whose child did not run, or died, without leaving an error
+ * status is given one: that from sdp_sched_run() if any. */
+static void
+ready_lost(struct ready_dev_t * dp, int sched_res)
+{
+    if (dp->res)
+        return;
+    dp->res = sched_res ? sched_res : SG_LIB_CAT_OTHER;
+    if ((RDY_ST_PENDING == dp->state) || (RDY_ST_SPINNING == dp->state))
+        dp->state = RDY_ST_FAILED;
+}
+
+static void
+ready_json(struct ready_dev_t * dev_arr, int num,
+           const struct sdparm_opt_coll * op, int limit_ms, sgj_state * jsp,
+           sgj_opaque_p jop)
+{
+    int k;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap;
+    const struct ready_dev_t * dp;
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "spin_up");
+    sgj_js_nv_i(jsp, jo2p, "max_concurrent", op->stagger_max);
+    sgj_js_nv_i(jsp, jo2p, "start_delay_ms", op->stagger_ms);
+    sgj_js_nv_i(jsp, jo2p, "limit_ms", limit_ms);
+    jap = sgj_named_subarray_r(jsp, jo2p, "devices");
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo3p, "device_name", dp->name);
+        sgj_js_nv_s(jsp, jo3p, "state", ready_state_s[dp->state]);
+        if ((RDY_ST_READY == dp->state) || (RDY_ST_TIMEOUT == dp->state))
+            sgj_js_nv_i(jsp, jo3p, "time_to_ready_ms", dp->ready_ms);
+        if (dp->res)
+            sgj_js_nv_i(jsp, jo3p, "error_status", dp->res);
+        sgj_js_nv_o(jsp, jap, NULL, jo3p);
+    }
+}
+
+/* Takes a one byte token from the pipe whose read end is fd, waiting for
+ * one if there is none. */
+static void
+ready_tok_get(int fd)
+{
+    char c;
+
+    while ((read(fd, &c, 1) < 0) && (EINTR == errno))
+        ;
+}
+
+static void
+ready_tok_put(int fd)
+{
+    while ((write(fd, "t", 1) < 0) && (EINTR == errno))
+        ;
+}
+
+/* Called by a child to get its turn to start a spin-up. First waits for one
+ * of the op->stagger_max spin-up tokens, then reserves a start time at
+ * least op->stagger_ms after the previous one (the shared next_start is
+ * guarded by the one byte lock pipe) and sleeps until that time. */
+static void
+ready_start_turn(struct ready_run_t * rrp)
+{
+    struct timespec now, when;
+
+    ready_tok_get(rrp->slot_fd[0]);
+    ready_tok_get(rrp->lock_fd[0]);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    when = rrp->shmp->next_start;
+    if (ready_ts_before(&when, &now))
+        when = now;
+    rrp->shmp->next_start = when;
+    ready_ts_add(&rrp->shmp->next_start, rrp->op->stagger_ms);
+    ready_tok_put(rrp->lock_fd[1]);
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when,
+                                    NULL))
+        ;
+}
+
+/* Runs in a child process (see sdp_sched_run()) for the k-th DEVICE: sends
+ * TEST UNIT READY and if not ready waits its turn, starts it and polls it
+ * until it is ready, fails or the limit has passed. The outcome is left in
+ * the shared dev[k]. */
+static int
+fleet_one(int k, void * arg)
+{
+    int res;
+    struct ready_run_t * rrp = (struct ready_run_t *)arg;
+    const struct sdparm_opt_coll * op = rrp->op;
+    sgj_state * jsp = rrp->jsp;
+    struct ready_dev_t * dp = rrp->shmp->dev + k;
+    struct timespec now, wake;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+
+    res = ready_open(dp, false, vb);
+    if (res) {
+        dp->state = RDY_ST_FAILED;
+        dp->res = res;
+        goto fini;
+    }
+    /* those that are already ready take no part in the power budget */
+    res = ready_tur(dp, vb);
+    if (SG_LIB_CAT_UNIT_ATTENTION == res)
+        res = ready_tur(dp, vb);
+    if (0 == res) {
+        dp->state = RDY_ST_ALREADY;
+        sgj_pr_hr(jsp, "    %s: already ready\n", dp->name);
+        goto fini;
+    } else if (! ready_not_yet(res)) {
+        ready_fail(dp, res, "test unit ready");
+        goto fini;
+    }
+    ready_start_turn(rrp);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (op->verbose)
+        pr2serr("%s: start at %d ms\n", dp->name,
+                ready_ms_since(&rrp->t0, &now));
+    res = ready_start(dp, vb);
+    if (res)
+        ready_fail(dp, res, "start stop unit");
+    else {
+        dp->state = RDY_ST_SPINNING;
+        dp->start_ts = now;
+        do {
+            wake = now;
+            ready_ts_add(&wake, READY_POLL_MS);
+            while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                            &wake, NULL))
+                ;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (! ready_check(dp, &now, rrp->limit_ms, jsp, vb));
+    }
+    ready_tok_put(rrp->slot_fd[1]);     /* no longer counts against N */
+fini:
+    if (dp->ptvp)
+        destruct_scsi_pt_obj(dp->ptvp);
+    dp->ptvp = NULL;
+    if (dp->sg_fd >= 0)
+        sg_cmds_close_device(dp->sg_fd);
+    dp->sg_fd = -1;
+    return dp->res;
+}
+
+/* Implements '--command=start --stagger=N[,MS[,SECS]]'. Each DEVICE in
+ * device_name_arr[] is handled by its own child process so one that is
+ * slow to respond (or hangs) does not hold up the others. Those not ready
+ * are started subject to at most op->stagger_max spinning up at once and
+ * op->stagger_ms milliseconds between starts; not necessarily in the order
+ * given. A DEVICE that is not ready SECS (def: 300) seconds after its start
+ * is given up on and no longer counts against the limit. Returns 0 if all
+ * DEVICEs became ready, else the first error. */
+int
+sdp_fleet_start(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+                sgj_opaque_p jop)
+{
+    int k, r, limit_ms;
+    int n_ready = 0;
+    int ret = 0;
+    const int num = ctxp->opts.num_devices;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct ready_dev_t * dp;
+    struct ready_run_t rr;
+    struct timespec now;
+
+    limit_ms = (op->stagger_secs > 0) ? op->stagger_secs * 1000 :
+                                        READY_DEF_LIMIT_MS;
+    ret = ready_run_init(&rr, device_name_arr, num, op);
+    if (ret)
+        goto fini;
+    rr.limit_ms = limit_ms;
+    /* no more tokens than DEVICEs, so they fit in the pipe's buffer */
+    for (k = 0; (k < op->stagger_max) && (k < num); ++k)
+        ready_tok_put(rr.slot_fd[1]);
+    ready_tok_put(rr.lock_fd[1]);
+    if (0 == op->do_quiet)
+        sgj_pr_hr(jsp, "spin up at most %d DEVICE%s at once, starts %d ms "
+                  "apart\n", op->stagger_max,
+                  (1 == op->stagger_max) ? "" : "s", op->stagger_ms);
+    rr.shmp->next_start = rr.t0;
+    r = sdp_sched_run(device_name_arr, num, fleet_one, &rr, &rr.sched_op);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (k = 0; k < num; ++k) {
+        dp = rr.shmp->dev + k;
+        if ((RDY_ST_READY == dp->state) || (RDY_ST_ALREADY == dp->state))
+            ++n_ready;
+        else {
+            ready_lost(dp, r);
+            if (0 == ret)
+                ret = dp->res;
+        }
+    }
+    if (0 == op->do_quiet) {
+        k = ready_ms_since(&rr.t0, &now);
+        sgj_pr_hr(jsp, "%d of %d DEVICE%s ready after %d.%03d seconds\n",
+                  n_ready, num, (1 == num) ? "" : "s", k / 1000, k % 1000);
+    }
+    if (jsp->pr_as_json)
+        ready_json(rr.shmp->dev, num, op, limit_ms, jsp, jop);
+fini:
+    ready_run_fini(&rr);
+    return ret;
+}
+
+static const struct ready_cond_t *
+ready_find_cond(const struct ready_dev_t * dp)
+{
+    const struct ready_cond_t * rcp;
+
+    if ((SPC_SK_NOT_READY != dp->sk) || (0x4 != dp->asc))
+        return NULL;
+    for (rcp = ready_cond_arr; rcp->js_name; ++rcp) {
+        if (rcp->ascq == dp->ascq)
+            return rcp;
+    }
+    return NULL;
+}
+
+/* Picks the interval until dp is next polled after a not ready TEST UNIT
+ * READY at *nowp. With two progress indications the time left is
+ * estimated and a quarter of it taken, so the poll interval shrinks as
+ * the operation nears its end. Otherwise the interval doubles. */
+static void
+ready_backoff(struct ready_dev_t * dp, const struct timespec * nowp, int vb)
+{
+    int dt, ivl;
+    double rate;
+
+    ivl = dp->ivl_ms * 2;
+    if ((dp->progress >= 0) && (dp->prev_progress >= 0) &&
+        (dp->progress > dp->prev_progress)) {
+        dt = ready_ms_since(&dp->prev_ts, nowp);
+        if (dt < 1)
+            dt = 1;
+        rate = (double)(dp->progress - dp->prev_progress) / (double)dt;
+        ivl = (int)(((65536 - dp->progress) / rate) / 4);
+    }
+    if (ivl < READY_MIN_POLL_MS)
+        ivl = READY_MIN_POLL_MS;
+    else if (ivl > READY_MAX_POLL_MS)
+        ivl = READY_MAX_POLL_MS;
+    if (vb > 1)
+        pr2serr("%s: not ready, progress=%d, next poll in %d ms\n",
+                dp->name, dp->progress, ivl);
+    dp->ivl_ms = ivl;
+    dp->prev_progress = dp->progress;
+    dp->prev_ts = *nowp;
+    dp->next_ts = *nowp;
+    ready_ts_add(&dp->next_ts, ivl);
+}
+
+static void
+ready_wait_pr(const struct ready_dev_t * dp, sgj_state * jsp)
+{
+    const struct ready_cond_t * rcp;
+    char b[80];
+    char d[144];
+
+    if (RDY_ST_ALREADY == dp->state) {
+        sgj_pr_hr(jsp, "    %s: ready\n", dp->name);
+        return;
+    } else if (RDY_ST_READY == dp->state) {
+        sgj_pr_hr(jsp, "    %s: ready after %d.%03d seconds\n", dp->name,
+                  dp->ready_ms / 1000, dp->ready_ms % 1000);
+        return;
+    }
+    if (RDY_ST_FAILED == dp->state)
+        return;         /* reported by ready_fail() */
+    rcp = ready_find_cond(dp);
+    if (rcp)
+        snprintf(d, sizeof(d), "%s", rcp->desc);
+    else
+        snprintf(d, sizeof(d), "not ready: %s",
+                 sg_get_asc_ascq_str(dp->asc, dp->ascq, sizeof(b), b));
+    if (dp->progress >= 0)
+        sgj_pr_hr(jsp, "    %s: still %s, %d%% done\n", dp->name, d,
+                  (dp->progress * 100) / 65536);
+    else
+        sgj_pr_hr(jsp, "    %s: still %s\n", dp->name, d);
+}
+
+static void
+ready_wait_json(struct ready_dev_t * dev_arr, int num, int wait_secs,
+                sgj_state * jsp, sgj_opaque_p jop)
+{
+    int k;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap;
+    const struct ready_dev_t * dp;
+    const struct ready_cond_t * rcp;
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "wait_ready");
+    sgj_js_nv_i(jsp, jo2p, "timeout_secs", wait_secs);
+    jap = sgj_named_subarray_r(jsp, jo2p, "devices");
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        jo3p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jo3p, "device_name", dp->name);
+        sgj_js_nv_s(jsp, jo3p, "state", ready_state_s[dp->state]);
+        if (RDY_ST_READY == dp->state)
+            sgj_js_nv_i(jsp, jo3p, "time_to_ready_ms", dp->ready_ms);
+        else if (RDY_ST_NOT_READY == dp->state) {
+            rcp = ready_find_cond(dp);
+            sgj_js_nv_s(jsp, jo3p, "condition",
+                        rcp ? rcp->js_name : "not_ready");
+            sgj_js_nv_ihex(jsp, jo3p, "asc", dp->asc);
+            sgj_js_nv_ihex(jsp, jo3p, "ascq", dp->ascq);
+            if (dp->progress >= 0)
+                sgj_js_nv_i(jsp, jo3p, "progress_percent",
+                            (dp->progress * 100) / 65536);
+        }
+        if (dp->res)
+            sgj_js_nv_i(jsp, jo3p, "error_status", dp->res);
+        sgj_js_nv_o(jsp, jap, NULL, jo3p);
+    }
+}
+
+/* Runs in a child process (see sdp_sched_run()) for the k-th DEVICE:
+ * polls it with TEST UNIT READY on its own schedule (see ready_backoff())
+ * until it is ready, fails or the --wait TIMEOUT has passed. The outcome
+ * is left in the shared dev[k]. */
+static int
+wait_one(int k, void * arg)
+{
+    int res;
+    struct ready_run_t * rrp = (struct ready_run_t *)arg;
+    const struct sdparm_opt_coll * op = rrp->op;
+    struct ready_dev_t * dp = rrp->shmp->dev + k;
+    struct timespec now, wake;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+
+    res = ready_open(dp, true, vb);
+    if (res) {
+        dp->state = RDY_ST_FAILED;
+        dp->res = res;
+        goto fini;
+    }
+    dp->state = RDY_ST_NOT_READY;
+    dp->ivl_ms = READY_MIN_POLL_MS / 2;     /* doubled before use */
+    dp->prev_progress = -2;                 /* -2 -> not polled yet */
+    while (true) {
+        res = ready_tur(dp, vb);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (0 == res) {
+            dp->state = (dp->prev_progress < -1) ? RDY_ST_ALREADY :
+                                                   RDY_ST_READY;
+            dp->ready_ms = ready_ms_since(&rrp->t0, &now);
+            dp->res = 0;
+            if (0 == op->do_quiet)
+                ready_wait_pr(dp, rrp->jsp);
+            break;
+        } else if ((SG_LIB_CAT_NOT_READY == res) ||
+                   (SG_LIB_PROGRESS_NOT_READY == res) ||
+                   (SG_LIB_CAT_STANDBY == res) ||
+                   (SG_LIB_CAT_UNAVAILABLE == res) ||
+                   (SG_LIB_CAT_UNIT_ATTENTION == res)) {
+            dp->res = res;
+            ready_backoff(dp, &now, vb);
+        } else {
+            ready_fail(dp, res, "test unit ready");
+            break;
+        }
+        wake = dp->next_ts;
+        if (rrp->limit_ms > 0) {
+            if (! ready_ts_before(&now, &rrp->end))
+                break;
+            if (ready_ts_before(&rrp->end, &wake))
+                wake = rrp->end;
+        }
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                        &wake, NULL))
+            ;
+    }
+fini:
+    if (dp->ptvp)
+        destruct_scsi_pt_obj(dp->ptvp);
+    dp->ptvp = NULL;
+    if (dp->sg_fd >= 0)
+        sg_cmds_close_device(dp->sg_fd);
+    dp->sg_fd = -1;
+    return dp->res;
+}
+
+/* Implements '--command=ready --wait[=TIMEOUT]'. Each DEVICE is polled by
+ * its own child process so one that is slow to respond (or hangs) does not
+ * hold up the others. Polling stops when all are ready, or have failed, or
+ * TIMEOUT seconds (def: 300, 0 -> no limit) have passed. Returns 0 if all
+ * DEVICEs are ready, else as '--command=ready' does for the first DEVICE
+ * that is not (e.g. SG_LIB_CAT_NOT_READY). */
+int
+sdp_wait_ready(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+               sgj_opaque_p jop)
+{
+    int k, r, wait_secs;
+    int n_ready = 0;
+    int ret = 0;
+    const int num = ctxp->opts.num_devices;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct ready_dev_t * dp;
+    struct ready_run_t rr;
+    struct timespec now;
+
+    ret = ready_run_init(&rr, device_name_arr, num, op);
+    if (ret)
+        goto fini;
+    wait_secs = (op->wait_secs < 0) ? READY_DEF_WAIT_SECS : op->wait_secs;
+    rr.limit_ms = wait_secs * 1000;
+    rr.end = rr.t0;
+    ready_ts_add(&rr.end, rr.limit_ms);
+    r = sdp_sched_run(device_name_arr, num, wait_one, &rr, &rr.sched_op);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (k = 0; k < num; ++k) {
+        dp = rr.shmp->dev + k;
+        if ((RDY_ST_READY == dp->state) || (RDY_ST_ALREADY == dp->state)) {
+            ++n_ready;
+            continue;
+        }
+        ready_lost(dp, r);
+        if (0 == ret)
+            ret = dp->res;
+        if (RDY_ST_NOT_READY == dp->state)
+            ready_wait_pr(dp, jsp);
+    }
+    if (0 == op->do_quiet) {
+        k = ready_ms_since(&rr.t0, &now);
+        sgj_pr_hr(jsp, "%d of %d DEVICE%s ready after %d.%03d seconds\n",
+                  n_ready, num, (1 == num) ? "" : "s", k / 1000, k % 1000);
+    }
+    if (jsp->pr_as_json)
+        ready_wait_json(rr.shmp->dev, num, wait_secs, jsp, jop);
+fini:
+    ready_run_fini(&rr);
+    return ret;
+}
+
+#else   /* SG_LIB_WIN32 */
+
+int
+sdp_fleet_start(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+                sgj_opaque_p jop)
+{
+    if (ctxp && device_name_arr && jop) { }     /* suppress warning */
+    pr2serr("'--stagger=' is not supported on Windows\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+
+int
+sdp_wait_ready(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+               sgj_opaque_p jop)
+{
+    if (ctxp && device_name_arr && jop) { }     /* suppress warning */
+    pr2serr("'--wait' is not supported on Windows\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+#endif  /* SG_LIB_WIN32 */
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SG_LIB_WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+#ifdef SG_LIB_LINUX
+#include <sys/sysmacros.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_sched.c : processes several DEVICEs at once ('--jobs=J[,HL[,EL]]')
+ * with one child process per DEVICE. DEVICEs are grouped by the SCSI host
+ * (HBA) and the SAS expander they are attached through, found by resolving
+ * the DEVICE node into the sysfs device hierarchy, so that no more than HL
+ * DEVICEs on the same host and EL DEVICEs behind the same expander are
+ * accessed at the same time. Other DEVICEs are started in their place so
+ * overall up to J DEVICEs are kept busy. Also here: running several jobs
+ * at once on one DEVICE (e.g. '--qdepth=QD') and the memory shared with
+ * those jobs.
+ */
+
+#ifndef SG_LIB_WIN32
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define SCHED_PENDING 0
+#define SCHED_RUNNING 1
+#define SCHED_DONE 2
+
+#define SCHED_EXP_NAME_LEN 48
+#define SCHED_MAX_EXP 8         /* cascaded expanders between host and DEVICE */
+
+struct sched_dev_t {
+    int host;           /* SCSI host number, -1 if not known */
+    int state;          /* SCHED_PENDING, SCHED_RUNNING or SCHED_DONE */
+    int num_exp;        /* number of expander[] entries */
+    pid_t pid;          /* of child while SCHED_RUNNING */
+    FILE * out_fp;      /* child's stdout, copied to stdout when done */
+    FILE * err_fp;      /* child's stderr, copied to stderr when done */
+    /* expanders from the host down, e.g. "expander-2:0", "expander-2:1" */
+    char expander[SCHED_MAX_EXP][SCHED_EXP_NAME_LEN];
+};
+
+/* Finds the SCSI host number and the chain of SAS expanders for the device
+ * node by following /sys/dev/{char|block}/<major>:<minor> into the sysfs
+ * device hierarchy. For example an sg node of a disk behind two cascaded
+ * expanders resolves to something like: /sys/devices/pci0000:00/
+ * 0000:00:03.0/0000:02:00.0/host2/port-2:0/expander-2:0/port-2:0:4/
+ * expander-2:1/port-2:1:5/end_device-2:1:5/target2:0:5/2:0:5:0/
+ * scsi_generic/sg5 . Leaves host as -1 and no expanders when not found
+ * (e.g. NVMe devices and other OSes). */
+static void
+sched_resolve(const char * device_name, struct sched_dev_t * sdp, int vb)
+{
+#ifdef SG_LIB_LINUX
+    int h;
+    char * cp;
+    char * savep = NULL;
+    struct stat st;
+    char b[64];
+    char rp[PATH_MAX];
+    static const int blen = sizeof(b);
+#endif
+
+    sdp->host = -1;
+    sdp->num_exp = 0;
+#ifdef SG_LIB_LINUX
+    if (stat(device_name, &st) < 0)
+        return;
+    if (S_ISCHR(st.st_mode))
+        snprintf(b, blen, "/sys/dev/char/%u:%u", major(st.st_rdev),
+                 minor(st.st_rdev));
+    else if (S_ISBLK(st.st_mode))
+        snprintf(b, blen, "/sys/dev/block/%u:%u", major(st.st_rdev),
+                 minor(st.st_rdev));
+    else
+        return;
+    if (NULL == realpath(b, rp))
+        return;
+    for (cp = strtok_r(rp, "/", &savep); cp;
+         cp = strtok_r(NULL, "/", &savep)) {
+        if ((0 == strncmp(cp, "host", 4)) && (1 == sscanf(cp + 4, "%d", &h)))
+            sdp->host = h;
+        else if ((0 == strncmp(cp, "expander-", 9)) &&
+                 (sdp->num_exp < SCHED_MAX_EXP))
+            snprintf(sdp->expander[sdp->num_exp++], SCHED_EXP_NAME_LEN,
+                     "%s", cp);
+    }
+#endif
+    if (vb > 1)
+        pr2serr("%s: %s: host=%d, expanders=%d%s%s\n", __func__,
+                device_name, sdp->host, sdp->num_exp,
+                (sdp->num_exp ? ", nearest=" : ""),
+                (sdp->num_exp ? sdp->expander[sdp->num_exp - 1] : ""));
+}
+
+/* Returns true if DEVICE sdp is behind (possibly several levels below) the
+ * expander named exp. */
+static bool
+sched_behind(const struct sched_dev_t * sdp, const char * exp)
+{
+    int j;
+
+    for (j = 0; j < sdp->num_exp; ++j) {
+        if (0 == strcmp(exp, sdp->expander[j]))
+            return true;
+    }
+    return false;
+}
+
+/* Returns true if the k-th DEVICE can be started without exceeding the
+ * per host limit and the per expander limit at each level of its expander
+ * chain. */
+static bool
+sched_can_start(const struct sched_dev_t * arr, int num, int k,
+                const struct sdparm_opt_coll * op)
+{
+    int j, e;
+    int on_host = 0;
+    int on_exp[SCHED_MAX_EXP];
+    const struct sched_dev_t * sdp = arr + k;
+
+    memset(on_exp, 0, sizeof(on_exp));
+    for (j = 0; j < num; ++j) {
+        if (SCHED_RUNNING != arr[j].state)
+            continue;
+        if ((sdp->host >= 0) && (sdp->host == arr[j].host))
+            ++on_host;
+        for (e = 0; e < sdp->num_exp; ++e) {
+            if (sched_behind(arr + j, sdp->expander[e]))
+                ++on_exp[e];
+        }
+    }
+    if ((op->host_limit > 0) && (on_host >= op->host_limit))
+        return false;
+    if (op->exp_limit > 0) {
+        for (e = 0; e < sdp->num_exp; ++e) {
+            if (on_exp[e] >= op->exp_limit)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void
+sched_copy_out(FILE * from_fp, FILE * to_fp)
+{
+    size_t n;
+    char b[4096];
+
+    if (NULL == from_fp)
+        return;
+    rewind(from_fp);
+    while ((n = fread(b, 1, sizeof(b), from_fp)) > 0)
+        fwrite(b, 1, n, to_fp);
+    fclose(from_fp);
+}
+
+/* Forks a child that calls fn(k, arg) with its stdout and stderr going to
+ * temporary files. The child closes the temporary files of the other
+ * DEVICEs (in arr[num]). Returns 0 if the child was started. */
+static int
+sched_start(struct sched_dev_t * arr, int num, int k,
+            int (*fn)(int, void *), void * arg)
+{
+    int err, j;
+    pid_t pid;
+    struct sched_dev_t * sdp = arr + k;
+
+    sdp->out_fp = tmpfile();
+    sdp->err_fp = tmpfile();
+    if ((NULL == sdp->out_fp) || (NULL == sdp->err_fp)) {
+        err = errno;
+        pr2serr("%s: tmpfile: %s\n", __func__, safe_strerror(err));
+        goto err_out;
+    }
+    fflush(stdout);     /* so the child doesn't output them again */
+    fflush(stderr);
+    pid = fork();
+    if (pid < 0) {
+        err = errno;
+        pr2serr("%s: fork: %s\n", __func__, safe_strerror(err));
+        goto err_out;
+    }
+    if (0 == pid) {     /* child */
+        int r;
+
+        dup2(fileno(sdp->out_fp), STDOUT_FILENO);
+        dup2(fileno(sdp->err_fp), STDERR_FILENO);
+        for (j = 0; j < num; ++j) {     /* including this DEVICE's */
+            if (arr[j].out_fp)
+                close(fileno(arr[j].out_fp));
+            if (arr[j].err_fp)
+                close(fileno(arr[j].err_fp));
+        }
+        r = fn(k, arg);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(r & 0xff);
+    }
+    sdp->pid = pid;
+    sdp->state = SCHED_RUNNING;
+    return 0;
+
+err_out:
+    if (sdp->out_fp)
+        fclose(sdp->out_fp);
+    if (sdp->err_fp)
+        fclose(sdp->err_fp);
+    sdp->out_fp = NULL;
+    sdp->err_fp = NULL;
+    return sg_convert_errno(err);
+}
+
+/* Calls fn(k, arg) for each DEVICE (k indexes device_name_arr[]) in a child
+ * process, running up to op->jobs at once subject to op->host_limit and
+ * op->exp_limit. The output of each child is passed through, unmixed, when
+ * it finishes; so DEVICEs are output in the order they complete. Returns
+ * the first error (i.e. non-zero child exit status), else 0. */
+int
+sdp_sched_run(const char * device_name_arr[], int num_devices,
+              int (*fn)(int dev_ind, void * arg), void * arg,
+              const struct sdparm_opt_coll * op)
+{
+    int k, r, n_run, n_done, wstatus;
+    int ret = 0;
+    pid_t pid;
+    struct sched_dev_t * arr;
+    struct sched_dev_t * sdp;
+
+    arr = (struct sched_dev_t *)calloc(num_devices, sizeof(*arr));
+    if (NULL == arr) {
+        pr2serr("%s: unable to allocate heap\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num_devices; ++k)
+        sched_resolve(device_name_arr[k], arr + k, op->verbose);
+
+    for (n_run = 0, n_done = 0; n_done < num_devices; ) {
+        for (k = 0; (k < num_devices) && (n_run < op->jobs); ++k) {
+            sdp = arr + k;
+            if ((SCHED_PENDING != sdp->state) ||
+                (! sched_can_start(arr, num_devices, k, op)))
+                continue;
+            r = sched_start(arr, num_devices, k, fn, arg);
+            if (r) {
+                sdp->state = SCHED_DONE;
+                ++n_done;
+                if ((0 == ret) || (SG_LIB_FILE_ERROR == ret))
+                    ret = r;
+                continue;
+            }
+            ++n_run;
+            if (op->verbose > 1)
+                pr2serr(">>> %s: started pid=%d, %d running\n",
+                        device_name_arr[k], (int)sdp->pid, n_run);
+        }
+        if (0 == n_run)
+            break;
+        pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (EINTR == errno)
+                continue;
+            r = errno;
+            pr2serr("%s: waitpid: %s\n", __func__, safe_strerror(r));
+            if (0 == ret)
+                ret = sg_convert_errno(r);
+            break;
+        }
+        for (k = 0, sdp = arr; k < num_devices; ++k, ++sdp) {
+            if ((SCHED_RUNNING == sdp->state) && (pid == sdp->pid))
+                break;
+        }
+        if (k >= num_devices)
+            continue;   /* not one of ours */
+        sdp->state = SCHED_DONE;
+        --n_run;
+        ++n_done;
+        fflush(stdout);
+        sched_copy_out(sdp->out_fp, stdout);
+        fflush(stdout);
+        sched_copy_out(sdp->err_fp, stderr);
+        sdp->out_fp = NULL;
+        sdp->err_fp = NULL;
+        if (WIFEXITED(wstatus))
+            r = WEXITSTATUS(wstatus);
+        else {
+            pr2serr("%s: child for %s terminated abnormally\n", __func__,
+                    device_name_arr[k]);
+            r = SG_LIB_CAT_OTHER;
+        }
+        if (r && ((0 == ret) || (SG_LIB_FILE_ERROR == ret)))
+            ret = r;
+    }
+    free(arr);
+    return ret;
+}
+
+/* Returns len bytes of zeroed memory that child processes forked later
+ * share with the caller, or NULL (with errno set) if not available. Free
+ * with sdp_shm_free(). */
+void *
+sdp_shm_alloc(size_t len)
+{
+    void * p;
+
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+             -1, 0);
+    if (MAP_FAILED == p)
+        return NULL;
+    memset(p, 0, len);
+    return p;
+}
+
+void
+sdp_shm_free(void * p, size_t len)
+{
+    if (p)
+        munmap(p, len);
+}
+
+/* Calls fn(j, arg) for each of num_jobs jobs on one DEVICE, each in its
+ * own child process so they run at once (a single job is run by the
+ * caller). The result of each job is kept in a status array shared with
+ * the children (0: not finished, -1: ok, else SG_LIB_* error) so a child
+ * that dies is noticed. Returns the first error, else 0. */
+int
+sdp_sched_jobs(int num_jobs, int (*fn)(int job, void * arg), void * arg)
+{
+    int j, r, wstatus;
+    int ret = 0;
+    int * st_arr;
+    pid_t pid;
+
+    if (num_jobs < 2)
+        return (1 == num_jobs) ? fn(0, arg) : 0;
+    st_arr = (int *)sdp_shm_alloc(num_jobs * sizeof(int));
+    if (NULL == st_arr) {
+        r = errno;
+        pr2serr("%s: mmap: %s\n", __func__, safe_strerror(r));
+        return sg_convert_errno(r);
+    }
+    fflush(stdout);     /* so children don't output them again */
+    fflush(stderr);
+    for (j = 0; j < num_jobs; ++j) {
+        pid = fork();
+        if (pid < 0) {
+            r = errno;
+            pr2serr("%s: fork: %s\n", __func__, safe_strerror(r));
+            st_arr[j] = sg_convert_errno(r);
+            continue;
+        }
+        if (0 == pid) {         /* child */
+            r = fn(j, arg);
+            st_arr[j] = r ? r : -1;
+            fflush(stdout);
+            fflush(stderr);
+            _exit(r & 0xff);
+        }
+    }
+    while ((wait(&wstatus) > 0) || (EINTR == errno))
+        ;
+    for (j = 0; j < num_jobs; ++j) {
+        r = st_arr[j];
+        if (0 == r) {           /* child died before finishing */
+            pr2serr("%s: job %d did not finish\n", __func__, j);
+            r = SG_LIB_CAT_OTHER;
+        }
+        if ((r > 0) && (0 == ret))
+            ret = r;
+    }
+    sdp_shm_free(st_arr, num_jobs * sizeof(int));
+    return ret;
+}
+
+#else   /* SG_LIB_WIN32 */
+
+/* No fork() so DEVICEs are processed one at a time */
+int
+sdp_sched_run(const char * device_name_arr[], int num_devices,
+              int (*fn)(int dev_ind, void * arg), void * arg,
+              const struct sdparm_opt_coll * op)
+{
+    int k, r;
+    int ret = 0;
+
+    if (device_name_arr && op) { }      /* suppress warning */
+    for (k = 0; k < num_devices; ++k) {
+        r = fn(k, arg);
+        if (r && ((0 == ret) || (SG_LIB_FILE_ERROR == ret)))
+            ret = r;
+    }
+    return ret;
+}
+
+/* No fork() so the memory need not be shared */
+void *
+sdp_shm_alloc(size_t len)
+{
+    void * p = calloc(1, len);
+
+    if (NULL == p)
+        errno = ENOMEM;
+    return p;
+}
+
+void
+sdp_shm_free(void * p, size_t len)
+{
+    if (len) { }        /* suppress warning */
+    free(p);
+}
+
+/* No fork() so the jobs are run one after another */
+int
+sdp_sched_jobs(int num_jobs, int (*fn)(int job, void * arg), void * arg)
+{
+    int j, r;
+    int ret = 0;
+
+    for (j = 0; j < num_jobs; ++j) {
+        r = fn(j, arg);
+        if (r && (0 == ret))
+            ret = r;
+    }
+    return ret;
+}
+
+#endif  /* SG_LIB_WIN32 */
@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_snap.c : saves the current, changeable, default and saved values
+ * of every mode page of a DEVICE to a file ('--snapshot=FILE') and writes
+ * the current values in such a file back to a DEVICE ('--restore=FILE').
+ *
+ * File format (version 1), all integers are big endian:
+ *   header (SNAP_HDR_LEN bytes):
+ *     0..3    magic: "SDPM"
+ *     4       version
+ *     5       header length
+ *     6       peripheral device type of DEVICE
+ *     7       reserved
+ *     8..9    number of mode page records that follow
+ *     10..11  reserved
+ *     12..19  T10 vendor identification (from standard INQUIRY)
+ *     20..35  product identification
+ *     36..39  product revision level
+ *     40..43  CRC-32 of bytes 0 to 39
+ *   then for each mode page:
+ *     0       page code
+ *     1       subpage code (0 when page has no subpages)
+ *     2       page control mask: bit 0 current values present, bit 1
+ *             changeable, bit 2 default and bit 3 saved values present
+ *     3       reserved
+ *     4..5    page length (PL) including the page's own header
+ *     6..     PL bytes for each page control present, in the above order
+ *     last 4  CRC-32 of this record, excluding this field
+ */
+
+#define SNAP_MAGIC "SDPM"
+#define SNAP_VERSION 1
+#define SNAP_HDR_LEN 44
+#define SNAP_REC_HDR_LEN 6
+#define SNAP_CRC_LEN 4
+#define SNAP_MAX_FILE_LEN (1024 * 1024)
+
+static const char * mp_s = "mode page";
+
+
+/* CRC-32 as used by Ethernet and zlib (reflected, polynomial 0x04c11db7) */
+static uint32_t
+snap_crc32(const uint8_t * bp, int len)
+{
+    int k;
+    uint32_t crc = 0xffffffff;
+
+    while (len-- > 0) {
+        crc ^= *bp++;
+        for (k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+    }
+    return ~crc;
+}
+
+static int
+snap_num_pc(int smask)
+{
+    int k, n;
+
+    for (k = 0, n = 0; k < MP_NUM_PG_CTL; ++k) {
+        if (smask & (1 << k))
+            ++n;
+    }
+    return n;
+}
+
+/* Looks for mode page pn,spn in the concatenated pages at mp (length
+ * mp_len) as placed by sdp_ctx_all_mpages(). Returns offset of that page
+ * (and places its length in *pg_lenp) or -1 if not found. */
+int
+sdp_find_mpage(const uint8_t * mp, int mp_len, int pn, int spn,
+               int * pg_lenp)
+{
+    int k, pg_len, l_pn, l_spn;
+
+    for (k = 0; k < mp_len; k += pg_len) {
+        pg_len = sdp_mpage_len(mp + k);
+        if ((pg_len < 2) || ((k + pg_len) > mp_len))
+            break;
+        l_pn = mp[k] & 0x3f;
+        l_spn = (mp[k] & 0x40) ? mp[k + 1] : 0;
+        if ((pn == l_pn) && (spn == l_spn)) {
+            *pg_lenp = pg_len;
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* The snapshot file image as it is built */
+struct snap_buf_t {
+    uint8_t * b;
+    int len;            /* bytes used so far */
+    int alloc_len;
+    int num;            /* number of mode page records */
+};
+
+/* Appends a record to sbp for each well formed mode page in the current
+ * values just fetched into ctxp (resp_len bytes). The same page is looked
+ * up in the buffer of each other page control since the DEVICE may leave
+ * pages out of, or give different lengths in, those responses. A page
+ * control in which the page is missing, or has another length, is left
+ * out of that page's record. Returns 0 on success. */
+static int
+snap_add_pages(struct sdparm_ctx_t * ctxp, int smask, int resp_len,
+               struct snap_buf_t * sbp)
+{
+    int k, j, n, pn, spn, pg_len, off, l_len, pg_smask;
+    uint8_t * rp;
+    const uint8_t * pg_p;
+    const uint8_t * pc_p[MP_NUM_PG_CTL];
+    const uint8_t * pc_arr[MP_NUM_PG_CTL];
+    int vb = ctxp->opts.verbose;
+
+    pc_arr[0] = ctxp->cur_mp;
+    pc_arr[1] = ctxp->cha_mp;
+    pc_arr[2] = ctxp->def_mp;
+    pc_arr[3] = ctxp->sav_mp;
+    for (k = 0; k < resp_len; k += pg_len) {
+        pg_p = ctxp->cur_mp + k;
+        pg_len = sdp_mpage_len(pg_p);
+        if ((pg_len < 2) || ((k + pg_len) > resp_len)) {
+            pr2serr("%s: %s at offset %d malformed, ignore it and rest\n",
+                    __func__, mp_s, k);
+            break;
+        }
+        pn = pg_p[0] & 0x3f;
+        spn = (pg_p[0] & 0x40) ? pg_p[1] : 0;
+        pc_p[0] = pg_p;
+        pg_smask = 1;
+        for (j = 1; j < MP_NUM_PG_CTL; ++j) {
+            if (0 == (smask & (1 << j)))
+                continue;
+            off = sdp_find_mpage(pc_arr[j], resp_len, pn, spn, &l_len);
+            if ((off < 0) || (l_len != pg_len)) {
+                if (vb > 1)
+                    pr2serr("  [0x%x,0x%x] %s for page control %d, left "
+                            "out\n", pn, spn, (off < 0) ? "missing" :
+                            "length differs", j);
+                continue;
+            }
+            pc_p[j] = pc_arr[j] + off;
+            pg_smask |= (1 << j);
+        }
+        n = SNAP_REC_HDR_LEN + (snap_num_pc(pg_smask) * pg_len) +
+            SNAP_CRC_LEN;
+        if ((sbp->len + n) > sbp->alloc_len) {
+            int new_len = 2 * sbp->alloc_len + n;
+            uint8_t * nbp = (uint8_t *)realloc(sbp->b, new_len);
+
+            if (NULL == nbp) {
+                pr2serr("%s: unable to allocate %d bytes on heap\n",
+                        __func__, new_len);
+                return sg_convert_errno(ENOMEM);
+            }
+            sbp->b = nbp;
+            sbp->alloc_len = new_len;
+        }
+        rp = sbp->b + sbp->len;
+        memset(rp, 0, SNAP_REC_HDR_LEN);
+        rp[0] = pn;
+        rp[1] = spn;
+        rp[2] = (uint8_t)pg_smask;
+        sg_put_unaligned_be16(pg_len, rp + 4);
+        n = SNAP_REC_HDR_LEN;
+        for (j = 0; j < MP_NUM_PG_CTL; ++j) {
+            if (pg_smask & (1 << j)) {
+                memcpy(rp + n, pc_p[j], pg_len);
+                n += pg_len;
+            }
+        }
+        sg_put_unaligned_be32(snap_crc32(rp, n), rp + n);
+        sbp->len += n + SNAP_CRC_LEN;
+        ++sbp->num;
+    }
+    return 0;
+}
+
+/* Fetches all mode pages from the DEVICE open in ctxp and writes them to
+ * the file fn in the format described above. When the DEVICE has more
+ * mode pages than fit in one response they are fetched one page code (and
+ * its subpages) at a time. Returns 0 on success. */
+int
+sdp_snapshot(struct sdparm_ctx_t * ctxp, const char * fn, sgj_opaque_p jop)
+{
+    bool trunc;
+    int pn, res, smask, resp_len, num, out_len;
+    uint8_t * bp;
+    FILE * fp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct snap_buf_t sb;
+
+    res = sdp_ctx_mpages(ctxp, ALL_MPAGES, &smask, &resp_len, &trunc);
+    if (res) {
+        pr2serr("%s: unable to fetch %ss\n", __func__, mp_s);
+        return res;
+    }
+    if (0 == (smask & 1)) {
+        pr2serr("%s: current values of %ss not available\n", __func__,
+                mp_s);
+        return SG_LIB_CAT_OTHER;
+    }
+    memset(&sb, 0, sizeof(sb));
+    sb.alloc_len = SNAP_HDR_LEN + (MP_NUM_PG_CTL * resp_len) + 1024;
+    sb.b = (uint8_t *)calloc(1, sb.alloc_len);
+    if (NULL == sb.b) {
+        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                sb.alloc_len);
+        return sg_convert_errno(ENOMEM);
+    }
+    sb.len = SNAP_HDR_LEN;
+    if (! trunc)
+        res = snap_add_pages(ctxp, smask, resp_len, &sb);
+    else {
+        if (op->verbose)
+            pr2serr("%ss don't fit in one response, fetching one page "
+                    "code at a time\n", mp_s);
+        for (pn = 0; (0 == res) && (pn < ALL_MPAGES); ++pn) {
+            if (sdp_ctx_mpages(ctxp, pn, &smask, &resp_len, NULL) ||
+                (0 == (smask & 1)))
+                continue;       /* page code not supported */
+            res = snap_add_pages(ctxp, smask, resp_len, &sb);
+        }
+    }
+    bp = sb.b;
+    if (res)
+        goto fini;
+    num = sb.num;
+    memcpy(bp, SNAP_MAGIC, 4);
+    bp[4] = SNAP_VERSION;
+    bp[5] = SNAP_HDR_LEN;
+    bp[6] = (uint8_t)ctxp->pdt;
+    sg_put_unaligned_be16(num, bp + 8);
+    memset(bp + 12, ' ', 28);
+    memcpy(bp + 12, ctxp->vendor, strlen(ctxp->vendor));
+    memcpy(bp + 20, ctxp->product, strlen(ctxp->product));
+    memcpy(bp + 36, ctxp->revision, strlen(ctxp->revision));
+    sg_put_unaligned_be32(snap_crc32(bp, SNAP_HDR_LEN - SNAP_CRC_LEN),
+                          bp + SNAP_HDR_LEN - SNAP_CRC_LEN);
+    out_len = sb.len;
+    fp = fopen(fn, "wb");
+    if (NULL == fp) {
+        res = errno;
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(res));
+        res = sg_convert_errno(res);
+        goto fini;
+    }
+    if (1 != fwrite(bp, out_len, 1, fp)) {
+        res = errno;
+        pr2serr("%s: write to %s failed: %s\n", __func__, fn,
+                safe_strerror(res));
+        res = sg_convert_errno(res);
+    }
+    if (fclose(fp) && (0 == res)) {
+        res = errno;
+        pr2serr("%s: close of %s failed: %s\n", __func__, fn,
+                safe_strerror(res));
+        res = sg_convert_errno(res);
+    }
+    if (0 == res) {
+        sgj_pr_hr(jsp, "Snapshot of %d %ss (%d bytes) written to %s\n",
+                  num, mp_s, out_len, fn);
+        sgj_js_nv_s(jsp, jop, "snapshot_file", fn);
+        sgj_js_nv_i(jsp, jop, "number_of_mode_pages", num);
+        sgj_js_nv_i(jsp, jop, "file_length", out_len);
+    }
+fini:
+    free(bp);
+    return res;
+}
+
+/* Reads and checks the --snapshot=FILE named fn, filling *snp. On success
+ * the caller should call sdp_snap_free(snp) when finished with it. Returns
+ * 0 on success, else SG_LIB_FILE_ERROR or a converted errno. */
+int
+sdp_snap_read(const char * fn, struct sdparm_snap_t * snp, int verbose)
+{
+    int k, j, n, res, len, num, hdr_len, rem, pg_len;
+    uint8_t * bp;
+    uint8_t * rp;
+    FILE * fp;
+    struct sdparm_snap_pg_t * spp;
+
+    memset(snp, 0, sizeof(*snp));
+    fp = fopen(fn, "rb");
+    if (NULL == fp) {
+        res = errno;
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    bp = (uint8_t *)malloc(SNAP_MAX_FILE_LEN + 1);
+    if (NULL == bp) {
+        fclose(fp);
+        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                SNAP_MAX_FILE_LEN + 1);
+        return sg_convert_errno(ENOMEM);
+    }
+    snp->free_b = bp;
+    len = (int)fread(bp, 1, SNAP_MAX_FILE_LEN + 1, fp);
+    fclose(fp);
+    if (len > SNAP_MAX_FILE_LEN) {
+        pr2serr("%s: %s is too long (more than %d bytes)\n", __func__, fn,
+                SNAP_MAX_FILE_LEN);
+        goto bad;
+    }
+    if ((len < SNAP_HDR_LEN) || memcmp(bp, SNAP_MAGIC, 4)) {
+        pr2serr("%s: %s is not a sdparm snapshot\n", __func__, fn);
+        goto bad;
+    }
+    snp->version = bp[4];
+    if (SNAP_VERSION != snp->version) {
+        pr2serr("%s: %s is version %d, only version %d supported\n",
+                __func__, fn, snp->version, SNAP_VERSION);
+        goto bad;
+    }
+    hdr_len = bp[5];
+    if ((hdr_len < SNAP_HDR_LEN) || (hdr_len > len) ||
+        (sg_get_unaligned_be32(bp + hdr_len - SNAP_CRC_LEN) !=
+         snap_crc32(bp, hdr_len - SNAP_CRC_LEN))) {
+        pr2serr("%s: %s header is corrupt (bad CRC)\n", __func__, fn);
+        goto bad;
+    }
+    snp->pdt = bp[6];
+    num = sg_get_unaligned_be16(bp + 8);
+    snprintf(snp->vendor, sizeof(snp->vendor), "%.8s", bp + 12);
+    snprintf(snp->product, sizeof(snp->product), "%.16s", bp + 20);
+    snprintf(snp->revision, sizeof(snp->revision), "%.4s", bp + 36);
+    snp->pgs = (struct sdparm_snap_pg_t *)calloc(num ? num : 1,
+                                                 sizeof(*snp->pgs));
+    if (NULL == snp->pgs) {
+        sdp_snap_free(snp);
+        return sg_convert_errno(ENOMEM);
+    }
+    rp = bp + hdr_len;
+    rem = len - hdr_len;
+    for (k = 0, spp = snp->pgs; k < num; ++k, ++spp) {
+        if (rem < (SNAP_REC_HDR_LEN + SNAP_CRC_LEN))
+            goto truncated;
+        spp->pn = rp[0] & 0x3f;
+        spp->spn = rp[1];
+        spp->smask = rp[2] & 0xf;
+        pg_len = sg_get_unaligned_be16(rp + 4);
+        spp->pg_len = pg_len;
+        n = SNAP_REC_HDR_LEN + (snap_num_pc(spp->smask) * pg_len);
+        if (rem < (n + SNAP_CRC_LEN))
+            goto truncated;
+        if (sg_get_unaligned_be32(rp + n) != snap_crc32(rp, n)) {
+            pr2serr("%s: %s record %d [0x%x,0x%x] is corrupt (bad CRC)\n",
+                    __func__, fn, k + 1, spp->pn, spp->spn);
+            goto bad;
+        }
+        for (j = 0, n = SNAP_REC_HDR_LEN; j < MP_NUM_PG_CTL; ++j) {
+            if (spp->smask & (1 << j)) {
+                spp->pc_arr[j] = rp + n;
+                n += pg_len;
+            }
+        }
+        n += SNAP_CRC_LEN;
+        rp += n;
+        rem -= n;
+    }
+    snp->num_pgs = num;
+    if (verbose > 1)
+        pr2serr("%s: %s holds %d %ss from %.8s %.16s %.4s, pdt=0x%x\n",
+                __func__, fn, num, mp_s, snp->vendor, snp->product,
+                snp->revision, snp->pdt);
+    return 0;
+
+truncated:
+    pr2serr("%s: %s is truncated, expected %d %ss\n", __func__, fn, num,
+            mp_s);
+bad:
+    sdp_snap_free(snp);
+    return SG_LIB_FILE_ERROR;
+}
+
+void
+sdp_snap_free(struct sdparm_snap_t * snp)
+{
+    if (snp->pgs)
+        free(snp->pgs);
+    if (snp->free_b)
+        free(snp->free_b);
+    memset(snp, 0, sizeof(*snp));
+}
+
+const struct sdparm_snap_pg_t *
+sdp_snap_find_pg(const struct sdparm_snap_t * snp, int pn, int spn)
+{
+    int k;
+    const struct sdparm_snap_pg_t * spp;
+
+    for (k = 0, spp = snp->pgs; k < snp->num_pgs; ++k, ++spp) {
+        if ((pn == spp->pn) && (spn == spp->spn))
+            return spp;
+    }
+    return NULL;
+}
+
+/* Writes the current values held in --restore=FILE (named fn) back to the
+ * DEVICE open in ctxp. Only changeable bits (per the DEVICE's changeable
+ * mask) are taken from the file and only mode pages that then differ from
+ * the DEVICE's current values are written, all in one MODE SELECT if the
+ * DEVICE accepts that. When the DEVICE's mode pages don't fit in one
+ * response, each page code in the file is fetched in turn. Returns 0 on
+ * success. */
+int
+sdp_restore(struct sdparm_ctx_t * ctxp, const char * fn, sgj_opaque_p jop)
+{
+    bool mode6, trunc;
+    int k, j, res, smask, resp_len, off, dev_len, len, hdr_len, start;
+    int resid, num_chg, bytes_chg, num_nf, num_no_mask, m_off, m_len;
+    int bytes_not_cha = 0;
+    int fetched_pn = -1;
+    uint8_t v;
+    uint8_t * mdp;
+    const uint8_t * dev_p;
+    const uint8_t * mask_p;
+    const uint8_t * snap_p;
+    const struct sdparm_snap_pg_t * spp;
+    struct sdparm_mp_change_t * mc_arr = NULL;
+    struct sdparm_mp_change_t * mcp;
+    struct sdparm_opt_coll * op = &ctxp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct sdparm_snap_t snap;
+    uint8_t hdr[8];
+
+    res = sdp_snap_read(fn, &snap, op->verbose);
+    if (res)
+        return res;
+    if ((snap.pdt != ctxp->pdt) && (! op->flexible)) {
+        pr2serr("%s is from a DEVICE with pdt=0x%x but this DEVICE has "
+                "pdt=0x%x\n    use '--flexible' to override\n", fn,
+                snap.pdt, ctxp->pdt);
+        res = SG_LIB_CONTRADICT;
+        goto fini;
+    }
+    if ((0 == op->do_quiet) &&
+        (strcmp(snap.vendor, ctxp->vendor) ||
+         strcmp(snap.product, ctxp->product)))
+        pr2serr(">> Warning: %s is from %.8s %.16s, not %.8s %.16s\n", fn,
+                snap.vendor, snap.product, ctxp->vendor, ctxp->product);
+    res = sdp_ctx_mpages(ctxp, ALL_MPAGES, &smask, &resp_len, &trunc);
+    if (res) {
+        pr2serr("%s: unable to fetch %ss\n", __func__, mp_s);
+        goto fini;
+    }
+    if (0 == (smask & 1)) {
+        pr2serr("%s: current values of %ss not available\n", __func__,
+                mp_s);
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    if (trunc && op->verbose)
+        pr2serr("%ss don't fit in one response, fetching one page code at "
+                "a time\n", mp_s);
+    mode6 = op->mode_6;
+    hdr_len = mode6 ? 4 : 8;
+    mc_arr = (struct sdparm_mp_change_t *)calloc(snap.num_pgs ?
+                                                 snap.num_pgs : 1,
+                                                 sizeof(*mc_arr));
+    if (NULL == mc_arr) {
+        pr2serr("%s: unable to allocate on heap\n", __func__);
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    num_chg = 0;
+    bytes_chg = 0;
+    num_nf = 0;
+    num_no_mask = 0;
+    for (k = 0, spp = snap.pgs; k < snap.num_pgs; ++k, ++spp) {
+        if (0 == (spp->smask & 1))
+            continue;
+        if (trunc && (spp->pn != fetched_pn)) {
+            fetched_pn = spp->pn;
+            if (sdp_ctx_mpages(ctxp, spp->pn, &smask, &resp_len, NULL) ||
+                (0 == (smask & 1)))
+                resp_len = 0;   /* page code not supported */
+        }
+        off = sdp_find_mpage(ctxp->cur_mp, resp_len, spp->pn, spp->spn,
+                             &dev_len);
+        if (off < 0) {
+            if (op->verbose)
+                pr2serr("  [0x%x,0x%x] not found on DEVICE, skip\n",
+                        spp->pn, spp->spn);
+            ++num_nf;
+            continue;
+        }
+        dev_p = ctxp->cur_mp + off;
+        /* the changeable values response may be laid out differently */
+        m_off = (smask & 2) ? sdp_find_mpage(ctxp->cha_mp, resp_len,
+                                             spp->pn, spp->spn, &m_len) : -1;
+        if ((m_off >= 0) && (m_len == dev_len))
+            mask_p = ctxp->cha_mp + m_off;
+        else if (spp->smask & 2)
+            mask_p = spp->pc_arr[1];    /* fall back to the file's mask */
+        else {
+            if (op->verbose)
+                pr2serr("  [0x%x,0x%x] no changeable mask, skip\n",
+                        spp->pn, spp->spn);
+            ++num_no_mask;
+            continue;
+        }
+        snap_p = spp->pc_arr[0];
+        len = (spp->pg_len < dev_len) ? spp->pg_len : dev_len;
+        start = (dev_p[0] & 0x40) ? 4 : 2;      /* skip page's own header */
+        mcp = mc_arr + num_chg;
+        if (NULL == mcp->md) {
+            mdp = (uint8_t *)malloc(2 * (hdr_len + dev_len));
+            if (NULL == mdp) {
+                pr2serr("%s: unable to allocate on heap\n", __func__);
+                res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+            mcp->md = mdp;
+        } else if (mcp->md_len < (hdr_len + dev_len)) {
+            /* left by a page that didn't change, may be too short */
+            mdp = (uint8_t *)realloc(mcp->md, 2 * (hdr_len + dev_len));
+            if (NULL == mdp) {
+                pr2serr("%s: unable to allocate on heap\n", __func__);
+                res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+            mcp->md = mdp;
+        }
+        mdp = mcp->md;
+        mcp->md_len = hdr_len + dev_len;
+        mcp->orig = mdp + hdr_len + dev_len;
+        memcpy(mcp->md + hdr_len, dev_p, dev_len);
+        mcp->md[hdr_len] &= 0x7f;       /* PS bit reserved in mode select */
+        memcpy(mcp->orig + hdr_len, mcp->md + hdr_len, dev_len);
+        for (j = start, v = 0; j < len; ++j) {
+            uint8_t b = (dev_p[j] & ~mask_p[j]) | (snap_p[j] & mask_p[j]);
+
+            if (b != dev_p[j]) {
+                mcp->md[hdr_len + j] = b;
+                ++bytes_chg;
+                v = 1;
+            }
+            if ((snap_p[j] ^ dev_p[j]) & ~mask_p[j])
+                ++bytes_not_cha;
+        }
+        if (0 == v)
+            continue;
+        if (op->save && (! (dev_p[0] & 0x80))) {
+            pr2serr("[0x%x,0x%x] %s is not saveable but '--save' option "
+                    "given (try without it)\n", spp->pn, spp->spn, mp_s);
+            res = SG_LIB_CAT_MALFORMED;
+            goto fini;
+        }
+        if (op->verbose)
+            pr2serr("  [0x%x,0x%x] will be restored\n", spp->pn, spp->spn);
+        mcp->pn = spp->pn;
+        mcp->spn = spp->spn;
+        mcp->off = hdr_len;
+        ++num_chg;
+    }
+    if (num_chg > 0) {
+        /* mode parameter header for MODE SELECT, without block
+         * descriptors so those are left as they are */
+        memset(hdr, 0, sizeof(hdr));
+        resid = 0;
+        res = sdp_ctx_mode_sense(ctxp, mc_arr[0].pn, mc_arr[0].spn, hdr,
+                                 hdr_len, &resid);
+        if (res) {
+            pr2serr("%s: unable to fetch mode parameter header\n", __func__);
+            goto fini;
+        }
+        hdr[0] = 0;             /* mode data length reserved */
+        if (mode6)
+            hdr[3] = 0;         /* block descriptor length */
+        else {
+            hdr[1] = 0;
+            hdr[4] &= 0xfe;     /* LONGLBA */
+            hdr[6] = 0;         /* block descriptor length */
+            hdr[7] = 0;
+        }
+        if (PDT_DISK == ctxp->pdt)     /* device specific parameter is */
+            hdr[mode6 ? 2 : 3] = 0;     /* reserved for mode select */
+        for (k = 0, mcp = mc_arr; k < num_chg; ++k, ++mcp) {
+            memcpy(mcp->md, hdr, hdr_len);
+            memcpy(mcp->orig, hdr, hdr_len);
+        }
+        res = sdp_write_mpages(ctxp->sg_fd, ctxp->pdt, mc_arr, num_chg, op);
+        if (res)
+            goto fini;
+    }
+    if (0 == num_chg)
+        sgj_pr_hr(jsp, "No changeable differences from %s, nothing "
+                  "written\n", fn);
+    else
+        sgj_pr_hr(jsp, "%s %d %ss (%d bytes) from %s\n",
+                  (op->dummy ? "Would restore" : "Restored"), num_chg,
+                  mp_s, bytes_chg, fn);
+    if (bytes_not_cha > 0)
+        sgj_pr_hr(jsp, "  %d bytes differ but are not changeable\n",
+                  bytes_not_cha);
+    if (num_nf > 0)
+        sgj_pr_hr(jsp, "  %d %ss in %s not found on DEVICE\n", num_nf, mp_s,
+                  fn);
+    if (num_no_mask > 0)
+        sgj_pr_hr(jsp, "  %d %ss skipped, changeable values unknown\n",
+                  num_no_mask, mp_s);
+    sgj_js_nv_s(jsp, jop, "restore_file", fn);
+    sgj_js_nv_i(jsp, jop, "number_of_mode_pages_changed", num_chg);
+    sgj_js_nv_i(jsp, jop, "bytes_changed", bytes_chg);
+    sgj_js_nv_i(jsp, jop, "bytes_not_changeable", bytes_not_cha);
+    sgj_js_nv_i(jsp, jop, "mode_pages_not_found", num_nf);
+fini:
+    if (mc_arr) {
+        for (k = 0; k < snap.num_pgs; ++k) {
+            if (mc_arr[k].md)
+                free(mc_arr[k].md);
+        }
+        free(mc_arr);
+    }
+    sdp_snap_free(&snap);
+    return res;
+}
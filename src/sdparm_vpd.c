@@ -3313,12 +3313,14 @@ decode_all_vpds(uint8_t * b, int len, int sg_fd, int req_pdt, bool protect,
 {
     uint16_t u;
     int k, ret, moff;
-    uint8_t bb[DECODE_ALL_VPDS_BUFLEN];
+    const uint8_t * bb = b + 4;
 
+    /* No need to copy the supported list in b: nested calls to
+     * sdp_process_vpd_page() use their own buffer, either the next level
+     * in the DEVICE's scratch arena or one from the heap. */
     len -= 4;
     if (len > DECODE_ALL_VPDS_BUFLEN)
         len = DECODE_ALL_VPDS_BUFLEN;
-    memcpy(bb, b + 4, len);
 
     for (k = 0, moff = off; k < len; ++k) {
         if (VPD_SUPPORTED_VPDS == bb[k])
@@ -3534,35 +3536,30 @@ skip1:
     std_inq_decode_js(b, blen, op, jop);
 }
 
-/* Hack: use vpd page=-1 to indicate want standard INQUIRY response */
+/* Hack: use vpd page=-1 to indicate want standard INQUIRY response. Uses
+ * the caller's buffer b which is assumed to be at least DEF_INQ_RESP_LEN
+ * bytes long. */
 static int
-fetch_decode_std_inq(int sg_fd, struct sdparm_opt_coll * op, sgj_opaque_p jop)
+fetch_decode_std_inq(int sg_fd, uint8_t * b, struct sdparm_opt_coll * op,
+                     sgj_opaque_p jop)
 {
     int res, verb, sz;
     int resid = 0;
-    int b_sz = DEF_INQ_RESP_LEN;
-    uint8_t * b = NULL;
-    uint8_t * free_b = NULL;
+    const int b_sz = DEF_INQ_RESP_LEN;
 
     verb = (op->verbose > 0) ? op->verbose - 1 : 0;
-    b = sg_memalign(b_sz, 0, &free_b, false);
-    if (NULL == b) {
-        pr2serr("%s: unalign to allocate ram\n", __func__);
-        return sg_convert_errno(ENOMEM);
-    }
     sz = op->do_long ? b_sz : STD_INQ_VD_RESP_LEN; /* + version descriptors */
     res = sg_ll_inquiry_v2(sg_fd, false, 0, b, sz, 0, &resid, false, verb);
     if (res) {
         pr2serr("INQUIRY fetching standard response failed\n");
-        goto fini;
+        return res;
     }
     if (resid > 0) {
         sz -= resid;
         if (sz < 5) {
             pr2serr("%s: after resid (%d) response size is too short (%d)\n",
                     __func__, resid, sz);
-            res = SG_LIB_WILD_RESID;
-            goto fini;
+            return SG_LIB_WILD_RESID;
         }
     }
     if (op->do_hex > 0) {
@@ -3572,11 +3569,7 @@ fetch_decode_std_inq(int sg_fd, struct sdparm_opt_coll * op, sgj_opaque_p jop)
             hex2stdout(b, sz, no_ascii_4hex(op));
     } else
         decode_std_inq(sz, b, op, jop);
-    res = 0;
-fini:
-    if (free_b)
-        free(free_b);
-    return res;
+    return 0;
 }
 
 /* If ihbp is NULL then need to send SCSI INQUIRY command to device referred
@@ -3606,8 +3599,10 @@ sdp_process_vpd_page(int sg_fd, int pn, int spn, int req_pdt, bool protect,
     sgj_opaque_p jo2p = NULL;
     sgj_opaque_p jap = NULL;
     const struct sdparm_vpd_page_t * vpp;
+    bool arena_held = false;
     uint8_t * b = NULL;
     uint8_t * free_b = NULL;
+    struct sdparm_arena_t * arp = op->arenap;
     const int b_sz = 2 * sg_get_page_size();
     char c[128];
     static const int clen = sizeof(c);
@@ -3619,10 +3614,18 @@ sdp_process_vpd_page(int sg_fd, int pn, int spn, int req_pdt, bool protect,
                 "%sgiven, ihb_len=%d, off=%d\n", __func__, sg_fd,
                 (unsigned int)pn, spn, ((!! ihbp) ? "" : "not "),
                 ((!! alt_buf) ? "" : "not "), op->inhex_len, off);
+    if ((sg_fd >= 0) && sdp_deadline_expired(op->ctxp))
+        return SG_LIB_CAT_TIMEOUT;
     hex_format = (dhex > 2) ? -1 : no_ascii_4hex(op);
     sz = b_sz;
     if (NULL == alt_buf) {
-        b = sg_memalign(b_sz, 0 /* page align */, &free_b, false);
+        if (arp && (arp->vpd_depth < SDP_ARENA_VPD_LEVELS) &&
+            (arp->vpd_b_sz >= b_sz)) {
+            b = arp->vpd_b[arp->vpd_depth++];
+            memset(b, 0, b_sz);
+            arena_held = true;
+        } else
+            b = sg_memalign(b_sz, 0 /* page align */, &free_b, false);
         if (NULL == b) {
             pr2serr("Unable to allocate %d bytes on the heap\n", b_sz);
             ret = sg_convert_errno(ENOMEM);
@@ -3708,9 +3711,14 @@ sdp_process_vpd_page(int sg_fd, int pn, int spn, int req_pdt, bool protect,
                 sz = bump;
         }
     } else {             /* so (sg_fd >= 0) , need to read from device */
+        if (NULL == b) {
+            pr2serr("Logic error, b should not be NULL\n");
+            ret = SG_LIB_CAT_MALFORMED;
+            goto fini;
+        }
         if (pn < 0) {
             if (VPD_NOT_STD_INQ == pn) {
-                ret = fetch_decode_std_inq(sg_fd, op, jop);
+                ret = fetch_decode_std_inq(sg_fd, b, op, jop);
                 goto fini;
             } else if (op->do_all)
                 pn = VPD_SUPPORTED_VPDS;  /* if '--all' list supported vpds */
@@ -3718,11 +3726,6 @@ sdp_process_vpd_page(int sg_fd, int pn, int spn, int req_pdt, bool protect,
                 pn = VPD_DEVICE_ID;  /* default to device id page */
         }
         sz = (VPD_ATA_INFO == pn) ? VPD_ATA_INFO_RESP_LEN : DEF_INQ_RESP_LEN;
-        if (NULL == b) {
-            pr2serr("Logic error, b should not be NULL\n");
-            ret = SG_LIB_CAT_MALFORMED;
-            goto fini;
-        }
 try_larger:
         ret = sg_ll_inquiry_v2(sg_fd, true, pn, b, sz, 0, &resid, false,
                                verb);
@@ -4800,6 +4803,8 @@ dumb_inq:
     return SG_LIB_CAT_MALFORMED;
 
 fini:
+    if (arena_held)
+        --arp->vpd_depth;
     if (free_b)
         free(free_b);
     return ret;
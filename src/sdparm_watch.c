@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2023, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sdparm.h"
+
+/* sdparm_watch.c : polls the fields given to --get= (or all known fields
+ * of the --page= mode page) every SECS seconds ('--watch=SECS[,COUNT]').
+ * DEVICEs are opened once and stay open. The fields given to --get= may
+ * come from several mode pages, each of those is fetched once per poll.
+ * Only the current values page control is read and after the first poll
+ * the MODE SENSE allocation length for each page is the mode data length
+ * that poll returned. A line of NDJSON
+ * (one JSON object per line) is output on stdout for each field whose
+ * value changes, for example:
+ *
+ *   {"timestamp":"2023-07-01T10:20:30.123Z","device_name":"/dev/sdb",
+ *    "page_code":28,"subpage_code":0,"acronym":"MRIE","previous_value":6,
+ *    "value":3}
+ *
+ * (shown here over two lines). The first poll outputs the starting value
+ * of each field (without "previous_value") unless --quiet is given. */
+
+#ifndef SG_LIB_WIN32
+
+#define WATCH_MS6_ALLOC 252     /* MODE SENSE(6) allocation length is 1 byte */
+
+struct watch_pg_t {             /* a mode page polled on a DEVICE */
+    int pn;
+    int spn;
+    int resp_len;               /* learnt on first poll, 0 -> unknown */
+    bool in_err;                /* last poll failed, error line output */
+    bool have_vals;             /* vals[] of its fields hold previous poll */
+};
+
+struct watch_dev_t {
+    const char * name;
+    char js_name[256];          /* name converted to a JSON string */
+    int sg_fd;
+    int pdt;
+    int num_pgs;
+    int num_flds;
+    struct watch_pg_t pgs[MAX_MP_IT_VAL];
+    const struct sdparm_mp_item_t ** flds;
+    int * fld_pg;               /* index in pgs[] of each field's page */
+    uint64_t * vals;
+};
+
+static const char * mp_s = "mode page";
+static const char * watch_s = "--watch=";
+
+/* Places an ISO 8601 UTC timestamp with milliseconds in b */
+static void
+watch_timestamp(char * b, int blen)
+{
+    int n;
+    struct timespec ts;
+    struct tm tm;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gmtime_r(&ts.tv_sec, &tm);
+    n = (int)strftime(b, blen, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(b + n, blen - n, ".%03dZ", (int)(ts.tv_nsec / 1000000));
+}
+
+static void
+watch_fld_name(const struct sdparm_mp_item_t * mpip, char * b, int blen)
+{
+    if (mpip->acron)
+        snprintf(b, blen, "%s", mpip->acron);
+    else
+        snprintf(b, blen, "%d:%d:%d", mpip->start_byte, mpip->start_bit,
+                 mpip->num_bits);
+}
+
+/* Outputs one NDJSON line. prevp is NULL for a starting value and errp is
+ * non-NULL (and mpip NULL) for an error line. */
+static void
+watch_line(const struct watch_dev_t * dp, int pn, int spn,
+           const struct sdparm_mp_item_t * mpip, const uint64_t * prevp,
+           uint64_t val, const char * errp)
+{
+    char ts[40];
+    char b[80];
+
+    watch_timestamp(ts, sizeof(ts));
+    printf("{\"timestamp\":\"%s\",\"device_name\":\"%s\",\"page_code\":%d,"
+           "\"subpage_code\":%d", ts, dp->js_name, pn, spn);
+    if (errp)
+        printf(",\"error\":\"%s\"}\n", errp);
+    else {
+        watch_fld_name(mpip, b, sizeof(b));
+        printf(",\"acronym\":\"%s\"", b);
+        if (prevp)
+            printf(",\"previous_value\":%" PRIu64, *prevp);
+        printf(",\"value\":%" PRIu64 "}\n", val);
+    }
+    fflush(stdout);
+}
+
+/* Builds the list of fields to watch on DEVICE dp: those given to --get=,
+ * otherwise all known fields (of the first descriptor) of mode page pn,spn
+ * that apply to the DEVICE's peripheral device type. Each distinct mode
+ * page of those fields is placed once in dp->pgs[]. */
+static int
+watch_dev_flds(struct watch_dev_t * dp, int pn, int spn,
+               const struct sdparm_mp_settings_t * mps,
+               const struct sdparm_opt_coll * op)
+{
+    int k, j, n;
+    const struct sdparm_mp_item_t * mpip;
+    const struct sdparm_mp_item_t * mpip0 = NULL;
+
+    if (mps->num_it_vals > 0)
+        n = mps->num_it_vals;
+    else {
+        mpip0 = sdp_get_mitem_arr(op->transport, op->vendor_id);
+        for (n = 0, mpip = mpip0; mpip && mpip->acron; ++mpip) {
+            if ((pn == mpip->pg_num) && (spn == mpip->subpg_num) &&
+                sg_pdt_s_eq(dp->pdt, mpip->com_pdt))
+                ++n;
+        }
+    }
+    if (0 == n) {
+        pr2serr("%s: no known fields in %s [0x%x,0x%x] for this device "
+                "type\n", dp->name, mp_s, pn, spn);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    dp->flds = (const struct sdparm_mp_item_t **)calloc(n, sizeof(mpip));
+    dp->fld_pg = (int *)calloc(n, sizeof(int));
+    dp->vals = (uint64_t *)calloc(n, sizeof(uint64_t));
+    if ((NULL == dp->flds) || (NULL == dp->fld_pg) || (NULL == dp->vals))
+        return sg_convert_errno(ENOMEM);
+    if (mps->num_it_vals > 0) {
+        for (k = 0; k < n; ++k)
+            dp->flds[k] = &mps->it_vals[k].mp_it;
+    } else {
+        for (k = 0, mpip = mpip0; mpip->acron && (k < n); ++mpip) {
+            if ((pn == mpip->pg_num) && (spn == mpip->subpg_num) &&
+                sg_pdt_s_eq(dp->pdt, mpip->com_pdt))
+                dp->flds[k++] = mpip;
+        }
+    }
+    dp->num_flds = n;
+    for (k = 0; k < n; ++k) {
+        mpip = dp->flds[k];
+        for (j = 0; j < dp->num_pgs; ++j) {
+            if ((mpip->pg_num == dp->pgs[j].pn) &&
+                (mpip->subpg_num == dp->pgs[j].spn))
+                break;
+        }
+        if (j == dp->num_pgs) {
+            if (j >= MAX_MP_IT_VAL)
+                return SG_LIB_LOGIC_ERROR;
+            dp->pgs[j].pn = mpip->pg_num;
+            dp->pgs[j].spn = mpip->subpg_num;
+            ++dp->num_pgs;
+        }
+        dp->fld_pg[k] = j;
+    }
+    return 0;
+}
+
+static int
+watch_open(struct watch_dev_t * dp, const struct sdparm_opt_coll * op)
+{
+    int res;
+    int vb = (op->verbose > 0) ? op->verbose - 1 : 0;
+    struct sg_simple_inquiry_resp sir;
+
+    sgj_conv2json_string((const uint8_t *)dp->name, (int)strlen(dp->name),
+                         dp->js_name, (int)sizeof(dp->js_name));
+    dp->sg_fd = sg_cmds_open_device(dp->name, true /* read_only */, vb);
+    if (dp->sg_fd < 0) {
+        pr2serr("open error: %s [read only]: %s\n", dp->name,
+                safe_strerror(-dp->sg_fd));
+        return sg_convert_errno(-dp->sg_fd);
+    }
+    res = sg_simple_inquiry(dp->sg_fd, &sir, false, vb);
+    if (res) {
+        pr2serr("SCSI INQUIRY command failed on %s\n", dp->name);
+        return (res > 0) ? res : SG_LIB_CAT_OTHER;
+    }
+    dp->pdt = sir.peripheral_type;
+    if ((PDT_WO == dp->pdt) || (PDT_OPTICAL == dp->pdt))
+        dp->pdt = PDT_DISK;     /* as open_and_simple_inquiry() does */
+    return 0;
+}
+
+/* One poll of mode page dp->pgs[pg_ind] on DEVICE dp, outputs a line for
+ * each field in that page that has changed */
+static void
+watch_poll(struct watch_dev_t * dp, int pg_ind, uint8_t * b,
+           const struct sdparm_opt_coll * op)
+{
+    bool spf;
+    int k, res, alloc, len, calc_len, off, pg_len, last_byte;
+    int resid = 0;
+    struct watch_pg_t * wpp = dp->pgs + pg_ind;
+    int pn = wpp->pn;
+    int spn = wpp->spn;
+    uint64_t val, prev;
+    const struct sdparm_mp_item_t * mpip;
+    char e[120];
+
+again:
+    alloc = wpp->resp_len;
+    if (0 == alloc)
+        alloc = op->mode_6 ? WATCH_MS6_ALLOC : MAX_MODE_DATA_LEN;
+    res = sdp_mode_sense_cur(dp->sg_fd, pn, spn, b, alloc, &resid, op);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(e), e, op->verbose);
+        goto err;
+    }
+    len = alloc - resid;
+    calc_len = sg_msense_calc_length(b, len, op->mode_6, NULL);
+    if (calc_len > len) {
+        if (wpp->resp_len > 0) {    /* mode data grew, learn it again */
+            wpp->resp_len = 0;
+            goto again;
+        }
+    } else
+        len = calc_len;
+    if (0 == wpp->resp_len) {
+        wpp->resp_len = len;
+        if (op->verbose > 1)
+            pr2serr("%s: %s [0x%x,0x%x] mode data length is %d bytes\n",
+                    dp->name, watch_s, pn, spn, len);
+    }
+    off = sg_mode_page_offset(b, len, op->mode_6, e, sizeof(e));
+    if (off < 0)
+        goto err;
+    spf = !! (b[off] & 0x40);
+    if (((b[off] & 0x3f) != pn) || ((spf ? b[off + 1] : 0) != spn)) {
+        snprintf(e, sizeof(e), "%s 0x%x,0x%x not returned", mp_s, pn, spn);
+        goto err;
+    }
+    pg_len = spf ? (sg_get_unaligned_be16(b + off + 2) + 4) :
+                   (b[off + 1] + 2);
+    if ((off + pg_len) > len)
+        pg_len = len - off;
+    if (wpp->in_err) {
+        wpp->in_err = false;
+        if (op->verbose)
+            pr2serr("%s: MODE SENSE [0x%x,0x%x] working again\n", dp->name,
+                    pn, spn);
+    }
+    for (k = 0; k < dp->num_flds; ++k) {
+        if (pg_ind != dp->fld_pg[k])
+            continue;
+        mpip = dp->flds[k];
+        last_byte = mpip->start_byte +
+                    ((mpip->num_bits - mpip->start_bit + 6) / 8);
+        if (last_byte >= pg_len)
+            continue;           /* field not in this (shorter) page */
+        val = sdp_mitem_get_value(mpip, b + off);
+        if (! wpp->have_vals) {
+            if (0 == op->do_quiet)
+                watch_line(dp, pn, spn, mpip, NULL, val, NULL);
+        } else if (val != dp->vals[k]) {
+            prev = dp->vals[k];
+            watch_line(dp, pn, spn, mpip, &prev, val, NULL);
+        }
+        dp->vals[k] = val;
+    }
+    wpp->have_vals = true;
+    return;
+err:
+    if (! wpp->in_err) {        /* only report entry into error state */
+        wpp->in_err = true;
+        watch_line(dp, pn, spn, NULL, NULL, 0, e);
+    }
+}
+
+/* Adds ms milliseconds to *tsp */
+static void
+watch_ts_add(struct timespec * tsp, int ms)
+{
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (tsp->tv_nsec >= 1000000000L) {
+        ++tsp->tv_sec;
+        tsp->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool
+watch_ts_before(const struct timespec * a, const struct timespec * b)
+{
+    return (a->tv_sec < b->tv_sec) ||
+           ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+/* Watches the fields in mps, which may be in several mode pages (or, if it
+ * holds none, all known fields of the mode page it names) on each DEVICE
+ * in device_name_arr[]. Polls every op->watch_ms milliseconds on a fixed
+ * schedule (a late poll does not delay later ones) for op->watch_count
+ * polls, 0 for until interrupted.
+ * Returns 0 or the first error met opening a DEVICE. */
+int
+sdp_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+          const struct sdparm_mp_settings_t * mps)
+{
+    int k, j, n, pn, spn, res;
+    int ret = 0;
+    const int num = ctxp->opts.num_devices;
+    struct watch_dev_t * dev_arr;
+    struct watch_dev_t * dp;
+    uint8_t * b = NULL;
+    uint8_t * free_b = NULL;
+    const struct sdparm_opt_coll * op = &ctxp->opts;
+    struct timespec next, now;
+
+    pn = mps->pg_num;
+    spn = (mps->subpg_num < 0) ? 0 : mps->subpg_num;
+    if (pn < 0) {
+        pr2serr("%s needs '--get=' or '--page='\n", watch_s);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    for (k = 0; k < mps->num_it_vals; ++k) {
+        if (mps->it_vals[k].descriptor_num > 0) {
+            pr2serr("%s only watches fields in the first descriptor\n",
+                    watch_s);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    dev_arr = (struct watch_dev_t *)calloc(num, sizeof(*dev_arr));
+    if (NULL == dev_arr)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0; k < num; ++k)
+        dev_arr[k].sg_fd = -1;
+    b = sg_memalign(MAX_MODE_DATA_LEN, 0, &free_b, false);
+    if (NULL == b) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        dp->name = device_name_arr[k];
+        ret = watch_open(dp, op);
+        if (ret)
+            goto fini;
+        ret = watch_dev_flds(dp, pn, spn, mps, op);
+        if (ret)
+            goto fini;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (n = 0; (0 == op->watch_count) || (n < op->watch_count); ++n) {
+        if (n > 0) {
+            watch_ts_add(&next, op->watch_ms);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            while (watch_ts_before(&next, &now))  /* skip missed polls */
+                watch_ts_add(&next, op->watch_ms);
+            do {
+                res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+                                      NULL);
+            } while (EINTR == res);
+        }
+        for (k = 0, dp = dev_arr; k < num; ++k, ++dp) {
+            for (j = 0; j < dp->num_pgs; ++j)
+                watch_poll(dp, j, b, op);
+        }
+    }
+fini:
+    for (k = 0; k < num; ++k) {
+        dp = dev_arr + k;
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+        free(dp->flds);
+        free(dp->fld_pg);
+        free(dp->vals);
+    }
+    free(dev_arr);
+    if (free_b)
+        free(free_b);
+    return ret;
+}
+
+#else   /* SG_LIB_WIN32 */
+
+int
+sdp_watch(struct sdparm_ctx_t * ctxp, const char * device_name_arr[],
+          const struct sdparm_mp_settings_t * mps)
+{
+    if (ctxp && device_name_arr && mps) { }     /* suppress warning */
+    pr2serr("--watch= is not supported on Windows\n");
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+#endif  /* SG_LIB_WIN32 */